@@ -952,6 +952,7 @@ struct state_t *ceph_alloc_state(struct fsal_export *exp_hdl,
 	my_fd->fd = NULL;
 	my_fd->openflags = FSAL_O_CLOSED;
 	PTHREAD_RWLOCK_init(&my_fd->fdlock, NULL);
+	fsal_fd_pins_init(&my_fd->pins);
 
 	return state;
 }
@@ -971,6 +972,7 @@ void ceph_free_state(struct fsal_export *exp_hdl, struct state_t *state)
 	struct ceph_fd *my_fd = &state_fd->ceph_fd;
 
 	PTHREAD_RWLOCK_destroy(&my_fd->fdlock);
+	fsal_fd_pins_destroy(&my_fd->pins);
 
 	gsh_free(state_fd);
 }
@@ -1554,6 +1556,7 @@ static fsal_status_t ceph_fsal_reopen2(struct fsal_obj_handle *obj_hdl,
 		 * about to close!
 		 */
 		PTHREAD_RWLOCK_wrlock(&my_share_fd->fdlock);
+		fsal_fd_pins_wait(&my_share_fd->pins);
 
 		ceph_close_my_fd(myself, my_share_fd);
 		my_share_fd->fd = my_fd->fd;
@@ -1610,6 +1613,131 @@ static fsal_status_t ceph_find_fd(Fh **fd,
 	return status;
 }
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+/**
+ * @brief State of a read or write handed to libcephfs
+ */
+
+struct ceph_io_arg {
+	struct fsal_async_io aio;
+	struct ceph_ll_io_info io_info;
+	/** State fd pinned for the I/O, if any */
+	struct ceph_fd *ceph_fd;
+	/** Fh used for the I/O, closed when done if closefd */
+	Fh *my_fd;
+	bool closefd;
+};
+
+/**
+ * @brief Completion of ceph_ll_nonblocking_readv_writev
+ *
+ * Runs on a libcephfs finisher thread, or on the submitting thread if
+ * the I/O could be done without waiting.
+ */
+
+static void ceph_io_cb(struct ceph_ll_io_info *io_info)
+{
+	struct ceph_io_arg *cio = io_info->priv;
+	struct fsal_io_arg *io_arg = cio->aio.io_arg;
+	struct ceph_export *export =
+		container_of(cio->aio.ctx.fsal_export, struct ceph_export,
+			     export);
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	size_t total_size = 0;
+	int i;
+
+	if (io_info->result < 0) {
+		status = ceph2fsal_error(io_info->result);
+		if (io_info->write)
+			io_arg->fsal_stable = false;
+	} else {
+		io_arg->io_amount = io_info->result;
+
+		if (!io_info->write) {
+			for (i = 0; i < io_arg->iov_count; i++)
+				total_size += io_arg->iov[i].iov_len;
+
+			if (io_arg->io_amount < total_size)
+				io_arg->end_of_file = true;
+		}
+	}
+
+	if (cio->ceph_fd)
+		fsal_fd_unpin(&cio->ceph_fd->pins);
+
+	if (cio->closefd)
+		(void) ceph_ll_close(export->cmount, cio->my_fd);
+
+	fsal_async_io_done(&cio->aio, status);
+
+	gsh_free(cio);
+}
+
+/**
+ * @brief Submit a read or write to libcephfs
+ *
+ * Only used when the Fh does not depend on the object lock, which
+ * must be released by the thread that took it.  The fdlock of ceph_fd
+ * is held for read and is released here, after pinning the fd for the
+ * I/O.  On success the completion unpins it, closes the Fh if closefd
+ * and calls done_cb.
+ *
+ * @return 0 or a negative error.
+ */
+
+static int64_t ceph_io_submit(struct fsal_obj_handle *obj_hdl,
+			      fsal_async_cb done_cb,
+			      struct fsal_io_arg *io_arg,
+			      void *caller_arg,
+			      struct ceph_fd *ceph_fd,
+			      Fh *my_fd,
+			      bool closefd,
+			      bool write)
+{
+	struct ceph_export *export =
+		container_of(op_ctx->fsal_export, struct ceph_export, export);
+	struct ceph_io_arg *cio;
+	int64_t rc;
+
+	cio = gsh_calloc(1, sizeof(*cio));
+	fsal_async_io_init(&cio->aio, obj_hdl, done_cb, io_arg, caller_arg);
+	cio->ceph_fd = ceph_fd;
+	cio->my_fd = my_fd;
+	cio->closefd = closefd;
+
+	cio->io_info.callback = ceph_io_cb;
+	cio->io_info.priv = cio;
+	cio->io_info.fh = my_fd;
+	cio->io_info.iov = io_arg->iov;
+	cio->io_info.iovcnt = io_arg->iov_count;
+	cio->io_info.off = io_arg->offset;
+	cio->io_info.write = write;
+	cio->io_info.fsync = write && io_arg->fsal_stable;
+	cio->io_info.syncdataonly = false;
+
+	if (ceph_fd) {
+		/* Keep the fd open, finisher threads can't drop the lock */
+		fsal_fd_pin(&ceph_fd->pins);
+		PTHREAD_RWLOCK_unlock(&ceph_fd->fdlock);
+	}
+
+	/* cio belongs to the callback once queued */
+	rc = ceph_ll_nonblocking_readv_writev(export->cmount, &cio->io_info);
+
+	if (rc < 0) {
+		LogDebug(COMPONENT_FSAL,
+			 "ceph_ll_nonblocking_readv_writev failed %"PRIi64,
+			 rc);
+		if (ceph_fd)
+			fsal_fd_unpin(&ceph_fd->pins);
+		gsh_free(cio);
+		return rc;
+	}
+
+	return 0;
+}
+#endif /* USE_FSAL_CEPH_LL_NONBLOCKING_IO */
+
 /**
  * @brief Read data from a file
  *
@@ -1670,6 +1798,20 @@ static void ceph_fsal_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+	if (!has_lock) {
+		nb_read = ceph_io_submit(obj_hdl, done_cb, read_arg, caller_arg,
+					 ceph_fd, my_fd, closefd, false);
+		if (nb_read == 0)
+			return;
+
+		/* The fdlock was released */
+		ceph_fd = NULL;
+		status = ceph2fsal_error(nb_read);
+		goto out;
+	}
+#endif
+
 	read_arg->io_amount = 0;
 
 	for (i = 0; i < read_arg->iov_count; i++) {
@@ -1776,6 +1918,22 @@ static void ceph_fsal_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
 		goto out;
 	}
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+	if (!has_lock) {
+		nb_written = ceph_io_submit(obj_hdl, done_cb, write_arg,
+					    caller_arg, ceph_fd, my_fd, closefd,
+					    true);
+		if (nb_written == 0)
+			return;
+
+		/* The fdlock was released */
+		ceph_fd = NULL;
+		status = ceph2fsal_error(nb_written);
+		write_arg->fsal_stable = false;
+		goto out;
+	}
+#endif
+
 	for (i = 0; i < write_arg->iov_count; i++) {
 		nb_written =
 			ceph_ll_write(export->cmount, my_fd, offset,
@@ -2409,6 +2567,7 @@ static fsal_status_t ceph_fsal_close2(struct fsal_obj_handle *obj_hdl,
 	 * is operating on the fd while we close it.
 	 */
 	PTHREAD_RWLOCK_wrlock(&my_fd->fdlock);
+	fsal_fd_pins_wait(&my_fd->pins);
 	status = ceph_close_my_fd(myself, my_fd);
 	PTHREAD_RWLOCK_unlock(&my_fd->fdlock);
 
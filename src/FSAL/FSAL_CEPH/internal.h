@@ -89,6 +89,8 @@ struct ceph_fd {
 	pthread_rwlock_t fdlock;
 	/** The cephfs file descriptor. */
 	Fh *fd;
+	/** Asynchronous I/Os using the file descriptor */
+	struct fsal_fd_pins pins;
 };
 
 struct ceph_state_fd {
@@ -384,6 +384,7 @@ struct state_t *glusterfs_alloc_state(struct fsal_export *exp_hdl,
 	my_fd->glfd = NULL;
 	my_fd->openflags = FSAL_O_CLOSED;
 	PTHREAD_RWLOCK_init(&my_fd->fdlock, NULL);
+	fsal_fd_pins_init(&my_fd->pins);
 
 	return state;
 }
@@ -402,6 +403,7 @@ void glusterfs_free_state(struct fsal_export *exp_hdl, struct state_t *state)
 	struct glusterfs_fd *my_fd = &state_fd->glusterfs_fd;
 
 	PTHREAD_RWLOCK_destroy(&my_fd->fdlock);
+	fsal_fd_pins_destroy(&my_fd->pins);
 
 	gsh_free(state_fd);
 }
@@ -172,6 +172,8 @@ struct glusterfs_fd {
 #ifdef USE_GLUSTER_DELEGATION
 	char lease_id[GLAPI_LEASE_ID_SIZE];
 #endif
+	/** Asynchronous I/Os using the file descriptor */
+	struct fsal_fd_pins pins;
 };
 
 struct glusterfs_handle {
@@ -270,6 +272,12 @@ void latency_dump(void);
 
 void handle_ops_init(struct fsal_obj_ops *ops);
 
+struct state_t *glusterfs_alloc_state(struct fsal_export *exp_hdl,
+				      enum state_type state_type,
+				      struct state_t *related_state);
+
+void glusterfs_free_state(struct fsal_export *exp_hdl, struct state_t *state);
+
 fsal_status_t gluster2fsal_error(const int gluster_errorcode);
 
 void stat2fsal_attributes(const struct stat *buffstat,
@@ -1867,6 +1867,7 @@ static fsal_status_t glusterfs_reopen2(struct fsal_obj_handle *obj_hdl,
 		 * about to close!
 		 */
 		PTHREAD_RWLOCK_wrlock(&my_share_fd->fdlock);
+		fsal_fd_pins_wait(&my_share_fd->pins);
 
 		glusterfs_close_my_fd(my_share_fd);
 		my_share_fd->glfd = my_fd->glfd;
@@ -1897,6 +1898,143 @@ static fsal_status_t glusterfs_reopen2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief State of a read or write handed to gfapi
+ */
+
+struct glusterfs_io_arg {
+	struct fsal_async_io aio;
+	/** State fd pinned for the I/O, if any */
+	struct glusterfs_fd *glusterfs_fd;
+	/** fd used for the I/O, closed when done if closefd */
+	struct glusterfs_fd my_fd;
+	bool closefd;
+	bool read;
+};
+
+/**
+ * @brief Completion of glfs_preadv_async and glfs_pwritev_async
+ *
+ * Runs on a gfapi thread.
+ */
+
+#ifdef USE_GLUSTER_STAT_FETCH_API
+static void glusterfs_io_cb(struct glfs_fd *fd, ssize_t ret,
+			    struct glfs_stat *prestat,
+			    struct glfs_stat *poststat,
+			    void *data)
+#else
+static void glusterfs_io_cb(struct glfs_fd *fd, ssize_t ret, void *data)
+#endif
+{
+	struct glusterfs_io_arg *glio = data;
+	struct fsal_io_arg *io_arg = glio->aio.io_arg;
+	struct req_op_context *saved_ctx = op_ctx;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	size_t total_size = 0;
+	int retval, i;
+
+	if (ret < 0) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		io_arg->io_amount = ret;
+
+		if (glio->read) {
+			for (i = 0; i < io_arg->iov_count; i++)
+				total_size += io_arg->iov[i].iov_len;
+
+			if (ret < total_size)
+				io_arg->end_of_file = true;
+		}
+	}
+
+	if (glio->glusterfs_fd)
+		fsal_fd_unpin(&glio->glusterfs_fd->pins);
+
+	if (glio->closefd) {
+		/* Closing needs the export from the op context */
+		op_ctx = &glio->aio.ctx;
+		glusterfs_close_my_fd(&glio->my_fd);
+		op_ctx = saved_ctx;
+	}
+
+	fsal_async_io_done(&glio->aio, status);
+
+	gsh_free(glio);
+}
+
+/**
+ * @brief Submit a read or write to gfapi
+ *
+ * Only used when the fd does not depend on the object lock, which
+ * must be released by the thread that took it.  The fdlock of
+ * glusterfs_fd is held for read and is released here, after pinning
+ * the fd for the I/O.  On success the completion unpins it, closes
+ * the fd if closefd and calls done_cb.
+ *
+ * @return 0 or an errno.
+ */
+
+static int glusterfs_io_submit(struct fsal_obj_handle *obj_hdl,
+			       fsal_async_cb done_cb,
+			       struct fsal_io_arg *io_arg,
+			       void *caller_arg,
+			       struct glusterfs_fd *glusterfs_fd,
+			       struct glusterfs_fd *my_fd,
+			       bool closefd,
+			       bool read)
+{
+	struct glusterfs_export *glfs_export =
+	    container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+	struct glusterfs_io_arg *glio;
+	int rc, retval = 0;
+
+	glio = gsh_calloc(1, sizeof(*glio));
+	fsal_async_io_init(&glio->aio, obj_hdl, done_cb, io_arg, caller_arg);
+	glio->glusterfs_fd = glusterfs_fd;
+	glio->my_fd = *my_fd;
+	glio->closefd = closefd;
+	glio->read = read;
+
+	if (glusterfs_fd) {
+		/* Keep the fd open, gfapi threads can't drop the lock */
+		fsal_fd_pin(&glusterfs_fd->pins);
+		PTHREAD_RWLOCK_unlock(&glusterfs_fd->fdlock);
+	}
+
+	SET_GLUSTER_CREDS(glfs_export, &op_ctx->creds->caller_uid,
+			  &op_ctx->creds->caller_gid,
+			  op_ctx->creds->caller_glen,
+			  op_ctx->creds->caller_garray,
+			  op_ctx->client->addr.addr,
+			  op_ctx->client->addr.len);
+
+	if (read)
+		rc = glfs_preadv_async(my_fd->glfd, io_arg->iov,
+				       io_arg->iov_count, io_arg->offset, 0,
+				       glusterfs_io_cb, glio);
+	else
+		rc = glfs_pwritev_async(my_fd->glfd, io_arg->iov,
+					io_arg->iov_count, io_arg->offset,
+					(io_arg->fsal_stable ? O_SYNC : 0),
+					glusterfs_io_cb, glio);
+
+	if (rc < 0)
+		retval = errno;
+
+	/* restore credentials */
+	SET_GLUSTER_CREDS(glfs_export, NULL, NULL, 0, NULL, NULL, 0);
+
+	if (retval != 0) {
+		if (glusterfs_fd)
+			fsal_fd_unpin(&glusterfs_fd->pins);
+		gsh_free(glio);
+	}
+
+	return retval;
+}
+
 /* read2
  */
 
@@ -1954,6 +2092,20 @@ static void glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	if (!has_lock) {
+		retval = glusterfs_io_submit(obj_hdl, done_cb, read_arg,
+					     caller_arg, glusterfs_fd, &my_fd,
+					     closefd, true);
+		if (retval == 0)
+			return;
+
+		/* The fdlock was released */
+		glusterfs_fd = NULL;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	/* The global fd is protected by the object lock, read in line */
 	SET_GLUSTER_CREDS(glfs_export, &op_ctx->creds->caller_uid,
 			  &op_ctx->creds->caller_gid,
 			  op_ctx->creds->caller_glen,
@@ -1961,7 +2113,6 @@ static void glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 			  op_ctx->client->addr.addr,
 			  op_ctx->client->addr.len);
 
-	/* XXX dang switch to preadv_async once async supported */
 	nb_read = glfs_preadv(my_fd.glfd, read_arg->iov, read_arg->iov_count,
 			      seek_descriptor, 0);
 
@@ -2060,6 +2211,20 @@ static void glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	if (!has_lock) {
+		retval = glusterfs_io_submit(obj_hdl, done_cb, write_arg,
+					     caller_arg, glusterfs_fd, &my_fd,
+					     closefd, false);
+		if (retval == 0)
+			return;
+
+		/* The fdlock was released */
+		glusterfs_fd = NULL;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	/* The global fd is protected by the object lock, write in line */
 	SET_GLUSTER_CREDS(glfs_export, &op_ctx->creds->caller_uid,
 			  &op_ctx->creds->caller_gid,
 			  op_ctx->creds->caller_glen,
@@ -2067,7 +2232,6 @@ static void glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 			  op_ctx->client->addr.addr,
 			  op_ctx->client->addr.len);
 
-	/* XXX dang switch to pwritev_async once async supported */
 	nb_written = glfs_pwritev(my_fd.glfd, write_arg->iov,
 				  write_arg->iov_count, write_arg->offset,
 				  (write_arg->fsal_stable ? O_SYNC : 0));
@@ -2859,6 +3023,7 @@ static fsal_status_t glusterfs_close2(struct fsal_obj_handle *obj_hdl,
 	 * is operating on the fd while we close it.
 	 */
 	PTHREAD_RWLOCK_wrlock(&my_fd->fdlock);
+	fsal_fd_pins_wait(&my_fd->pins);
 	status = glusterfs_close_my_fd(my_fd);
 	PTHREAD_RWLOCK_unlock(&my_fd->fdlock);
 
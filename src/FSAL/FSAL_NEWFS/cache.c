@@ -0,0 +1,437 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file cache.c
+ * @brief Attribute cache for FSAL_NEWFS
+ *
+ * Every NewFS getattr is a metadata store transaction.  Each export
+ * keeps the attributes it last read, tagged with the inode generation
+ * they were read at, and answers getattrs from them for as long as the
+ * metadata store has not reported a newer generation through
+ * newfs_watch().
+ *
+ * A change notification for an inode whose cached attributes were in
+ * use also goes up to MDCACHE as an FSAL_UP invalidate, so MDCACHE
+ * refreshes early instead of serving its own copy until it expires.
+ * Notifications for an inode that is already invalid are absorbed, so
+ * a stream of writes costs one upcall per refresh, not one per write.
+ *
+ * Without newfs_watch() (USE_NEWFS_WATCH) there is nothing to tell us
+ * the attributes changed, so the cache stays off.
+ */
+
+#include "config.h"
+#include "fsal.h"
+#include "fsal_types.h"
+#include "fsal_api.h"
+#include "fsal_up.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "gsh_list.h"
+#include "avltree.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+#include "internal.h"
+
+struct newfs_attr_entry {
+  struct avltree_node node_k;   /*< In partition tree, by ino */
+  struct glist_head lru;        /*< In partition LRU, hottest first */
+  uint64_t ino;
+  uint64_t attr_gen;            /*< Generation attr was read at */
+  uint64_t seen_gen;            /*< Newest generation notified */
+  bool valid;
+  struct stat attr;
+};
+
+static struct fsal_op_stats newfs_op_stats[NEWFS_STAT_OPS];
+static struct fsal_stats newfs_stats;
+
+static const char *newfs_stat_names[NEWFS_STAT_OPS] = {
+  [NEWFS_STAT_GETATTR] = "getattr",
+  [NEWFS_STAT_GETATTR_CACHED] = "getattr_cached",
+  [NEWFS_STAT_INVALIDATE] = "invalidate",
+  [NEWFS_STAT_UPCALL] = "upcall",
+};
+
+/**
+ * @brief Count an operation in the FSAL stats
+ *
+ * @param[in] op    NEWFS_STAT_*
+ * @param[in] start Start time, or NULL for an untimed event
+ */
+void newfs_stat_record(int op, struct timespec *start)
+{
+  struct fsal_op_stats *stat = &newfs_op_stats[op];
+  struct timespec stop;
+  uint64_t resp_time;
+
+  if (!nfs_param.core_param.enable_FSALSTATS)
+    return;
+
+  (void) atomic_inc_uint64_t(&stat->num_ops);
+  if (start == NULL)
+    return;
+
+  now(&stop);
+  resp_time = timespec_diff(start, &stop);
+  (void) atomic_add_uint64_t(&stat->resp_time, resp_time);
+  if (stat->resp_time_max < resp_time)
+    stat->resp_time_max = resp_time;
+  if (stat->resp_time_min == 0 || stat->resp_time_min > resp_time)
+    stat->resp_time_min = resp_time;
+}
+
+void newfs_prepare_for_stats(struct fsal_module *fsal_hdl)
+{
+  int op;
+
+  newfs_stats.total_ops = NEWFS_STAT_OPS;
+  newfs_stats.op_stats = newfs_op_stats;
+  for (op = 0; op < NEWFS_STAT_OPS; op++)
+    newfs_op_stats[op].op_code = op;
+  fsal_hdl->stats = &newfs_stats;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report FSAL_NEWFS counters for GetFSALStats
+ *
+ * getattr is backend transactions made, getattr_cached is transactions
+ * saved, invalidate is change notifications received and upcall is
+ * invalidates sent to MDCACHE.
+ */
+void newfs_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+  struct timespec timestamp;
+  DBusMessageIter struct_iter;
+  DBusMessageIter *iter1 = (DBusMessageIter *)iter;
+  const char *message;
+  uint64_t total_ops, op_counter = 0;
+  double res = 0.0;
+  int i;
+
+  now(&timestamp);
+  dbus_append_timestamp(iter, &timestamp);
+  message = "NEWFS";
+  dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+
+  dbus_message_iter_open_container(iter1, DBUS_TYPE_STRUCT, NULL,
+                                   &struct_iter);
+  for (i = 0; i < NEWFS_STAT_OPS; i++) {
+    total_ops = atomic_fetch_uint64_t(&newfs_op_stats[i].num_ops);
+    if (total_ops == 0)
+      continue;
+
+    message = newfs_stat_names[i];
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+                                   &message);
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+                                   &total_ops);
+    res = (double) atomic_fetch_uint64_t(&newfs_op_stats[i].resp_time) *
+          0.000001 / total_ops;
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &res);
+    res = (double) newfs_op_stats[i].resp_time_min * 0.000001;
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &res);
+    res = (double) newfs_op_stats[i].resp_time_max * 0.000001;
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &res);
+    op_counter += total_ops;
+  }
+  if (op_counter == 0) {
+    message = "None";
+    res = 0.0;
+    /* insert dummy stats to avoid dbus crash */
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+                                   &message);
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+                                   &op_counter);
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &res);
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &res);
+    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &res);
+  } else {
+    message = "OK";
+  }
+  dbus_message_iter_close_container(iter1, &struct_iter);
+  dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+}
+#endif /* USE_DBUS */
+
+void newfs_reset_stats(struct fsal_module *fsal_hdl)
+{
+  int i;
+
+  for (i = 0; i < NEWFS_STAT_OPS; i++) {
+    atomic_store_uint64_t(&newfs_op_stats[i].num_ops, 0);
+    atomic_store_uint64_t(&newfs_op_stats[i].resp_time, 0);
+    atomic_store_uint64_t(&newfs_op_stats[i].resp_time_min, 0);
+    atomic_store_uint64_t(&newfs_op_stats[i].resp_time_max, 0);
+  }
+}
+
+static int newfs_attr_cmpf(const struct avltree_node *lhs,
+                           const struct avltree_node *rhs)
+{
+  struct newfs_attr_entry *lk, *rk;
+
+  lk = avltree_container_of(lhs, struct newfs_attr_entry, node_k);
+  rk = avltree_container_of(rhs, struct newfs_attr_entry, node_k);
+
+  if (lk->ino < rk->ino)
+    return -1;
+  return lk->ino > rk->ino;
+}
+
+static inline struct newfs_attr_part *
+newfs_attr_part(struct newfs_export *export, uint64_t ino)
+{
+  return &export->attr_cache[ino % NEWFS_ATTR_PARTITIONS];
+}
+
+/* Called with part->lock held */
+static struct newfs_attr_entry *
+newfs_attr_find(struct newfs_attr_part *part, uint64_t ino)
+{
+  struct newfs_attr_entry key;
+  struct avltree_node *node;
+
+  key.ino = ino;
+  node = avltree_lookup(&key.node_k, &part->tree);
+  if (node == NULL)
+    return NULL;
+  return avltree_container_of(node, struct newfs_attr_entry, node_k);
+}
+
+/* Find or add the entry for ino, evicting the coldest entry if the
+ * partition is full.  Called with part->lock held. */
+static struct newfs_attr_entry *
+newfs_attr_get(struct newfs_attr_part *part, uint64_t ino)
+{
+  struct newfs_attr_entry *entry = newfs_attr_find(part, ino);
+
+  if (entry != NULL) {
+    glist_del(&entry->lru);
+    glist_add(&part->lru, &entry->lru);
+    return entry;
+  }
+
+  if (part->count >= NewFS.attr_cache_size / NEWFS_ATTR_PARTITIONS + 1) {
+    entry = glist_last_entry(&part->lru, struct newfs_attr_entry, lru);
+    glist_del(&entry->lru);
+    avltree_remove(&entry->node_k, &part->tree);
+  } else {
+    entry = gsh_malloc(sizeof(*entry));
+    part->count++;
+  }
+
+  memset(entry, 0, sizeof(*entry));
+  entry->ino = ino;
+  (void) avltree_insert(&entry->node_k, &part->tree);
+  glist_add(&part->lru, &entry->lru);
+  return entry;
+}
+
+#ifdef USE_NEWFS_WATCH
+/**
+ * @brief Metadata store change notification
+ *
+ * Runs with metadata store locks held, so it only touches the cache
+ * and hands the MDCACHE invalidate to the general fridge.
+ */
+static void newfs_attr_notify(void *arg, uint64_t ino, uint64_t gen)
+{
+  struct newfs_export *export = arg;
+  struct newfs_attr_part *part = newfs_attr_part(export, ino);
+  struct newfs_attr_entry *entry;
+  struct newfs_handle_key key = { .ino = ino };
+  struct gsh_buffdesc fh_desc = { .addr = &key, .len = sizeof(key) };
+  bool upcall = false;
+
+  newfs_stat_record(NEWFS_STAT_INVALIDATE, NULL);
+
+  PTHREAD_MUTEX_lock(&part->lock);
+  entry = newfs_attr_find(part, ino);
+  if (entry == NULL) {
+    /* Never cached here, but MDCACHE may have it from a lookup */
+    entry = newfs_attr_get(part, ino);
+    entry->seen_gen = gen;
+    upcall = true;
+  } else if (gen > entry->seen_gen) {
+    entry->seen_gen = gen;
+    if (entry->valid && gen > entry->attr_gen) {
+      entry->valid = false;
+      upcall = true;
+    }
+  }
+  PTHREAD_MUTEX_unlock(&part->lock);
+
+  if (upcall && export->export.up_ops != NULL) {
+    newfs_stat_record(NEWFS_STAT_UPCALL, NULL);
+    (void) up_async_invalidate(general_fridge, export->export.up_ops,
+                               &fh_desc, FSAL_UP_INVALIDATE_ATTRS,
+                               NULL, NULL);
+  }
+}
+#endif /* USE_NEWFS_WATCH */
+
+/**
+ * @brief Set up an export's attribute cache and watch for changes
+ */
+void newfs_attr_cache_init(struct newfs_export *export)
+{
+  int i;
+
+  for (i = 0; i < NEWFS_ATTR_PARTITIONS; i++) {
+    struct newfs_attr_part *part = &export->attr_cache[i];
+
+    PTHREAD_MUTEX_init(&part->lock, NULL);
+    avltree_init(&part->tree, newfs_attr_cmpf, 0);
+    glist_init(&part->lru);
+    part->count = 0;
+  }
+
+  export->attr_cache_on = false;
+#ifdef USE_NEWFS_WATCH
+  int rc;
+
+  if (NewFS.attr_cache_size == 0)
+    return;
+
+  rc = newfs_watch(export->newfs_info, newfs_attr_notify, export);
+  if (rc < 0) {
+    LogWarn(COMPONENT_FSAL,
+            "Unable to watch NEWFS metadata (%d), attribute cache disabled",
+            rc);
+    return;
+  }
+  export->attr_cache_on = true;
+#endif
+}
+
+/**
+ * @brief Stop watching and drop an export's attribute cache
+ */
+void newfs_attr_cache_fini(struct newfs_export *export)
+{
+  struct newfs_attr_entry *entry;
+  int i;
+
+#ifdef USE_NEWFS_WATCH
+  if (export->attr_cache_on)
+    (void) newfs_watch(export->newfs_info, NULL, NULL);
+#endif
+  export->attr_cache_on = false;
+
+  for (i = 0; i < NEWFS_ATTR_PARTITIONS; i++) {
+    struct newfs_attr_part *part = &export->attr_cache[i];
+
+    while ((entry = glist_first_entry(&part->lru, struct newfs_attr_entry,
+                                      lru)) != NULL) {
+      glist_del(&entry->lru);
+      gsh_free(entry);
+    }
+    PTHREAD_MUTEX_destroy(&part->lock);
+  }
+}
+
+/**
+ * @brief Attributes from the cache if still current
+ *
+ * @param[in]  export Export
+ * @param[in]  ino    Inode
+ * @param[out] st     Attributes
+ *
+ * @return true if st was filled from the cache.
+ */
+bool newfs_attr_lookup(struct newfs_export *export, uint64_t ino,
+                       struct stat *st)
+{
+  struct newfs_attr_part *part;
+  struct newfs_attr_entry *entry;
+  struct timespec start;
+  bool hit = false;
+
+  if (!export->attr_cache_on)
+    return false;
+
+  now(&start);
+  part = newfs_attr_part(export, ino);
+
+  PTHREAD_MUTEX_lock(&part->lock);
+  entry = newfs_attr_find(part, ino);
+  if (entry != NULL && entry->valid) {
+    *st = entry->attr;
+    glist_del(&entry->lru);
+    glist_add(&part->lru, &entry->lru);
+    hit = true;
+  }
+  PTHREAD_MUTEX_unlock(&part->lock);
+
+  if (hit)
+    newfs_stat_record(NEWFS_STAT_GETATTR_CACHED, &start);
+  return hit;
+}
+
+/**
+ * @brief Get attributes, from the cache if the backend has not changed
+ *
+ * @param[in]  export Export
+ * @param[in]  item   Object
+ * @param[in]  ino    Inode of item
+ * @param[out] st     Attributes
+ *
+ * @return 0 or -errno.
+ */
+int newfs_attr_get_cached(struct newfs_export *export, newfs_item *item,
+                          uint64_t ino, struct stat *st)
+{
+  struct newfs_attr_part *part;
+  struct newfs_attr_entry *entry;
+  struct timespec start;
+  uint64_t gen = 0;
+  int rc;
+
+  if (newfs_attr_lookup(export, ino, st))
+    return 0;
+
+  now(&start);
+#ifdef USE_NEWFS_WATCH
+  rc = newfs_getattr_gen(export->newfs_info, item, st, &gen);
+#else
+  rc = newfs_getattr(export->newfs_info, item, st);
+#endif
+  newfs_stat_record(NEWFS_STAT_GETATTR, &start);
+  if (rc < 0 || !export->attr_cache_on)
+    return rc;
+
+  part = newfs_attr_part(export, ino);
+
+  PTHREAD_MUTEX_lock(&part->lock);
+  entry = newfs_attr_get(part, ino);
+  /* A change notified while we were reading wins */
+  if (gen >= entry->seen_gen) {
+    entry->attr = *st;
+    entry->attr_gen = gen;
+    entry->seen_gen = gen;
+    entry->valid = true;
+  }
+  PTHREAD_MUTEX_unlock(&part->lock);
+
+  return 0;
+}
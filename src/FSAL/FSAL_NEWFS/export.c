@@ -9,6 +9,8 @@
 #include "FSAL/fsal_config.h"
 #include "internal.h"
 #include "sal_functions.h"
+#include "nfs_core.h"
+#include "abstract_atomic.h"
 
 /**
  * @brief Clean up an export
@@ -25,7 +27,11 @@ static void release(struct fsal_export* export_pub)
   struct newfs_export* export = container_of(export_pub,
   				struct newfs_export, export);
 
-  int rc = newfs_fini(export->newfs_info);
+  int rc;
+
+  newfs_attr_cache_fini(export);
+
+  rc = newfs_fini(export->newfs_info);
   assert(rc == 0);
   
   deconstruct_handle(export->root);
@@ -189,7 +195,9 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
       return newfs2fsal_error(rc);
   }
 
-  rc = newfs_getattr(export->newfs_info, item, &st);
+  /* Decoding a handle MDCACHE has dropped is common, the attributes
+   * may still be current here. */
+  rc = newfs_attr_get_cached(export, item, key->ino, &st);
   if (rc < 0)
     return newfs2fsal_error(rc);
 
@@ -242,6 +250,29 @@ static fsal_status_t get_fs_dynamic_info(struct fsal_export *export_pub,
   return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Get write verifier
+ *
+ * The global verifier, changed when a deferred write error could not be
+ * reported to a COMMIT, see io.c.
+ *
+ * @param[in]     exp_hdl   Export
+ * @param[in,out] verf_desc Address and length of verifier
+ */
+static void newfs_get_write_verifier(struct fsal_export *exp_hdl,
+                                     struct gsh_buffdesc *verf_desc)
+{
+  union {
+    verifier4 verf;
+    uint32_t word[2];
+  } verifier;
+
+  memcpy(verifier.verf, NFS4_write_verifier, sizeof(verifier.verf));
+  verifier.word[1] ^= atomic_fetch_uint32_t(&newfs_write_verifier_gen);
+
+  memcpy(verf_desc->addr, verifier.verf, verf_desc->len);
+}
+
 /**
  * @brief Set operations for exports
  *
@@ -260,4 +291,5 @@ void export_ops_init(struct export_ops* ops)
   ops->get_fs_dynamic_info = get_fs_dynamic_info;
   ops->alloc_state = newfs_alloc_state;
   ops->free_state = newfs_free_state;
+  ops->get_write_verifier = newfs_get_write_verifier;
 }
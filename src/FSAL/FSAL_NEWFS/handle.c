@@ -25,6 +25,7 @@ static void newfs_fsal_release(struct fsal_obj_handle *obj_hdl)
     // FIXME: also release newfs releated stub?
     // API: 
     //
+    newfs_io_release(obj);
     deconstruct_handle(obj);
   }
 }
@@ -189,6 +190,12 @@ static fsal_status_t newfs_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
  * which is ironic since the newfs not store anything for them) and passes
  * dirent information to the supplied callback.
  *
+ * Entries are fetched NEWFS_READDIR_BATCH at a time.  Cookies are the
+ * backend's continuation cursors offset past the reserved cookies, so
+ * a listing resumes where it stopped even if the directory changed.
+ * On DIR_READAHEAD the rest of the batch already fetched is passed up,
+ * but no further batch is read.
+ *
  * @param[in]	dir_hdl		The directory to read
  * @param[in]	whence		The cookie indicating resumption, NULL to start
  * @param[in]	dir_state	Opaque, passed to cb
@@ -202,8 +209,12 @@ static fsal_status_t newfs_fsal_readdir(struct fsal_obj_handle *dir_hdl,
                        fsal_readdir_cb cb, attrmask_t attrmask, bool *eof)
 {
   int rc = -1;
+  int i = 0, n = 0;
   fsal_status_t fsal_status = {ERR_FSAL_NO_ERROR, 0};
-  uint64_t start = 0;
+  uint64_t cursor = 0;
+  bool readahead = false;
+  bool stop = false;
+  struct newfs_dirent *ents;
 
   struct newfs_export *export = container_of(op_ctx->fsal_export,
                                   struct newfs_export, export);
@@ -211,55 +222,61 @@ static fsal_status_t newfs_fsal_readdir(struct fsal_obj_handle *dir_hdl,
 
   LogFullDebug(COMPONENT_FSAL, "%s enter dir_hdl %p", __func__, dir_hdl);
 
-  if (whence != NULL) {
-    start = *whence;
+  if (whence != NULL && *whence >= FIRST_COOKIE) {
+    cursor = *whence - FIRST_COOKIE;
   }
-  // FIXME: newfs_opendir() ????
-  //        we need a newfs_opendir() or we cannot make sure dir's entries
-  //        stay the same as the first time newfs_readir()
-  while (!(*eof)) {
-    newfs_item *item = NULL;
-    struct stat st;
-    struct dirent de;
-    rc = newfs_readdir(export->newfs_info, dir->item, &de, start, &item, &st);
+
+  *eof = false;
+  ents = gsh_malloc(NEWFS_READDIR_BATCH * sizeof(*ents));
+
+  while (!stop && !(*eof)) {
+    rc = newfs_readdir_batch(export->newfs_info, dir->item, cursor, ents,
+                             NEWFS_READDIR_BATCH, &cursor, eof);
     if (rc < 0) {
       fsal_status = newfs2fsal_error(rc);
       break;
-    } else if (rc == 1) {
+    }
+    n = rc;
+
+    for (i = 0; i < n && !stop; i++) {
       struct newfs_handle *obj = NULL;
       struct attrlist attrs;
       enum fsal_dir_result cb_rc;
 
-      // FIXME: how to handle . and ..
-      rc = construct_handle(export, item, &st, &obj);
+      rc = construct_handle(export, ents[i].item, &ents[i].st, &obj);
       if (rc < 0) {
         fsal_status = newfs2fsal_error(rc);
+        stop = true;
         break;
       }
 
       fsal_prepare_attrs(&attrs, attrmask);
-      posix2fsal_attributes_all(&st, &attrs);
+      posix2fsal_attributes_all(&ents[i].st, &attrs);
       // TODO: security labels support
-      // rc = newfs_fsal_get_sec_label(obj, &attrs);
-      // if (rc < 0) {
-      //   fsal_status = newfs2fsal_error(rc);
-      //   break;
-      // }
-      cb_rc = cb(de.d_name, &obj->handle, &attrs, dir_state, de.d_off);
+      cb_rc = cb(ents[i].name, &obj->handle, &attrs, dir_state,
+                 ents[i].cursor + FIRST_COOKIE);
       fsal_release_attrs(&attrs);
-      if (cb_rc >= DIR_READAHEAD) {
-        /* Read ahead not supported by this FSAL. */
-        break;
+
+      if (cb_rc >= DIR_TERMINATE) {
+        stop = true;
+      } else if (cb_rc == DIR_READAHEAD) {
+        readahead = true;
       }
-      start ++; /* next entry */
-    } else if (rc == 0) {
-      *eof = true;
-    } else {
-      /* Can't happend */
-      abort();
     }
+
+    /* Entries fetched but not passed up */
+    if (i < n) {
+      *eof = false;
+      for (; i < n; i++)
+        newfs_put(export->newfs_info, ents[i].item);
+    }
+
+    if (readahead)
+      break;
   }
- 
+
+  gsh_free(ents);
+
   return fsal_status;
 }
 
@@ -286,7 +303,7 @@ static fsal_status_t newfs_fsal_getattrs(struct fsal_obj_handle *obj_hdl,
 
   LogFullDebug(COMPONENT_FSAL, "%s enter obj_hdl %p", __func__, obj_hdl);
 
-  rc = newfs_getattr(export->newfs_info, handle->item, &st);
+  rc = newfs_attr_get_cached(export, handle->item, handle->key.ino, &st);
   if (rc < 0) {
     if (attrs->request_mask & ATTR_RDATTR_ERR) {
       /* Caller asked for error to be visible */
@@ -295,6 +312,9 @@ static fsal_status_t newfs_fsal_getattrs(struct fsal_obj_handle *obj_hdl,
     return newfs2fsal_error(rc);
   }
 
+  /* Size must reflect coalesced writes */
+  newfs_io_stat(handle, &st);
+
   posix2fsal_attributes_all(&st, attrs);
 
   return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -442,6 +462,8 @@ static fsal_status_t newfs_close_my_fd(struct newfs_handle *handle,
   fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 
   if (my_fd->fd != NULL && my_fd->openflags != FSAL_O_CLOSED) {
+    (void) newfs_io_flush(handle, (my_fd->openflags & FSAL_O_WRITE) ?
+                                  my_fd->fd : NULL);
     rc = newfs_close(handle->export->newfs_info, my_fd->fd);
     if (rc < 0)
       status = newfs2fsal_error(rc);
@@ -1173,14 +1195,10 @@ static void newfs_fsal_read2(struct fsal_obj_handle *obj_hdl,
   Fh *my_fd = NULL;
   bool has_lock = false;
   bool closefd = false;
-  ssize_t nb_read = 0;
   struct newfs_handle *myself = container_of(obj_hdl, struct newfs_handle,
                                              handle);
-  struct newfs_export *export = container_of(op_ctx->fsal_export,
-                                  struct newfs_export, export);
-  uint64_t offset = read_arg->offset;
   struct newfs_fd *newfs_fd = NULL;
-  int i = 0;
+  int rc;
 
   if (read_arg->info != NULL) {
     /* Currently we don't support READ_PLUS */
@@ -1208,22 +1226,10 @@ static void newfs_fsal_read2(struct fsal_obj_handle *obj_hdl,
 
   read_arg->io_amount = 0;
 
-  for (i = 0; i < read_arg->iov_count; i++) {
-    nb_read = newfs_read(export->newfs_info, my_fd, offset,
-                         read_arg->iov[i].iov_len,
-                         read_arg->iov[i].iov_base);
-
-    if (nb_read == 0) {
-      read_arg->end_of_file = true;
-      break;
-    } else if (nb_read < 0) {
-      status = newfs2fsal_error(nb_read);
-      goto out;
-    }
-
-    read_arg->io_amount += nb_read;
-    offset += nb_read;
-  }
+  /* Chunked, parallel and possibly served from readahead */
+  rc = newfs_io_read(myself, my_fd, read_arg);
+  if (rc < 0)
+    status = newfs2fsal_error(rc);
 
 out:
   if (newfs_fd)
@@ -1268,10 +1274,7 @@ static void newfs_fsal_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
   bool has_lock = false;
   bool closefd = false;
   fsal_openflags_t openflags = FSAL_O_WRITE;
-  int i = 0;
   int rc = -1;
-  ssize_t nb_written = 0;
-  uint64_t offset = write_arg->offset;
 
   struct newfs_export *export = container_of(op_ctx->fsal_export,
                                              struct newfs_export, export);
@@ -1297,19 +1300,11 @@ static void newfs_fsal_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
     goto out;
   }
 
-  for (i = 0; i < write_arg->iov_count; i++) {
-    nb_written = newfs_write(export->newfs_info, my_fd, offset,
-                             write_arg->iov[i].iov_len,
-                             write_arg->iov[i].iov_base);
-    if (nb_written == 0) {
-      break;
-    } else if (nb_written < 0) {
-      status = newfs2fsal_error(nb_written);
-      goto out;
-    }
-
-    write_arg->io_amount += nb_written;
-    offset += nb_written;
+  /* Chunked and parallel, small unstable writes are coalesced */
+  rc = newfs_io_write(myself, my_fd, write_arg);
+  if (rc < 0) {
+    status = newfs2fsal_error(rc);
+    goto out;
   }
 
   if (write_arg->fsal_stable) {
@@ -1359,6 +1354,12 @@ static fsal_status_t newfs_fsal_commit2(struct fsal_obj_handle *obj_hdl,
   struct newfs_export *export = container_of(op_ctx->fsal_export,
                                              struct newfs_export, export);
 
+  /* Coalesced writes go out first, and a failed deferred write
+   * must fail the COMMIT so the client resends. */
+  rc = newfs_io_commit(myself);
+  if (rc < 0)
+    return newfs2fsal_error(rc);
+
   /* we can avoid opening altogether */ 
   rc = newfs_sync_item(export->newfs_info, myself->item, 0);
 
@@ -1437,6 +1438,14 @@ static fsal_status_t newfs_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
     }
   }
 
+  if (obj_hdl->type == REGULAR_FILE) {
+    /* Order coalesced writes before the change, and drop readahead
+     * that a truncate would make stale. */
+    (void) newfs_io_flush(myself, NULL);
+    if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE))
+      newfs_io_invalidate(myself);
+  }
+
   memset(&st, 0, sizeof(struct stat));
 
   // FIXME: newfs_truncate???
@@ -3,6 +3,7 @@
 #include "fsal.h"
 #include "fsal_convert.h"
 #include "FSAL/fsal_commonlib.h"
+#include "common_utils.h"
 #include "internal.h"
 
 /**
@@ -50,8 +51,11 @@ int construct_handle(struct newfs_export *export, newfs_item *item,
   constructing->handle.obj_ops = &NewFS.handle_ops;
   constructing->handle.fsid = posix2fsal_fsid(st->st_dev);
   constructing->handle.fileid = st->st_ino;
+  constructing->key.ino = st->st_ino;
 
   constructing->export = export;
+  if (constructing->handle.type == REGULAR_FILE)
+    newfs_io_cache_init(&constructing->io);
 
   *obj = constructing;
 
@@ -66,6 +70,42 @@ int construct_handle(struct newfs_export *export, newfs_item *item,
 void deconstruct_handle(struct newfs_handle* obj)
 {
         // FIXME: fdb
+        if (obj->handle.type == REGULAR_FILE)
+          newfs_io_cache_fini(&obj->io);
         fsal_obj_handle_fini(&obj->handle);
         gsh_free(obj);
 }
+
+#ifndef USE_NEWFS_READDIR_BATCH
+/**
+ * @brief Read a batch of directory entries with the per-entry API
+ *
+ * Older libnewfs only has newfs_readdir(), which reads the entry at an
+ * index.  The cursor is that index, so a listing is not stable across
+ * changes to the directory, and each entry is still a backend call.
+ */
+int newfs_readdir_batch(struct newfs_info *info, newfs_item *dir,
+                        uint64_t cursor, struct newfs_dirent *ents, int max,
+                        uint64_t *next, bool *eof)
+{
+  struct dirent de;
+  int n, rc;
+
+  *eof = false;
+
+  for (n = 0; n < max; n++) {
+    rc = newfs_readdir(info, dir, &de, cursor, &ents[n].item, &ents[n].st);
+    if (rc < 0)
+      return rc;
+    if (rc == 0) {
+      *eof = true;
+      break;
+    }
+    strlcpy(ents[n].name, de.d_name, sizeof(ents[n].name));
+    ents[n].cursor = ++cursor;
+  }
+
+  *next = cursor;
+  return n;
+}
+#endif
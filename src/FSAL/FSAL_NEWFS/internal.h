@@ -1,6 +1,7 @@
 #ifndef _FSAL_NEWFS_INTERNAL_H
 #define _FSAL_NEWFS_INTERNAL_H
 
+#include "config.h"
 #include "fsal.h"
 #include "fsal_types.h"
 #include "fsal_api.h"
@@ -8,6 +9,8 @@
 #include <stdbool.h>
 #include <uuid/uuid.h>
 #include "FSAL/fsal_commonlib.h"
+#include "avltree.h"
+#include "gsh_list.h"
 
 #include "newfs/newfs_c.h"
 
@@ -18,17 +21,60 @@
 #define MAXSECRETLEN	(88)
 
 /* Max file size in newfs */
-#define NEWFS_MAX_FILE_SIZE     (20 << 20)
+#define NEWFS_MAX_FILE_SIZE     (1ULL << 44)
+
+/* Defaults for the chunked data path, see io.c */
+#define NEWFS_CHUNK_SIZE        (4 << 20)
+#define NEWFS_IO_THREADS        16
+#define NEWFS_READAHEAD_SIZE    (8 << 20)
+#define NEWFS_WRITE_COALESCE    (1 << 20)
+
+/* Attribute cache, see cache.c */
+#define NEWFS_ATTR_CACHE_SIZE   65536
+#define NEWFS_ATTR_PARTITIONS   32
+
+/* FSAL stats counters, see cache.c */
+enum newfs_stat_op {
+  NEWFS_STAT_GETATTR,           /*< backend getattr transactions */
+  NEWFS_STAT_GETATTR_CACHED,    /*< getattrs answered from the cache */
+  NEWFS_STAT_INVALIDATE,        /*< change notifications received */
+  NEWFS_STAT_UPCALL,            /*< invalidates sent to MDCACHE */
+  NEWFS_STAT_OPS
+};
+
+/* Directory entries fetched per backend readdir call */
+#define NEWFS_READDIR_BATCH     64
+
+#ifndef USE_NEWFS_READDIR_BATCH
+/* libnewfs without the batched readdir API, see internal.c */
+struct newfs_dirent {
+  char name[NAME_MAX + 1];
+  uint64_t cursor;          /*< Cursor to resume after this entry */
+  newfs_item *item;
+  struct stat st;
+};
+
+int newfs_readdir_batch(struct newfs_info *info, newfs_item *dir,
+                        uint64_t cursor, struct newfs_dirent *ents, int max,
+                        uint64_t *next, bool *eof);
+#endif
 
 struct newfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_obj_ops handle_ops;
 	char* ceph_conf_path;
 	char* fdb_conf_path;		/*< foudationdb conf path */
+	uint64_t chunk_size;		/*< unit of parallel data I/O */
+	uint32_t io_threads;		/*< threads issuing chunk I/O */
+	uint64_t readahead_size;	/*< sequential readahead, 0 = off */
+	uint64_t write_coalesce_size;	/*< write gathering, 0 = off */
+	struct fridgethr *io_fridge;	/*< chunk I/O and readahead */
+	uint32_t attr_cache_size;	/*< cached inodes per export, 0 = off */
         //bool init_done;			/*< alreay initialized */
 	/* TODO: FDBDatabase* db */
 };
 extern struct newfs_fsal_module NewFS;
+extern uint32_t newfs_write_verifier_gen;
 
 struct newfs_fd {
   /* The open and share mode etc. */
@@ -44,6 +90,25 @@ struct newfs_state_fd {
   struct newfs_fd newfs_fd;
 };
 
+/**
+ * Per-file data cache: readahead window and coalesced writes, see io.c
+ */
+struct newfs_io_cache {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;      /*< signalled when readahead completes */
+  uint64_t next_off;        /*< where a sequential read would start */
+  uint32_t seq_reads;       /*< sequential reads in a row */
+  bool ra_inflight;
+  uint64_t ra_gen;          /*< bumped to discard in-flight readahead */
+  char *ra_buf;
+  uint64_t ra_off;
+  size_t ra_len;
+  char *wb_buf;             /*< write_coalesce_size bytes once used */
+  uint64_t wb_off;
+  size_t wb_len;
+  int wb_error;             /*< deferred write error, for COMMIT */
+};
+
 struct newfs_handle_key {
   uint64_t ino;
 };
@@ -59,6 +124,17 @@ struct newfs_handle {
 	struct newfs_export* export;		/*< The first export this handle
 						 *< belongs to */
 	struct newfs_handle_key key;		/*< map handle to digest(ino) */
+	struct newfs_io_cache io;		/*< data cache, regular files */
+};
+
+/**
+ * One partition of an export's attribute cache
+ */
+struct newfs_attr_part {
+  pthread_mutex_t lock;
+  struct avltree tree;      /*< newfs_attr_entry by ino */
+  struct glist_head lru;    /*< most recently used first */
+  uint32_t count;
 };
 
 /**
@@ -72,6 +148,8 @@ struct newfs_export {
 
 	char* user_id; 		   /* cephx user_id for this mount */
 	char* secret_key;	   /* keyring path of ceph user */
+	bool attr_cache_on;	   /* watching metadata, cache usable */
+	struct newfs_attr_part attr_cache[NEWFS_ATTR_PARTITIONS];
 //	char* cephf_conf;	   /* config file of the backend ceph cluster */
 };
 
@@ -96,6 +174,34 @@ int construct_handle(struct newfs_export *export, newfs_item *item,
                      struct stat *st, struct newfs_handle **obj);
 void deconstruct_handle(struct newfs_handle* obj);
 
+int newfs_io_init(void);
+void newfs_io_fini(void);
+void newfs_io_cache_init(struct newfs_io_cache *io);
+void newfs_io_cache_fini(struct newfs_io_cache *io);
+int64_t newfs_chunk_io(struct newfs_info *info, Fh *fd, bool write,
+                       uint64_t offset, const struct iovec *iov, int iovcnt,
+                       bool fanout, bool *eof);
+int newfs_io_read(struct newfs_handle *myself, Fh *fd,
+                  struct fsal_io_arg *arg);
+int newfs_io_write(struct newfs_handle *myself, Fh *fd,
+                   struct fsal_io_arg *arg);
+int newfs_io_flush(struct newfs_handle *myself, Fh *fd);
+int newfs_io_commit(struct newfs_handle *myself);
+void newfs_io_release(struct newfs_handle *myself);
+void newfs_io_stat(struct newfs_handle *myself, struct stat *st);
+void newfs_io_invalidate(struct newfs_handle *myself);
+
+void newfs_attr_cache_init(struct newfs_export *export);
+void newfs_attr_cache_fini(struct newfs_export *export);
+bool newfs_attr_lookup(struct newfs_export *export, uint64_t ino,
+                       struct stat *st);
+int newfs_attr_get_cached(struct newfs_export *export, newfs_item *item,
+                          uint64_t ino, struct stat *st);
+void newfs_stat_record(int op, struct timespec *start);
+void newfs_prepare_for_stats(struct fsal_module *fsal_hdl);
+void newfs_extract_stats(struct fsal_module *fsal_hdl, void *iter);
+void newfs_reset_stats(struct fsal_module *fsal_hdl);
+
 void export_ops_init(struct export_ops *ops);
 void handle_ops_init(struct fsal_obj_ops *ops);
 
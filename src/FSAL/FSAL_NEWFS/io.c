@@ -0,0 +1,674 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file io.c
+ * @brief Chunked data I/O for FSAL_NEWFS
+ *
+ * Files are laid out in chunk_size chunks.  A read or write is split
+ * at chunk boundaries and the pieces are issued to the backend in
+ * parallel on the NewFS I/O fridge, so a large request is spread over
+ * the backend instead of being one long synchronous call.
+ *
+ * On top of that, each handle has a small data cache:
+ *
+ * - sequential readahead: after two sequential reads, the next
+ *   readahead_size bytes are fetched in the background and later reads
+ *   inside that window are served from memory.
+ *
+ * - write coalescing: small contiguous UNSTABLE writes are gathered
+ *   into a buffer of up to write_coalesce_size bytes and written as
+ *   one chunked write.  The buffer is flushed before anything that
+ *   could observe the data (read, setattrs, commit, close, release);
+ *   getattrs only extends the size to cover it.  A failed flush is
+ *   kept on the handle until a COMMIT reports it, and if the handle
+ *   goes away first the write verifier is changed instead, so either
+ *   way clients send the unstable data again.
+ */
+
+#include <fcntl.h>
+#include "fsal.h"
+#include "fsal_types.h"
+#include "fsal_api.h"
+#include "fridgethr.h"
+#include "common_utils.h"
+#include "abstract_atomic.h"
+#include "internal.h"
+
+/** Changed when a deferred write error can no longer be reported */
+uint32_t newfs_write_verifier_gen;
+
+/** One piece of a request, within one chunk and one iovec */
+struct newfs_io_piece {
+  struct newfs_io_batch *batch;
+  uint64_t offset;
+  size_t len;
+  char *buf;
+  int64_t result;
+};
+
+struct newfs_io_batch {
+  struct newfs_info *info;
+  Fh *fd;
+  bool write;
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  int pending;
+};
+
+static void newfs_io_piece_run(struct newfs_io_piece *piece)
+{
+  struct newfs_io_batch *batch = piece->batch;
+
+  if (batch->write)
+    piece->result = newfs_write(batch->info, batch->fd, piece->offset,
+                                piece->len, piece->buf);
+  else
+    piece->result = newfs_read(batch->info, batch->fd, piece->offset,
+                               piece->len, piece->buf);
+}
+
+static void newfs_io_piece_thread(struct fridgethr_context *ctx)
+{
+  struct newfs_io_piece *piece = ctx->arg;
+  struct newfs_io_batch *batch = piece->batch;
+
+  newfs_io_piece_run(piece);
+
+  PTHREAD_MUTEX_lock(&batch->mtx);
+  if (--batch->pending == 0)
+    pthread_cond_signal(&batch->cv);
+  PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+/**
+ * @brief Split an iovec at chunk boundaries
+ *
+ * @return Number of pieces, at most max.
+ */
+static int newfs_io_split(uint64_t offset, const struct iovec *iov,
+                          int iovcnt, struct newfs_io_piece *pieces, int max)
+{
+  uint64_t chunk = NewFS.chunk_size;
+  int i, n = 0;
+
+  for (i = 0; i < iovcnt; i++) {
+    char *buf = iov[i].iov_base;
+    size_t left = iov[i].iov_len;
+
+    while (left > 0) {
+      size_t len = chunk - offset % chunk;
+
+      if (len > left)
+        len = left;
+      if (n == max)
+        return n;
+
+      pieces[n].offset = offset;
+      pieces[n].len = len;
+      pieces[n].buf = buf;
+      pieces[n].result = 0;
+      n++;
+
+      offset += len;
+      buf += len;
+      left -= len;
+    }
+  }
+
+  return n;
+}
+
+/**
+ * @brief Read or write an iovec a chunk at a time, in parallel
+ *
+ * @param[in]  info   Backend
+ * @param[in]  fd     Open file
+ * @param[in]  write  Write rather than read
+ * @param[in]  offset File offset
+ * @param[in]  iov    Buffers
+ * @param[in]  iovcnt Number of buffers
+ * @param[in]  fanout Use the I/O fridge, false on fridge threads
+ * @param[out] eof    For reads, a piece came back short
+ *
+ * @return Bytes transferred (contiguous from offset) or -errno.
+ */
+int64_t newfs_chunk_io(struct newfs_info *info, Fh *fd, bool write,
+                       uint64_t offset, const struct iovec *iov, int iovcnt,
+                       bool fanout, bool *eof)
+{
+  struct newfs_io_piece stack_pieces[8], *pieces = stack_pieces;
+  struct newfs_io_batch batch;
+  size_t total = 0;
+  int64_t done = 0;
+  int i, n, max = sizeof(stack_pieces) / sizeof(stack_pieces[0]);
+
+  for (i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+
+  /* Pieces never exceed chunks crossed plus one per iovec */
+  if (total / NewFS.chunk_size + iovcnt + 1 > (size_t)max) {
+    max = total / NewFS.chunk_size + iovcnt + 1;
+    pieces = gsh_malloc(max * sizeof(*pieces));
+  }
+
+  n = newfs_io_split(offset, iov, iovcnt, pieces, max);
+
+  batch.info = info;
+  batch.fd = fd;
+  batch.write = write;
+  batch.pending = n - 1;
+
+  if (n > 1) {
+    PTHREAD_MUTEX_init(&batch.mtx, NULL);
+    PTHREAD_COND_init(&batch.cv, NULL);
+  }
+
+  /* Hand all but the first piece to the fridge, do the first here */
+  for (i = 0; i < n; i++) {
+    pieces[i].batch = &batch;
+    if (i == 0)
+      continue;
+    if (!fanout || NewFS.io_fridge == NULL ||
+        fridgethr_submit(NewFS.io_fridge, newfs_io_piece_thread,
+                         &pieces[i]) != 0) {
+      newfs_io_piece_run(&pieces[i]);
+      PTHREAD_MUTEX_lock(&batch.mtx);
+      batch.pending--;
+      PTHREAD_MUTEX_unlock(&batch.mtx);
+    }
+  }
+
+  if (n > 0)
+    newfs_io_piece_run(&pieces[0]);
+
+  if (n > 1) {
+    PTHREAD_MUTEX_lock(&batch.mtx);
+    while (batch.pending != 0)
+      pthread_cond_wait(&batch.cv, &batch.mtx);
+    PTHREAD_MUTEX_unlock(&batch.mtx);
+    PTHREAD_COND_destroy(&batch.cv);
+    PTHREAD_MUTEX_destroy(&batch.mtx);
+  }
+
+  if (eof != NULL)
+    *eof = false;
+
+  for (i = 0; i < n; i++) {
+    if (pieces[i].result < 0) {
+      done = pieces[i].result;
+      break;
+    }
+    done += pieces[i].result;
+    if ((size_t)pieces[i].result < pieces[i].len) {
+      /* Short read is end of file, short write is out of space */
+      if (eof != NULL)
+        *eof = true;
+      break;
+    }
+  }
+
+  if (pieces != stack_pieces)
+    gsh_free(pieces);
+
+  return done;
+}
+
+int newfs_io_init(void)
+{
+  struct fridgethr_params frp;
+  int rc;
+
+  if (NewFS.io_threads <= 1)
+    return 0;
+
+  memset(&frp, 0, sizeof(frp));
+  frp.thr_max = NewFS.io_threads;
+  frp.thr_min = 1;
+  frp.thread_delay = 60;
+  frp.flavor = fridgethr_flavor_worker;
+  frp.deferment = fridgethr_defer_queue;
+
+  rc = fridgethr_init(&NewFS.io_fridge, "newfs_io", &frp);
+  if (rc != 0) {
+    LogMajor(COMPONENT_FSAL,
+             "Unable to start NewFS I/O threads: %d, chunks will be done serially",
+             rc);
+    NewFS.io_fridge = NULL;
+  }
+
+  return rc;
+}
+
+void newfs_io_fini(void)
+{
+  int rc;
+
+  if (NewFS.io_fridge == NULL)
+    return;
+
+  rc = fridgethr_sync_command(NewFS.io_fridge, fridgethr_comm_stop, 120);
+  if (rc == ETIMEDOUT) {
+    LogMajor(COMPONENT_FSAL, "Shutdown timed out, cancelling threads.");
+    fridgethr_cancel(NewFS.io_fridge);
+  } else if (rc != 0) {
+    LogMajor(COMPONENT_FSAL,
+             "Failed shutting down NewFS I/O threads: %d", rc);
+  }
+
+  fridgethr_destroy(NewFS.io_fridge);
+  NewFS.io_fridge = NULL;
+}
+
+void newfs_io_cache_init(struct newfs_io_cache *io)
+{
+  memset(io, 0, sizeof(*io));
+  PTHREAD_MUTEX_init(&io->lock, NULL);
+  PTHREAD_COND_init(&io->cond, NULL);
+}
+
+/* Drop the readahead window and any readahead in flight.
+ * Called with io->lock held. */
+static void newfs_ra_drop(struct newfs_io_cache *io)
+{
+  io->ra_gen++;
+  gsh_free(io->ra_buf);
+  io->ra_buf = NULL;
+  io->ra_len = 0;
+}
+
+void newfs_io_cache_fini(struct newfs_io_cache *io)
+{
+  PTHREAD_MUTEX_lock(&io->lock);
+  newfs_ra_drop(io);
+  while (io->ra_inflight)
+    pthread_cond_wait(&io->cond, &io->lock);
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  gsh_free(io->wb_buf);
+  PTHREAD_COND_destroy(&io->cond);
+  PTHREAD_MUTEX_destroy(&io->lock);
+}
+
+/* Write out coalesced data.  Called with io->lock held. */
+static int newfs_wb_flush_locked(struct newfs_handle *myself, Fh *fd)
+{
+  struct newfs_io_cache *io = &myself->io;
+  struct newfs_info *info = myself->export->newfs_info;
+  struct iovec iov;
+  Fh *tmp_fd = NULL;
+  int64_t rc;
+
+  if (io->wb_len == 0)
+    return 0;
+
+  if (fd == NULL) {
+    rc = newfs_open(info, myself->item, O_WRONLY, &tmp_fd);
+    if (rc < 0)
+      goto out;
+    fd = tmp_fd;
+  }
+
+  iov.iov_base = io->wb_buf;
+  iov.iov_len = io->wb_len;
+  rc = newfs_chunk_io(info, fd, true, io->wb_off, &iov, 1, true, NULL);
+  if (rc >= 0 && (size_t)rc < io->wb_len)
+    rc = -ENOSPC;
+
+  if (tmp_fd != NULL)
+    (void) newfs_close(info, tmp_fd);
+
+out:
+  io->wb_len = 0;
+  if (rc < 0) {
+    LogDebug(COMPONENT_FSAL, "Deferred write of %p failed %d",
+             myself, (int)rc);
+    io->wb_error = rc;
+    return rc;
+  }
+  return 0;
+}
+
+/**
+ * @brief Write out coalesced data
+ *
+ * A failure is also kept for the next COMMIT, see newfs_io_commit().
+ *
+ * @param[in] myself Handle
+ * @param[in] fd     Open file, or NULL to open one if needed
+ *
+ * @return 0 or -errno of this flush.
+ */
+int newfs_io_flush(struct newfs_handle *myself, Fh *fd)
+{
+  struct newfs_io_cache *io = &myself->io;
+  int rc;
+
+  if (myself->handle.type != REGULAR_FILE)
+    return 0;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  rc = newfs_wb_flush_locked(myself, fd);
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  return rc;
+}
+
+/**
+ * @brief Write out coalesced data and report any deferred error
+ *
+ * Only COMMIT may consume the error: it fails, and the client sends
+ * its unstable writes again.
+ *
+ * @param[in] myself Handle
+ *
+ * @return 0 or -errno.
+ */
+int newfs_io_commit(struct newfs_handle *myself)
+{
+  struct newfs_io_cache *io = &myself->io;
+  int rc;
+
+  if (myself->handle.type != REGULAR_FILE)
+    return 0;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  (void) newfs_wb_flush_locked(myself, NULL);
+  rc = io->wb_error;
+  io->wb_error = 0;
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  return rc;
+}
+
+/**
+ * @brief Write out coalesced data of a handle going away
+ *
+ * No COMMIT can report a deferred error once the handle is gone, so
+ * change the write verifier instead.
+ *
+ * @param[in] myself Handle
+ */
+void newfs_io_release(struct newfs_handle *myself)
+{
+  struct newfs_io_cache *io = &myself->io;
+
+  if (myself->handle.type != REGULAR_FILE)
+    return;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  (void) newfs_wb_flush_locked(myself, NULL);
+  if (io->wb_error != 0) {
+    LogInfo(COMPONENT_FSAL,
+            "Deferred write error %d of %p not committed, changing write verifier",
+            io->wb_error, myself);
+    (void) atomic_inc_uint32_t(&newfs_write_verifier_gen);
+    io->wb_error = 0;
+  }
+  PTHREAD_MUTEX_unlock(&io->lock);
+}
+
+/**
+ * @brief Account for coalesced data in attributes
+ *
+ * @param[in]     myself Handle
+ * @param[in,out] st     Attributes from the backend
+ */
+void newfs_io_stat(struct newfs_handle *myself, struct stat *st)
+{
+  struct newfs_io_cache *io = &myself->io;
+
+  if (myself->handle.type != REGULAR_FILE)
+    return;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  if (io->wb_len != 0 && io->wb_off + io->wb_len > (uint64_t)st->st_size)
+    st->st_size = io->wb_off + io->wb_len;
+  PTHREAD_MUTEX_unlock(&io->lock);
+}
+
+/**
+ * @brief Forget cached file data, e.g. after a truncate
+ */
+void newfs_io_invalidate(struct newfs_handle *myself)
+{
+  struct newfs_io_cache *io = &myself->io;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  newfs_ra_drop(io);
+  io->seq_reads = 0;
+  PTHREAD_MUTEX_unlock(&io->lock);
+}
+
+struct newfs_ra_job {
+  struct newfs_handle *myself;
+  uint64_t offset;
+  size_t len;
+  uint64_t gen;
+};
+
+static void newfs_ra_thread(struct fridgethr_context *ctx)
+{
+  struct newfs_ra_job *job = ctx->arg;
+  struct newfs_handle *myself = job->myself;
+  struct newfs_io_cache *io = &myself->io;
+  struct newfs_info *info = myself->export->newfs_info;
+  char *buf = gsh_malloc(job->len);
+  struct iovec iov = { .iov_base = buf, .iov_len = job->len };
+  int64_t nb = -EIO;
+  Fh *fd;
+
+  if (newfs_open(info, myself->item, O_RDONLY, &fd) == 0) {
+    /* Already on a fridge thread, don't wait on the fridge */
+    nb = newfs_chunk_io(info, fd, false, job->offset, &iov, 1, false,
+                        NULL);
+    (void) newfs_close(info, fd);
+  }
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  if (nb > 0 && job->gen == io->ra_gen) {
+    gsh_free(io->ra_buf);
+    io->ra_buf = buf;
+    io->ra_off = job->offset;
+    io->ra_len = nb;
+    buf = NULL;
+  }
+  io->ra_inflight = false;
+  pthread_cond_broadcast(&io->cond);
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  gsh_free(buf);
+  gsh_free(job);
+}
+
+/* Start reading ahead from offset.  Called with io->lock held. */
+static void newfs_ra_start(struct newfs_handle *myself, uint64_t offset)
+{
+  struct newfs_io_cache *io = &myself->io;
+  struct newfs_ra_job *job;
+
+  if (io->ra_inflight || NewFS.io_fridge == NULL)
+    return;
+
+  /* Window already covers the next read */
+  if (io->ra_len != 0 && offset >= io->ra_off &&
+      offset < io->ra_off + io->ra_len / 2)
+    return;
+
+  job = gsh_malloc(sizeof(*job));
+  job->myself = myself;
+  job->offset = offset;
+  job->len = NewFS.readahead_size;
+  job->gen = io->ra_gen;
+
+  io->ra_inflight = true;
+  if (fridgethr_submit(NewFS.io_fridge, newfs_ra_thread, job) != 0) {
+    io->ra_inflight = false;
+    gsh_free(job);
+  }
+}
+
+/* Copy from the readahead window.  Called with io->lock held. */
+static bool newfs_ra_hit(struct newfs_io_cache *io, struct fsal_io_arg *arg)
+{
+  uint64_t offset = arg->offset;
+  size_t total = 0;
+  char *src;
+  int i;
+
+  if (io->ra_len == 0 || offset < io->ra_off)
+    return false;
+
+  for (i = 0; i < arg->iov_count; i++)
+    total += arg->iov[i].iov_len;
+
+  if (offset + total > io->ra_off + io->ra_len)
+    return false;
+
+  src = io->ra_buf + (offset - io->ra_off);
+  for (i = 0; i < arg->iov_count; i++) {
+    memcpy(arg->iov[i].iov_base, src, arg->iov[i].iov_len);
+    src += arg->iov[i].iov_len;
+  }
+  arg->io_amount = total;
+  arg->end_of_file = false;
+  return true;
+}
+
+/**
+ * @brief Read through the handle's data cache
+ *
+ * @param[in]     myself Handle
+ * @param[in]     fd     Open file
+ * @param[in,out] arg    Read arguments, io_amount and end_of_file are set
+ *
+ * @return 0 or -errno.
+ */
+int newfs_io_read(struct newfs_handle *myself, Fh *fd,
+                  struct fsal_io_arg *arg)
+{
+  struct newfs_io_cache *io = &myself->io;
+  struct newfs_info *info = myself->export->newfs_info;
+  bool sequential, hit = false, eof = false;
+  int64_t nb;
+  int rc;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+
+  /* fd may be read-only, let the flush open its own */
+  rc = newfs_wb_flush_locked(myself, NULL);
+  if (rc < 0) {
+    PTHREAD_MUTEX_unlock(&io->lock);
+    return rc;
+  }
+
+  sequential = arg->offset == io->next_off;
+  if (NewFS.readahead_size != 0)
+    hit = newfs_ra_hit(io, arg);
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  if (!hit) {
+    nb = newfs_chunk_io(info, fd, false, arg->offset, arg->iov,
+                        arg->iov_count, true, &eof);
+    if (nb < 0)
+      return nb;
+    arg->io_amount = nb;
+    arg->end_of_file = eof || nb == 0;
+  }
+
+  PTHREAD_MUTEX_lock(&io->lock);
+  io->next_off = arg->offset + arg->io_amount;
+  io->seq_reads = sequential ? io->seq_reads + 1 : 0;
+  if (NewFS.readahead_size != 0 && io->seq_reads >= 2 &&
+      !arg->end_of_file)
+    newfs_ra_start(myself, io->next_off);
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  return 0;
+}
+
+/**
+ * @brief Write through the handle's data cache
+ *
+ * Small UNSTABLE writes that continue the coalescing buffer are only
+ * copied into it; anything else flushes the buffer and is written
+ * directly.
+ *
+ * @param[in]     myself Handle
+ * @param[in]     fd     Open file
+ * @param[in,out] arg    Write arguments, io_amount is set
+ *
+ * @return 0 or -errno.
+ */
+int newfs_io_write(struct newfs_handle *myself, Fh *fd,
+                   struct fsal_io_arg *arg)
+{
+  struct newfs_io_cache *io = &myself->io;
+  struct newfs_info *info = myself->export->newfs_info;
+  size_t total = 0, cap = NewFS.write_coalesce_size;
+  int64_t nb;
+  int i, rc;
+
+  for (i = 0; i < arg->iov_count; i++)
+    total += arg->iov[i].iov_len;
+
+  PTHREAD_MUTEX_lock(&io->lock);
+
+  /* Cached data for this file is stale now */
+  newfs_ra_drop(io);
+
+  if (!arg->fsal_stable && cap != 0 && total < cap) {
+    if (io->wb_len != 0 &&
+        (arg->offset != io->wb_off + io->wb_len ||
+         io->wb_len + total > cap)) {
+      rc = newfs_wb_flush_locked(myself, fd);
+      if (rc < 0)
+        goto out;
+    }
+
+    if (io->wb_buf == NULL)
+      io->wb_buf = gsh_malloc(cap);
+    if (io->wb_len == 0)
+      io->wb_off = arg->offset;
+
+    for (i = 0; i < arg->iov_count; i++) {
+      memcpy(io->wb_buf + io->wb_len, arg->iov[i].iov_base,
+             arg->iov[i].iov_len);
+      io->wb_len += arg->iov[i].iov_len;
+    }
+
+    arg->io_amount = total;
+    rc = 0;
+    goto out;
+  }
+
+  rc = newfs_wb_flush_locked(myself, fd);
+  if (rc < 0)
+    goto out;
+  PTHREAD_MUTEX_unlock(&io->lock);
+
+  nb = newfs_chunk_io(info, fd, true, arg->offset, arg->iov,
+                      arg->iov_count, true, NULL);
+  if (nb < 0)
+    return nb;
+  arg->io_amount = nb;
+  return 0;
+
+out:
+  PTHREAD_MUTEX_unlock(&io->lock);
+  return rc;
+}
@@ -25,8 +25,8 @@ struct newfs_fsal_module NewFS = {
   .fsal = {
     .fs_info = {
       .maxfilesize = NEWFS_MAX_FILE_SIZE,
-      .maxread = NEWFS_MAX_FILE_SIZE,
-      .maxwrite = NEWFS_MAX_FILE_SIZE,
+      .maxread = FSAL_MAXIOSIZE,
+      .maxwrite = FSAL_MAXIOSIZE,
       .acl_support = 0,
       .lock_support = true,
       .lock_support_async_block = false,
@@ -58,6 +58,16 @@ static struct config_item newfs_items[] = {
                  newfs_fsal_module, fdb_conf_path),
   CONF_ITEM_MODE("umask", 0,
                  newfs_fsal_module, fsal.fs_info.umask),
+  CONF_ITEM_UI64("chunk_size", 4096, 1 << 30, NEWFS_CHUNK_SIZE,
+                 newfs_fsal_module, chunk_size),
+  CONF_ITEM_UI32("io_threads", 0, 256, NEWFS_IO_THREADS,
+                 newfs_fsal_module, io_threads),
+  CONF_ITEM_UI64("readahead_size", 0, 1 << 30, NEWFS_READAHEAD_SIZE,
+                 newfs_fsal_module, readahead_size),
+  CONF_ITEM_UI64("write_coalesce_size", 0, 64 << 20, NEWFS_WRITE_COALESCE,
+                 newfs_fsal_module, write_coalesce_size),
+  CONF_ITEM_UI32("attr_cache_size", 0, 1 << 24, NEWFS_ATTR_CACHE_SIZE,
+                 newfs_fsal_module, attr_cache_size),
   CONFIG_EOL
 };
 
@@ -94,6 +104,11 @@ static fsal_status_t init_config(struct fsal_module *module_in,
   if (!config_error_is_harmless(err_type))
     return fsalstat(ERR_FSAL_INVAL, 0);
 
+  /* Chunk I/O runs alongside the calling thread, so io_threads of 0
+   * or 1 both mean no fan-out. */
+  if (myself->io_fridge == NULL)
+    (void) newfs_io_init();
+
   display_fsinfo(&myself->fsal);
   return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -177,6 +192,9 @@ static fsal_status_t create_export(struct fsal_module* module_in,
   export->root = handle;
   op_ctx->fsal_export = &export->export;
 
+  /* up_ops is set, change notifications can be passed up now */
+  newfs_attr_cache_init(export);
+
   return status;
 
 error:
@@ -211,6 +229,11 @@ MODULE_INIT void init(void)
   /* override default module operations */
   myself->m_ops.create_export = create_export;
   myself->m_ops.init_config = init_config;
+#ifdef USE_DBUS
+  myself->m_ops.fsal_extract_stats = newfs_extract_stats;
+#endif
+  myself->m_ops.fsal_reset_stats = newfs_reset_stats;
+  newfs_prepare_for_stats(myself);
 
   /* Initialize the fsal_obj_handle ops for FSAL NewFS */
   handle_ops_init(&NewFS.handle_ops);
@@ -223,6 +246,8 @@ MODULE_FINI void fini(void)
 {
 	LogDebug(COMPONENT_FSAL, "NewFS module finishing.");
 
+	newfs_io_fini();
+
 	if (unregister_fsal(&NewFS.fsal) != 0) {
 		LogCrit(COMPONENT_FSAL,
 			"Unable to unload NewFS FSAL.");
@@ -0,0 +1,171 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file newfs_c.h
+ * @brief NewFS client API, as provided by the in-memory stand-in
+ *
+ * This mirrors the subset of libnewfs that FSAL_NEWFS uses, so the FSAL
+ * can be built and benchmarked (-DUSE_FSAL_NEWFS_MEM=ON) without a
+ * FoundationDB/Ceph backed NewFS deployment.  All calls return 0 (or
+ * a count) on success and -errno on failure.
+ */
+
+#ifndef NEWFS_C_H
+#define NEWFS_C_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct newfs_info;
+typedef struct newfs_item newfs_item;
+typedef struct Fh Fh;
+
+/* newfs_setattr() mask bits */
+#define NEWFS_SETATTR_MODE   0x01
+#define NEWFS_SETATTR_UID    0x02
+#define NEWFS_SETATTR_GID    0x04
+#define NEWFS_SETATTR_SIZE   0x08
+#define NEWFS_SETATTR_ATIME  0x10
+#define NEWFS_SETATTR_MTIME  0x20
+#define NEWFS_SETATTR_CTIME  0x40
+
+/* newfs_delegation() commands */
+#define NEWFS_DELEGATION_NONE 0
+#define NEWFS_DELEGATION_RD   1
+#define NEWFS_DELEGATION_WR   2
+
+/**
+ * @brief An entry returned by newfs_readdir_batch()
+ */
+struct newfs_dirent {
+  char name[NAME_MAX + 1];
+  uint64_t cursor;          /*< Cursor to resume after this entry */
+  newfs_item *item;
+  struct stat st;
+};
+
+int newfs_init(const char *conf_path, struct newfs_info **info,
+               const char *root_path);
+int newfs_fini(struct newfs_info *info);
+void newfs_sync_fs(struct newfs_info *info);
+int newfs_statfs(struct newfs_info *info, newfs_item *item,
+                 struct statvfs *st);
+
+int newfs_walk(struct newfs_info *info, const char *path, newfs_item **item,
+               struct stat *st);
+newfs_item *newfs_get_item(struct newfs_info *info, uint64_t ino);
+int newfs_lookup_item(struct newfs_info *info, uint64_t ino,
+                      newfs_item **item);
+void newfs_put(struct newfs_info *info, newfs_item *item);
+
+int newfs_lookup(struct newfs_info *info, newfs_item *dir, const char *name,
+                 newfs_item **item, struct stat *st);
+int newfs_mkdir(struct newfs_info *info, newfs_item *dir, const char *name,
+                struct stat *st, newfs_item **item);
+int newfs_create(struct newfs_info *info, newfs_item *dir, const char *name,
+                 struct stat *st, Fh **fd, newfs_item **item, int flags);
+int newfs_unlink(struct newfs_info *info, newfs_item *dir, const char *name);
+int newfs_rmdir(struct newfs_info *info, newfs_item *dir, const char *name);
+int newfs_rename(struct newfs_info *info, newfs_item *olddir,
+                 const char *oldname, newfs_item *newdir,
+                 const char *newname);
+
+/**
+ * @brief Read one directory entry by index
+ *
+ * @return 1 if an entry was returned, 0 at end of directory.
+ */
+int newfs_readdir(struct newfs_info *info, newfs_item *dir, struct dirent *de,
+                  uint64_t start, newfs_item **item, struct stat *st);
+
+/**
+ * @brief Read a batch of directory entries
+ *
+ * Cursors are stable across creates and removes in the directory, so
+ * a listing can be resumed from any cursor returned.
+ *
+ * @param[in]  cursor 0 to start, else a cursor returned earlier
+ * @param[out] ents   Up to max entries
+ * @param[out] next   Cursor to resume after the last entry returned
+ * @param[out] eof    No entries after the last one returned
+ *
+ * @return Number of entries returned.
+ */
+int newfs_readdir_batch(struct newfs_info *info, newfs_item *dir,
+                        uint64_t cursor, struct newfs_dirent *ents, int max,
+                        uint64_t *next, bool *eof);
+
+int newfs_getattr(struct newfs_info *info, newfs_item *item,
+                  struct stat *st);
+
+/**
+ * @brief Read attributes and the generation they belong to
+ *
+ * The generation of an inode increases on every change to it,
+ * including, for a directory, changes to its entries.
+ */
+int newfs_getattr_gen(struct newfs_info *info, newfs_item *item,
+                      struct stat *st, uint64_t *gen);
+
+/**
+ * @brief Metadata change notification
+ *
+ * Called by the metadata store with the new generation of a changed
+ * inode, possibly with store locks held: the callback must not call
+ * back into newfs.
+ */
+typedef void (*newfs_watch_cb)(void *arg, uint64_t ino, uint64_t gen);
+
+/**
+ * @brief Watch for metadata changes under this mount
+ *
+ * @param[in] cb  Callback, NULL to stop watching
+ */
+int newfs_watch(struct newfs_info *info, newfs_watch_cb cb, void *arg);
+int newfs_setattr(struct newfs_info *info, newfs_item *item,
+                  struct stat *st, int mask);
+int newfs_sync_item(struct newfs_info *info, newfs_item *item, int flags);
+
+int newfs_open(struct newfs_info *info, newfs_item *item, int flags, Fh **fd);
+int newfs_close(struct newfs_info *info, Fh *fd);
+int64_t newfs_read(struct newfs_info *info, Fh *fd, uint64_t offset,
+                   uint64_t len, char *buf);
+int64_t newfs_write(struct newfs_info *info, Fh *fd, uint64_t offset,
+                    uint64_t len, char *buf);
+int newfs_fsync(struct newfs_info *info, Fh *fd, bool dataonly);
+
+int newfs_getlk(struct newfs_info *info, Fh *fd, struct flock *fl,
+                uint64_t owner);
+int newfs_setlk(struct newfs_info *info, Fh *fd, struct flock *fl,
+                uint64_t owner, bool sleep);
+int newfs_delegation(struct newfs_info *info, Fh *fd, unsigned int cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NEWFS_C_H */
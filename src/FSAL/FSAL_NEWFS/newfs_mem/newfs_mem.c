@@ -0,0 +1,869 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file newfs_mem.c
+ * @brief In-memory stand-in for libnewfs
+ *
+ * One file system per process, shared by every newfs_init() caller,
+ * each rooted at its own path.  A single rwlock serializes metadata;
+ * this is for exercising and benchmarking FSAL_NEWFS, not for
+ * measuring the stand-in itself.
+ *
+ * Directory entries are kept in creation order, each tagged with a
+ * sequence number that never changes, so readdir cursors are just
+ * sequence numbers and a listing can be resumed after concurrent
+ * changes, as with a key-value metadata store.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "newfs/newfs_c.h"
+
+#define NEWFS_MEM_BLKSIZE 4096
+#define NEWFS_MEM_INO_BUCKETS 65536
+
+struct newfs_mem_dirent {
+  struct newfs_mem_dirent *hnext;    /*< Name hash chain */
+  newfs_item *item;
+  uint64_t seq;                      /*< Cursor of this entry */
+  bool removed;
+  char name[];
+};
+
+struct newfs_item {
+  struct newfs_item *inext;          /*< Inode hash chain */
+  struct stat st;
+  uint64_t gen;                      /*< Bumped on every change */
+  /* directories */
+  struct newfs_mem_dirent **ents;    /*< In seq order */
+  uint32_t nents, maxents, nremoved;
+  struct newfs_mem_dirent **names;   /*< Name hash */
+  uint32_t nnames;                   /*< Buckets in names */
+  uint64_t next_seq;
+  /* regular files */
+  char *data;
+  uint64_t alloc;
+};
+
+struct Fh {
+  newfs_item *item;
+  int flags;
+};
+
+struct newfs_info {
+  newfs_item *root;
+  newfs_watch_cb watch_cb;
+  void *watch_arg;
+  struct newfs_info *wnext;          /*< In newfs_mem_watchers */
+};
+
+static pthread_rwlock_t newfs_mem_lock = PTHREAD_RWLOCK_INITIALIZER;
+static newfs_item *newfs_mem_inodes[NEWFS_MEM_INO_BUCKETS];
+static newfs_item *newfs_mem_root;
+static uint64_t newfs_mem_next_ino = 1;
+static uint64_t newfs_mem_files;
+static uint64_t newfs_mem_bytes;
+static struct newfs_info *newfs_mem_watchers;
+
+static uint32_t name_hash(const char *name)
+{
+  uint32_t h = 2166136261u;
+
+  while (*name)
+    h = (h ^ (unsigned char)*name++) * 16777619u;
+  return h;
+}
+
+static newfs_item *item_new(mode_t mode, struct stat *attrs)
+{
+  newfs_item *item = calloc(1, sizeof(*item));
+  uint64_t bucket;
+
+  if (item == NULL)
+    return NULL;
+
+  item->st.st_ino = newfs_mem_next_ino++;
+  item->st.st_mode = mode;
+  item->st.st_nlink = S_ISDIR(mode) ? 2 : 1;
+  item->st.st_blksize = NEWFS_MEM_BLKSIZE;
+  if (attrs != NULL) {
+    item->st.st_uid = attrs->st_uid;
+    item->st.st_gid = attrs->st_gid;
+  }
+  clock_gettime(CLOCK_REALTIME, &item->st.st_mtim);
+  item->st.st_atim = item->st.st_ctim = item->st.st_mtim;
+  item->next_seq = 1;
+
+  bucket = item->st.st_ino % NEWFS_MEM_INO_BUCKETS;
+  item->inext = newfs_mem_inodes[bucket];
+  newfs_mem_inodes[bucket] = item;
+  newfs_mem_files++;
+
+  return item;
+}
+
+static newfs_item *ino_find(uint64_t ino)
+{
+  newfs_item *item = newfs_mem_inodes[ino % NEWFS_MEM_INO_BUCKETS];
+
+  while (item != NULL && item->st.st_ino != ino)
+    item = item->inext;
+  return item;
+}
+
+/* Unlinked items stay allocated, handles may still point at them */
+static void item_unhash(newfs_item *item)
+{
+  newfs_item **pp = &newfs_mem_inodes[item->st.st_ino %
+                                      NEWFS_MEM_INO_BUCKETS];
+
+  while (*pp != item)
+    pp = &(*pp)->inext;
+  *pp = item->inext;
+  newfs_mem_files--;
+}
+
+/* Called with newfs_mem_lock held for write on every change */
+static void changed(newfs_item *item)
+{
+  struct newfs_info *w;
+
+  item->gen++;
+  for (w = newfs_mem_watchers; w != NULL; w = w->wnext)
+    w->watch_cb(w->watch_arg, item->st.st_ino, item->gen);
+}
+
+static void touch(newfs_item *item)
+{
+  clock_gettime(CLOCK_REALTIME, &item->st.st_mtim);
+  item->st.st_ctim = item->st.st_mtim;
+  changed(item);
+}
+
+static struct newfs_mem_dirent *dir_find(newfs_item *dir, const char *name)
+{
+  struct newfs_mem_dirent *de;
+
+  if (dir->nnames == 0)
+    return NULL;
+
+  de = dir->names[name_hash(name) % dir->nnames];
+  while (de != NULL && strcmp(de->name, name) != 0)
+    de = de->hnext;
+  return de;
+}
+
+static void dir_rehash(newfs_item *dir, uint32_t nnames)
+{
+  struct newfs_mem_dirent **names = calloc(nnames, sizeof(*names));
+  uint32_t i;
+
+  if (names == NULL)
+    return;
+
+  for (i = 0; i < dir->nents; i++) {
+    struct newfs_mem_dirent *de = dir->ents[i];
+    uint32_t b;
+
+    if (de->removed)
+      continue;
+    b = name_hash(de->name) % nnames;
+    de->hnext = names[b];
+    names[b] = de;
+  }
+
+  free(dir->names);
+  dir->names = names;
+  dir->nnames = nnames;
+}
+
+/* Drop removed entries, keeping seq order */
+static void dir_compact(newfs_item *dir)
+{
+  uint32_t i, j = 0;
+
+  for (i = 0; i < dir->nents; i++) {
+    if (dir->ents[i]->removed)
+      free(dir->ents[i]);
+    else
+      dir->ents[j++] = dir->ents[i];
+  }
+  dir->nents = j;
+  dir->nremoved = 0;
+}
+
+static int dir_add(newfs_item *dir, const char *name, newfs_item *item)
+{
+  size_t len = strlen(name);
+  struct newfs_mem_dirent *de;
+
+  if (len > NAME_MAX)
+    return -ENAMETOOLONG;
+
+  if (dir->nents == dir->maxents) {
+    uint32_t max = dir->maxents ? dir->maxents * 2 : 16;
+    struct newfs_mem_dirent **ents;
+
+    ents = realloc(dir->ents, max * sizeof(*ents));
+    if (ents == NULL)
+      return -ENOMEM;
+    dir->ents = ents;
+    dir->maxents = max;
+  }
+
+  de = malloc(sizeof(*de) + len + 1);
+  if (de == NULL)
+    return -ENOMEM;
+  memcpy(de->name, name, len + 1);
+  de->item = item;
+  de->seq = dir->next_seq++;
+  de->removed = false;
+  dir->ents[dir->nents++] = de;
+
+  if (dir->nents - dir->nremoved > dir->nnames)
+    dir_rehash(dir, dir->nnames ? dir->nnames * 2 : 16);
+  else {
+    uint32_t b = name_hash(name) % dir->nnames;
+
+    de->hnext = dir->names[b];
+    dir->names[b] = de;
+  }
+
+  dir->st.st_size++;
+  touch(dir);
+  return 0;
+}
+
+static void dir_del(newfs_item *dir, struct newfs_mem_dirent *de)
+{
+  struct newfs_mem_dirent **pp;
+
+  pp = &dir->names[name_hash(de->name) % dir->nnames];
+  while (*pp != de)
+    pp = &(*pp)->hnext;
+  *pp = de->hnext;
+
+  de->removed = true;
+  dir->nremoved++;
+  dir->st.st_size--;
+  touch(dir);
+
+  if (dir->nremoved > dir->nents / 2)
+    dir_compact(dir);
+}
+
+/* Index of the first entry with seq >= cursor */
+static uint32_t dir_seek(newfs_item *dir, uint64_t cursor)
+{
+  uint32_t lo = 0, hi = dir->nents;
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (dir->ents[mid]->seq < cursor)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static int walk_locked(newfs_item *from, const char *path, bool create,
+                       newfs_item **item)
+{
+  char name[NAME_MAX + 1];
+  newfs_item *cur = from;
+
+  while (*path != '\0') {
+    const char *end;
+    struct newfs_mem_dirent *de;
+    size_t len;
+
+    while (*path == '/')
+      path++;
+    if (*path == '\0')
+      break;
+
+    end = strchr(path, '/');
+    len = end ? (size_t)(end - path) : strlen(path);
+    if (len > NAME_MAX)
+      return -ENAMETOOLONG;
+    memcpy(name, path, len);
+    name[len] = '\0';
+    path += len;
+
+    if (!S_ISDIR(cur->st.st_mode))
+      return -ENOTDIR;
+
+    de = dir_find(cur, name);
+    if (de != NULL) {
+      cur = de->item;
+    } else if (create) {
+      newfs_item *sub = item_new(S_IFDIR | 0755, NULL);
+      int rc;
+
+      if (sub == NULL)
+        return -ENOMEM;
+      rc = dir_add(cur, name, sub);
+      if (rc < 0)
+        return rc;
+      cur->st.st_nlink++;
+      cur = sub;
+    } else {
+      return -ENOENT;
+    }
+  }
+
+  *item = cur;
+  return 0;
+}
+
+int newfs_init(const char *conf_path, struct newfs_info **info,
+               const char *root_path)
+{
+  struct newfs_info *fs = calloc(1, sizeof(*fs));
+  int rc;
+
+  if (fs == NULL)
+    return -ENOMEM;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  if (newfs_mem_root == NULL)
+    newfs_mem_root = item_new(S_IFDIR | 0755, NULL);
+  rc = walk_locked(newfs_mem_root, root_path ? root_path : "/", true,
+                   &fs->root);
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  if (rc < 0) {
+    free(fs);
+    return rc;
+  }
+
+  *info = fs;
+  return 0;
+}
+
+int newfs_fini(struct newfs_info *info)
+{
+  (void)newfs_watch(info, NULL, NULL);
+  free(info);
+  return 0;
+}
+
+void newfs_sync_fs(struct newfs_info *info)
+{
+}
+
+int newfs_statfs(struct newfs_info *info, newfs_item *item,
+                 struct statvfs *st)
+{
+  memset(st, 0, sizeof(*st));
+  st->f_bsize = st->f_frsize = NEWFS_MEM_BLKSIZE;
+  st->f_blocks = 1ULL << 30;
+
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  st->f_bfree = st->f_bavail = st->f_blocks -
+                               newfs_mem_bytes / NEWFS_MEM_BLKSIZE;
+  st->f_files = 1ULL << 32;
+  st->f_ffree = st->f_favail = st->f_files - newfs_mem_files;
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  st->f_namemax = NAME_MAX;
+  return 0;
+}
+
+int newfs_walk(struct newfs_info *info, const char *path, newfs_item **item,
+               struct stat *st)
+{
+  int rc;
+
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  rc = walk_locked(info->root, path, false, item);
+  if (rc == 0)
+    *st = (*item)->st;
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return rc;
+}
+
+newfs_item *newfs_get_item(struct newfs_info *info, uint64_t ino)
+{
+  newfs_item *item;
+
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  item = ino_find(ino);
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return item;
+}
+
+int newfs_lookup_item(struct newfs_info *info, uint64_t ino,
+                      newfs_item **item)
+{
+  *item = newfs_get_item(info, ino);
+  return *item != NULL ? 0 : -ESTALE;
+}
+
+void newfs_put(struct newfs_info *info, newfs_item *item)
+{
+}
+
+int newfs_lookup(struct newfs_info *info, newfs_item *dir, const char *name,
+                 newfs_item **item, struct stat *st)
+{
+  struct newfs_mem_dirent *de;
+  int rc = 0;
+
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  if (strcmp(name, ".") == 0) {
+    *item = dir;
+  } else if ((de = dir_find(dir, name)) != NULL) {
+    *item = de->item;
+  } else {
+    rc = -ENOENT;
+  }
+  if (rc == 0)
+    *st = (*item)->st;
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return rc;
+}
+
+static int create_locked(newfs_item *dir, const char *name, mode_t type,
+                         struct stat *st, bool excl, newfs_item **item)
+{
+  struct newfs_mem_dirent *de = dir_find(dir, name);
+  newfs_item *new;
+  int rc;
+
+  if (de != NULL) {
+    if (excl || S_ISDIR(type))
+      return -EEXIST;
+    *item = de->item;
+    *st = de->item->st;
+    return 0;
+  }
+
+  new = item_new(type | (st->st_mode & 07777), st);
+  if (new == NULL)
+    return -ENOMEM;
+
+  rc = dir_add(dir, name, new);
+  if (rc < 0) {
+    item_unhash(new);
+    free(new);
+    return rc;
+  }
+  if (S_ISDIR(type))
+    dir->st.st_nlink++;
+
+  *item = new;
+  *st = new->st;
+  return 0;
+}
+
+int newfs_mkdir(struct newfs_info *info, newfs_item *dir, const char *name,
+                struct stat *st, newfs_item **item)
+{
+  int rc;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  rc = create_locked(dir, name, S_IFDIR, st, true, item);
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return rc;
+}
+
+int newfs_create(struct newfs_info *info, newfs_item *dir, const char *name,
+                 struct stat *st, Fh **fd, newfs_item **item, int flags)
+{
+  int rc;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  rc = create_locked(dir, name, S_IFREG, st, (flags & O_EXCL) != 0, item);
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  if (rc < 0)
+    return rc;
+
+  return newfs_open(info, *item, flags & ~(O_CREAT | O_EXCL), fd);
+}
+
+static int remove_locked(newfs_item *dir, const char *name, bool isdir)
+{
+  struct newfs_mem_dirent *de = dir_find(dir, name);
+  newfs_item *item;
+
+  if (de == NULL)
+    return -ENOENT;
+
+  item = de->item;
+  if (isdir != S_ISDIR(item->st.st_mode))
+    return isdir ? -ENOTDIR : -EISDIR;
+  if (isdir && item->st.st_size != 0)
+    return -ENOTEMPTY;
+
+  dir_del(dir, de);
+  if (isdir) {
+    dir->st.st_nlink--;
+    item->st.st_nlink = 0;
+  } else {
+    item->st.st_nlink--;
+  }
+  touch(item);
+
+  if (item->st.st_nlink == 0) {
+    item_unhash(item);
+    newfs_mem_bytes -= item->st.st_size;
+  }
+
+  return 0;
+}
+
+int newfs_unlink(struct newfs_info *info, newfs_item *dir, const char *name)
+{
+  int rc;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  rc = remove_locked(dir, name, false);
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return rc;
+}
+
+int newfs_rmdir(struct newfs_info *info, newfs_item *dir, const char *name)
+{
+  int rc;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  rc = remove_locked(dir, name, true);
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return rc;
+}
+
+int newfs_rename(struct newfs_info *info, newfs_item *olddir,
+                 const char *oldname, newfs_item *newdir,
+                 const char *newname)
+{
+  struct newfs_mem_dirent *de, *target;
+  newfs_item *item;
+  int rc = 0;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+
+  de = dir_find(olddir, oldname);
+  if (de == NULL) {
+    rc = -ENOENT;
+    goto out;
+  }
+  item = de->item;
+
+  target = dir_find(newdir, newname);
+  if (target != NULL) {
+    if (target->item == item)
+      goto out;
+    rc = remove_locked(newdir, newname,
+                       S_ISDIR(target->item->st.st_mode));
+    if (rc < 0)
+      goto out;
+  }
+
+  rc = dir_add(newdir, newname, item);
+  if (rc < 0)
+    goto out;
+  dir_del(olddir, dir_find(olddir, oldname));
+
+  if (S_ISDIR(item->st.st_mode) && olddir != newdir) {
+    olddir->st.st_nlink--;
+    newdir->st.st_nlink++;
+  }
+  touch(item);
+
+out:
+  pthread_rwlock_unlock(&newfs_mem_lock);
+  return rc;
+}
+
+int newfs_readdir_batch(struct newfs_info *info, newfs_item *dir,
+                        uint64_t cursor, struct newfs_dirent *ents, int max,
+                        uint64_t *next, bool *eof)
+{
+  uint32_t i;
+  int n = 0;
+
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+
+  if (!S_ISDIR(dir->st.st_mode)) {
+    pthread_rwlock_unlock(&newfs_mem_lock);
+    return -ENOTDIR;
+  }
+
+  for (i = dir_seek(dir, cursor); i < dir->nents && n < max; i++) {
+    struct newfs_mem_dirent *de = dir->ents[i];
+
+    if (de->removed)
+      continue;
+
+    strcpy(ents[n].name, de->name);
+    ents[n].cursor = de->seq + 1;
+    ents[n].item = de->item;
+    ents[n].st = de->item->st;
+    cursor = de->seq + 1;
+    n++;
+  }
+
+  while (i < dir->nents && dir->ents[i]->removed)
+    i++;
+  *eof = i >= dir->nents;
+  *next = cursor;
+
+  pthread_rwlock_unlock(&newfs_mem_lock);
+  return n;
+}
+
+int newfs_readdir(struct newfs_info *info, newfs_item *dir, struct dirent *de,
+                  uint64_t start, newfs_item **item, struct stat *st)
+{
+  struct newfs_dirent ent;
+  uint64_t cursor = 0, next;
+  bool eof = false;
+  int rc;
+
+  /* The old interface indexes entries, so walk up to start */
+  do {
+    rc = newfs_readdir_batch(info, dir, cursor, &ent, 1, &next, &eof);
+    if (rc <= 0)
+      return rc;
+    cursor = next;
+  } while (start-- > 0);
+
+  memset(de, 0, sizeof(*de));
+  strncpy(de->d_name, ent.name, sizeof(de->d_name) - 1);
+  de->d_ino = ent.st.st_ino;
+  de->d_off = ent.cursor;
+  *item = ent.item;
+  *st = ent.st;
+  return 1;
+}
+
+int newfs_getattr(struct newfs_info *info, newfs_item *item,
+                  struct stat *st)
+{
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  *st = item->st;
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return 0;
+}
+
+int newfs_getattr_gen(struct newfs_info *info, newfs_item *item,
+                      struct stat *st, uint64_t *gen)
+{
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  *st = item->st;
+  *gen = item->gen;
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return 0;
+}
+
+int newfs_watch(struct newfs_info *info, newfs_watch_cb cb, void *arg)
+{
+  struct newfs_info **pp;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  if (info->watch_cb != NULL) {
+    for (pp = &newfs_mem_watchers; *pp != info; pp = &(*pp)->wnext)
+      ;
+    *pp = info->wnext;
+  }
+  info->watch_cb = cb;
+  info->watch_arg = arg;
+  if (cb != NULL) {
+    info->wnext = newfs_mem_watchers;
+    newfs_mem_watchers = info;
+  }
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return 0;
+}
+
+static int truncate_locked(newfs_item *item, uint64_t size)
+{
+  if (size > item->alloc) {
+    uint64_t alloc = item->alloc ? item->alloc : NEWFS_MEM_BLKSIZE;
+    char *data;
+
+    while (alloc < size)
+      alloc *= 2;
+    data = realloc(item->data, alloc);
+    if (data == NULL)
+      return -ENOMEM;
+    memset(data + item->alloc, 0, alloc - item->alloc);
+    item->data = data;
+    item->alloc = alloc;
+  } else if (size < (uint64_t)item->st.st_size) {
+    memset(item->data + size, 0, item->st.st_size - size);
+  }
+
+  newfs_mem_bytes += size - item->st.st_size;
+  item->st.st_size = size;
+  item->st.st_blocks = (size + 511) / 512;
+  return 0;
+}
+
+int newfs_setattr(struct newfs_info *info, newfs_item *item,
+                  struct stat *st, int mask)
+{
+  int rc = 0;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+
+  if (mask & NEWFS_SETATTR_SIZE) {
+    if (!S_ISREG(item->st.st_mode)) {
+      rc = -EINVAL;
+      goto out;
+    }
+    rc = truncate_locked(item, st->st_size);
+    if (rc < 0)
+      goto out;
+    touch(item);
+  }
+  if (mask & NEWFS_SETATTR_MODE)
+    item->st.st_mode = (item->st.st_mode & S_IFMT) | (st->st_mode & 07777);
+  if (mask & NEWFS_SETATTR_UID)
+    item->st.st_uid = st->st_uid;
+  if (mask & NEWFS_SETATTR_GID)
+    item->st.st_gid = st->st_gid;
+  if (mask & NEWFS_SETATTR_ATIME)
+    item->st.st_atim = st->st_atim;
+  if (mask & NEWFS_SETATTR_MTIME)
+    item->st.st_mtim = st->st_mtim;
+  if (mask & NEWFS_SETATTR_CTIME)
+    item->st.st_ctim = st->st_ctim;
+  else
+    clock_gettime(CLOCK_REALTIME, &item->st.st_ctim);
+  changed(item);
+
+out:
+  pthread_rwlock_unlock(&newfs_mem_lock);
+  return rc;
+}
+
+int newfs_sync_item(struct newfs_info *info, newfs_item *item, int flags)
+{
+  return 0;
+}
+
+int newfs_open(struct newfs_info *info, newfs_item *item, int flags, Fh **fd)
+{
+  Fh *fh;
+
+  if (S_ISDIR(item->st.st_mode) && (flags & O_ACCMODE) != O_RDONLY)
+    return -EISDIR;
+
+  fh = calloc(1, sizeof(*fh));
+  if (fh == NULL)
+    return -ENOMEM;
+  fh->item = item;
+  fh->flags = flags;
+
+  if (flags & O_TRUNC) {
+    pthread_rwlock_wrlock(&newfs_mem_lock);
+    (void)truncate_locked(item, 0);
+    touch(item);
+    pthread_rwlock_unlock(&newfs_mem_lock);
+  }
+
+  *fd = fh;
+  return 0;
+}
+
+int newfs_close(struct newfs_info *info, Fh *fd)
+{
+  free(fd);
+  return 0;
+}
+
+int64_t newfs_read(struct newfs_info *info, Fh *fd, uint64_t offset,
+                   uint64_t len, char *buf)
+{
+  newfs_item *item = fd->item;
+  int64_t nb = 0;
+
+  pthread_rwlock_rdlock(&newfs_mem_lock);
+  if (offset < (uint64_t)item->st.st_size) {
+    nb = item->st.st_size - offset;
+    if ((uint64_t)nb > len)
+      nb = len;
+    memcpy(buf, item->data + offset, nb);
+  }
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return nb;
+}
+
+int64_t newfs_write(struct newfs_info *info, Fh *fd, uint64_t offset,
+                    uint64_t len, char *buf)
+{
+  newfs_item *item = fd->item;
+  int rc = 0;
+
+  pthread_rwlock_wrlock(&newfs_mem_lock);
+  if (fd->flags & O_APPEND)
+    offset = item->st.st_size;
+  if (offset + len > (uint64_t)item->st.st_size)
+    rc = truncate_locked(item, offset + len);
+  if (rc == 0) {
+    memcpy(item->data + offset, buf, len);
+    touch(item);
+  }
+  pthread_rwlock_unlock(&newfs_mem_lock);
+
+  return rc < 0 ? rc : (int64_t)len;
+}
+
+int newfs_fsync(struct newfs_info *info, Fh *fd, bool dataonly)
+{
+  return 0;
+}
+
+/* Locks and delegations are left to the SAL in the stand-in */
+int newfs_getlk(struct newfs_info *info, Fh *fd, struct flock *fl,
+                uint64_t owner)
+{
+  fl->l_type = F_UNLCK;
+  return 0;
+}
+
+int newfs_setlk(struct newfs_info *info, Fh *fd, struct flock *fl,
+                uint64_t owner, bool sleep)
+{
+  return 0;
+}
+
+int newfs_delegation(struct newfs_info *info, Fh *fd, unsigned int cmd)
+{
+  return 0;
+}
@@ -52,6 +52,7 @@
 #include "export_mgr.h"
 #include "subfsal.h"
 #include "gsh_config.h"
+#include "nfs_core.h"
 
 /* helpers to/from other VFS objects
  */
@@ -299,6 +300,30 @@ static fsal_status_t wire_to_host(struct fsal_export *exp_hdl,
 	return vfs_check_handle(exp_hdl, fh_desc, &fs, fh, &dummy);
 }
 
+/**
+ * @brief Get write verifier
+ *
+ * The global verifier, changed each time a flush of a file fails so
+ * clients write UNSTABLE data again.
+ *
+ * @param[in]     exp_hdl	Export
+ * @param[in,out] verf_desc	Address and length of verifier
+ */
+
+static void vfs_get_write_verifier(struct fsal_export *exp_hdl,
+				   struct gsh_buffdesc *verf_desc)
+{
+	union {
+		verifier4 verf;
+		uint32_t word[2];
+	} verifier;
+
+	memcpy(verifier.verf, NFS4_write_verifier, sizeof(verifier.verf));
+	verifier.word[1] ^= atomic_fetch_uint32_t(&vfs_write_verifier_gen);
+
+	memcpy(verf_desc->addr, verifier.verf, verf_desc->len);
+}
+
 /* vfs_export_ops_init
  * overwrite vector entries with the methods that we support
  */
@@ -314,6 +339,7 @@ void vfs_export_ops_init(struct export_ops *ops)
 	ops->set_quota = set_quota;
 	ops->alloc_state = vfs_alloc_state;
 	ops->free_state = vfs_free_state;
+	ops->get_write_verifier = vfs_get_write_verifier;
 }
 
 void free_vfs_filesystem(struct vfs_filesystem *vfs_fs)
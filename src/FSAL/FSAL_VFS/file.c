@@ -39,6 +39,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef LINUX
+#include <linux/fs.h>
+#endif
 #include "vfs_methods.h"
 #include "os/subr.h"
 #include "sal_data.h"
@@ -1159,6 +1164,175 @@ fsal_status_t find_fd(int *fd,
 	return status;
 }
 
+/** @brief Sequential reads in a row before the kernel is told so */
+#define VFS_SEQ_READS 4
+/** @brief Distance from the last read still taken as sequential, as
+ *  clients have several reads of a stream in flight */
+#define VFS_SEQ_SLACK (1024 * 1024)
+/** @brief Readahead kept in front of a sequential stream */
+#define VFS_READAHEAD (8 * 1024 * 1024)
+
+#define VFS_ADVISE(hint) (1U << (hint))
+
+/**
+ * @brief Apply the access pattern of a state to a read just done
+ *
+ * Data of a NOREUSE stream is dropped from the page cache once read.
+ * Unless the client said how it reads, reads near where the previous
+ * one ended are counted, and after VFS_SEQ_READS of them the fd is
+ * advised sequential.  A sequential stream then keeps VFS_READAHEAD of
+ * readahead in front of it, deeper than the default kernel window.
+ *
+ * The counters are only hints, racing reads of a state may lose an
+ * update.  Called with the fdlock of the state held.
+ *
+ * @param[in] state_fd	State the read was done with
+ * @param[in] fd	File descriptor read
+ * @param[in] offset	Offset of the read
+ * @param[in] len	Bytes read
+ */
+static void vfs_read_advise(struct vfs_state_fd *state_fd, int fd,
+			    uint64_t offset, size_t len)
+{
+	uint32_t hints = atomic_fetch_uint32_t(&state_fd->io_advise);
+	uint64_t next = atomic_fetch_uint64_t(&state_fd->next_offset);
+	uint64_t end = offset + len;
+	uint64_t ra_end;
+	uint32_t seq;
+
+	if (hints & VFS_ADVISE(IO_ADVISE4_NOREUSE)) {
+		(void) posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+		return;
+	}
+
+	if (hints & (VFS_ADVISE(IO_ADVISE4_RANDOM) |
+		     VFS_ADVISE(IO_ADVISE4_SEQUENTIAL_BACKWARDS)))
+		return;
+
+	if (end > next)
+		atomic_store_uint64_t(&state_fd->next_offset, end);
+
+	if (!(hints & VFS_ADVISE(IO_ADVISE4_SEQUENTIAL))) {
+		if (offset + VFS_SEQ_SLACK < next ||
+		    offset > next + VFS_SEQ_SLACK) {
+			/* Random access, back to the default readahead */
+			if (atomic_fetch_uint32_t(&state_fd->seq_reads) >=
+			    VFS_SEQ_READS)
+				(void) posix_fadvise(fd, 0, 0,
+						     POSIX_FADV_NORMAL);
+			atomic_store_uint32_t(&state_fd->seq_reads, 0);
+			atomic_store_uint64_t(&state_fd->ra_end, 0);
+			return;
+		}
+
+		seq = atomic_fetch_uint32_t(&state_fd->seq_reads);
+		if (seq < VFS_SEQ_READS) {
+			seq = atomic_inc_uint32_t(&state_fd->seq_reads);
+			if (seq < VFS_SEQ_READS)
+				return;
+			if (seq == VFS_SEQ_READS)
+				(void) posix_fadvise(fd, 0, 0,
+						     POSIX_FADV_SEQUENTIAL);
+		}
+	}
+
+	ra_end = atomic_fetch_uint64_t(&state_fd->ra_end);
+	if (ra_end < end)
+		ra_end = end;
+
+	if (ra_end - end < VFS_READAHEAD / 2) {
+		(void) posix_fadvise(fd, ra_end, VFS_READAHEAD,
+				     POSIX_FADV_WILLNEED);
+		atomic_store_uint64_t(&state_fd->ra_end,
+				      ra_end + VFS_READAHEAD);
+	}
+}
+
+/**
+ * @brief Read a range for READ_PLUS, skipping its holes
+ *
+ * The range is split into data and hole segments with SEEK_DATA and
+ * SEEK_HOLE.  Only the data segments are read, packed one after the
+ * other at the start of the buffer.  If the range has more segments
+ * than fit in a reply, the reply ends early and the client reads on.
+ *
+ * @param[in]     fd		File descriptor
+ * @param[in,out] read_arg	Read with one buffer and info set
+ *
+ * @return 0 or errno.
+ */
+static int vfs_read_plus(int fd, struct fsal_io_arg *read_arg)
+{
+	struct io_info *info = read_arg->info;
+	char *buffer = read_arg->iov[0].iov_base;
+	off_t pos = read_arg->offset;
+	off_t end = pos + read_arg->iov[0].iov_len;
+	off_t data, hole;
+	size_t packed = 0;
+	ssize_t nb_read;
+	contents *seg;
+	struct stat st;
+
+	info->io_seg_count = 0;
+
+	if (fstat(fd, &st) < 0)
+		return errno;
+
+	if (end > st.st_size)
+		end = st.st_size;
+
+	while (pos < end && info->io_seg_count < IO_INFO_MAX_SEGS) {
+		seg = &info->io_segs[info->io_seg_count];
+
+		data = lseek(fd, pos, SEEK_DATA);
+		if (data < 0 && errno != ENXIO) {
+			/* No hole support, it is all data */
+			data = pos;
+		} else if (data < 0 || data > pos) {
+			/* A hole, up to the next data or the end of file */
+			if (data < 0 || data > end)
+				data = end;
+			seg->what = NFS4_CONTENT_HOLE;
+			seg->hole.di_offset = pos;
+			seg->hole.di_length = data - pos;
+			info->io_seg_count++;
+			pos = data;
+			continue;
+		}
+
+		hole = lseek(fd, pos, SEEK_HOLE);
+		if (hole < 0 || hole > end)
+			hole = end;
+
+		nb_read = pread(fd, buffer + packed, hole - pos, pos);
+		if (nb_read < 0) {
+			if (info->io_seg_count == 0)
+				return errno;
+			break;
+		}
+
+		if (nb_read == 0)
+			break;
+
+		seg->what = NFS4_CONTENT_DATA;
+		seg->data.d_offset = pos;
+		seg->data.d_data.data_len = nb_read;
+		seg->data.d_data.data_val = buffer + packed;
+		info->io_seg_count++;
+		packed += nb_read;
+		pos += nb_read;
+
+		/* Truncated under us */
+		if (pos < hole)
+			break;
+	}
+
+	read_arg->io_amount = packed;
+	read_arg->end_of_file = pos >= st.st_size;
+
+	return 0;
+}
+
 /**
  * @brief Read data from a file
  *
@@ -1192,13 +1366,6 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	struct vfs_fd *vfs_fd = NULL;
 
-	if (read_arg->info != NULL) {
-		/* Currently we don't support READ_PLUS */
-		done_cb(obj_hdl, fsalstat(ERR_FSAL_NOTSUPP, 0), read_arg,
-			caller_arg);
-		return;
-	}
-
 	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
 		LogDebug(COMPONENT_FSAL,
 			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
@@ -1227,6 +1394,13 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	if (read_arg->info != NULL && read_arg->iov_count == 1) {
+		retval = vfs_read_plus(my_fd, read_arg);
+		if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
 	nb_read = preadv(my_fd, read_arg->iov, read_arg->iov_count,
 			 read_arg->offset);
 
@@ -1240,24 +1414,18 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 
 	read_arg->end_of_file = (nb_read == 0);
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
-	}
-#endif
-
  out:
 
+	if (vfs_fd && !FSAL_IS_ERROR(status)) {
+		/* A READ_PLUS covers its holes too */
+		vfs_read_advise(container_of(vfs_fd, struct vfs_state_fd,
+					     vfs_fd),
+				my_fd, read_arg->offset,
+				read_arg->info != NULL
+					? read_arg->iov[0].iov_len
+					: read_arg->io_amount);
+	}
+
 	if (vfs_fd)
 		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
 
@@ -1272,6 +1440,295 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	done_cb(obj_hdl, status, read_arg, caller_arg);
 }
 
+/**
+ * @brief Bumped each time a flush fails
+ *
+ * UNSTABLE data written before a failed flush may be lost, so the write
+ * verifier changes and clients send it again.
+ */
+uint32_t vfs_write_verifier_gen;
+
+void vfs_sync_init(struct vfs_sync *sync)
+{
+	memset(sync, 0, sizeof(*sync));
+	PTHREAD_MUTEX_init(&sync->mutex, NULL);
+	PTHREAD_COND_init(&sync->cond, NULL);
+}
+
+void vfs_sync_fini(struct vfs_sync *sync)
+{
+	PTHREAD_MUTEX_destroy(&sync->mutex);
+	PTHREAD_COND_destroy(&sync->cond);
+}
+
+/**
+ * @brief Flush UNSTABLE writes of a file whose handle is released
+ *
+ * A COMMIT that comes after the handle is released finds no dirty
+ * ranges on the handle that replaces it and returns at once, so they
+ * have to be stable by then.  If they can't be made so, the write
+ * verifier changes and clients write them again.
+ *
+ * @param[in] myself	Handle being released, with no I/O in progress
+ */
+void vfs_sync_release(struct vfs_fsal_obj_handle *myself)
+{
+	struct vfs_sync *sync = &myself->u.file.sync;
+	fsal_errors_t fsal_error;
+	int fd = myself->u.file.fd.fd;
+	bool closefd = false;
+	bool dirty;
+	int retval = 0;
+
+	PTHREAD_MUTEX_lock(&sync->mutex);
+	dirty = sync->ndirty != 0 || sync->nflushing != 0;
+	PTHREAD_MUTEX_unlock(&sync->mutex);
+
+	if (!dirty)
+		return;
+
+	if (fd < 0) {
+		/* Written through state fds that are closed already */
+		fd = vfs_fsal_open(myself, O_RDONLY, &fsal_error);
+		closefd = fd >= 0;
+	}
+
+	if (fd < 0)
+		retval = -fd;
+	else if (fdatasync(fd) == -1)
+		retval = errno;
+
+	if (closefd)
+		close(fd);
+
+	if (retval != 0) {
+		LogWarn(COMPONENT_FSAL,
+			"Flush of released handle %p failed: %s",
+			&myself->obj_handle, strerror(retval));
+		(void) atomic_inc_uint32_t(&vfs_write_verifier_gen);
+	}
+}
+
+/**
+ * @brief Add a range to a sorted range array
+ *
+ * Overlapping and adjacent ranges are merged.  When the array is full,
+ * the two closest ranges are merged to make room.
+ *
+ * @param[in,out] ranges	Range array of VFS_DIRTY_RANGES
+ * @param[in,out] count		Ranges in use
+ * @param[in]     start		Start of the range
+ * @param[in]     end		End of the range, exclusive
+ */
+static void vfs_range_add(struct vfs_range *ranges, uint32_t *count,
+			  uint64_t start, uint64_t end)
+{
+	uint32_t i, j, best = 0;
+	uint64_t gap, best_gap = UINT64_MAX;
+
+	/* Skip the ranges ending before this one */
+	for (i = 0; i < *count && ranges[i].end < start; i++)
+		;
+
+	/* Merge the ranges overlapping or touching this one */
+	for (j = i; j < *count && ranges[j].start <= end; j++) {
+		if (ranges[j].start < start)
+			start = ranges[j].start;
+		if (ranges[j].end > end)
+			end = ranges[j].end;
+	}
+
+	if (j > i) {
+		ranges[i].start = start;
+		ranges[i].end = end;
+		memmove(&ranges[i + 1], &ranges[j],
+			(*count - j) * sizeof(*ranges));
+		*count -= j - i - 1;
+		return;
+	}
+
+	if (*count == VFS_DIRTY_RANGES) {
+		for (j = 0; j + 1 < *count; j++) {
+			gap = ranges[j + 1].start - ranges[j].end;
+			if (gap < best_gap) {
+				best_gap = gap;
+				best = j;
+			}
+		}
+
+		ranges[best].end = ranges[best + 1].end;
+		memmove(&ranges[best + 1], &ranges[best + 2],
+			(*count - best - 2) * sizeof(*ranges));
+		(*count)--;
+
+		if (i == best + 1) {
+			/* The merged range covers this one */
+			return;
+		}
+
+		if (i > best + 1)
+			i--;
+	}
+
+	memmove(&ranges[i + 1], &ranges[i], (*count - i) * sizeof(*ranges));
+	ranges[i].start = start;
+	ranges[i].end = end;
+	(*count)++;
+}
+
+static bool vfs_range_overlaps(const struct vfs_range *ranges,
+			       uint32_t count, uint64_t start, uint64_t end)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		if (ranges[i].start < end && start < ranges[i].end)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Record a completed write
+ *
+ * @param[in] sync	Tracking of the file
+ * @param[in] offset	Offset of the write
+ * @param[in] len	Bytes written
+ *
+ * @return Sequence of the write, for vfs_sync_wait().
+ */
+static uint64_t vfs_sync_dirty(struct vfs_sync *sync, uint64_t offset,
+			       size_t len)
+{
+	uint64_t seq;
+
+	PTHREAD_MUTEX_lock(&sync->mutex);
+
+	if (len != 0)
+		vfs_range_add(sync->dirty, &sync->ndirty, offset,
+			      offset + len);
+
+	seq = ++sync->write_seq;
+
+	PTHREAD_MUTEX_unlock(&sync->mutex);
+
+	return seq;
+}
+
+/**
+ * @brief Check a range for data that is not on stable storage
+ *
+ * @param[in]  sync	Tracking of the file
+ * @param[in]  offset	Start of the range
+ * @param[in]  len	Length of the range, 0 for up to end of file
+ * @param[out] seq	Sequence to wait for if the range is dirty
+ *
+ * @return true if the range needs flushing.
+ */
+static bool vfs_sync_check(struct vfs_sync *sync, uint64_t offset,
+			   uint64_t len, uint64_t *seq)
+{
+	uint64_t end = UINT64_MAX;
+	bool dirty;
+
+	if (len != 0 && offset + len > offset)
+		end = offset + len;
+
+	PTHREAD_MUTEX_lock(&sync->mutex);
+
+	dirty = vfs_range_overlaps(sync->dirty, sync->ndirty, offset, end) ||
+		vfs_range_overlaps(sync->flushing, sync->nflushing, offset,
+				   end);
+	*seq = sync->write_seq;
+
+	PTHREAD_MUTEX_unlock(&sync->mutex);
+
+	return dirty;
+}
+
+/**
+ * @brief Wait for writes to reach stable storage
+ *
+ * If a flush is running, wait for it.  Once none is, the first waiter
+ * whose writes are still not stable flushes the file for all of them.
+ *
+ * @param[in] sync	Tracking of the file
+ * @param[in] fd	Open file descriptor of the file
+ * @param[in] seq	Sequence of the last write to wait for
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_sync_wait(struct vfs_sync *sync, int fd, uint64_t seq)
+{
+	uint32_t fails, i;
+	uint64_t start;
+	int retval = 0;
+
+	PTHREAD_MUTEX_lock(&sync->mutex);
+
+	fails = sync->fail_count;
+
+	while (sync->stable_seq < seq) {
+		if (sync->fail_count != fails && sync->failed_seq >= seq) {
+			/* The flush covering our writes failed */
+			retval = sync->failed_err;
+			break;
+		}
+
+		if (sync->flush_inflight) {
+			pthread_cond_wait(&sync->cond, &sync->mutex);
+			continue;
+		}
+
+		start = sync->write_seq;
+		memcpy(sync->flushing, sync->dirty, sizeof(sync->dirty));
+		sync->nflushing = sync->ndirty;
+		sync->ndirty = 0;
+		sync->flush_inflight = true;
+
+		PTHREAD_MUTEX_unlock(&sync->mutex);
+
+		retval = fdatasync(fd);
+		if (retval == -1)
+			retval = errno;
+
+		PTHREAD_MUTEX_lock(&sync->mutex);
+
+		if (retval == 0) {
+			sync->stable_seq = start;
+		} else {
+			LogWarn(COMPONENT_FSAL,
+				"fdatasync of fd %d failed: %s", fd,
+				strerror(retval));
+
+			/* The kernel may have dropped the pages, make the
+			 * clients write them again.
+			 */
+			for (i = 0; i < sync->nflushing; i++)
+				vfs_range_add(sync->dirty, &sync->ndirty,
+					      sync->flushing[i].start,
+					      sync->flushing[i].end);
+
+			sync->fail_count++;
+			sync->failed_seq = start;
+			sync->failed_err = retval;
+			(void) atomic_inc_uint32_t(&vfs_write_verifier_gen);
+		}
+
+		sync->nflushing = 0;
+		sync->flush_inflight = false;
+		pthread_cond_broadcast(&sync->cond);
+
+		if (retval != 0)
+			break;
+	}
+
+	PTHREAD_MUTEX_unlock(&sync->mutex);
+
+	return retval;
+}
+
 /**
  * @brief Write data to a file
  *
@@ -1299,7 +1756,11 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 		struct fsal_io_arg *write_arg,
 		void *caller_arg)
 {
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 	ssize_t nb_written;
+	uint32_t verifier_gen;
+	uint64_t seq;
 	fsal_status_t status;
 	int retval = 0;
 	int my_fd = -1;
@@ -1345,6 +1806,8 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	verifier_gen = atomic_fetch_uint32_t(&vfs_write_verifier_gen);
+
 	nb_written = pwritev(my_fd, write_arg->iov, write_arg->iov_count,
 			     write_arg->offset);
 
@@ -1356,10 +1819,19 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	write_arg->io_amount = nb_written;
 
+	seq = vfs_sync_dirty(&myself->u.file.sync, write_arg->offset,
+			     nb_written);
+
+	if (atomic_fetch_uint32_t(&vfs_write_verifier_gen) != verifier_gen) {
+		/* A flush failed meanwhile, this write may already be lost
+		 * and would be answered with the new verifier.
+		 */
+		write_arg->fsal_stable = true;
+	}
+
 	if (write_arg->fsal_stable) {
-		retval = fsync(my_fd);
-		if (retval == -1) {
-			retval = errno;
+		retval = vfs_sync_wait(&myself->u.file.sync, my_fd, seq);
+		if (retval != 0) {
 			status = fsalstat(posix2fsal_error(retval), retval);
 			write_arg->fsal_stable = false;
 		}
@@ -1478,6 +1950,108 @@ fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
 }
 #endif
 
+/**
+ * @brief IO_ADVISE4 hints and the posix_fadvise advice they map to
+ */
+static const struct {
+	uint32_t hint;
+	int advice;
+} vfs_advice[] = {
+	{ IO_ADVISE4_NORMAL, POSIX_FADV_NORMAL },
+	{ IO_ADVISE4_SEQUENTIAL, POSIX_FADV_SEQUENTIAL },
+	{ IO_ADVISE4_RANDOM, POSIX_FADV_RANDOM },
+	{ IO_ADVISE4_WILLNEED, POSIX_FADV_WILLNEED },
+	{ IO_ADVISE4_DONTNEED, POSIX_FADV_DONTNEED },
+	{ IO_ADVISE4_NOREUSE, POSIX_FADV_NOREUSE },
+};
+
+/** @brief Hints describing how the state's fd goes on being read */
+#define VFS_ADVISE_PATTERN (VFS_ADVISE(IO_ADVISE4_NORMAL) | \
+			    VFS_ADVISE(IO_ADVISE4_SEQUENTIAL) | \
+			    VFS_ADVISE(IO_ADVISE4_RANDOM) | \
+			    VFS_ADVISE(IO_ADVISE4_NOREUSE))
+
+/**
+ * @brief Advise the kernel of the access pattern of a file
+ *
+ * Each hint with a posix_fadvise counterpart is applied to the range.
+ * Hints about the access pattern are also kept in the state, replacing
+ * the ones given before, and take over from the detection of
+ * sequential reads in vfs_read2.  They are only honoured when the
+ * state has its own fd.
+ *
+ * @param[in]     obj_hdl	File on which to operate
+ * @param[in]     state		state_t to use for this operation
+ * @param[in,out] hints		Hints asked, set to the hints honoured
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints)
+{
+	struct vfs_state_fd *state_fd = NULL;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	uint32_t honoured = 0;
+	int my_fd = -1;
+	size_t i;
+
+	if (state != NULL) {
+		state_fd = container_of(state, struct vfs_state_fd, state);
+		PTHREAD_RWLOCK_rdlock(&state_fd->vfs_fd.fdlock);
+	}
+
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_ANY,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	for (i = 0; i < sizeof(vfs_advice) / sizeof(vfs_advice[0]); i++) {
+		if (!(hints->hints & VFS_ADVISE(vfs_advice[i].hint)))
+			continue;
+
+		/* A count of 0 is to the end of file for both */
+		if (posix_fadvise(my_fd, hints->offset, hints->count,
+				  vfs_advice[i].advice) == 0)
+			honoured |= VFS_ADVISE(vfs_advice[i].hint);
+	}
+
+	if (state_fd == NULL || closefd) {
+		honoured &= ~VFS_ADVISE_PATTERN;
+	} else if (honoured & VFS_ADVISE_PATTERN) {
+		atomic_store_uint32_t(&state_fd->io_advise,
+				      honoured & VFS_ADVISE_PATTERN);
+		atomic_store_uint32_t(&state_fd->seq_reads, 0);
+		atomic_store_uint64_t(&state_fd->ra_end, 0);
+	}
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "hints 0x%" PRIx32 " honoured 0x%" PRIx32,
+		     hints->hints, honoured);
+
+ out:
+
+	hints->hints = honoured;
+
+	if (closefd) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Closing Opened fd %d", my_fd);
+		close(my_fd);
+	}
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	if (state_fd != NULL)
+		PTHREAD_RWLOCK_unlock(&state_fd->vfs_fd.fdlock);
+
+	return status;
+}
+
 /**
  * @brief Reserve/Deallocate space in a region of a file
  *
@@ -1545,6 +2119,409 @@ fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
 }
 #endif
 
+/** @brief Buffer size when copying with read and write */
+#define VFS_COPY_BUFSIZE (1024 * 1024)
+
+/**
+ * @brief File descriptors for a copy or clone
+ */
+
+struct vfs_copy_fds {
+	int src_fd;
+	int dst_fd;
+	bool src_has_lock;
+	bool dst_has_lock;
+	bool src_closefd;
+	bool dst_closefd;
+	struct vfs_fd *src_vfs_fd;
+	struct vfs_fd *dst_vfs_fd;
+};
+
+static fsal_status_t vfs_copy_find_src(struct fsal_obj_handle *src_hdl,
+				       struct state_t *src_state,
+				       struct vfs_copy_fds *fds)
+{
+	fsal_status_t status;
+
+	status = find_fd(&fds->src_fd, src_hdl, false, src_state,
+			 FSAL_O_READ, &fds->src_has_lock, &fds->src_closefd,
+			 false);
+
+	if (FSAL_IS_ERROR(status))
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd for source failed %s",
+			 msg_fsal_err(status.major));
+
+	return status;
+}
+
+static fsal_status_t vfs_copy_find_dst(struct fsal_obj_handle *dst_hdl,
+				       struct state_t *dst_state,
+				       struct vfs_copy_fds *fds)
+{
+	fsal_status_t status;
+
+	status = find_fd(&fds->dst_fd, dst_hdl, false, dst_state,
+			 FSAL_O_WRITE, &fds->dst_has_lock, &fds->dst_closefd,
+			 false);
+
+	if (FSAL_IS_ERROR(status))
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd for destination failed %s",
+			 msg_fsal_err(status.major));
+
+	return status;
+}
+
+/**
+ * @brief Get file descriptors to copy from one file to another
+ *
+ * The state fdlocks are taken as for read2 and write2.  When both ends
+ * are the same file a single read/write descriptor is used, otherwise
+ * the locks of the two files are taken in address order.
+ *
+ * @param[in]  src_hdl		File to copy from
+ * @param[in]  src_state	state_t to read with, or NULL
+ * @param[in]  dst_hdl		File to copy to
+ * @param[in]  dst_state	state_t to write with, or NULL
+ * @param[out] fds		Descriptors, released with vfs_copy_put_fds()
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t vfs_copy_get_fds(struct fsal_obj_handle *src_hdl,
+				      struct state_t *src_state,
+				      struct fsal_obj_handle *dst_hdl,
+				      struct state_t *dst_state,
+				      struct vfs_copy_fds *fds)
+{
+	fsal_status_t status;
+
+	memset(fds, 0, sizeof(*fds));
+	fds->src_fd = -1;
+	fds->dst_fd = -1;
+
+	if (src_hdl->fsal != src_hdl->fs->fsal ||
+	    dst_hdl->fsal != dst_hdl->fs->fsal ||
+	    src_hdl->fs != dst_hdl->fs) {
+		LogDebug(COMPONENT_FSAL,
+			 "Copy between different filesystems, return EXDEV");
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	if (src_hdl->type != REGULAR_FILE || dst_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	if (src_hdl == dst_hdl) {
+		if (dst_state) {
+			fds->dst_vfs_fd = &container_of(dst_state,
+							struct vfs_state_fd,
+							state)->vfs_fd;
+			PTHREAD_RWLOCK_rdlock(&fds->dst_vfs_fd->fdlock);
+		}
+
+		status = find_fd(&fds->dst_fd, dst_hdl, false, dst_state,
+				 FSAL_O_RDWR, &fds->dst_has_lock,
+				 &fds->dst_closefd, false);
+		fds->src_fd = fds->dst_fd;
+		return status;
+	}
+
+	if (dst_state)
+		fds->dst_vfs_fd = &container_of(dst_state, struct vfs_state_fd,
+						state)->vfs_fd;
+
+	if (src_state && src_state != dst_state)
+		fds->src_vfs_fd = &container_of(src_state, struct vfs_state_fd,
+						state)->vfs_fd;
+
+	/* A copy the other way round takes the same locks, always take
+	 * them by address so that the two can't deadlock.
+	 */
+	if (fds->src_vfs_fd != NULL && fds->dst_vfs_fd != NULL &&
+	    fds->src_vfs_fd < fds->dst_vfs_fd) {
+		PTHREAD_RWLOCK_rdlock(&fds->src_vfs_fd->fdlock);
+		PTHREAD_RWLOCK_rdlock(&fds->dst_vfs_fd->fdlock);
+	} else {
+		if (fds->dst_vfs_fd != NULL)
+			PTHREAD_RWLOCK_rdlock(&fds->dst_vfs_fd->fdlock);
+		if (fds->src_vfs_fd != NULL)
+			PTHREAD_RWLOCK_rdlock(&fds->src_vfs_fd->fdlock);
+	}
+
+	/* find_fd may keep the object lock, or take it for write to open
+	 * the global fd.
+	 */
+	if (src_hdl < dst_hdl) {
+		status = vfs_copy_find_src(src_hdl, src_state, fds);
+		if (!FSAL_IS_ERROR(status))
+			status = vfs_copy_find_dst(dst_hdl, dst_state, fds);
+	} else {
+		status = vfs_copy_find_dst(dst_hdl, dst_state, fds);
+		if (!FSAL_IS_ERROR(status))
+			status = vfs_copy_find_src(src_hdl, src_state, fds);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Release the file descriptors of a copy or clone
+ *
+ * @param[in] src_hdl	File copied from
+ * @param[in] dst_hdl	File copied to
+ * @param[in] fds	Descriptors from vfs_copy_get_fds()
+ */
+static void vfs_copy_put_fds(struct fsal_obj_handle *src_hdl,
+			     struct fsal_obj_handle *dst_hdl,
+			     struct vfs_copy_fds *fds)
+{
+	if (fds->src_closefd && fds->src_fd != fds->dst_fd)
+		close(fds->src_fd);
+
+	if (fds->dst_closefd)
+		close(fds->dst_fd);
+
+	if (fds->src_has_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	if (fds->dst_has_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->obj_lock);
+
+	if (fds->src_vfs_fd)
+		PTHREAD_RWLOCK_unlock(&fds->src_vfs_fd->fdlock);
+
+	if (fds->dst_vfs_fd)
+		PTHREAD_RWLOCK_unlock(&fds->dst_vfs_fd->fdlock);
+}
+
+/**
+ * @brief Copy with read and write through a bounce buffer
+ *
+ * @param[in]     src_fd	Descriptor to read from
+ * @param[in]     src_offset	Offset in the source file
+ * @param[in]     dst_fd	Descriptor to write to
+ * @param[in]     dst_offset	Offset in the destination file
+ * @param[in]     count		Bytes to copy
+ * @param[in,out] copied	Bytes copied
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_copy_rw(int src_fd, uint64_t src_offset, int dst_fd,
+		       uint64_t dst_offset, uint64_t count, uint64_t *copied)
+{
+	char *buf = gsh_malloc(VFS_COPY_BUFSIZE);
+	ssize_t got, put;
+	size_t len, done;
+	int retval = 0;
+
+	while (*copied < count) {
+		len = MIN(count - *copied, VFS_COPY_BUFSIZE);
+
+		got = pread(src_fd, buf, len, src_offset + *copied);
+
+		if (got < 0) {
+			retval = errno;
+			break;
+		}
+
+		if (got == 0)
+			break;
+
+		for (done = 0; done < got; done += put) {
+			put = pwrite(dst_fd, buf + done, got - done,
+				     dst_offset + *copied + done);
+
+			if (put < 0) {
+				retval = errno;
+				goto out;
+			}
+		}
+
+		*copied += got;
+	}
+
+ out:
+
+	gsh_free(buf);
+
+	return retval;
+}
+
+/**
+ * @brief Copy a range of a file to another file
+ *
+ * The copy is done by the kernel with copy_file_range() when it can,
+ * which lets filesystems share blocks or copy on the storage side.
+ * Otherwise the data is read and written here.  The destination range is
+ * recorded as dirty so a later COMMIT flushes it.
+ *
+ * @param[in]  src_hdl		File to copy from
+ * @param[in]  src_state	state_t to read with, or NULL
+ * @param[in]  src_offset	Offset in the source file
+ * @param[in]  dst_hdl		File to copy to
+ * @param[in]  dst_state	state_t to write with, or NULL
+ * @param[in]  dst_offset	Offset in the destination file
+ * @param[in]  count		Bytes to copy
+ * @param[out] copied		Bytes copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state, uint64_t src_offset,
+		       struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state, uint64_t dst_offset,
+		       uint64_t count, uint64_t *copied)
+{
+	struct vfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	struct vfs_copy_fds fds;
+	fsal_status_t status;
+	int retval = 0;
+
+	*copied = 0;
+
+	status = vfs_copy_get_fds(src_hdl, src_state, dst_hdl, dst_state,
+				  &fds);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	if (!vfs_set_credentials(op_ctx->creds, dst_hdl->fsal)) {
+		status = posix2fsal_status(EPERM);
+		goto out;
+	}
+
+#ifdef __NR_copy_file_range
+	while (*copied < count) {
+		loff_t in_off = src_offset + *copied;
+		loff_t out_off = dst_offset + *copied;
+		ssize_t ret;
+
+		ret = syscall(__NR_copy_file_range, fds.src_fd, &in_off,
+			      fds.dst_fd, &out_off, count - *copied, 0);
+
+		if (ret < 0) {
+			retval = errno;
+			break;
+		}
+
+		if (ret == 0)
+			break;
+
+		*copied += ret;
+	}
+
+	if (*copied == 0 &&
+	    (retval == ENOSYS || retval == EXDEV || retval == EOPNOTSUPP ||
+	     retval == EINVAL)) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "copy_file_range returned %s, copying with read and write",
+			     strerror(retval));
+		retval = vfs_copy_rw(fds.src_fd, src_offset, fds.dst_fd,
+				     dst_offset, count, copied);
+	}
+#else
+	retval = vfs_copy_rw(fds.src_fd, src_offset, fds.dst_fd, dst_offset,
+			     count, copied);
+#endif
+
+	if (*copied != 0)
+		(void) vfs_sync_dirty(&dst->u.file.sync, dst_offset, *copied);
+
+	if (retval != 0) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "copy failed with %s (%d) after %" PRIu64 " bytes",
+			     strerror(retval), retval, *copied);
+		status = posix2fsal_status(retval);
+	}
+
+	vfs_restore_ganesha_credentials(dst_hdl->fsal);
+
+ out:
+
+	vfs_copy_put_fds(src_hdl, dst_hdl, &fds);
+
+	return status;
+}
+
+/**
+ * @brief Share the storage of a range of a file with another file
+ *
+ * Uses the FICLONERANGE ioctl, so only filesystems with reflinks
+ * support it.  Not supported when built without it.
+ *
+ * @param[in] src_hdl		File to clone from
+ * @param[in] src_state		state_t to read with, or NULL
+ * @param[in] src_offset	Offset in the source file
+ * @param[in] dst_hdl		File to clone to
+ * @param[in] dst_state		state_t to write with, or NULL
+ * @param[in] dst_offset	Offset in the destination file
+ * @param[in] count		Bytes to clone, 0 for up to the end of the
+ *				source file
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_clone(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state, uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state, uint64_t dst_offset,
+			uint64_t count)
+{
+#ifdef FICLONERANGE
+	struct vfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	struct file_clone_range range;
+	struct vfs_copy_fds fds;
+	fsal_status_t status;
+	uint64_t len;
+	int retval;
+
+	status = vfs_copy_get_fds(src_hdl, src_state, dst_hdl, dst_state,
+				  &fds);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	if (!vfs_set_credentials(op_ctx->creds, dst_hdl->fsal)) {
+		status = posix2fsal_status(EPERM);
+		goto out;
+	}
+
+	range.src_fd = fds.src_fd;
+	range.src_offset = src_offset;
+	range.src_length = count;
+	range.dest_offset = dst_offset;
+
+	retval = ioctl(fds.dst_fd, FICLONERANGE, &range);
+
+	if (retval < 0) {
+		retval = errno;
+		LogFullDebug(COMPONENT_FSAL,
+			     "FICLONERANGE returned %s (%d)",
+			     strerror(retval), retval);
+		status = posix2fsal_status(retval);
+	} else {
+		/* Count 0 clones up to the end of the source, we do not know
+		 * how much that was.
+		 */
+		len = count != 0 ? count : UINT64_MAX - dst_offset;
+		(void) vfs_sync_dirty(&dst->u.file.sync, dst_offset, len);
+	}
+
+	vfs_restore_ganesha_credentials(dst_hdl->fsal);
+
+ out:
+
+	vfs_copy_put_fds(src_hdl, dst_hdl, &fds);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+#endif
+}
+
 /**
  * @brief Commit written data
  *
@@ -1574,9 +2551,17 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 	struct vfs_fd *out_fd = &temp_fd;
 	bool has_lock = false;
 	bool closefd = false;
+	uint64_t seq;
 
 	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 
+	if (!vfs_sync_check(&myself->u.file.sync, offset, len, &seq)) {
+		/* Nothing written UNSTABLE in the range since it was
+		 * last flushed.
+		 */
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
 	/* Make sure file is open in appropriate mode.
 	 * Do not check share reservation.
 	 */
@@ -1595,12 +2580,10 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			goto out;
 		}
 
-		retval = fsync(out_fd->fd);
+		retval = vfs_sync_wait(&myself->u.file.sync, out_fd->fd, seq);
 
-		if (retval == -1) {
-			retval = errno;
+		if (retval != 0)
 			status = fsalstat(posix2fsal_error(retval), retval);
-		}
 
 		vfs_restore_ganesha_credentials(obj_hdl->fsal);
 	}
@@ -104,6 +104,7 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	if (hdl->obj_handle.type == REGULAR_FILE) {
 		hdl->u.file.fd.fd = -1;	/* no open on this yet */
 		hdl->u.file.fd.openflags = FSAL_O_CLOSED;
+		vfs_sync_init(&hdl->u.file.sync);
 	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		ssize_t retlink;
 		size_t len = stat->st_size + 1;
@@ -150,7 +151,9 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	return hdl;
 
  spcerr:
-	if (hdl->obj_handle.type == SYMBOLIC_LINK) {
+	if (hdl->obj_handle.type == REGULAR_FILE) {
+		vfs_sync_fini(&hdl->u.file.sync);
+	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		gsh_free(hdl->u.symlink.link_content);
 	} else if (vfs_unopenable_type(hdl->obj_handle.type)) {
 		gsh_free(hdl->u.unopenable.name);
@@ -1643,6 +1646,9 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		 */
 		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
 
+		/* Nothing will track the dirty ranges once we are gone */
+		vfs_sync_release(myself);
+
 		st = vfs_close_my_fd(&myself->u.file.fd);
 
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1663,6 +1669,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 		handle_to_key(obj_hdl, &key);
 		vfs_state_release(&key);
+		vfs_sync_fini(&myself->u.file.sync);
 	} else if (vfs_unopenable_type(type)) {
 		gsh_free(myself->u.unopenable.name);
 		gsh_free(myself->u.unopenable.dir);
@@ -1704,6 +1711,9 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 #ifdef __USE_GNU
 	ops->seek2 = vfs_seek2;
 #endif
+	ops->io_advise2 = vfs_io_advise2;
+	ops->copy = vfs_copy;
+	ops->clone = vfs_clone;
 	ops->commit2 = vfs_commit2;
 #ifdef F_OFD_GETLK
 	ops->lock_op2 = vfs_lock_op2;
@@ -75,6 +75,7 @@ static struct vfs_fsal_module PANFS = {
 			.maxread = FSAL_MAXIOSIZE,
 			.maxwrite = FSAL_MAXIOSIZE,
 			.link_supports_permission_checks = false,
+			.read_plus = true,
 		}
 	},
 	.only_one_user = false
@@ -81,6 +81,7 @@ static struct vfs_fsal_module VFS = {
 			.maxread = FSAL_MAXIOSIZE,
 			.maxwrite = FSAL_MAXIOSIZE,
 			.link_supports_permission_checks = false,
+			.read_plus = true,
 		}
 	},
 	.only_one_user = false
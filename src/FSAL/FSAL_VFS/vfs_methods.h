@@ -156,6 +156,59 @@ struct vfs_fd {
 struct vfs_state_fd {
 	struct state_t state;
 	struct vfs_fd vfs_fd;
+	/** IO_ADVISE4 access pattern hints in effect on the fd */
+	uint32_t io_advise;
+	/** Sequential reads in a row, up to VFS_SEQ_READS */
+	uint32_t seq_reads;
+	/** Offset after the furthest read */
+	uint64_t next_offset;
+	/** End of the readahead asked of the kernel */
+	uint64_t ra_end;
+};
+
+/** @brief Dirty ranges tracked per file before they are merged */
+#define VFS_DIRTY_RANGES 8
+
+/**
+ * @brief A range of a file, [start, end)
+ */
+struct vfs_range {
+	uint64_t start;
+	uint64_t end;
+};
+
+/**
+ * @brief Stable storage tracking of a regular file
+ *
+ * Ranges written UNSTABLE are kept until a flush of the file completes,
+ * so a COMMIT of a range that is already stable returns at once.  Only
+ * one flush of a file runs at a time; COMMITs and stable WRITEs that
+ * arrive meanwhile wait for it, and the first of them to wake up starts
+ * a single flush for all the others.
+ */
+struct vfs_sync {
+	/** Protects the fields below */
+	pthread_mutex_t mutex;
+	/** Signalled when a flush completes */
+	pthread_cond_t cond;
+	/** Ranges written since the last flush started, sorted */
+	struct vfs_range dirty[VFS_DIRTY_RANGES];
+	uint32_t ndirty;
+	/** Ranges being flushed, sorted */
+	struct vfs_range flushing[VFS_DIRTY_RANGES];
+	uint32_t nflushing;
+	/** Bumped by each write recorded */
+	uint64_t write_seq;
+	/** Writes up to this sequence are on stable storage */
+	uint64_t stable_seq;
+	/** A flush is running */
+	bool flush_inflight;
+	/** Bumped by each failed flush */
+	uint32_t fail_count;
+	/** Sequence covered by the last failed flush */
+	uint64_t failed_seq;
+	/** Error of the last failed flush */
+	int failed_err;
 };
 
 /*
@@ -185,6 +238,7 @@ struct vfs_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct vfs_fd fd;
+			struct vfs_sync sync;
 		} file;
 		struct {
 			unsigned char *link_content;
@@ -284,6 +338,12 @@ struct state_hdl *vfs_state_locate(struct fsal_obj_handle *obj);
 	/* I/O management */
 fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd);
 
+/* Stable storage tracking */
+extern uint32_t vfs_write_verifier_gen;
+void vfs_sync_init(struct vfs_sync *sync);
+void vfs_sync_fini(struct vfs_sync *sync);
+void vfs_sync_release(struct vfs_fsal_obj_handle *myself);
+
 fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl);
 
 /* Multiple file descriptor methods */
@@ -328,12 +388,28 @@ fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
 			struct io_info *info);
 #endif
 
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints);
+
 #ifdef FALLOC_FL_PUNCH_HOLE
 fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
 			    struct state_t *state, uint64_t offset,
 			    uint64_t length, bool allocate);
 #endif
 
+fsal_status_t vfs_copy(struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state, uint64_t src_offset,
+		       struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state, uint64_t dst_offset,
+		       uint64_t count, uint64_t *copied);
+
+fsal_status_t vfs_clone(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state, uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state, uint64_t dst_offset,
+			uint64_t count);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
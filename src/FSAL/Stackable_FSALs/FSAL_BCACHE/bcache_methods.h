@@ -0,0 +1,293 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published
+ *   by the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @brief BCACHE methods for handles
+ *
+ * BCACHE is a stackable FSAL that keeps file data read through it in
+ * fixed size extents on a local file or block device.  Extents are
+ * validated against the change and mtime attributes of their file,
+ * dropped on FSAL_UP invalidate and update, and updated by writes going
+ * through to the sub-FSAL.  The extent index is kept on the device so
+ * the cache survives a clean restart.
+ */
+
+/* BCACHE methods for handles
+ */
+
+#ifndef BCACHE_METHODS_H
+#define BCACHE_METHODS_H
+
+struct bcache_fsal_module {
+	struct fsal_module module;
+	struct fsal_obj_ops handle_ops;
+	/** File or block device holding the cache */
+	char *cache_path;
+	/** Bytes of it to use, 0 for all of it */
+	uint64_t cache_size;
+	/** Size of a cached extent */
+	uint32_t extent_size;
+};
+
+extern struct bcache_fsal_module BCACHE;
+
+struct bcache_fsal_obj_handle;
+struct bcache_file;
+
+/**
+ * Structure used to store data for read_dirents callback.
+ *
+ * Before executing the upper level callback (it might be another
+ * stackable fsal or the inode cache), the context has to be restored.
+ */
+struct bcache_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct bcache_fsal_export *exp; /*< Export of the current bcachefsal. */
+	void *dir_state; /*< State to be sent to the next callback. */
+};
+
+extern struct fsal_up_vector fsal_up_top;
+void bcache_handle_ops_init(struct fsal_obj_ops *ops);
+
+/*
+ * BCACHE internal export
+ */
+struct bcache_fsal_export {
+	struct fsal_export export;
+	/** Upcalls of the sub-FSAL come through here */
+	struct fsal_up_vector up_ops;
+	/** Upcall vector we were given */
+	const struct fsal_up_vector *super_up_ops;
+	/** Update cached extents on write, rather than dropping them */
+	bool write_through;
+};
+
+fsal_status_t bcache_lookup_path(struct fsal_export *exp_hdl,
+				 const char *path,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out);
+
+fsal_status_t bcache_create_handle(struct fsal_export *exp_hdl,
+				   struct gsh_buffdesc *hdl_desc,
+				   struct fsal_obj_handle **handle,
+				   struct attrlist *attrs_out);
+
+fsal_status_t bcache_alloc_and_check_handle(
+		struct bcache_fsal_export *export,
+		struct fsal_obj_handle *sub_handle,
+		struct fsal_filesystem *fs,
+		struct fsal_obj_handle **new_handle,
+		fsal_status_t subfsal_status);
+
+/*
+ * BCACHE internal object handle
+ *
+ * It contains a pointer to the fsal_obj_handle used by the subfsal.
+ *
+ * AF_UNIX sockets are strange ducks.  I personally cannot see why they
+ * are here except for the ability of a client to see such an animal with
+ * an 'ls' or get rid of one with an 'rm'.  You can't open them in the
+ * usual file way so open_by_handle_at leads to a deadend.  To work around
+ * this, we save the args that were used to mknod or lookup the socket.
+ */
+
+struct bcache_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing bcache data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	int32_t refcnt;		/*< Reference count.  This is signed to make
+				   mistakes easy to see. */
+	struct bcache_file *file; /*< Cached data, set on first I/O */
+};
+
+int bcache_fsal_open(struct bcache_fsal_obj_handle *, int, fsal_errors_t *);
+int bcache_fsal_readlink(struct bcache_fsal_obj_handle *, fsal_errors_t *);
+
+static inline bool bcache_unopenable_type(object_file_type_t type)
+{
+	if ((type == SOCKET_FILE) || (type == CHARACTER_FILE)
+	    || (type == BLOCK_FILE)) {
+		return true;
+	} else {
+		return false;
+	}
+}
+
+/* I/O management */
+fsal_status_t bcache_close(struct fsal_obj_handle *obj_hdl);
+
+/* Extent cache */
+
+/** @brief Largest key of a cached file, sub-FSAL name included */
+#define BCACHE_KEY_MAX 212
+
+/**
+ * @brief What a cached extent was read from
+ */
+
+struct bcache_validator {
+	uint64_t change;
+	struct timespec mtime;
+};
+
+/**
+ * @brief In flight write of a file
+ *
+ * Overlapping writes may reach the sub-FSAL in any order, so their
+ * extents are dropped rather than updated.
+ */
+
+struct bcache_wio {
+	struct glist_head list;
+	uint64_t offset;
+	uint64_t len;
+	bool race;		/*< Overlapped another write */
+};
+
+/** @brief FSAL stats of BCACHE */
+enum bcache_stat_op {
+	BCACHE_STAT_HIT,	/*< Reads served from the cache */
+	BCACHE_STAT_MISS,	/*< Reads that went to the sub-FSAL */
+	BCACHE_STAT_BYTES_SERVED, /*< Bytes read from the cache */
+	BCACHE_STAT_BYTES_FILLED, /*< Bytes written to the cache on a miss */
+	BCACHE_STAT_WRITE_THROUGH, /*< Bytes written to cached extents */
+	BCACHE_STAT_INVALIDATE,	/*< Extents dropped as stale */
+	BCACHE_STAT_EVICT,	/*< Extents evicted for space */
+	BCACHE_STAT_OPS
+};
+
+fsal_status_t bcache_pkginit(void);
+void bcache_pkgshutdown(void);
+void bcache_extract_stats(struct fsal_module *fsal_hdl, void *iter);
+void bcache_reset_stats(struct fsal_module *fsal_hdl);
+void bcache_prepare_for_stats(struct fsal_module *fsal_hdl);
+bool bcache_enabled(void);
+struct bcache_file *bcache_file_get(struct bcache_fsal_obj_handle *hdl,
+				    struct bcache_fsal_export *export);
+void bcache_file_put(struct bcache_fsal_obj_handle *hdl);
+bool bcache_file_usable(struct bcache_fsal_obj_handle *hdl,
+			struct bcache_fsal_export *export,
+			struct bcache_file *file);
+void bcache_file_validate(struct bcache_file *file,
+			  const struct attrlist *attrs);
+void bcache_file_opened(struct bcache_file *file);
+void bcache_file_modified(struct bcache_file *file);
+void bcache_invalidate(struct bcache_file *file, uint64_t offset,
+		       uint64_t len);
+void bcache_invalidate_key(struct bcache_fsal_export *export,
+			   struct gsh_buffdesc *key,
+			   const struct bcache_validator *valid);
+fsal_status_t bcache_read(struct bcache_fsal_obj_handle *hdl,
+			  struct bcache_fsal_export *export,
+			  struct bcache_file *file,
+			  bool bypass,
+			  struct fsal_io_arg *read_arg);
+void bcache_write_start(struct bcache_file *file, struct bcache_wio *wio);
+void bcache_write_done(struct bcache_file *file, struct bcache_wio *wio,
+		       struct fsal_io_arg *write_arg, bool update);
+void bcache_up_ops_init(struct bcache_fsal_export *export,
+			const struct fsal_up_vector *super_up_ops);
+
+/* Multi-FD */
+fsal_status_t bcache_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check);
+bool bcache_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier);
+fsal_openflags_t bcache_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state);
+fsal_status_t bcache_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags);
+void bcache_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg);
+void bcache_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg);
+fsal_status_t bcache_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info);
+fsal_status_t bcache_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints);
+fsal_status_t bcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len);
+fsal_status_t bcache_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock);
+fsal_status_t bcache_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state);
+fsal_status_t bcache_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate);
+
+/* extended attributes management */
+fsal_status_t bcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				    unsigned int cookie,
+				    fsal_xattrent_t *xattrs_tab,
+				    unsigned int xattrs_tabsize,
+				    unsigned int *p_nb_returned,
+				    int *end_of_list);
+fsal_status_t bcache_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					   const char *xattr_name,
+					   unsigned int *pxattr_id);
+fsal_status_t bcache_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					      const char *xattr_name,
+					      void *buffer_addr,
+					      size_t buffer_size,
+					      size_t *p_output_size);
+fsal_status_t bcache_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size,
+					    size_t *p_output_size);
+fsal_status_t bcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
+				      const char *xattr_name,
+				      void *buffer_addr,
+				      size_t buffer_size,
+				      int create);
+fsal_status_t bcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size);
+fsal_status_t bcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id);
+fsal_status_t bcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name);
+
+#endif			/* BCACHE_METHODS_H */
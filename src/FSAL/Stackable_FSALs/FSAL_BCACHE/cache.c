@@ -0,0 +1,1561 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file cache.c
+ * @brief Extent cache of FSAL_BCACHE
+ *
+ * The cache device holds a header, then one index record per extent
+ * slot, then the slots.  A record names the file (by the sub-FSAL name
+ * and handle key), the extent in it and the change and mtime attributes
+ * the data was read at.  Records are written as extents are filled; the
+ * ones made stale by a later change are rewritten at shutdown, and the
+ * index is only trusted at startup if the header says the last shutdown
+ * was clean.
+ *
+ * A read misses on an extent reads the whole extent from the sub-FSAL,
+ * stores it and answers the client from it.  Extents are evicted with
+ * a CLOCK over the slots.  A slot being read from or written to is
+ * pinned, so it can not be reused under the I/O.
+ *
+ * Cached data of a file is only used once the file's validator has
+ * been compared with the sub-FSAL's attributes since it was last
+ * opened.  A mismatch drops the file's extents, except after writes made
+ * through this FSAL, which change the attributes without making the
+ * (updated) extents stale.  Changes made behind our back are expected to
+ * be reported by the sub-FSAL as upcalls.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "city.h"
+#include "nfs_core.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+#include "bcache_methods.h"
+
+#define BCACHE_MAGIC 0x3130484348414342ULL	/* "BCACHE01" */
+#define BCACHE_RECORD_MAGIC 0x3130545845484342ULL	/* "BCHEXT01" */
+#define BCACHE_VERSION 1
+#define BCACHE_HEADER_SIZE 4096
+#define BCACHE_RECORD_EOF 0x1
+
+/**
+ * @brief Header at the start of the cache device
+ */
+
+struct bcache_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t clean;		/*< Index was written by a clean shutdown */
+	uint64_t extent_size;
+	uint64_t nslots;
+};
+
+/**
+ * @brief Index record of a slot
+ */
+
+struct bcache_record {
+	uint64_t magic;		/*< BCACHE_RECORD_MAGIC if the slot is used */
+	uint64_t index;		/*< Extent of the file */
+	uint64_t change;
+	uint64_t mtime_sec;
+	uint32_t mtime_nsec;
+	uint32_t len;		/*< Valid bytes in the slot */
+	uint16_t flags;		/*< BCACHE_RECORD_* */
+	uint16_t key_len;
+	uint8_t key[BCACHE_KEY_MAX];
+};
+
+enum bcache_extent_state {
+	BCACHE_EXT_FREE,
+	BCACHE_EXT_FILLING,	/*< Being read from the sub-FSAL */
+	BCACHE_EXT_VALID,
+	BCACHE_EXT_DEAD,	/*< Dropped while pinned */
+};
+
+/**
+ * @brief A slot of the cache device
+ */
+
+struct bcache_extent {
+	struct glist_head hash;		/*< In bcache.ext_hash */
+	struct glist_head file_list;	/*< In file->extents */
+	struct bcache_file *file;
+	uint64_t index;			/*< Extent of the file */
+	uint32_t len;			/*< Valid bytes */
+	uint32_t pins;			/*< I/O in progress on the slot */
+	uint8_t state;			/*< enum bcache_extent_state */
+	bool eof;			/*< End of file is at len */
+	bool referenced;		/*< CLOCK bit */
+	bool rec_stale;			/*< Record on the device is outdated */
+};
+
+/**
+ * @brief A file with cached extents or an attached handle
+ */
+
+struct bcache_file {
+	struct glist_head hash;		/*< In bcache.file_hash */
+	struct glist_head extents;	/*< Its bcache_extent */
+	struct glist_head writes;	/*< bcache_wio in flight */
+	uint64_t hk;			/*< Hash of key */
+	uint32_t refs;			/*< Handles attached */
+	uint32_t nextents;
+	uint64_t gen;			/*< Bumped by every change to the data,
+					    fills started before are dropped */
+	struct bcache_validator valid;
+	bool have_valid;		/*< valid is known */
+	bool checked;			/*< valid compared since last open */
+	bool modified;			/*< Written through us since */
+	uint16_t key_len;
+	uint8_t key[BCACHE_KEY_MAX];
+};
+
+/**
+ * @brief The cache device and its index, all protected by lock
+ */
+
+static struct bcache_store {
+	pthread_mutex_t lock;
+	int fd;
+	bool enabled;
+	uint32_t extent_size;
+	uint64_t nslots;
+	off_t data_off;			/*< Offset of the first slot */
+	struct bcache_extent *slots;
+	struct glist_head *ext_hash;
+	uint64_t ext_mask;
+	struct glist_head *file_hash;
+	uint64_t file_mask;
+	uint64_t hand;			/*< CLOCK hand */
+} bcache = {
+	.fd = -1,
+};
+
+static struct fsal_op_stats bcache_op_stats[BCACHE_STAT_OPS];
+static struct fsal_stats bcache_stats;
+
+static const char *bcache_stat_names[BCACHE_STAT_OPS] = {
+	[BCACHE_STAT_HIT] = "hit",
+	[BCACHE_STAT_MISS] = "miss",
+	[BCACHE_STAT_BYTES_SERVED] = "bytes_served",
+	[BCACHE_STAT_BYTES_FILLED] = "bytes_filled",
+	[BCACHE_STAT_WRITE_THROUGH] = "bytes_written_through",
+	[BCACHE_STAT_INVALIDATE] = "invalidate",
+	[BCACHE_STAT_EVICT] = "evict",
+};
+
+/**
+ * @brief Count in the FSAL stats
+ *
+ * @param[in] op    BCACHE_STAT_*
+ * @param[in] count Events or bytes to add
+ * @param[in] start Start time, or NULL for an untimed count
+ */
+static void bcache_stat_add(int op, uint64_t count, struct timespec *start)
+{
+	struct fsal_op_stats *stat = &bcache_op_stats[op];
+	struct timespec stop;
+	uint64_t resp_time;
+
+	if (!nfs_param.core_param.enable_FSALSTATS || count == 0)
+		return;
+
+	(void) atomic_add_uint64_t(&stat->num_ops, count);
+	if (start == NULL)
+		return;
+
+	now(&stop);
+	resp_time = timespec_diff(start, &stop);
+	(void) atomic_add_uint64_t(&stat->resp_time, resp_time);
+	if (stat->resp_time_max < resp_time)
+		stat->resp_time_max = resp_time;
+	if (stat->resp_time_min == 0 || stat->resp_time_min > resp_time)
+		stat->resp_time_min = resp_time;
+}
+
+void bcache_prepare_for_stats(struct fsal_module *fsal_hdl)
+{
+	int op;
+
+	bcache_stats.total_ops = BCACHE_STAT_OPS;
+	bcache_stats.op_stats = bcache_op_stats;
+	for (op = 0; op < BCACHE_STAT_OPS; op++)
+		bcache_op_stats[op].op_code = op;
+	fsal_hdl->stats = &bcache_stats;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report FSAL_BCACHE counters for GetFSALStats
+ *
+ * hit and miss count reads, with their latency.  The bytes_* counters
+ * count bytes, and hit_percent is the share of reads served entirely
+ * from the cache.
+ */
+void bcache_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	DBusMessageIter *iter1 = (DBusMessageIter *)iter;
+	const char *message;
+	uint64_t total_ops, hits, reads, op_counter = 0;
+	double res = 0.0;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	message = "BCACHE";
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+
+	dbus_message_iter_open_container(iter1, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < BCACHE_STAT_OPS; i++) {
+		total_ops = atomic_fetch_uint64_t(&bcache_op_stats[i].num_ops);
+		if (total_ops == 0)
+			continue;
+
+		message = bcache_stat_names[i];
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &message);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &total_ops);
+		res = (double)
+		      atomic_fetch_uint64_t(&bcache_op_stats[i].resp_time) *
+		      0.000001 / total_ops;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		res = (double) bcache_op_stats[i].resp_time_min * 0.000001;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		res = (double) bcache_op_stats[i].resp_time_max * 0.000001;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		op_counter += total_ops;
+	}
+	hits = atomic_fetch_uint64_t(&bcache_op_stats[BCACHE_STAT_HIT].num_ops);
+	reads = hits +
+		atomic_fetch_uint64_t(&bcache_op_stats[BCACHE_STAT_MISS].num_ops);
+	if (reads != 0) {
+		message = "hit_percent";
+		total_ops = hits * 100 / reads;
+		res = 0.0;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &message);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &total_ops);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+	}
+	if (op_counter == 0) {
+		message = "None";
+		res = 0.0;
+		/* insert dummy stats to avoid dbus crash */
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &message);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &op_counter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &res);
+	} else {
+		message = "OK";
+	}
+	dbus_message_iter_close_container(iter1, &struct_iter);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+}
+#endif /* USE_DBUS */
+
+void bcache_reset_stats(struct fsal_module *fsal_hdl)
+{
+	int i;
+
+	for (i = 0; i < BCACHE_STAT_OPS; i++) {
+		atomic_store_uint64_t(&bcache_op_stats[i].num_ops, 0);
+		atomic_store_uint64_t(&bcache_op_stats[i].resp_time, 0);
+		atomic_store_uint64_t(&bcache_op_stats[i].resp_time_min, 0);
+		atomic_store_uint64_t(&bcache_op_stats[i].resp_time_max, 0);
+	}
+}
+
+bool bcache_enabled(void)
+{
+	return bcache.enabled;
+}
+
+/* Device layout and I/O */
+
+static inline off_t bcache_record_off(uint64_t slot)
+{
+	return BCACHE_HEADER_SIZE + slot * sizeof(struct bcache_record);
+}
+
+static inline uint64_t bcache_slot(struct bcache_extent *ext)
+{
+	return ext - bcache.slots;
+}
+
+static inline off_t bcache_data_off(struct bcache_extent *ext)
+{
+	return bcache.data_off + (off_t) bcache_slot(ext) * bcache.extent_size;
+}
+
+/**
+ * @brief Read or write the cache device
+ *
+ * @param[in] write	Write rather than read
+ * @param[in,out] iov	Buffers, consumed
+ * @param[in] iovcnt	Number of buffers
+ * @param[in] off	Device offset
+ *
+ * @return 0 or -errno.
+ */
+static int bcache_dev_io(bool write, struct iovec *iov, int iovcnt, off_t off)
+{
+	ssize_t n;
+
+	while (iovcnt > 0) {
+		if (write)
+			n = pwritev(bcache.fd, iov, iovcnt, off);
+		else
+			n = preadv(bcache.fd, iov, iovcnt, off);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0)
+			return -EIO;
+
+		off += n;
+		while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return 0;
+}
+
+static int bcache_dev_pio(bool write, void *buf, size_t len, off_t off)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+
+	return bcache_dev_io(write, &iov, 1, off);
+}
+
+/**
+ * @brief Describe a range of an I/O vector
+ *
+ * @param[in] iov	Vector
+ * @param[in] iovcnt	Its length
+ * @param[in] pos	Start of the range in the vector
+ * @param[in] len	Length of the range
+ * @param[out] out	Range, room for iovcnt entries
+ *
+ * @return Entries of out used.
+ */
+static int bcache_iov_slice(const struct iovec *iov, int iovcnt, size_t pos,
+			    size_t len, struct iovec *out)
+{
+	int i, n = 0;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (pos >= iov[i].iov_len) {
+			pos -= iov[i].iov_len;
+			continue;
+		}
+		out[n].iov_base = (char *) iov[i].iov_base + pos;
+		out[n].iov_len = MIN(iov[i].iov_len - pos, len);
+		len -= out[n].iov_len;
+		pos = 0;
+		n++;
+	}
+
+	return n;
+}
+
+static void bcache_iov_copy(const struct iovec *iov, int iovcnt, size_t pos,
+			    const char *src, size_t len)
+{
+	int i;
+	size_t n;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (pos >= iov[i].iov_len) {
+			pos -= iov[i].iov_len;
+			continue;
+		}
+		n = MIN(iov[i].iov_len - pos, len);
+		memcpy((char *) iov[i].iov_base + pos, src, n);
+		src += n;
+		len -= n;
+		pos = 0;
+	}
+}
+
+/* Index, called with bcache.lock held */
+
+static inline bool bcache_valid_eq(const struct bcache_validator *a,
+				   const struct bcache_validator *b)
+{
+	return a->change == b->change &&
+	       a->mtime.tv_sec == b->mtime.tv_sec &&
+	       a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+static inline struct glist_head *bcache_ext_bucket(struct bcache_file *file,
+						   uint64_t index)
+{
+	return &bcache.ext_hash[(file->hk ^ (index * 0x9e3779b97f4a7c15ULL))
+				& bcache.ext_mask];
+}
+
+static struct bcache_extent *bcache_extent_find(struct bcache_file *file,
+						uint64_t index)
+{
+	struct glist_head *node;
+	struct bcache_extent *ext;
+
+	glist_for_each(node, bcache_ext_bucket(file, index)) {
+		ext = glist_entry(node, struct bcache_extent, hash);
+		if (ext->file == file && ext->index == index)
+			return ext;
+	}
+
+	return NULL;
+}
+
+static struct bcache_file *bcache_file_lookup(const uint8_t *key,
+					      uint16_t key_len, bool create)
+{
+	uint64_t hk = CityHash64((const char *) key, key_len);
+	struct glist_head *bucket = &bcache.file_hash[hk & bcache.file_mask];
+	struct glist_head *node;
+	struct bcache_file *file;
+
+	glist_for_each(node, bucket) {
+		file = glist_entry(node, struct bcache_file, hash);
+		if (file->hk == hk && file->key_len == key_len &&
+		    memcmp(file->key, key, key_len) == 0)
+			return file;
+	}
+
+	if (!create)
+		return NULL;
+
+	file = gsh_calloc(1, sizeof(*file));
+	glist_init(&file->extents);
+	glist_init(&file->writes);
+	file->hk = hk;
+	file->key_len = key_len;
+	memcpy(file->key, key, key_len);
+	glist_add_tail(bucket, &file->hash);
+
+	return file;
+}
+
+static void bcache_file_maybe_free(struct bcache_file *file)
+{
+	if (file->refs != 0 || file->nextents != 0 ||
+	    !glist_empty(&file->writes))
+		return;
+
+	glist_del(&file->hash);
+	gsh_free(file);
+}
+
+static void bcache_extent_link(struct bcache_extent *ext,
+			       struct bcache_file *file, uint64_t index)
+{
+	ext->file = file;
+	ext->index = index;
+	glist_add_tail(bcache_ext_bucket(file, index), &ext->hash);
+	glist_add_tail(&file->extents, &ext->file_list);
+	file->nextents++;
+}
+
+/* The slot's record no longer describes it; this may free the file */
+static void bcache_extent_unlink(struct bcache_extent *ext)
+{
+	struct bcache_file *file = ext->file;
+
+	glist_del(&ext->hash);
+	glist_del(&ext->file_list);
+	ext->file = NULL;
+	ext->rec_stale = true;
+	file->nextents--;
+	bcache_file_maybe_free(file);
+}
+
+static void bcache_extent_drop(struct bcache_extent *ext)
+{
+	bcache_extent_unlink(ext);
+	ext->state = ext->pins != 0 ? BCACHE_EXT_DEAD : BCACHE_EXT_FREE;
+	bcache_stat_add(BCACHE_STAT_INVALIDATE, 1, NULL);
+}
+
+static void bcache_extent_unpin(struct bcache_extent *ext)
+{
+	if (--ext->pins == 0 && ext->state == BCACHE_EXT_DEAD)
+		ext->state = BCACHE_EXT_FREE;
+}
+
+/**
+ * @brief Take a slot for an extent, evicting if needed
+ *
+ * @return The slot, FILLING and pinned, or NULL if all are busy.
+ */
+static struct bcache_extent *bcache_extent_alloc(struct bcache_file *file,
+						 uint64_t index)
+{
+	struct bcache_extent *ext;
+	uint64_t scanned;
+
+	for (scanned = 0; scanned < 2 * bcache.nslots; scanned++) {
+		ext = &bcache.slots[bcache.hand];
+		bcache.hand = (bcache.hand + 1) % bcache.nslots;
+
+		if (ext->state == BCACHE_EXT_FREE)
+			goto found;
+		if (ext->state != BCACHE_EXT_VALID || ext->pins != 0)
+			continue;
+		if (ext->referenced) {
+			ext->referenced = false;
+			continue;
+		}
+		bcache_extent_unlink(ext);
+		bcache_stat_add(BCACHE_STAT_EVICT, 1, NULL);
+		goto found;
+	}
+
+	return NULL;
+
+found:
+	ext->len = 0;
+	ext->eof = false;
+	ext->referenced = true;
+	ext->state = BCACHE_EXT_FILLING;
+	ext->pins = 1;
+	bcache_extent_link(ext, file, index);
+
+	return ext;
+}
+
+/**
+ * @brief Drop the extents of a file in a range
+ *
+ * Fills in progress are abandoned as well.
+ */
+static void bcache_file_drop(struct bcache_file *file, uint64_t offset,
+			     uint64_t len)
+{
+	struct glist_head *node, *noden;
+	struct bcache_extent *ext;
+	uint64_t first, last, index;
+
+	file->gen++;
+	if (len == 0 || file->nextents == 0)
+		return;
+
+	first = offset / bcache.extent_size;
+	if (len > UINT64_MAX - offset)
+		last = UINT64_MAX / bcache.extent_size;
+	else
+		last = (offset + len - 1) / bcache.extent_size;
+
+	/* Dropping the last extent must not free the file under us */
+	file->refs++;
+
+	if (last - first < file->nextents) {
+		for (index = first; index <= last; index++) {
+			ext = bcache_extent_find(file, index);
+			if (ext != NULL)
+				bcache_extent_drop(ext);
+		}
+	} else {
+		glist_for_each_safe(node, noden, &file->extents) {
+			ext = glist_entry(node, struct bcache_extent,
+					  file_list);
+			if (ext->index >= first && ext->index <= last)
+				bcache_extent_drop(ext);
+		}
+	}
+
+	file->refs--;
+	bcache_file_maybe_free(file);
+}
+
+static void bcache_record_fill(struct bcache_extent *ext,
+			       const struct bcache_validator *valid,
+			       struct bcache_record *rec)
+{
+	struct bcache_file *file = ext->file;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->magic = BCACHE_RECORD_MAGIC;
+	rec->index = ext->index;
+	rec->change = valid->change;
+	rec->mtime_sec = valid->mtime.tv_sec;
+	rec->mtime_nsec = valid->mtime.tv_nsec;
+	rec->len = ext->len;
+	rec->flags = ext->eof ? BCACHE_RECORD_EOF : 0;
+	rec->key_len = file->key_len;
+	memcpy(rec->key, file->key, file->key_len);
+}
+
+/* Files */
+
+static bool bcache_make_key(struct bcache_fsal_export *export,
+			    const struct gsh_buffdesc *sub_key,
+			    uint8_t *key, uint16_t *key_len)
+{
+	const char *name = export->export.sub_export->fsal->name;
+	size_t name_len = strlen(name) + 1;
+
+	if (name_len + sub_key->len > BCACHE_KEY_MAX)
+		return false;
+
+	memcpy(key, name, name_len);
+	memcpy(key + name_len, sub_key->addr, sub_key->len);
+	*key_len = name_len + sub_key->len;
+
+	return true;
+}
+
+/**
+ * @brief Find the cached file of a handle, attaching it on first use
+ *
+ * @return The file, or NULL if the handle is not cached.
+ */
+struct bcache_file *bcache_file_get(struct bcache_fsal_obj_handle *hdl,
+				    struct bcache_fsal_export *export)
+{
+	struct bcache_file *file;
+	struct gsh_buffdesc sub_key;
+	uint8_t key[BCACHE_KEY_MAX];
+	uint16_t key_len;
+
+	if (!bcache.enabled || hdl->obj_handle.type != REGULAR_FILE)
+		return NULL;
+
+	file = atomic_fetch_voidptr((void **) &hdl->file);
+	if (file != NULL)
+		return file;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	hdl->sub_handle->obj_ops->handle_to_key(hdl->sub_handle, &sub_key);
+	op_ctx->fsal_export = &export->export;
+
+	if (!bcache_make_key(export, &sub_key, key, &key_len))
+		return NULL;
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	if (hdl->file == NULL) {
+		file = bcache_file_lookup(key, key_len, true);
+		file->refs++;
+		file->checked = false;
+		atomic_store_voidptr((void **) &hdl->file, file);
+	}
+	file = hdl->file;
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+
+	return file;
+}
+
+void bcache_file_put(struct bcache_fsal_obj_handle *hdl)
+{
+	struct bcache_file *file = hdl->file;
+
+	if (file == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	hdl->file = NULL;
+	file->refs--;
+	bcache_file_maybe_free(file);
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+/**
+ * @brief Compare a file's validator with new attributes
+ *
+ * Attributes without both change and mtime are ignored.
+ */
+void bcache_file_validate(struct bcache_file *file,
+			  const struct attrlist *attrs)
+{
+	struct bcache_validator valid;
+	struct glist_head *node;
+
+	if (!FSAL_TEST_MASK(attrs->valid_mask, ATTR_CHANGE) ||
+	    !FSAL_TEST_MASK(attrs->valid_mask, ATTR_MTIME))
+		return;
+
+	valid.change = attrs->change;
+	valid.mtime = attrs->mtime;
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	if (file->have_valid && !bcache_valid_eq(&file->valid, &valid)) {
+		if (file->modified) {
+			/* Our own writes, the extents were kept up to date */
+			glist_for_each(node, &file->extents)
+				glist_entry(node, struct bcache_extent,
+					    file_list)->rec_stale = true;
+		} else {
+			LogFullDebug(COMPONENT_FSAL,
+				     "Dropping %" PRIu32 " stale extents",
+				     file->nextents);
+			bcache_file_drop(file, 0, UINT64_MAX);
+		}
+	}
+	file->valid = valid;
+	file->have_valid = true;
+	file->checked = true;
+	file->modified = false;
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+/**
+ * @brief Check a file's validator if it was not since it was opened
+ *
+ * @return Whether the cached data of the file may be used.
+ */
+bool bcache_file_usable(struct bcache_fsal_obj_handle *hdl,
+			struct bcache_fsal_export *export,
+			struct bcache_file *file)
+{
+	struct attrlist attrs;
+	fsal_status_t status;
+
+	/* A stale false only costs a getattrs */
+	if (file->checked)
+		return true;
+
+	fsal_prepare_attrs(&attrs, ATTR_CHANGE | ATTR_MTIME);
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status = hdl->sub_handle->obj_ops->getattrs(hdl->sub_handle, &attrs);
+	op_ctx->fsal_export = &export->export;
+
+	if (!FSAL_IS_ERROR(status))
+		bcache_file_validate(file, &attrs);
+
+	fsal_release_attrs(&attrs);
+
+	/* Without a validator, every read goes to the sub-FSAL */
+	return file->checked;
+}
+
+/* Close-to-open: check the validator again before the next read */
+void bcache_file_opened(struct bcache_file *file)
+{
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	file->checked = false;
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+/* Attributes were changed through us */
+void bcache_file_modified(struct bcache_file *file)
+{
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	file->modified = true;
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+void bcache_invalidate(struct bcache_file *file, uint64_t offset,
+		       uint64_t len)
+{
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	bcache_file_drop(file, offset, len);
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+/**
+ * @brief Drop a file on an upcall
+ *
+ * @param[in] export	Our export
+ * @param[in] key	Sub-FSAL key of the file
+ * @param[in] valid	New validator, if known; the file is kept if it
+ *			matches
+ */
+void bcache_invalidate_key(struct bcache_fsal_export *export,
+			   struct gsh_buffdesc *key,
+			   const struct bcache_validator *valid)
+{
+	uint8_t fkey[BCACHE_KEY_MAX];
+	uint16_t fkey_len;
+	struct bcache_file *file;
+
+	if (!bcache.enabled || !bcache_make_key(export, key, fkey, &fkey_len))
+		return;
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	file = bcache_file_lookup(fkey, fkey_len, false);
+	if (file != NULL &&
+	    !(valid != NULL && file->have_valid &&
+	      bcache_valid_eq(&file->valid, valid))) {
+		file->checked = false;
+		bcache_file_drop(file, 0, UINT64_MAX);
+	}
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+/* Reads */
+
+struct bcache_sync_arg {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool done;
+	fsal_status_t status;
+};
+
+static void bcache_sync_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			   void *obj_data, void *caller_data)
+{
+	struct bcache_sync_arg *sync = caller_data;
+
+	PTHREAD_MUTEX_lock(&sync->mutex);
+	sync->status = ret;
+	sync->done = true;
+	pthread_cond_signal(&sync->cond);
+	PTHREAD_MUTEX_unlock(&sync->mutex);
+}
+
+/**
+ * @brief Read from the sub-FSAL and wait for it
+ */
+static fsal_status_t bcache_sub_read(struct bcache_fsal_obj_handle *hdl,
+				     struct bcache_fsal_export *export,
+				     bool bypass, struct state_t *state,
+				     uint64_t offset, const struct iovec *iov,
+				     int iovcnt, size_t *got, bool *eof)
+{
+	struct fsal_io_arg *read_arg;
+	struct bcache_sync_arg sync;
+
+	read_arg = gsh_calloc(1, sizeof(*read_arg) +
+				 iovcnt * sizeof(struct iovec));
+	read_arg->state = state;
+	read_arg->offset = offset;
+	read_arg->iov_count = iovcnt;
+	memcpy(read_arg->iov, iov, iovcnt * sizeof(struct iovec));
+
+	PTHREAD_MUTEX_init(&sync.mutex, NULL);
+	PTHREAD_COND_init(&sync.cond, NULL);
+	sync.done = false;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	hdl->sub_handle->obj_ops->read2(hdl->sub_handle, bypass,
+					bcache_sync_cb, read_arg, &sync);
+	op_ctx->fsal_export = &export->export;
+
+	PTHREAD_MUTEX_lock(&sync.mutex);
+	while (!sync.done)
+		pthread_cond_wait(&sync.cond, &sync.mutex);
+	PTHREAD_MUTEX_unlock(&sync.mutex);
+
+	*got = read_arg->io_amount;
+	*eof = read_arg->end_of_file;
+
+	PTHREAD_MUTEX_destroy(&sync.mutex);
+	PTHREAD_COND_destroy(&sync.cond);
+	gsh_free(read_arg);
+
+	return sync.status;
+}
+
+/**
+ * @brief Fill a slot from the sub-FSAL
+ *
+ * @param[in] ext	Slot, FILLING and pinned; unpinned on return
+ * @param[in] gen	File generation the slot was taken at
+ * @param[in] valid	File validator the slot was taken at
+ * @param[in] buf	Buffer of an extent size, holds the data on return
+ * @param[out] got	Bytes read
+ * @param[out] eof	End of file was reached
+ */
+static fsal_status_t bcache_fill(struct bcache_fsal_obj_handle *hdl,
+				 struct bcache_fsal_export *export,
+				 struct bcache_file *file,
+				 struct bcache_extent *ext, uint64_t gen,
+				 const struct bcache_validator *valid,
+				 bool bypass, struct state_t *state,
+				 char *buf, size_t *got, bool *eof)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = bcache.extent_size,
+	};
+	struct bcache_record rec;
+	fsal_status_t status;
+	int rc = -1;
+
+	status = bcache_sub_read(hdl, export, bypass, state,
+				 ext->index * bcache.extent_size, &iov, 1,
+				 got, eof);
+
+	if (!FSAL_IS_ERROR(status) && *got > 0) {
+		/* Nobody else touches a FILLING slot */
+		ext->len = *got;
+		ext->eof = *eof;
+		rc = bcache_dev_pio(true, buf, *got, bcache_data_off(ext));
+		if (rc == 0) {
+			bcache_record_fill(ext, valid, &rec);
+			rc = bcache_dev_pio(true, &rec, sizeof(rec),
+					    bcache_record_off(bcache_slot(ext)));
+		}
+		if (rc != 0)
+			LogWarn(COMPONENT_FSAL,
+				"BCACHE: could not write to %s: %s",
+				BCACHE.cache_path, strerror(-rc));
+	}
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	if (ext->state == BCACHE_EXT_FILLING) {
+		if (rc == 0 && file->gen == gen) {
+			ext->state = BCACHE_EXT_VALID;
+			ext->rec_stale = !bcache_valid_eq(&file->valid, valid);
+			bcache_stat_add(BCACHE_STAT_BYTES_FILLED, *got, NULL);
+		} else {
+			bcache_extent_unlink(ext);
+			ext->state = BCACHE_EXT_DEAD;
+		}
+	}
+	bcache_extent_unpin(ext);
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+
+	return status;
+}
+
+/**
+ * @brief Read a file through the cache
+ *
+ * Extents present are read from the cache device, missing ones are
+ * read whole from the sub-FSAL and stored.  An extent another thread is
+ * filling, or for which no slot is free, is read from the sub-FSAL
+ * directly.  The caller has checked the file's validator.
+ *
+ * @param[in] hdl	Handle
+ * @param[in] export	Our export
+ * @param[in] file	Cached file of the handle
+ * @param[in] bypass	Bypass share reservations
+ * @param[in,out] read_arg Read, io_amount and end_of_file set
+ *
+ * @return FSAL status.
+ */
+fsal_status_t bcache_read(struct bcache_fsal_obj_handle *hdl,
+			  struct bcache_fsal_export *export,
+			  struct bcache_file *file,
+			  bool bypass,
+			  struct fsal_io_arg *read_arg)
+{
+	uint32_t es = bcache.extent_size;
+	uint64_t offset = read_arg->offset, index, eoff, gen;
+	size_t total = 0, pos = 0, n, m, got;
+	struct bcache_validator valid;
+	struct bcache_extent *ext;
+	enum bcache_extent_state state;
+	struct iovec *slice;
+	struct timespec start;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	uint32_t ext_len;
+	bool eof = false, hit = true, ext_eof, sub_eof;
+	char *buf = NULL;
+	int i, cnt, rc;
+
+	now(&start);
+
+	for (i = 0; i < read_arg->iov_count; i++)
+		total += read_arg->iov[i].iov_len;
+
+	slice = gsh_malloc((read_arg->iov_count + 1) * sizeof(*slice));
+
+	while (pos < total) {
+		index = (offset + pos) / es;
+		eoff = (offset + pos) % es;
+		n = MIN(es - eoff, total - pos);
+
+		PTHREAD_MUTEX_lock(&bcache.lock);
+		ext = bcache_extent_find(file, index);
+		if (ext == NULL) {
+			ext = bcache_extent_alloc(file, index);
+		} else if (ext->state == BCACHE_EXT_VALID) {
+			ext->pins++;
+			ext->referenced = true;
+		} else {
+			/* Another reader is filling it */
+			ext = NULL;
+		}
+		state = ext != NULL ? ext->state : BCACHE_EXT_FREE;
+		ext_len = ext != NULL ? ext->len : 0;
+		ext_eof = ext != NULL && ext->eof;
+		gen = file->gen;
+		valid = file->valid;
+		PTHREAD_MUTEX_unlock(&bcache.lock);
+
+		if (state == BCACHE_EXT_VALID) {
+			/* A short extent without EOF can not answer past
+			 * its end
+			 */
+			rc = -1;
+			if (eoff < ext_len || ext_eof) {
+				m = eoff < ext_len ? MIN(n, ext_len - eoff) : 0;
+				cnt = bcache_iov_slice(read_arg->iov,
+						       read_arg->iov_count,
+						       pos, m, slice);
+				rc = bcache_dev_io(false, slice, cnt,
+						   bcache_data_off(ext) + eoff);
+				if (rc != 0)
+					LogWarn(COMPONENT_FSAL,
+						"BCACHE: could not read %s: %s",
+						BCACHE.cache_path,
+						strerror(-rc));
+			}
+
+			PTHREAD_MUTEX_lock(&bcache.lock);
+			if (rc != 0 && ext->state == BCACHE_EXT_VALID)
+				bcache_extent_drop(ext);
+			bcache_extent_unpin(ext);
+			PTHREAD_MUTEX_unlock(&bcache.lock);
+
+			if (rc == 0) {
+				pos += m;
+				bcache_stat_add(BCACHE_STAT_BYTES_SERVED, m,
+						NULL);
+				if (m < n) {
+					eof = ext_eof;
+					break;
+				}
+				continue;
+			}
+			/* Read it from the sub-FSAL */
+			ext = NULL;
+			state = BCACHE_EXT_FREE;
+		}
+
+		hit = false;
+
+		if (state == BCACHE_EXT_FILLING) {
+			if (buf == NULL)
+				buf = gsh_malloc(es);
+			status = bcache_fill(hdl, export, file, ext, gen,
+					     &valid, bypass, read_arg->state,
+					     buf, &got, &sub_eof);
+			if (FSAL_IS_ERROR(status))
+				break;
+			m = eoff < got ? MIN(n, got - eoff) : 0;
+			bcache_iov_copy(read_arg->iov, read_arg->iov_count,
+					pos, buf + eoff, m);
+		} else {
+			cnt = bcache_iov_slice(read_arg->iov,
+					       read_arg->iov_count, pos, n,
+					       slice);
+			status = bcache_sub_read(hdl, export, bypass,
+						 read_arg->state,
+						 offset + pos, slice, cnt,
+						 &got, &sub_eof);
+			if (FSAL_IS_ERROR(status))
+				break;
+			m = MIN(n, got);
+		}
+
+		pos += m;
+		if (m < n) {
+			/* A short read ends the request */
+			eof = sub_eof;
+			break;
+		}
+	}
+
+	gsh_free(buf);
+	gsh_free(slice);
+
+	read_arg->io_amount = pos;
+	read_arg->end_of_file = eof;
+
+	if (!FSAL_IS_ERROR(status))
+		bcache_stat_add(hit ? BCACHE_STAT_HIT : BCACHE_STAT_MISS, 1,
+				&start);
+
+	return status;
+}
+
+/* Writes */
+
+void bcache_write_start(struct bcache_file *file, struct bcache_wio *wio)
+{
+	struct glist_head *node;
+	struct bcache_wio *other;
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	glist_for_each(node, &file->writes) {
+		other = glist_entry(node, struct bcache_wio, list);
+		if (other->offset < wio->offset + wio->len &&
+		    wio->offset < other->offset + other->len) {
+			other->race = true;
+			wio->race = true;
+		}
+	}
+	glist_add_tail(&file->writes, &wio->list);
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+}
+
+/**
+ * @brief Bring the cache up to date after a write
+ *
+ * Cached extents covered by a successful write are updated in place
+ * when @a update is set and no overlapping write was in flight with
+ * it; otherwise they are dropped.
+ *
+ * @param[in] file	Cached file
+ * @param[in] wio	The write, from bcache_write_start()
+ * @param[in] write_arg	The write, NULL if it failed
+ * @param[in] update	Write through to the cache
+ */
+void bcache_write_done(struct bcache_file *file, struct bcache_wio *wio,
+		       struct fsal_io_arg *write_arg, bool update)
+{
+	uint32_t es = bcache.extent_size;
+	struct bcache_extent **exts;
+	struct iovec *slice;
+	uint64_t first, last, index, eoff, len;
+	size_t pos, m;
+	uint32_t count = 0, i;
+	int cnt, rc;
+
+	PTHREAD_MUTEX_lock(&bcache.lock);
+	glist_del(&wio->list);
+	file->modified = true;
+
+	if (write_arg == NULL || !update || wio->race ||
+	    write_arg->io_amount == 0) {
+		bcache_file_drop(file, wio->offset, wio->len);
+		PTHREAD_MUTEX_unlock(&bcache.lock);
+		return;
+	}
+
+	len = write_arg->io_amount;
+	first = wio->offset / es;
+	last = (wio->offset + len - 1) / es;
+	exts = gsh_calloc(last - first + 1, sizeof(*exts));
+
+	for (index = first; index <= last; index++) {
+		struct bcache_extent *ext = bcache_extent_find(file, index);
+
+		if (ext == NULL)
+			continue;
+
+		eoff = index == first ? wio->offset % es : 0;
+		m = MIN(es - eoff, wio->offset + len - index * es - eoff);
+
+		/* The new data must join the valid bytes, and may only
+		 * extend them at end of file.
+		 */
+		if (ext->state != BCACHE_EXT_VALID || eoff > ext->len ||
+		    (eoff + m > ext->len && !ext->eof)) {
+			if (ext->state == BCACHE_EXT_VALID ||
+			    ext->state == BCACHE_EXT_FILLING)
+				bcache_extent_drop(ext);
+			continue;
+		}
+		ext->pins++;
+		exts[count++] = ext;
+	}
+
+	/* Fills in progress may have read the old data */
+	file->gen++;
+	PTHREAD_MUTEX_unlock(&bcache.lock);
+
+	slice = gsh_malloc((write_arg->iov_count + 1) * sizeof(*slice));
+
+	for (i = 0; i < count; i++) {
+		struct bcache_extent *ext = exts[i];
+
+		index = ext->index;
+		eoff = index == first ? wio->offset % es : 0;
+		pos = index * es + eoff - wio->offset;
+		m = MIN(es - eoff, len - pos);
+
+		cnt = bcache_iov_slice(write_arg->iov, write_arg->iov_count,
+				       pos, m, slice);
+		rc = bcache_dev_io(true, slice, cnt,
+				   bcache_data_off(ext) + eoff);
+		if (rc != 0)
+			LogWarn(COMPONENT_FSAL,
+				"BCACHE: could not write to %s: %s",
+				BCACHE.cache_path, strerror(-rc));
+
+		PTHREAD_MUTEX_lock(&bcache.lock);
+		if (ext->state == BCACHE_EXT_VALID) {
+			if (rc != 0) {
+				bcache_extent_drop(ext);
+			} else {
+				if (eoff + m > ext->len) {
+					ext->len = eoff + m;
+					ext->rec_stale = true;
+				}
+				if (index != last && ext->eof) {
+					/* The file goes on past it now */
+					ext->eof = false;
+					ext->rec_stale = true;
+				}
+				bcache_stat_add(BCACHE_STAT_WRITE_THROUGH, m,
+						NULL);
+			}
+		}
+		bcache_extent_unpin(ext);
+		PTHREAD_MUTEX_unlock(&bcache.lock);
+	}
+
+	gsh_free(slice);
+	gsh_free(exts);
+}
+
+/* Startup and shutdown */
+
+static void bcache_free_index(void)
+{
+	struct glist_head *node, *noden;
+	uint64_t i;
+
+	if (bcache.file_hash != NULL) {
+		for (i = 0; i <= bcache.file_mask; i++) {
+			glist_for_each_safe(node, noden, &bcache.file_hash[i]) {
+				glist_del(node);
+				gsh_free(glist_entry(node, struct bcache_file,
+						     hash));
+			}
+		}
+	}
+
+	gsh_free(bcache.file_hash);
+	gsh_free(bcache.ext_hash);
+	gsh_free(bcache.slots);
+	bcache.file_hash = NULL;
+	bcache.ext_hash = NULL;
+	bcache.slots = NULL;
+}
+
+static int bcache_write_header(bool clean)
+{
+	struct bcache_header *hdr = gsh_calloc(1, BCACHE_HEADER_SIZE);
+	int rc;
+
+	hdr->magic = BCACHE_MAGIC;
+	hdr->version = BCACHE_VERSION;
+	hdr->clean = clean;
+	hdr->extent_size = bcache.extent_size;
+	hdr->nslots = bcache.nslots;
+
+	rc = bcache_dev_pio(true, hdr, BCACHE_HEADER_SIZE, 0);
+	if (rc == 0 && fdatasync(bcache.fd) != 0)
+		rc = -errno;
+
+	gsh_free(hdr);
+	return rc;
+}
+
+/* Forget the index on the device */
+static int bcache_format(void)
+{
+	size_t chunk = 1024 * 1024;
+	off_t off = bcache_record_off(0), end = bcache_record_off(bcache.nslots);
+	char *zero = gsh_calloc(1, chunk);
+	int rc = 0;
+
+	LogEvent(COMPONENT_FSAL, "BCACHE: formatting %s", BCACHE.cache_path);
+
+	while (off < end && rc == 0) {
+		rc = bcache_dev_pio(true, zero, MIN(chunk, end - off), off);
+		off += chunk;
+	}
+
+	gsh_free(zero);
+	return rc;
+}
+
+static void bcache_load_record(uint64_t slot, struct bcache_record *rec)
+{
+	struct bcache_extent *ext = &bcache.slots[slot];
+	struct bcache_validator valid;
+	struct bcache_file *file;
+
+	if (rec->magic != BCACHE_RECORD_MAGIC)
+		return;
+
+	if (rec->key_len > BCACHE_KEY_MAX || rec->len == 0 ||
+	    rec->len > bcache.extent_size)
+		goto stale;
+
+	valid.change = rec->change;
+	valid.mtime.tv_sec = rec->mtime_sec;
+	valid.mtime.tv_nsec = rec->mtime_nsec;
+
+	file = bcache_file_lookup(rec->key, rec->key_len, true);
+	if (!file->have_valid) {
+		file->valid = valid;
+		file->have_valid = true;
+	} else if (!bcache_valid_eq(&file->valid, &valid) ||
+		   bcache_extent_find(file, rec->index) != NULL) {
+		bcache_file_maybe_free(file);
+		goto stale;
+	}
+
+	ext->len = rec->len;
+	ext->eof = rec->flags & BCACHE_RECORD_EOF;
+	ext->state = BCACHE_EXT_VALID;
+	bcache_extent_link(ext, file, rec->index);
+	return;
+
+stale:
+	ext->rec_stale = true;
+}
+
+/* Rebuild the index from the device, if it was shut down cleanly */
+static int bcache_load(void)
+{
+	struct bcache_header hdr;
+	struct bcache_record *recs;
+	size_t chunk = 4096, n;
+	uint64_t slot, i, loaded = 0;
+	int rc;
+
+	rc = bcache_dev_pio(false, &hdr, sizeof(hdr), 0);
+	if (rc != 0)
+		return rc;
+
+	if (hdr.magic != BCACHE_MAGIC || hdr.version != BCACHE_VERSION ||
+	    hdr.extent_size != bcache.extent_size ||
+	    hdr.nslots != bcache.nslots || !hdr.clean)
+		return bcache_format();
+
+	recs = gsh_malloc(chunk * sizeof(*recs));
+
+	for (slot = 0; slot < bcache.nslots; slot += n) {
+		n = MIN(chunk, bcache.nslots - slot);
+		rc = bcache_dev_pio(false, recs, n * sizeof(*recs),
+				    bcache_record_off(slot));
+		if (rc != 0)
+			break;
+		for (i = 0; i < n; i++)
+			bcache_load_record(slot + i, &recs[i]);
+	}
+
+	gsh_free(recs);
+
+	if (rc != 0)
+		return rc;
+
+	for (slot = 0; slot < bcache.nslots; slot++)
+		if (bcache.slots[slot].state == BCACHE_EXT_VALID)
+			loaded++;
+
+	LogEvent(COMPONENT_FSAL, "BCACHE: %" PRIu64 " extents loaded from %s",
+		 loaded, BCACHE.cache_path);
+
+	return 0;
+}
+
+static uint64_t bcache_pow2(uint64_t n)
+{
+	uint64_t p = 64;
+
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+/**
+ * @brief Open the cache device and load its index
+ *
+ * Called once the BCACHE block is parsed.
+ */
+fsal_status_t bcache_pkginit(void)
+{
+	struct stat st;
+	uint64_t size, nslots, i;
+	int fd, rc;
+
+	if (bcache.enabled)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (BCACHE.cache_path == NULL) {
+		LogCrit(COMPONENT_FSAL, "BCACHE: Cache_Path is not set");
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	}
+
+	fd = open(BCACHE.cache_path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_FSAL, "BCACHE: could not open %s: %s",
+			BCACHE.cache_path, strerror(rc));
+		if (fd >= 0)
+			close(fd);
+		return fsalstat(posix2fsal_error(rc), rc);
+	}
+
+	if (S_ISREG(st.st_mode) && BCACHE.cache_size > (uint64_t) st.st_size &&
+	    ftruncate(fd, BCACHE.cache_size) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_FSAL, "BCACHE: could not size %s: %s",
+			BCACHE.cache_path, strerror(rc));
+		close(fd);
+		return fsalstat(posix2fsal_error(rc), rc);
+	}
+
+	/* Also the size of a block device */
+	size = lseek(fd, 0, SEEK_END);
+	if (BCACHE.cache_size != 0 && BCACHE.cache_size < size)
+		size = BCACHE.cache_size;
+
+	bcache.fd = fd;
+	bcache.extent_size = BCACHE.extent_size - BCACHE.extent_size % 4096;
+
+	/* Slots start on a page after the index */
+	nslots = size > BCACHE_HEADER_SIZE
+		? (size - BCACHE_HEADER_SIZE) /
+		  (bcache.extent_size + sizeof(struct bcache_record))
+		: 0;
+	while (nslots > 0) {
+		bcache.data_off = bcache_record_off(nslots);
+		bcache.data_off = (bcache.data_off + 4095) & ~((off_t) 4095);
+		if (bcache.data_off + nslots * bcache.extent_size <= size)
+			break;
+		nslots--;
+	}
+
+	if (nslots == 0) {
+		LogCrit(COMPONENT_FSAL,
+			"BCACHE: %s is too small for an extent of %" PRIu32,
+			BCACHE.cache_path, bcache.extent_size);
+		close(fd);
+		bcache.fd = -1;
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	}
+
+	bcache.nslots = nslots;
+	bcache.slots = gsh_calloc(nslots, sizeof(*bcache.slots));
+	bcache.ext_mask = bcache_pow2(nslots) - 1;
+	bcache.ext_hash = gsh_malloc((bcache.ext_mask + 1) *
+				     sizeof(*bcache.ext_hash));
+	for (i = 0; i <= bcache.ext_mask; i++)
+		glist_init(&bcache.ext_hash[i]);
+	bcache.file_mask = bcache_pow2(nslots / 4) - 1;
+	bcache.file_hash = gsh_malloc((bcache.file_mask + 1) *
+				      sizeof(*bcache.file_hash));
+	for (i = 0; i <= bcache.file_mask; i++)
+		glist_init(&bcache.file_hash[i]);
+	bcache.hand = 0;
+	PTHREAD_MUTEX_init(&bcache.lock, NULL);
+
+	BUILD_BUG_ON(sizeof(struct bcache_record) != 256);
+
+	rc = bcache_load();
+	if (rc == 0)
+		rc = bcache_write_header(false);
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL, "BCACHE: could not use %s: %s",
+			BCACHE.cache_path, strerror(-rc));
+		bcache_free_index();
+		PTHREAD_MUTEX_destroy(&bcache.lock);
+		close(fd);
+		bcache.fd = -1;
+		return fsalstat(posix2fsal_error(-rc), -rc);
+	}
+
+	bcache.enabled = true;
+
+	LogInfo(COMPONENT_FSAL,
+		"BCACHE: %" PRIu64 " extents of %" PRIu32 " bytes on %s",
+		bcache.nslots, bcache.extent_size, BCACHE.cache_path);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Write out the index and close the cache device
+ *
+ * Exports are gone, so nothing is pinned.
+ */
+void bcache_pkgshutdown(void)
+{
+	struct bcache_extent *ext;
+	struct bcache_record rec;
+	uint64_t slot;
+	int rc = 0;
+
+	if (!bcache.enabled)
+		return;
+
+	bcache.enabled = false;
+
+	for (slot = 0; slot < bcache.nslots && rc == 0; slot++) {
+		ext = &bcache.slots[slot];
+		if (!ext->rec_stale)
+			continue;
+		if (ext->state == BCACHE_EXT_VALID && !ext->file->modified)
+			bcache_record_fill(ext, &ext->file->valid, &rec);
+		else
+			memset(&rec, 0, sizeof(rec));
+		rc = bcache_dev_pio(true, &rec, sizeof(rec),
+				    bcache_record_off(slot));
+	}
+
+	if (rc == 0)
+		rc = bcache_write_header(true);
+	if (rc != 0)
+		LogWarn(COMPONENT_FSAL,
+			"BCACHE: could not save the index of %s: %s",
+			BCACHE.cache_path, strerror(-rc));
+
+	bcache_free_index();
+	PTHREAD_MUTEX_destroy(&bcache.lock);
+	close(bcache.fd);
+	bcache.fd = -1;
+}
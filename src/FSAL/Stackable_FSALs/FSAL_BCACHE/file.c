@@ -0,0 +1,497 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* file.c
+ * File I/O methods for BCACHE module
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include "fsal.h"
+#include "FSAL/access_check.h"
+#include "fsal_convert.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "FSAL/fsal_commonlib.h"
+#include "bcache_methods.h"
+
+/**
+ * @brief Callback arg for BCACHE async callbacks
+ *
+ * BCACHE needs to know what its object is related to the sub-FSAL's object.
+ * This wraps the given callback arg with BCACHE specific info
+ */
+struct bcache_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< BCACHE's handle */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+};
+
+/**
+ * @brief Callback for BCACHE async calls
+ *
+ * Unstack, and call up.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+void bcache_async_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+		     void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct bcache_async_arg *arg = caller_data;
+
+	op_ctx->fsal_export = save_exp->super_export;
+	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg);
+}
+
+/**
+ * @brief Callback arg for writes to a cached file
+ */
+struct bcache_write_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< BCACHE's handle */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+	struct bcache_file *file;		/**< Cached file */
+	bool write_through;			/**< Update cached extents */
+	struct bcache_wio wio;			/**< The write in flight */
+};
+
+/**
+ * @brief Callback for writes to a cached file
+ *
+ * Bring the cache up to date, unstack, and call up.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+static void bcache_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			    void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct bcache_write_arg *arg = caller_data;
+
+	bcache_write_done(arg->file, &arg->wio,
+			  FSAL_IS_ERROR(ret) ? NULL : obj_data,
+			  arg->write_through);
+
+	op_ctx->fsal_export = save_exp->super_export;
+	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg);
+}
+
+/* bcache_close
+ * Close the file if it is still open.
+ * Yes, we ignor lock status.  Closing a file in POSIX
+ * releases all locks but that is state and cache inode's problem.
+ */
+
+fsal_status_t bcache_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close(handle->sub_handle);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t bcache_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+	struct fsal_obj_handle *sub_handle = NULL;
+	struct bcache_file *file;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->open2(handle->sub_handle, state,
+						  openflags, createmode, name,
+						  attrs_in, verifier,
+						  &sub_handle, attrs_out,
+						  caller_perm_check);
+	op_ctx->fsal_export = &export->export;
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (sub_handle) {
+		/* wrap the subfsal handle in a bcache handle. */
+		status = bcache_alloc_and_check_handle(export, sub_handle,
+						       obj_hdl->fs, new_obj,
+						       status);
+		handle = container_of(*new_obj, struct bcache_fsal_obj_handle,
+				      obj_handle);
+	}
+
+	file = bcache_file_get(handle, export);
+	if (file != NULL) {
+		/* Revalidate on open, drop what a truncate made stale */
+		if (openflags & FSAL_O_TRUNC) {
+			bcache_invalidate(file, 0, UINT64_MAX);
+			bcache_file_modified(file);
+		}
+		bcache_file_opened(file);
+	}
+
+	return status;
+}
+
+bool bcache_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	bool result =
+		handle->sub_handle->obj_ops->check_verifier(handle->sub_handle,
+							   verifier);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_openflags_t bcache_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_openflags_t result =
+		handle->sub_handle->obj_ops->status2(handle->sub_handle,
+						    state);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_status_t bcache_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->reopen2(handle->sub_handle,
+						    state, openflags);
+	op_ctx->fsal_export = &export->export;
+
+	if (!FSAL_IS_ERROR(status) && handle->file != NULL &&
+	    (openflags & FSAL_O_TRUNC)) {
+		bcache_invalidate(handle->file, 0, UINT64_MAX);
+		bcache_file_modified(handle->file);
+	}
+
+	return status;
+}
+
+void bcache_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+	struct bcache_async_arg *arg;
+	struct bcache_file *file = NULL;
+	fsal_status_t status;
+
+	/* READ_PLUS wants holes reported, leave it to the sub-FSAL */
+	if (read_arg->info == NULL)
+		file = bcache_file_get(handle, export);
+
+	if (file != NULL && bcache_file_usable(handle, export, file)) {
+		status = bcache_read(handle, export, file, bypass, read_arg);
+		done_cb(obj_hdl, status, read_arg, caller_arg);
+		return;
+	}
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, bypass,
+					  bcache_async_cb, read_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+void bcache_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+	struct bcache_async_arg *arg;
+	struct bcache_write_arg *warg;
+	struct bcache_file *file = bcache_file_get(handle, export);
+	int i;
+
+	if (file != NULL) {
+		/* Set up write-through callback */
+		warg = gsh_calloc(1, sizeof(*warg));
+		warg->obj_hdl = obj_hdl;
+		warg->cb = done_cb;
+		warg->cb_arg = caller_arg;
+		warg->file = file;
+		warg->write_through = export->write_through;
+		warg->wio.offset = write_arg->offset;
+		for (i = 0; i < write_arg->iov_count; i++)
+			warg->wio.len += write_arg->iov[i].iov_len;
+		bcache_write_start(file, &warg->wio);
+
+		/* calling subfsal method */
+		op_ctx->fsal_export = export->export.sub_export;
+		handle->sub_handle->obj_ops->write2(handle->sub_handle, bypass,
+						   bcache_write_cb, write_arg,
+						   warg);
+		op_ctx->fsal_export = &export->export;
+		return;
+	}
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->write2(handle->sub_handle, bypass,
+					   bcache_async_cb, write_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+fsal_status_t bcache_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->seek2(handle->sub_handle, state,
+						  info);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t bcache_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->io_advise2(handle->sub_handle,
+						       state, hints);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t bcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->commit2(handle->sub_handle, offset,
+						    len);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t bcache_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->lock_op2(handle->sub_handle, state,
+						     p_owner, lock_op, req_lock,
+						     conflicting_lock);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t bcache_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close2(handle->sub_handle, state);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t bcache_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate)
+{
+	struct bcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct bcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct bcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct bcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->fallocate(handle->sub_handle,
+							state, offset, length,
+							allocate);
+	op_ctx->fsal_export = &export->export;
+
+	if (handle->file != NULL) {
+		/* A hole punched, or the end of file moved */
+		bcache_invalidate(handle->file, allocate ? 0 : offset,
+				  allocate ? UINT64_MAX : length);
+		bcache_file_modified(handle->file);
+	}
+
+	return status;
+}
@@ -0,0 +1,203 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* main.c
+ * Module core functions
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <libgen.h>		/* used for 'dirname' */
+#include <pthread.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include "gsh_list.h"
+#include "config_parsing.h"
+#include "FSAL/fsal_init.h"
+#include "bcache_methods.h"
+
+
+/* FSAL name determines name of shared library: libfsal<name>.so */
+const char myname[] = "BCACHE";
+
+/* my module private storage
+ */
+
+struct bcache_fsal_module BCACHE = {
+	.module = {
+		.fs_info = {
+			.maxfilesize = UINT64_MAX,
+			.maxlink = _POSIX_LINK_MAX,
+			.maxnamelen = 1024,
+			.maxpathlen = 1024,
+			.no_trunc = true,
+			.chown_restricted = true,
+			.case_insensitive = false,
+			.case_preserving = true,
+			.link_support = true,
+			.symlink_support = true,
+			.lock_support = true,
+			.lock_support_async_block = false,
+			.named_attr = true,
+			.unique_handles = true,
+			.acl_support = FSAL_ACLSUPPORT_ALLOW,
+			.cansettime = true,
+			.homogenous = true,
+			.supported_attrs = ALL_ATTRIBUTES,
+			.maxread = FSAL_MAXIOSIZE,
+			.maxwrite = FSAL_MAXIOSIZE,
+			.umask = 0,
+			.auth_exportpath_xdev = false,
+			.link_supports_permission_checks = true,
+		}
+	}
+};
+
+static struct config_item bcache_items[] = {
+	CONF_ITEM_PATH("Cache_Path", 1, MAXPATHLEN, NULL,
+		       bcache_fsal_module, cache_path),
+	CONF_ITEM_UI64("Cache_Size", 0, UINT64_MAX, 0,
+		       bcache_fsal_module, cache_size),
+	CONF_ITEM_UI32("Extent_Size", 4096, 64 * 1024 * 1024, 1024 * 1024,
+		       bcache_fsal_module, extent_size),
+	CONFIG_EOL
+};
+
+static struct config_block bcache_block = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.bcache",
+	.blk_desc.name = "BCACHE",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = bcache_items,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/* Module methods
+ */
+
+/* init_config
+ * must be called with a reference taken (via lookup_fsal)
+ */
+
+static fsal_status_t init_config(struct fsal_module *bcache_fsal_module,
+				 config_file_t config_struct,
+				 struct config_error_type *err_type)
+{
+	/* Configuration setting options:
+	 * 1. the cache device is shared by all exports and set here.
+	 *
+	 * 2. we set some here.  These must be independent of whatever
+	 *    may be set by lower level fsals.
+	 *
+	 * If there is any filtering or change of parameters in the stack,
+	 * this must be done in export data structures, not fsal params because
+	 * a stackable could be configured above multiple fsals for multiple
+	 * diverse exports.
+	 */
+
+	struct bcache_fsal_module *bcache_me =
+	    container_of(bcache_fsal_module, struct bcache_fsal_module, module);
+
+	(void) load_config_from_parse(config_struct,
+				      &bcache_block,
+				      bcache_me,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type))
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	display_fsinfo(bcache_fsal_module);
+	LogDebug(COMPONENT_FSAL,
+		 "FSAL INIT: Supported attributes mask = 0x%" PRIx64,
+		 bcache_fsal_module->fs_info.supported_attrs);
+	LogDebug(COMPONENT_FSAL,
+		 "FSAL INIT: Cache %s, size %" PRIu64 ", extent size %" PRIu32,
+		 bcache_me->cache_path ? bcache_me->cache_path : "(none)",
+		 bcache_me->cache_size, bcache_me->extent_size);
+
+	return bcache_pkginit();
+}
+
+/* Internal BCACHE method linkage to export object
+ */
+
+fsal_status_t bcache_create_export(struct fsal_module *fsal_hdl,
+				   void *parse_node,
+				   struct config_error_type *err_type,
+				   const struct fsal_up_vector *up_ops);
+
+fsal_status_t bcache_update_export(struct fsal_module *fsal_hdl,
+				   void *parse_node,
+				   struct config_error_type *err_type,
+				   struct fsal_export *original,
+				   struct fsal_module *updated_super);
+
+/* Module initialization.
+ * Called by dlopen() to register the module
+ * keep a private pointer to me in myself
+ */
+
+/* linkage to the exports and handle ops initializers
+ */
+MODULE_INIT void bcache_init(void)
+{
+	int retval;
+	struct fsal_module *myself = &BCACHE.module;
+
+	retval = register_fsal(myself, myname, FSAL_MAJOR_VERSION,
+			       FSAL_MINOR_VERSION, FSAL_ID_NO_PNFS);
+	if (retval != 0) {
+		fprintf(stderr, "BCACHE module failed to register");
+		return;
+	}
+	myself->m_ops.create_export = bcache_create_export;
+	myself->m_ops.update_export = bcache_update_export;
+	myself->m_ops.init_config = init_config;
+#ifdef USE_DBUS
+	myself->m_ops.fsal_extract_stats = bcache_extract_stats;
+#endif
+	myself->m_ops.fsal_reset_stats = bcache_reset_stats;
+	bcache_prepare_for_stats(myself);
+
+	/* Initialize the fsal_obj_handle ops for FSAL BCACHE */
+	bcache_handle_ops_init(&BCACHE.handle_ops);
+}
+
+MODULE_FINI void bcache_unload(void)
+{
+	int retval;
+
+	bcache_pkgshutdown();
+
+	retval = unregister_fsal(&BCACHE.module);
+	if (retval != 0) {
+		fprintf(stderr, "BCACHE module failed to unregister");
+		return;
+	}
+}
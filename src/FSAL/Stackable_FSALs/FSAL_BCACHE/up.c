@@ -0,0 +1,90 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file up.c
+ * @brief Upcalls of FSAL_BCACHE
+ *
+ * The sub-FSAL is given our own copy of the upcall vector, so changes
+ * it reports drop the cached data before going up.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "fsal_up.h"
+#include "FSAL/fsal_commonlib.h"
+#include "bcache_methods.h"
+
+static fsal_status_t bcache_up_invalidate(const struct fsal_up_vector *vec,
+					  struct gsh_buffdesc *obj,
+					  uint32_t flags)
+{
+	struct bcache_fsal_export *export =
+		container_of(vec, struct bcache_fsal_export, up_ops);
+
+	if (flags & FSAL_UP_INVALIDATE_CONTENT)
+		bcache_invalidate_key(export, obj, NULL);
+
+	return export->super_up_ops->invalidate(export->super_up_ops, obj,
+						flags);
+}
+
+static fsal_status_t bcache_up_update(const struct fsal_up_vector *vec,
+				      struct gsh_buffdesc *obj,
+				      struct attrlist *attr,
+				      uint32_t flags)
+{
+	struct bcache_fsal_export *export =
+		container_of(vec, struct bcache_fsal_export, up_ops);
+	struct bcache_validator valid;
+
+	if (FSAL_TEST_MASK(attr->valid_mask, ATTR_CHANGE) &&
+	    FSAL_TEST_MASK(attr->valid_mask, ATTR_MTIME)) {
+		/* Kept if this is a change we know about */
+		valid.change = attr->change;
+		valid.mtime = attr->mtime;
+		bcache_invalidate_key(export, obj, &valid);
+	} else if (attr->valid_mask & (ATTR_CHANGE | ATTR_MTIME | ATTR_SIZE)) {
+		bcache_invalidate_key(export, obj, NULL);
+	}
+
+	return export->super_up_ops->update(export->super_up_ops, obj, attr,
+					    flags);
+}
+
+/**
+ * @brief Set up the upcall vector given to the sub-FSAL
+ *
+ * @param[in] export		Our export
+ * @param[in] super_up_ops	Vector we were given
+ */
+void bcache_up_ops_init(struct bcache_fsal_export *export,
+			const struct fsal_up_vector *super_up_ops)
+{
+	/* Init with super ops. Struct copy */
+	export->super_up_ops = super_up_ops;
+	export->up_ops = *super_up_ops;
+
+	up_ready_init(&export->up_ops);
+
+	/* Replace calls that change file data */
+	export->up_ops.invalidate = bcache_up_invalidate;
+	export->up_ops.update = bcache_up_update;
+}
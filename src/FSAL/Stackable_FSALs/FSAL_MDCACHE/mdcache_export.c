@@ -102,6 +102,9 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 	 */
 	atomic_set_uint8_t_bits(&exp->flags, MDC_UNEXPORT);
 
+	/* Drop the references the handle caches of the threads hold */
+	mdc_fh_cache_flush(exp);
+
 	/* Next, clean up our cache entries on the export */
 	while (true) {
 		PTHREAD_RWLOCK_rdlock(&exp->mdc_exp_lock);
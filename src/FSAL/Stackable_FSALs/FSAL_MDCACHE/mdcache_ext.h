@@ -109,6 +109,20 @@ struct mdcache_parameter {
 	    we disable caching, when in extremis.  Defaults to 8,
 	    settable with Futility_Count */
 	uint32_t futility_count;
+	/** Bytes of extended attributes cached over all entries, 0 to
+	    not cache them.  Defaults to 16MB, settable with
+	    Xattr_Cache_Size. */
+	uint64_t xattr_cache_size;
+	/** Largest xattr value cached.  Defaults to 1024, settable with
+	    Xattr_Max_Value. */
+	uint32_t xattr_max_value;
+	/** Most xattrs cached per entry.  Defaults to 16, settable with
+	    Xattr_Max_Per_Entry. */
+	uint32_t xattr_max_per_entry;
+	/** Recently converted handles remembered by each thread, 0 to
+	    always look them up.  Defaults to 16, settable with
+	    Handle_Cache_Slots. */
+	uint32_t handle_cache_slots;
 };
 
 extern struct mdcache_parameter mdcache_param;
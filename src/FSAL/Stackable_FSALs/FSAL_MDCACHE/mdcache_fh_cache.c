@@ -0,0 +1,402 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_fh_cache.c
+ * @brief Per-thread cache of recently converted handles
+ *
+ * Nearly every NFS request starts by turning a handle into an entry,
+ * and most of them name a handle the same thread saw a moment ago.
+ * Each thread keeps a small direct mapped table of the last host
+ * handles it converted with the entry they gave, so that those skip
+ * host_to_key, hashing the key and the partition lock of the handle
+ * cache.
+ *
+ * Slots hold an LRU reference on their entry, and the entry counts the
+ * slots holding one.  When an entry is killed or made unreachable, the
+ * slots holding it are emptied in every thread so that it can be freed.
+ * A slot is also only used if the entry is still in the handle cache and
+ * reachable, otherwise it is emptied and the handle looked up again.
+ * Entries can only be unmapped from an export by unexport, which
+ * empties the slots of that export in every thread first.  The lock of
+ * a table is only ever contended by these.
+ *
+ * The references keep at most a slot count per thread of entries off
+ * the LRU reaper.  A hit takes a plain reference, which does not move
+ * the entry in the LRU, so that it stays off the lane lock; every
+ * MDC_FH_PROMOTE_HITS hits of a slot take an initial reference instead,
+ * so entries that are only ever found here still age as hot ones.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <pthread.h>
+#include "fsal.h"
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/** Hits of a slot between two moves of its entry to the MRU end */
+#define MDC_FH_PROMOTE_HITS 16
+
+/**
+ * @brief A converted handle
+ */
+
+struct mdc_fh_slot {
+	/** Export the handle was converted in */
+	struct mdcache_fsal_export *export;
+	/** Entry, with an LRU reference, NULL if the slot is empty */
+	mdcache_entry_t *entry;
+	/** Length of the host handle */
+	uint32_t len;
+	/** Hits since the slot was filled */
+	uint32_t hits;
+	/** Host handle */
+	char fh[NFS4_FHSIZE];
+};
+
+/**
+ * @brief The table of a thread
+ */
+
+struct mdc_fh_cache {
+	/** Link in mdc_fh_caches */
+	struct glist_head caches;
+	/** Taken by the owning thread and by unexport */
+	pthread_mutex_t lock;
+	/** Number of slots, a power of two */
+	uint32_t nslots;
+	struct mdc_fh_slot slots[];
+};
+
+/** Table of this thread, created on first use */
+static __thread struct mdc_fh_cache *mdc_fh_cache;
+
+/** To empty the table of an exiting thread */
+static pthread_key_t mdc_fh_cache_key;
+
+/** All tables, protected by mdc_fh_caches_lock */
+static struct glist_head mdc_fh_caches = GLIST_HEAD_INIT(mdc_fh_caches);
+static pthread_mutex_t mdc_fh_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool mdc_fh_cache_usable(mdcache_entry_t *entry)
+{
+	return entry->fh_hk.inavl &&
+	       !test_mde_flags(entry, MDCACHE_UNREACHABLE);
+}
+
+/**
+ * @brief Empty a slot, with its table locked
+ *
+ * @return The entry, whose reference the caller drops.
+ */
+
+static inline mdcache_entry_t *mdc_fh_slot_clear(struct mdc_fh_slot *slot)
+{
+	mdcache_entry_t *entry = slot->entry;
+
+	(void) atomic_dec_uint32_t(&entry->fh_cache_slots);
+	slot->entry = NULL;
+
+	return entry;
+}
+
+static inline struct mdc_fh_slot *mdc_fh_slot(struct mdc_fh_cache *cache,
+					      struct gsh_buffdesc *fh_desc)
+{
+	uint64_t tail = 0;
+	size_t n = MIN(fh_desc->len, sizeof(tail));
+
+	/* The end of a host handle is usually the most variable part */
+	memcpy(&tail, (char *)fh_desc->addr + fh_desc->len - n, n);
+	tail = (tail ^ fh_desc->len) * 0x9E3779B97F4A7C15ULL;
+
+	return &cache->slots[(tail >> 32) & (cache->nslots - 1)];
+}
+
+/**
+ * @brief Empty a table when its thread exits
+ *
+ * @param[in] arg	The table
+ */
+
+static void mdc_fh_cache_destroy(void *arg)
+{
+	struct mdc_fh_cache *cache = arg;
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&mdc_fh_caches_lock);
+	glist_del(&cache->caches);
+	PTHREAD_MUTEX_unlock(&mdc_fh_caches_lock);
+
+	for (i = 0; i < cache->nslots; i++) {
+		if (cache->slots[i].entry != NULL)
+			mdcache_put(mdc_fh_slot_clear(&cache->slots[i]));
+	}
+
+	PTHREAD_MUTEX_destroy(&cache->lock);
+	gsh_free(cache);
+	mdc_fh_cache = NULL;
+}
+
+void mdc_fh_cache_pkginit(void)
+{
+	(void) pthread_key_create(&mdc_fh_cache_key, mdc_fh_cache_destroy);
+}
+
+static struct mdc_fh_cache *mdc_fh_cache_create(void)
+{
+	struct mdc_fh_cache *cache;
+	uint32_t nslots = 1;
+
+	while (nslots < mdcache_param.handle_cache_slots)
+		nslots <<= 1;
+
+	cache = gsh_calloc(1, sizeof(*cache) +
+			      nslots * sizeof(cache->slots[0]));
+	cache->nslots = nslots;
+	PTHREAD_MUTEX_init(&cache->lock, NULL);
+
+	PTHREAD_MUTEX_lock(&mdc_fh_caches_lock);
+	glist_add_tail(&mdc_fh_caches, &cache->caches);
+	PTHREAD_MUTEX_unlock(&mdc_fh_caches_lock);
+
+	(void) pthread_setspecific(mdc_fh_cache_key, cache);
+	mdc_fh_cache = cache;
+
+	return cache;
+}
+
+/**
+ * @brief Find the entry of a handle this thread converted recently
+ *
+ * @param[in]  export	Export of the handle
+ * @param[in]  fh_desc	Host handle
+ * @param[out] entry	Entry, with an LRU reference
+ *
+ * @return true if the entry was found.
+ */
+
+bool mdc_fh_cache_get(struct mdcache_fsal_export *export,
+		      struct gsh_buffdesc *fh_desc,
+		      mdcache_entry_t **entry)
+{
+	struct mdc_fh_cache *cache = mdc_fh_cache;
+	struct mdc_fh_slot *slot;
+	mdcache_entry_t *stale = NULL;
+	uint32_t flags = LRU_FLAG_NONE;
+
+	*entry = NULL;
+
+	if (cache == NULL || mdcache_param.handle_cache_slots == 0 ||
+	    fh_desc->len > NFS4_FHSIZE)
+		return false;
+
+	slot = mdc_fh_slot(cache, fh_desc);
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+
+	if (slot->entry != NULL && slot->export == export &&
+	    slot->len == fh_desc->len &&
+	    memcmp(slot->fh, fh_desc->addr, fh_desc->len) == 0) {
+		if (mdc_fh_cache_usable(slot->entry) &&
+		    !(atomic_fetch_uint8_t(&export->flags) & MDC_UNEXPORT)) {
+			/* Not an initial ref, the slot keeps it off the LRU,
+			 * but now and then bump it to MRU.
+			 */
+			if (++slot->hits % MDC_FH_PROMOTE_HITS == 0)
+				flags = LRU_REQ_INITIAL;
+
+			(void) mdcache_lru_ref(slot->entry, flags);
+			*entry = slot->entry;
+		} else {
+			/* Killed since, look it up again */
+			stale = mdc_fh_slot_clear(slot);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&cache->lock);
+
+	if (stale != NULL)
+		mdcache_put(stale);
+
+	if (*entry == NULL) {
+		(void) atomic_inc_uint64_t(&cache_stp->handle_cache_miss);
+		return false;
+	}
+
+	(void) atomic_inc_uint64_t(&cache_stp->handle_cache_hit);
+	return true;
+}
+
+/**
+ * @brief Remember the entry of a handle this thread converted
+ *
+ * @param[in] export	Export of the handle
+ * @param[in] fh_desc	Host handle
+ * @param[in] entry	Entry, the slot takes its own reference
+ */
+
+void mdc_fh_cache_put(struct mdcache_fsal_export *export,
+		      struct gsh_buffdesc *fh_desc,
+		      mdcache_entry_t *entry)
+{
+	struct mdc_fh_cache *cache = mdc_fh_cache;
+	struct mdc_fh_slot *slot;
+	mdcache_entry_t *old;
+
+	if (mdcache_param.handle_cache_slots == 0 ||
+	    fh_desc->len > NFS4_FHSIZE)
+		return;
+
+	if (cache == NULL)
+		cache = mdc_fh_cache_create();
+
+	slot = mdc_fh_slot(cache, fh_desc);
+
+	(void) mdcache_lru_ref(entry, LRU_FLAG_NONE);
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+
+	/* Counted first, so that either mdc_fh_cache_forget() sees this
+	 * slot or we see the entry killed.
+	 */
+	(void) atomic_inc_uint32_t(&entry->fh_cache_slots);
+
+	if (atomic_fetch_uint8_t(&export->flags) & MDC_UNEXPORT ||
+	    !mdc_fh_cache_usable(entry)) {
+		/* Too late, the slots may have been emptied already */
+		(void) atomic_dec_uint32_t(&entry->fh_cache_slots);
+		old = entry;
+	} else {
+		old = slot->entry != NULL ? mdc_fh_slot_clear(slot) : NULL;
+		slot->export = export;
+		slot->entry = entry;
+		slot->len = fh_desc->len;
+		slot->hits = 0;
+		memcpy(slot->fh, fh_desc->addr, fh_desc->len);
+	}
+
+	PTHREAD_MUTEX_unlock(&cache->lock);
+
+	if (old != NULL)
+		mdcache_put(old);
+}
+
+/**
+ * @brief Empty the slots of an export in every thread
+ *
+ * Called by unexport once MDC_UNEXPORT is set, so that no new slot is
+ * filled for the export.
+ *
+ * @param[in] export	Export going away
+ */
+
+void mdc_fh_cache_flush(struct mdcache_fsal_export *export)
+{
+	struct mdc_fh_cache *cache;
+	struct glist_head *glist;
+	mdcache_entry_t **put = NULL;
+	uint32_t i, n = 0, size = 0;
+
+	PTHREAD_MUTEX_lock(&mdc_fh_caches_lock);
+
+	glist_for_each(glist, &mdc_fh_caches) {
+		cache = glist_entry(glist, struct mdc_fh_cache, caches);
+
+		PTHREAD_MUTEX_lock(&cache->lock);
+
+		for (i = 0; i < cache->nslots; i++) {
+			struct mdc_fh_slot *slot = &cache->slots[i];
+
+			if (slot->entry == NULL || slot->export != export)
+				continue;
+
+			if (n == size) {
+				size = size == 0 ? cache->nslots : size * 2;
+				put = gsh_realloc(put, size * sizeof(*put));
+			}
+
+			put[n++] = mdc_fh_slot_clear(slot);
+		}
+
+		PTHREAD_MUTEX_unlock(&cache->lock);
+	}
+
+	PTHREAD_MUTEX_unlock(&mdc_fh_caches_lock);
+
+	/* The last reference may be ours, put them without the locks */
+	while (n > 0)
+		mdcache_put(put[--n]);
+
+	gsh_free(put);
+}
+
+/**
+ * @brief Empty the slots holding an entry in every thread
+ *
+ * Called once the entry is killed or made unreachable, so that no new
+ * slot takes it.  The caller holds a reference, the ones of the slots
+ * are never the last.
+ *
+ * @param[in] entry	Entry going away
+ */
+
+void mdc_fh_cache_forget(mdcache_entry_t *entry)
+{
+	struct mdc_fh_cache *cache;
+	struct glist_head *glist;
+	uint32_t i, n = 0;
+
+	if (atomic_fetch_uint32_t(&entry->fh_cache_slots) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&mdc_fh_caches_lock);
+
+	glist_for_each(glist, &mdc_fh_caches) {
+		cache = glist_entry(glist, struct mdc_fh_cache, caches);
+
+		PTHREAD_MUTEX_lock(&cache->lock);
+
+		for (i = 0; i < cache->nslots; i++) {
+			if (cache->slots[i].entry == entry) {
+				(void) mdc_fh_slot_clear(&cache->slots[i]);
+				n++;
+			}
+		}
+
+		PTHREAD_MUTEX_unlock(&cache->lock);
+	}
+
+	PTHREAD_MUTEX_unlock(&mdc_fh_caches_lock);
+
+	while (n-- > 0)
+		mdcache_put(entry);
+}
+
+/** @} */
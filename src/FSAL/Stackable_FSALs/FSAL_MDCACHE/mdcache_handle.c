@@ -1489,6 +1489,8 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
 	ops->fallocate = mdcache_fallocate;
+	ops->copy = mdcache_copy;
+	ops->clone = mdcache_clone;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = mdcache_list_ext_attrs;
@@ -1608,14 +1610,28 @@ fsal_status_t mdcache_create_handle(struct fsal_export *exp_hdl,
 	fsal_status_t status;
 
 	*handle = NULL;
+
+	/* Handles seen lately by this thread need no hashing or locking,
+	 * unless attributes are wanted.
+	 */
+	if (attrs_out == NULL && mdc_fh_cache_get(export, fh_desc, &entry))
+		goto found;
+
 	status = mdcache_locate_host(fh_desc, export, &entry, attrs_out);
 	if (FSAL_IS_ERROR(status))
 		return status;
 
-	/* Make sure this entry has a parent pointer */
-	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-	mdc_get_parent(export, entry);
-	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	mdc_fh_cache_put(export, fh_desc, entry);
+
+found:
+	/* Make sure this entry has a parent pointer, only directories have
+	 * one and the type never changes.
+	 */
+	if (entry->obj_handle.type == DIRECTORY) {
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+		mdc_get_parent(export, entry);
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	}
 
 	if (attrs_out != NULL) {
 		LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
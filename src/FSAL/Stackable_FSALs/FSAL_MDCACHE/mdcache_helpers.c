@@ -3233,6 +3233,8 @@ _mdcache_kill_entry(mdcache_entry_t *entry,
 	if (!freed) {
 		/* queue for cleanup */
 		mdcache_lru_cleanup_push(entry);
+		/* the handle caches may hold the last refs but ours */
+		mdc_fh_cache_forget(entry);
 	}
 
 }
@@ -160,6 +160,20 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	/** xattr lookups and listings served from the cache */
+	uint64_t xattr_hit;
+	/** xattr lookups and listings passed to the sub-FSAL */
+	uint64_t xattr_miss;
+	/** Times cached xattrs of an entry were dropped */
+	uint64_t xattr_inval;
+	/** Results not cached for lack of room in Xattr_Cache_Size */
+	uint64_t xattr_full;
+	/** Bytes of cached xattrs, bounded by Xattr_Cache_Size */
+	uint64_t xattr_bytes;
+	/** Handles found in the per-thread handle cache */
+	uint64_t handle_cache_hit;
+	/** Handles looked up in the handle hash table */
+	uint64_t handle_cache_miss;
 };
 
 extern struct mdcache_stats *cache_stp;
@@ -202,6 +216,48 @@ struct entry_export_map {
 static const uint32_t MDCACHE_UNREACHABLE = 0x100;
 
 
+/**
+ * @brief A cached extended attribute
+ */
+
+struct mdcache_xattr {
+	/** Link in mdcache_xattrs, oldest first */
+	struct glist_head list;
+	/** Length of the name */
+	uint32_t name_len;
+	/** Length of the value, -1 if there is no such xattr */
+	int32_t value_len;
+	/** The name, followed by the value */
+	char data[];
+};
+
+/**
+ * @brief The cached extended attributes of an entry
+ *
+ * Only valid while the change attribute of the entry is the one they
+ * were cached with.  Protected by the attr_lock of the entry.
+ */
+
+struct mdcache_xattrs {
+	/** Cached xattrs, oldest first */
+	struct glist_head xattrs;
+	/** Number of xattrs in the list */
+	uint32_t count;
+	/** Change attribute of the entry when cached */
+	uint64_t change;
+	/** Complete list of names as listed from cookie 0, NULL if not
+	 *  cached.  The names follow the array. */
+	component4 *names;
+	/** Number of names */
+	uint32_t names_count;
+	/** Length of the names */
+	uint32_t names_len;
+	/** Cookie verifier returned with the names */
+	verifier4 names_verf;
+	/** Bytes counted in xattr_bytes */
+	size_t bytes;
+};
+
 /**
  * @brief Represents a cached inode
  *
@@ -253,12 +309,21 @@ struct mdcache_fsal_obj_handle {
 	struct fsal_obj_handle *sub_handle;
 	/** Cached attributes */
 	struct attrlist attrs;
+	/** Cached extended attributes, NULL if none.  Protected by
+	 *  attr_lock. */
+	struct mdcache_xattrs *xattrs;
+	/** Bumped each time the cached xattrs are dropped, protected by
+	 *  attr_lock */
+	uint32_t xattr_gen;
 	/** FH hash linkage */
 	struct {
 		struct avltree_node node_k;	/*< AVL node in tree */
 		mdcache_key_t key;	/*< Key of this entry */
 		bool inavl;
 	} fh_hk;
+	/** Per-thread handle cache slots holding a reference, updated
+	 *  atomically */
+	uint32_t fh_cache_slots;
 	/** Flags for this entry */
 	uint32_t mde_flags;
 	/** Time at which we last refreshed attributes. */
@@ -892,6 +957,17 @@ mdc_has_state(mdcache_entry_t *entry)
 	}
 }
 
+/* Per-thread handle cache */
+void mdc_fh_cache_pkginit(void);
+bool mdc_fh_cache_get(struct mdcache_fsal_export *export,
+		      struct gsh_buffdesc *fh_desc,
+		      mdcache_entry_t **entry);
+void mdc_fh_cache_put(struct mdcache_fsal_export *export,
+		      struct gsh_buffdesc *fh_desc,
+		      mdcache_entry_t *entry);
+void mdc_fh_cache_flush(struct mdcache_fsal_export *export);
+void mdc_fh_cache_forget(mdcache_entry_t *entry);
+
 /**
  * @brief Mark an entry as unreachable
  *
@@ -921,6 +997,9 @@ _mdc_unreachable(mdcache_entry_t *entry,
 	}
 
 	atomic_set_uint32_t_bits(&entry->mde_flags, MDCACHE_UNREACHABLE);
+
+	/* Don't let the handle caches keep it until state is freed */
+	mdc_fh_cache_forget(entry);
 }
 
 #define mdc_unreachable(entry) \
@@ -1022,6 +1101,16 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 				struct state_t *state, uint64_t offset,
 				uint64_t length, bool allocate);
+fsal_status_t mdcache_copy(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state, uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state, uint64_t dst_offset,
+			   uint64_t count, uint64_t *copied);
+fsal_status_t mdcache_clone(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    uint64_t count);
 
 /* extended attributes management */
 fsal_status_t mdcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -1067,6 +1156,8 @@ fsal_status_t mdcache_listxattrs(struct fsal_obj_handle *obj_hdl,
 				 count4 len, nfs_cookie4 *cookie,
 				 verifier4 *verf, bool_t *eof,
 				 xattrlist4 *names);
+void mdc_xattrs_release(mdcache_entry_t *entry);
+void mdc_xattrs_invalidate(mdcache_entry_t *entry);
 
 /* Handle functions */
 void mdcache_handle_ops_init(struct fsal_obj_ops *ops);
@@ -85,6 +85,14 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, required_progress),
 	CONF_ITEM_UI32("Futility_Count", 1, 50, 8,
 		       mdcache_parameter, futility_count),
+	CONF_ITEM_UI64("Xattr_Cache_Size", 0, UINT64_MAX, 16 * 1024 * 1024,
+		       mdcache_parameter, xattr_cache_size),
+	CONF_ITEM_UI32("Xattr_Max_Value", 0, 65536, 1024,
+		       mdcache_parameter, xattr_max_value),
+	CONF_ITEM_UI32("Xattr_Max_Per_Entry", 1, 1024, 16,
+		       mdcache_parameter, xattr_max_per_entry),
+	CONF_ITEM_UI32("Handle_Cache_Slots", 0, 1024, 16,
+		       mdcache_parameter, handle_cache_slots),
 	CONFIG_EOL
 };
 
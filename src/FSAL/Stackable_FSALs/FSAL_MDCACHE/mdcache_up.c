@@ -71,6 +71,10 @@ mdc_up_invalidate(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 	atomic_clear_uint32_t_bits(&entry->mde_flags,
 				   flags & FSAL_UP_INVALIDATE_CACHE);
 
+	/* Changing an xattr changes the attributes too */
+	if (flags & FSAL_UP_INVALIDATE_ATTRS)
+		mdc_xattrs_invalidate(entry);
+
 	if (flags & FSAL_UP_INVALIDATE_CLOSE)
 		status = fsal_close(&entry->obj_handle);
 
@@ -40,6 +40,206 @@
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
 
+/**
+ * @brief Drop the cached xattrs of an entry
+ *
+ * @note the caller MUST hold attr_lock for write, or own the entry
+ *
+ * @param[in] entry	Entry whose xattrs to drop
+ */
+void mdc_xattrs_release(mdcache_entry_t *entry)
+{
+	struct mdcache_xattrs *xattrs = entry->xattrs;
+	struct glist_head *glist, *glistn;
+
+	entry->xattr_gen++;
+
+	if (xattrs == NULL)
+		return;
+
+	glist_for_each_safe(glist, glistn, &xattrs->xattrs) {
+		glist_del(glist);
+		gsh_free(glist_entry(glist, struct mdcache_xattr, list));
+	}
+
+	gsh_free(xattrs->names);
+	(void) atomic_sub_uint64_t(&cache_stp->xattr_bytes, xattrs->bytes);
+	(void) atomic_inc_uint64_t(&cache_stp->xattr_inval);
+
+	gsh_free(xattrs);
+	entry->xattrs = NULL;
+}
+
+/**
+ * @brief Drop the cached xattrs of an entry, as they changed
+ *
+ * @param[in] entry	Entry whose xattrs to drop
+ */
+void mdc_xattrs_invalidate(mdcache_entry_t *entry)
+{
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	mdc_xattrs_release(entry);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
+/**
+ * @brief Get the cached xattrs of an entry, if still valid
+ *
+ * @note the caller MUST hold attr_lock
+ *
+ * @param[in] entry	Entry to look at
+ *
+ * @return The cached xattrs or NULL.
+ */
+static struct mdcache_xattrs *mdc_xattrs_valid(mdcache_entry_t *entry)
+{
+	if (entry->xattrs == NULL ||
+	    !mdcache_is_attrs_valid(entry, ATTR_CHANGE) ||
+	    entry->xattrs->change != entry->attrs.change)
+		return NULL;
+
+	return entry->xattrs;
+}
+
+/**
+ * @brief Get the xattrs of an entry to add to
+ *
+ * Cached xattrs of an older change attribute are dropped.  Nothing may
+ * be cached if the xattrs were dropped since @a gen was read, or if
+ * the entry changed since @a change was read.
+ *
+ * @note the caller MUST hold attr_lock for write
+ *
+ * @param[in] entry	Entry to cache in
+ * @param[in] gen	xattr_gen when the result was fetched
+ * @param[in] change	Change attribute when the result was fetched
+ *
+ * @return The xattrs to add to or NULL.
+ */
+static struct mdcache_xattrs *mdc_xattrs_fill(mdcache_entry_t *entry,
+					      uint32_t gen, uint64_t change)
+{
+	struct mdcache_xattrs *xattrs;
+
+	if (entry->xattr_gen != gen ||
+	    !mdcache_is_attrs_valid(entry, ATTR_CHANGE) ||
+	    entry->attrs.change != change)
+		return NULL;
+
+	if (entry->xattrs != NULL && entry->xattrs->change != change)
+		mdc_xattrs_release(entry);
+
+	xattrs = entry->xattrs;
+	if (xattrs == NULL) {
+		xattrs = gsh_calloc(1, sizeof(*xattrs));
+		glist_init(&xattrs->xattrs);
+		xattrs->change = change;
+		entry->xattrs = xattrs;
+	}
+
+	return xattrs;
+}
+
+/**
+ * @brief Count bytes against Xattr_Cache_Size
+ *
+ * @param[in] xattrs	Xattrs the bytes are cached in
+ * @param[in] bytes	Bytes to cache
+ *
+ * @return true if there is room for them.
+ */
+static bool mdc_xattrs_charge(struct mdcache_xattrs *xattrs, size_t bytes)
+{
+	if (atomic_add_uint64_t(&cache_stp->xattr_bytes, bytes) >
+	    mdcache_param.xattr_cache_size) {
+		(void) atomic_sub_uint64_t(&cache_stp->xattr_bytes, bytes);
+		(void) atomic_inc_uint64_t(&cache_stp->xattr_full);
+		return false;
+	}
+
+	xattrs->bytes += bytes;
+	return true;
+}
+
+/**
+ * @brief Find a cached xattr
+ *
+ * @note the caller MUST hold attr_lock
+ *
+ * @param[in] xattrs	Cached xattrs
+ * @param[in] name	Name of the xattr
+ *
+ * @return The cached xattr or NULL.
+ */
+static struct mdcache_xattr *mdc_xattr_find(struct mdcache_xattrs *xattrs,
+					    xattrname4 *name)
+{
+	struct mdcache_xattr *xattr;
+	struct glist_head *glist;
+
+	glist_for_each(glist, &xattrs->xattrs) {
+		xattr = glist_entry(glist, struct mdcache_xattr, list);
+		if (xattr->name_len == name->utf8string_len &&
+		    memcmp(xattr->data, name->utf8string_val,
+			   xattr->name_len) == 0)
+			return xattr;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Cache the value of an xattr, or that it does not exist
+ *
+ * The oldest xattr of the entry makes room if it has
+ * Xattr_Max_Per_Entry of them already.
+ *
+ * @note the caller MUST hold attr_lock for write
+ *
+ * @param[in] xattrs	Cached xattrs
+ * @param[in] name	Name of the xattr
+ * @param[in] value	Value of the xattr, NULL if it does not exist
+ */
+static void mdc_xattr_add(struct mdcache_xattrs *xattrs, xattrname4 *name,
+			  xattrvalue4 *value)
+{
+	struct mdcache_xattr *xattr;
+	size_t value_len = value != NULL ? value->utf8string_len : 0;
+	size_t bytes = sizeof(*xattr) + name->utf8string_len + value_len;
+	size_t old_bytes;
+
+	/* Another thread may have cached it meanwhile */
+	if (mdc_xattr_find(xattrs, name) != NULL)
+		return;
+
+	if (xattrs->count >= mdcache_param.xattr_max_per_entry) {
+		xattr = glist_first_entry(&xattrs->xattrs,
+					  struct mdcache_xattr, list);
+		old_bytes = sizeof(*xattr) + xattr->name_len +
+			    (xattr->value_len > 0 ? xattr->value_len : 0);
+
+		glist_del(&xattr->list);
+		gsh_free(xattr);
+		xattrs->count--;
+		xattrs->bytes -= old_bytes;
+		(void) atomic_sub_uint64_t(&cache_stp->xattr_bytes, old_bytes);
+	}
+
+	if (!mdc_xattrs_charge(xattrs, bytes))
+		return;
+
+	xattr = gsh_malloc(bytes);
+	xattr->name_len = name->utf8string_len;
+	xattr->value_len = value != NULL ? value_len : -1;
+	memcpy(xattr->data, name->utf8string_val, xattr->name_len);
+	if (value_len != 0)
+		memcpy(xattr->data + xattr->name_len, value->utf8string_val,
+		       value_len);
+
+	glist_add_tail(&xattrs->xattrs, &xattr->list);
+	xattrs->count++;
+}
+
 /**
  * @brief List extended attributes on a file
  *
@@ -194,6 +394,8 @@ fsal_status_t mdcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
 			buf_size, create)
 	       );
 
+	mdc_xattrs_invalidate(handle);
+
 	return status;
 }
 
@@ -224,6 +426,8 @@ fsal_status_t mdcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 				buf_size)
 	       );
 
+	mdc_xattrs_invalidate(handle);
+
 	return status;
 }
 
@@ -249,6 +453,8 @@ fsal_status_t mdcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, id)
 	       );
 
+	mdc_xattrs_invalidate(handle);
+
 	return status;
 }
 
@@ -274,13 +480,17 @@ fsal_status_t mdcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	mdc_xattrs_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Get an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Served from the cached xattrs of the entry if they hold the name,
+ * otherwise passed to the sub-FSAL.  Values up to Xattr_Max_Value
+ * long, and names that do not exist, are then cached.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of attribute
@@ -293,13 +503,79 @@ fsal_status_t mdcache_getxattrs(struct fsal_obj_handle *obj_hdl,
 	struct mdcache_fsal_obj_handle *handle =
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
+	struct mdcache_xattrs *xattrs;
+	struct mdcache_xattr *xattr;
 	fsal_status_t status;
+	uint64_t change = 0;
+	uint32_t gen = 0;
+	bool cacheable = false;
+
+	if (mdcache_param.xattr_cache_size == 0)
+		goto passthrough;
+
+	PTHREAD_RWLOCK_rdlock(&handle->attr_lock);
+
+	xattrs = mdc_xattrs_valid(handle);
+	xattr = xattrs != NULL ? mdc_xattr_find(xattrs, name) : NULL;
+
+	if (xattr != NULL) {
+		if (xattr->value_len < 0) {
+			status = fsalstat(ERR_FSAL_NOENT, 0);
+		} else if (value->utf8string_len == 0) {
+			/* Only asking for the size */
+			value->utf8string_len = xattr->value_len;
+			status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		} else if (value->utf8string_len < xattr->value_len) {
+			status = fsalstat(ERR_FSAL_TOOSMALL, 0);
+		} else {
+			memcpy(value->utf8string_val,
+			       xattr->data + xattr->name_len,
+			       xattr->value_len);
+			value->utf8string_len = xattr->value_len;
+			status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+
+		PTHREAD_RWLOCK_unlock(&handle->attr_lock);
+		(void) atomic_inc_uint64_t(&cache_stp->xattr_hit);
+		return status;
+	}
+
+	cacheable = mdcache_is_attrs_valid(handle, ATTR_CHANGE);
+	change = handle->attrs.change;
+	gen = handle->xattr_gen;
+
+	PTHREAD_RWLOCK_unlock(&handle->attr_lock);
+
+	(void) atomic_inc_uint64_t(&cache_stp->xattr_miss);
+
+ passthrough:
 
 	subcall(
 		status = handle->sub_handle->obj_ops->getxattrs(
 			handle->sub_handle, name, value)
 	       );
 
+	if (!cacheable)
+		return status;
+
+	if (status.major == ERR_FSAL_NO_ERROR) {
+		/* Not a query of the size only, and small enough */
+		if (value->utf8string_val == NULL ||
+		    value->utf8string_len > mdcache_param.xattr_max_value)
+			return status;
+	} else if (status.major != ERR_FSAL_NOENT) {
+		return status;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&handle->attr_lock);
+
+	xattrs = mdc_xattrs_fill(handle, gen, change);
+	if (xattrs != NULL)
+		mdc_xattr_add(xattrs, name,
+			      status.major == ERR_FSAL_NOENT ? NULL : value);
+
+	PTHREAD_RWLOCK_unlock(&handle->attr_lock);
+
 	return status;
 }
 
@@ -328,6 +604,8 @@ fsal_status_t mdcache_setxattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, type, name, value)
 	       );
 
+	mdc_xattrs_invalidate(handle);
+
 	return status;
 }
 
@@ -353,13 +631,18 @@ fsal_status_t mdcache_removexattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	mdc_xattrs_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief List Extended Attributes
  *
- * Pass through to sub-FSAL
+ * A complete listing from cookie 0 is cached, and repeated from the
+ * cache while it fits in @a len.  Other listings are passed to the
+ * sub-FSAL.  As for the sub-FSAL, the names are copied @a len bytes
+ * after the start of @a names->entries.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] len	Length of names buffer
@@ -377,12 +660,94 @@ fsal_status_t mdcache_listxattrs(struct fsal_obj_handle *obj_hdl,
 	struct mdcache_fsal_obj_handle *handle =
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
+	struct mdcache_xattrs *xattrs;
 	fsal_status_t status;
+	uint64_t change = 0;
+	uint32_t gen = 0;
+	bool cacheable = false;
+	char *val;
+	size_t bytes;
+	uint32_t i;
+
+	if (mdcache_param.xattr_cache_size == 0 || *cookie != 0)
+		goto passthrough;
+
+	PTHREAD_RWLOCK_rdlock(&handle->attr_lock);
+
+	xattrs = mdc_xattrs_valid(handle);
+
+	if (xattrs != NULL && xattrs->names != NULL &&
+	    xattrs->names_count * sizeof(component4) <= len &&
+	    xattrs->names_len <= len) {
+		val = (char *)names->entries + len;
+		memcpy(val, &xattrs->names[xattrs->names_count],
+		       xattrs->names_len);
+
+		for (i = 0; i < xattrs->names_count; i++) {
+			names->entries[i].utf8string_len =
+				xattrs->names[i].utf8string_len;
+			names->entries[i].utf8string_val = val;
+			val += xattrs->names[i].utf8string_len;
+		}
+
+		names->entryCount = xattrs->names_count;
+		memcpy(*verf, xattrs->names_verf, NFS4_VERIFIER_SIZE);
+		*eof = true;
+
+		PTHREAD_RWLOCK_unlock(&handle->attr_lock);
+		(void) atomic_inc_uint64_t(&cache_stp->xattr_hit);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	cacheable = mdcache_is_attrs_valid(handle, ATTR_CHANGE);
+	change = handle->attrs.change;
+	gen = handle->xattr_gen;
+
+	PTHREAD_RWLOCK_unlock(&handle->attr_lock);
+
+	(void) atomic_inc_uint64_t(&cache_stp->xattr_miss);
+
+ passthrough:
 
 	subcall(
 		status = handle->sub_handle->obj_ops->listxattrs(
 			handle->sub_handle, len, cookie, verf, eof, names)
 	       );
 
+	if (!cacheable || FSAL_IS_ERROR(status) || !*eof)
+		return status;
+
+	PTHREAD_RWLOCK_wrlock(&handle->attr_lock);
+
+	xattrs = mdc_xattrs_fill(handle, gen, change);
+	if (xattrs != NULL && xattrs->names == NULL) {
+		size_t names_len = 0;
+
+		for (i = 0; i < names->entryCount; i++)
+			names_len += names->entries[i].utf8string_len;
+
+		bytes = names->entryCount * sizeof(component4) + names_len;
+
+		if (mdc_xattrs_charge(xattrs, bytes)) {
+			xattrs->names = gsh_malloc(bytes);
+			val = (char *)&xattrs->names[names->entryCount];
+
+			for (i = 0; i < names->entryCount; i++) {
+				xattrs->names[i].utf8string_len =
+					names->entries[i].utf8string_len;
+				xattrs->names[i].utf8string_val = val;
+				memcpy(val, names->entries[i].utf8string_val,
+				       names->entries[i].utf8string_len);
+				val += names->entries[i].utf8string_len;
+			}
+
+			xattrs->names_count = names->entryCount;
+			xattrs->names_len = names_len;
+			memcpy(xattrs->names_verf, *verf, NFS4_VERIFIER_SIZE);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&handle->attr_lock);
+
 	return status;
 }
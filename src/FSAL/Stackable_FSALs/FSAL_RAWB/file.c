@@ -0,0 +1,1449 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* file.c
+ * File I/O methods for RAWB module
+ *
+ * Readahead of sequential streams and write-behind of UNSTABLE writes.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include "fsal.h"
+#include "FSAL/access_check.h"
+#include "fsal_convert.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include "FSAL/fsal_commonlib.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "client_mgr.h"
+#include "rawb_methods.h"
+
+/**
+ * @brief Callback arg for RAWB async callbacks
+ *
+ * RAWB needs to know what its object is related to the sub-FSAL's object.
+ * This wraps the given callback arg with RAWB specific info
+ */
+struct rawb_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< RAWB's handle */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+};
+
+/**
+ * @brief Callback for RAWB async calls
+ *
+ * Unstack, and call up.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+void rawb_async_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+		   void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct rawb_async_arg *arg = caller_data;
+
+	op_ctx->fsal_export = save_exp->super_export;
+	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg);
+}
+
+/** @brief Readahead thread pool, NULL to read ahead in line */
+static struct fridgethr *rawb_fridge;
+
+/**
+ * @brief Reserve buffer memory
+ *
+ * @param[in] size	Bytes to reserve
+ *
+ * @return true if the reservation fits in Max_Memory.
+ */
+static bool rawb_mem_get(size_t size)
+{
+	if (atomic_add_uint64_t(&RAWB.mem_used, size) > RAWB.max_memory) {
+		atomic_sub_uint64_t(&RAWB.mem_used, size);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Allocate a buffer against the memory bound
+ *
+ * @param[in,out] buf	Buffer to allocate
+ * @param[in] size	Size of the buffer
+ *
+ * @return true if the buffer was allocated.
+ */
+static bool rawb_buf_alloc(struct rawb_buf *buf, size_t size)
+{
+	if (!rawb_mem_get(size))
+		return false;
+
+	buf->data = gsh_malloc(size);
+	buf->size = size;
+	buf->len = 0;
+	return true;
+}
+
+static void rawb_buf_free(struct rawb_buf *buf)
+{
+	if (buf->data == NULL)
+		return;
+
+	gsh_free(buf->data);
+	atomic_sub_uint64_t(&RAWB.mem_used, buf->size);
+	buf->data = NULL;
+	buf->size = 0;
+	buf->len = 0;
+}
+
+static inline uint64_t rawb_buf_end(struct rawb_buf *buf)
+{
+	return buf->offset + buf->len;
+}
+
+static inline bool rawb_buf_overlaps(struct rawb_buf *buf, uint64_t offset,
+				     size_t len)
+{
+	return buf->len != 0 && offset < rawb_buf_end(buf) &&
+	       offset + len > buf->offset;
+}
+
+static size_t rawb_iov_len(struct fsal_io_arg *io_arg)
+{
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < io_arg->iov_count; i++)
+		len += io_arg->iov[i].iov_len;
+
+	return len;
+}
+
+/**
+ * @brief Copy from a buffer into the caller's vectors
+ */
+static void rawb_copy_to_iov(struct fsal_io_arg *read_arg, const char *src,
+			     size_t len)
+{
+	size_t n;
+	int i;
+
+	for (i = 0; i < read_arg->iov_count && len > 0; i++) {
+		n = MIN(len, read_arg->iov[i].iov_len);
+		memcpy(read_arg->iov[i].iov_base, src, n);
+		src += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Copy from the caller's vectors into a buffer
+ */
+static void rawb_copy_from_iov(char *dst, struct fsal_io_arg *write_arg)
+{
+	int i;
+
+	for (i = 0; i < write_arg->iov_count; i++) {
+		memcpy(dst, write_arg->iov[i].iov_base,
+		       write_arg->iov[i].iov_len);
+		dst += write_arg->iov[i].iov_len;
+	}
+}
+
+/**
+ * @brief Issue a read on the sub-FSAL
+ */
+static void rawb_sub_read2(struct rawb_fsal_obj_handle *handle,
+			   struct rawb_fsal_export *export,
+			   bool bypass,
+			   fsal_async_cb done_cb,
+			   struct fsal_io_arg *read_arg,
+			   void *caller_arg)
+{
+	struct rawb_async_arg *arg;
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = &handle->obj_handle;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, bypass,
+					   rawb_async_cb, read_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+/**
+ * @brief Issue a write on the sub-FSAL
+ */
+static void rawb_sub_write2(struct rawb_fsal_obj_handle *handle,
+			    struct rawb_fsal_export *export,
+			    bool bypass,
+			    fsal_async_cb done_cb,
+			    struct fsal_io_arg *write_arg,
+			    void *caller_arg)
+{
+	struct rawb_async_arg *arg;
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = &handle->obj_handle;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->write2(handle->sub_handle, bypass,
+					    rawb_async_cb, write_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+/**
+ * @brief Completion of an I/O we wait for
+ */
+struct rawb_sync_arg {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool done;
+	fsal_status_t status;
+};
+
+static void rawb_sync_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *obj_data, void *caller_data)
+{
+	struct rawb_sync_arg *sync = caller_data;
+
+	PTHREAD_MUTEX_lock(&sync->mutex);
+	sync->status = ret;
+	sync->done = true;
+	pthread_cond_signal(&sync->cond);
+	PTHREAD_MUTEX_unlock(&sync->mutex);
+}
+
+/**
+ * @brief Write the head of the write-behind buffer to the sub-FSAL
+ *
+ * The sub-FSAL may complete the write on another thread; wait for it.
+ *
+ * @param[in] handle	File
+ * @param[in] export	Our export
+ * @param[in] len	Bytes to write from the start of the buffer
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t rawb_wb_write(struct rawb_fsal_obj_handle *handle,
+				   struct rawb_fsal_export *export,
+				   size_t len)
+{
+	struct rawb_wbuf *wb = &handle->wb;
+	struct fsal_io_arg *write_arg;
+	struct rawb_sync_arg sync;
+	size_t done = 0;
+
+	write_arg = gsh_calloc(1, sizeof(*write_arg) + sizeof(struct iovec));
+	PTHREAD_MUTEX_init(&sync.mutex, NULL);
+	PTHREAD_COND_init(&sync.cond, NULL);
+	sync.status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	while (done < len) {
+		write_arg->io_amount = 0;
+		write_arg->fsal_stable = false;
+		write_arg->state = wb->state;
+		write_arg->offset = wb->buf.offset + done;
+		write_arg->iov_count = 1;
+		write_arg->iov[0].iov_base = wb->buf.data + done;
+		write_arg->iov[0].iov_len = len - done;
+		sync.done = false;
+
+		op_ctx->fsal_export = export->export.sub_export;
+		handle->sub_handle->obj_ops->write2(handle->sub_handle,
+						    wb->bypass, rawb_sync_cb,
+						    write_arg, &sync);
+		op_ctx->fsal_export = &export->export;
+
+		PTHREAD_MUTEX_lock(&sync.mutex);
+		while (!sync.done)
+			pthread_cond_wait(&sync.cond, &sync.mutex);
+		PTHREAD_MUTEX_unlock(&sync.mutex);
+
+		if (FSAL_IS_ERROR(sync.status))
+			break;
+
+		if (write_arg->io_amount == 0) {
+			sync.status = fsalstat(ERR_FSAL_IO, 0);
+			break;
+		}
+
+		done += write_arg->io_amount;
+	}
+
+	PTHREAD_COND_destroy(&sync.cond);
+	PTHREAD_MUTEX_destroy(&sync.mutex);
+	gsh_free(write_arg);
+
+	return sync.status;
+}
+
+/**
+ * @brief Write back the write-behind buffer
+ *
+ * Called with the io_lock held.  If the write fails, the data is
+ * dropped and the error kept for the next COMMIT or close.
+ *
+ * @param[in] handle	File
+ * @param[in] export	Our export
+ * @param[in] all	Write all of it, else only up to the last aligned
+ *			offset
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t rawb_wb_flush(struct rawb_fsal_obj_handle *handle,
+				   struct rawb_fsal_export *export,
+				   bool all)
+{
+	struct rawb_wbuf *wb = &handle->wb;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t len = wb->buf.len;
+
+	if (!all && len != 0) {
+		uint32_t align =
+			atomic_fetch_uint32_t(&export->write_alignment);
+		uint64_t aligned = rawb_buf_end(&wb->buf);
+
+		aligned -= aligned % align;
+		if (aligned > wb->buf.offset)
+			len = aligned - wb->buf.offset;
+	}
+
+	if (len != 0) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Write-behind of %zu bytes at %" PRIu64,
+			     len, wb->buf.offset);
+
+		status = rawb_wb_write(handle, export, len);
+
+		if (FSAL_IS_ERROR(status)) {
+			LogInfo(COMPONENT_FSAL,
+				"Write-behind of %zu bytes at %" PRIu64
+				" failed: %s",
+				wb->buf.len, wb->buf.offset,
+				fsal_err_txt(status));
+			if (!FSAL_IS_ERROR(wb->error))
+				wb->error = status;
+			len = wb->buf.len;
+		}
+
+		wb->buf.len -= len;
+		wb->buf.offset += len;
+		if (wb->buf.len != 0)
+			memmove(wb->buf.data, wb->buf.data + len,
+				wb->buf.len);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Write back and free the write-behind buffer
+ *
+ * Called with the io_lock held.
+ *
+ * @param[in] handle	File
+ * @param[in] export	Our export
+ * @param[in] report	The error is being returned to the client, clear it
+ *
+ * @return The first write-back error since the last COMMIT or close.
+ */
+static fsal_status_t rawb_wb_release(struct rawb_fsal_obj_handle *handle,
+				     struct rawb_fsal_export *export,
+				     bool report)
+{
+	struct rawb_wbuf *wb = &handle->wb;
+	fsal_status_t status;
+
+	(void) rawb_wb_flush(handle, export, true);
+	rawb_buf_free(&wb->buf);
+	wb->state = NULL;
+
+	status = wb->error;
+	if (report)
+		wb->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return status;
+}
+
+/**
+ * @brief Drop readahead data made stale by a change to the file
+ *
+ * Called with the io_lock held.
+ *
+ * @param[in] handle	File
+ * @param[in] offset	Start of the change
+ * @param[in] len	Length of the change, UINT64_MAX for the whole file
+ */
+static void rawb_invalidate(struct rawb_fsal_obj_handle *handle,
+			    uint64_t offset, uint64_t len)
+{
+	struct glist_head *glist;
+	struct rawb_stream *stream;
+	int i;
+
+	handle->data_gen++;
+
+	glist_for_each(glist, &handle->streams) {
+		stream = glist_entry(glist, struct rawb_stream, list);
+		stream->eof = false;
+
+		for (i = 0; i < RAWB_WINDOWS; i++) {
+			struct rawb_window *win = &stream->win[i];
+
+			if (win->buf.data == NULL)
+				continue;
+
+			if (len == UINT64_MAX ||
+			    win->eof ||
+			    rawb_buf_overlaps(&win->buf, offset, len))
+				rawb_buf_free(&win->buf);
+		}
+	}
+}
+
+static void rawb_stream_free(struct rawb_fsal_obj_handle *handle,
+			     struct rawb_stream *stream)
+{
+	int i;
+
+	for (i = 0; i < RAWB_WINDOWS; i++)
+		rawb_buf_free(&stream->win[i].buf);
+
+	glist_del(&stream->list);
+	handle->stream_count--;
+	gsh_free(stream);
+}
+
+static struct rawb_stream *rawb_stream_find(struct rawb_fsal_obj_handle *hdl,
+					    struct state_t *state)
+{
+	struct glist_head *glist;
+	struct rawb_stream *stream;
+
+	glist_for_each(glist, &hdl->streams) {
+		stream = glist_entry(glist, struct rawb_stream, list);
+		if (stream->state == state)
+			return stream;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find or make the stream of an open state
+ *
+ * Called with the io_lock held.  The least recently used stream without
+ * a readahead in flight makes room for a new one.
+ *
+ * @return The stream, or NULL if all of them are busy.
+ */
+static struct rawb_stream *rawb_stream_get(struct rawb_fsal_obj_handle *hdl,
+					   struct state_t *state)
+{
+	struct rawb_stream *stream = rawb_stream_find(hdl, state);
+
+	if (stream != NULL) {
+		/* Most recently used first */
+		glist_del(&stream->list);
+		glist_add(&hdl->streams, &stream->list);
+		return stream;
+	}
+
+	if (hdl->stream_count >= RAWB_MAX_STREAMS) {
+		stream = glist_last_entry(&hdl->streams, struct rawb_stream,
+					  list);
+		while (stream != NULL && stream->inflight)
+			stream = glist_prev_entry(&hdl->streams,
+						  struct rawb_stream, list,
+						  &stream->list);
+
+		if (stream == NULL)
+			return NULL;
+
+		rawb_stream_free(hdl, stream);
+	}
+
+	stream = gsh_calloc(1, sizeof(*stream));
+	stream->state = state;
+	stream->id = hdl->next_stream_id++;
+	glist_add(&hdl->streams, &stream->list);
+	hdl->stream_count++;
+
+	return stream;
+}
+
+/**
+ * @brief A readahead
+ */
+struct rawb_ra_req {
+	struct glist_head list;		/*< On the handle's ra_done */
+	fsal_status_t status;
+	struct rawb_fsal_obj_handle *handle;
+	struct rawb_fsal_export *export;
+	struct gsh_export *ctx_export;	/*< With a reference */
+	struct gsh_client *client;	/*< With a reference, if any */
+	struct user_cred creds;		/*< Of the reader, groups copied */
+	/** Op context of the readahead thread, the sub-FSAL may keep
+	 *  pointers into it until the read completes
+	 */
+	struct root_op_context root_ctx;
+	/** The completion, and the readahead thread while it uses
+	 *  root_ctx, updated atomically
+	 */
+	uint32_t refs;
+	uint64_t stream_id;
+	uint64_t data_gen;
+	struct rawb_buf buf;
+	struct fsal_io_arg *read_arg;
+};
+
+/**
+ * @brief Drop a reference to a readahead
+ *
+ * Once the read is complete and the readahead thread is done with it,
+ * queue it to be installed by the next reader.  The io_lock may be held
+ * by a write-back waiting on this very completion thread.  The
+ * references taken for the reader are dropped first, the request may
+ * be reaped as soon as it is queued.
+ */
+static void rawb_ra_put(struct rawb_ra_req *req)
+{
+	struct rawb_fsal_obj_handle *handle = req->handle;
+
+	if (atomic_dec_uint32_t(&req->refs) != 0)
+		return;
+
+	put_gsh_export(req->ctx_export);
+	if (req->client != NULL)
+		put_gsh_client(req->client);
+
+	PTHREAD_MUTEX_lock(&handle->ra_lock);
+	glist_add_tail(&handle->ra_done, &req->list);
+	if (--handle->ra_inflight == 0)
+		pthread_cond_broadcast(&handle->ra_cond);
+	PTHREAD_MUTEX_unlock(&handle->ra_lock);
+}
+
+/**
+ * @brief Completion of a readahead, maybe on the issuing thread
+ */
+static void rawb_ra_done(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *obj_data, void *caller_data)
+{
+	struct rawb_ra_req *req = caller_data;
+
+	req->status = ret;
+	rawb_ra_put(req);
+}
+
+/**
+ * @brief Install completed readaheads
+ *
+ * Called with the io_lock held.  The data becomes a window of its
+ * stream, unless the stream is gone or the file changed while it was
+ * read.
+ */
+static void rawb_ra_reap(struct rawb_fsal_obj_handle *handle)
+{
+	struct glist_head done, *glist;
+	struct rawb_ra_req *req;
+	struct rawb_stream *stream;
+	struct rawb_window *win;
+	int i;
+
+	glist_init(&done);
+
+	PTHREAD_MUTEX_lock(&handle->ra_lock);
+	glist_splice_tail(&done, &handle->ra_done);
+	PTHREAD_MUTEX_unlock(&handle->ra_lock);
+
+	while ((req = glist_first_entry(&done, struct rawb_ra_req,
+					list)) != NULL) {
+		glist_del(&req->list);
+
+		stream = NULL;
+		glist_for_each(glist, &handle->streams) {
+			stream = glist_entry(glist, struct rawb_stream, list);
+			if (stream->id == req->stream_id)
+				break;
+			stream = NULL;
+		}
+
+		if (stream != NULL) {
+			stream->inflight = false;
+
+			if (!FSAL_IS_ERROR(req->status) &&
+			    req->data_gen == handle->data_gen) {
+				/* Take a free window, or the one furthest
+				 * behind.
+				 */
+				win = NULL;
+				for (i = 0; i < RAWB_WINDOWS; i++) {
+					if (stream->win[i].buf.data == NULL) {
+						win = &stream->win[i];
+						break;
+					}
+					if (win == NULL ||
+					    stream->win[i].buf.offset <
+							win->buf.offset)
+						win = &stream->win[i];
+				}
+
+				rawb_buf_free(&win->buf);
+				win->buf = req->buf;
+				win->buf.len = req->read_arg->io_amount;
+				win->eof = req->read_arg->end_of_file;
+				stream->eof = win->eof;
+				req->buf.data = NULL;
+			}
+		}
+
+		rawb_buf_free(&req->buf);
+		gsh_free(req->creds.caller_garray);
+		gsh_free(req->read_arg);
+		gsh_free(req);
+	}
+}
+
+/**
+ * @brief Wait for all readaheads of a file to complete
+ *
+ * Called with the io_lock held, so no new ones start.
+ */
+static void rawb_ra_wait(struct rawb_fsal_obj_handle *handle)
+{
+	PTHREAD_MUTEX_lock(&handle->ra_lock);
+	while (handle->ra_inflight != 0)
+		pthread_cond_wait(&handle->ra_cond, &handle->ra_lock);
+	PTHREAD_MUTEX_unlock(&handle->ra_lock);
+
+	rawb_ra_reap(handle);
+}
+
+static void rawb_ra_issue(struct rawb_ra_req *req)
+{
+	struct rawb_fsal_obj_handle *handle = req->handle;
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+
+	op_ctx->fsal_export = req->export->export.sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, false,
+					   rawb_ra_done, req->read_arg, req);
+	op_ctx->fsal_export = save_exp;
+}
+
+static void rawb_ra_run(struct fridgethr_context *ctx)
+{
+	struct rawb_ra_req *req = ctx->arg;
+
+	/* The read may complete before we are done with root_ctx */
+	(void) atomic_inc_uint32_t(&req->refs);
+
+	/* Need an op context for the sub-FSAL, read as the reader */
+	init_root_op_context(&req->root_ctx, req->ctx_export,
+			     &req->export->export, 0, 0, UNKNOWN_REQUEST);
+	req->root_ctx.req_ctx.creds = &req->creds;
+	req->root_ctx.req_ctx.client = req->client;
+
+	rawb_ra_issue(req);
+
+	release_root_op_context();
+	rawb_ra_put(req);
+}
+
+/**
+ * @brief Set up a readahead for a stream
+ *
+ * Called with the io_lock held.  Dirty data in the window is written
+ * back first so that the readahead sees it.
+ *
+ * @return The readahead to submit once the lock is dropped, or NULL.
+ */
+static struct rawb_ra_req *rawb_ra_prepare(struct rawb_fsal_obj_handle *hdl,
+					   struct rawb_fsal_export *export,
+					   struct rawb_stream *stream,
+					   uint64_t offset)
+{
+	uint32_t size = atomic_fetch_uint32_t(&export->readahead_size);
+	struct rawb_ra_req *req;
+
+	if (rawb_buf_overlaps(&hdl->wb.buf, offset, size))
+		(void) rawb_wb_flush(hdl, export, true);
+
+	req = gsh_calloc(1, sizeof(*req));
+
+	if (!rawb_buf_alloc(&req->buf, size)) {
+		gsh_free(req);
+		return NULL;
+	}
+
+	req->handle = hdl;
+	req->export = export;
+	req->refs = 1;
+	req->ctx_export = op_ctx->ctx_export;
+	get_gsh_export_ref(req->ctx_export);
+	req->client = op_ctx->client;
+	if (req->client != NULL)
+		inc_gsh_client_refcount(req->client);
+	req->creds = *op_ctx->creds;
+	if (req->creds.caller_glen != 0) {
+		req->creds.caller_garray =
+			gsh_malloc(req->creds.caller_glen * sizeof(gid_t));
+		memcpy(req->creds.caller_garray,
+		       op_ctx->creds->caller_garray,
+		       req->creds.caller_glen * sizeof(gid_t));
+	} else {
+		req->creds.caller_garray = NULL;
+	}
+	req->stream_id = stream->id;
+	req->data_gen = hdl->data_gen;
+	req->buf.offset = offset;
+	req->read_arg = gsh_calloc(1, sizeof(*req->read_arg) +
+					sizeof(struct iovec));
+	req->read_arg->state = stream->state;
+	req->read_arg->offset = offset;
+	req->read_arg->iov_count = 1;
+	req->read_arg->iov[0].iov_base = req->buf.data;
+	req->read_arg->iov[0].iov_len = size;
+
+	stream->inflight = true;
+	PTHREAD_MUTEX_lock(&hdl->ra_lock);
+	hdl->ra_inflight++;
+	PTHREAD_MUTEX_unlock(&hdl->ra_lock);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "Readahead of %" PRIu32 " bytes at %" PRIu64,
+		     size, offset);
+
+	return req;
+}
+
+static void rawb_ra_submit(struct rawb_ra_req *req)
+{
+	if (rawb_fridge != NULL &&
+	    fridgethr_submit(rawb_fridge, rawb_ra_run, req) == 0)
+		return;
+
+	/* No thread for it, read ahead in line */
+	rawb_ra_issue(req);
+}
+
+/**
+ * @brief Serve a read from a stream's readahead windows
+ *
+ * Called with the io_lock held.  Tracks whether the stream is
+ * sequential and starts the next readahead when the data read ahead
+ * runs short of a window.
+ *
+ * @param[in] handle	File
+ * @param[in] export	Our export
+ * @param[in] stream	Stream of the read
+ * @param[in,out] read_arg	The read
+ * @param[in] len	Bytes asked for
+ * @param[out] ra	Readahead to submit, or NULL
+ *
+ * @return true if the read was served.
+ */
+static bool rawb_stream_read(struct rawb_fsal_obj_handle *handle,
+			     struct rawb_fsal_export *export,
+			     struct rawb_stream *stream,
+			     struct fsal_io_arg *read_arg,
+			     size_t len,
+			     struct rawb_ra_req **ra)
+{
+	uint64_t offset = read_arg->offset;
+	uint64_t ahead = offset + len;
+	struct rawb_window *hit = NULL;
+	bool seq = offset == stream->next;
+	size_t n;
+	int i;
+
+	stream->seq = seq ? stream->seq + 1 : 0;
+	stream->next = offset + len;
+
+	for (i = 0; i < RAWB_WINDOWS; i++) {
+		struct rawb_window *win = &stream->win[i];
+		uint64_t end = rawb_buf_end(&win->buf);
+
+		if (win->buf.data == NULL)
+			continue;
+
+		if (offset >= win->buf.offset &&
+		    (offset + len <= end || (win->eof && offset <= end)))
+			hit = win;
+	}
+
+	if (hit != NULL) {
+		n = MIN(len, rawb_buf_end(&hit->buf) - offset);
+		rawb_copy_to_iov(read_arg, hit->buf.data +
+					   (offset - hit->buf.offset), n);
+		read_arg->io_amount = n;
+		read_arg->end_of_file =
+			hit->eof && offset + n == rawb_buf_end(&hit->buf);
+
+		/* Windows wholly behind the read are used up */
+		for (i = 0; i < RAWB_WINDOWS; i++) {
+			struct rawb_window *win = &stream->win[i];
+
+			if (win != hit && win->buf.data != NULL &&
+			    rawb_buf_end(&win->buf) <= offset)
+				rawb_buf_free(&win->buf);
+		}
+	} else if (!seq) {
+		/* Random access, the windows are of no use */
+		for (i = 0; i < RAWB_WINDOWS; i++)
+			rawb_buf_free(&stream->win[i].buf);
+		stream->eof = false;
+	}
+
+	if (stream->seq < atomic_fetch_uint32_t(&export->sequential_reads) ||
+	    stream->inflight || stream->eof)
+		return hit != NULL;
+
+	for (i = 0; i < RAWB_WINDOWS; i++) {
+		struct rawb_window *win = &stream->win[i];
+
+		if (win->buf.data != NULL && rawb_buf_end(&win->buf) > ahead)
+			ahead = rawb_buf_end(&win->buf);
+	}
+
+	if (ahead - (offset + len) <
+	    atomic_fetch_uint32_t(&export->readahead_size))
+		*ra = rawb_ra_prepare(handle, export, stream, ahead);
+
+	return hit != NULL;
+}
+
+/**
+ * @brief Set up the I/O state of a handle
+ */
+void rawb_io_init(struct rawb_fsal_obj_handle *hdl)
+{
+	PTHREAD_MUTEX_init(&hdl->io_lock, NULL);
+	PTHREAD_MUTEX_init(&hdl->ra_lock, NULL);
+	PTHREAD_COND_init(&hdl->ra_cond, NULL);
+	glist_init(&hdl->streams);
+	glist_init(&hdl->ra_done);
+}
+
+/**
+ * @brief Tear down the I/O state of a handle being released
+ *
+ * Writes back what is left in the write-behind buffer and waits for
+ * readaheads in flight.  No COMMIT can see a write-back error any more,
+ * so it changes the write verifier instead.
+ */
+void rawb_io_fini(struct rawb_fsal_obj_handle *hdl,
+		  struct rawb_fsal_export *export)
+{
+	struct rawb_stream *stream;
+	fsal_status_t status;
+
+	PTHREAD_MUTEX_lock(&hdl->io_lock);
+
+	/* The states are gone by now */
+	hdl->wb.state = NULL;
+	status = rawb_wb_release(hdl, export, false);
+	if (FSAL_IS_ERROR(status)) {
+		LogWarn(COMPONENT_FSAL,
+			"Write-behind of released handle %p failed: %s",
+			&hdl->obj_handle, fsal_err_txt(status));
+		(void) atomic_inc_uint32_t(&export->write_verifier_gen);
+	}
+
+	rawb_ra_wait(hdl);
+
+	while ((stream = glist_first_entry(&hdl->streams, struct rawb_stream,
+					   list)) != NULL)
+		rawb_stream_free(hdl, stream);
+
+	PTHREAD_MUTEX_unlock(&hdl->io_lock);
+
+	PTHREAD_COND_destroy(&hdl->ra_cond);
+	PTHREAD_MUTEX_destroy(&hdl->ra_lock);
+	PTHREAD_MUTEX_destroy(&hdl->io_lock);
+}
+
+/**
+ * @brief Write back and drop everything buffered for a file
+ *
+ * For operations that change the file's data or size behind our back:
+ * truncation, fallocate and truncating opens.  A write-back failure is
+ * kept for the next COMMIT or close.
+ */
+void rawb_io_sync(struct rawb_fsal_obj_handle *hdl,
+		  struct rawb_fsal_export *export)
+{
+	PTHREAD_MUTEX_lock(&hdl->io_lock);
+	(void) rawb_wb_release(hdl, export, false);
+	rawb_invalidate(hdl, 0, UINT64_MAX);
+	PTHREAD_MUTEX_unlock(&hdl->io_lock);
+}
+
+/**
+ * @brief Account for the write-behind buffer in attributes
+ *
+ * The sub-FSAL does not know about data we have not written back yet,
+ * so extend the size to cover it.
+ */
+void rawb_io_getattrs(struct rawb_fsal_obj_handle *hdl,
+		      struct attrlist *attrs)
+{
+	uint64_t end;
+
+	if (!FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE))
+		return;
+
+	PTHREAD_MUTEX_lock(&hdl->io_lock);
+
+	end = rawb_buf_end(&hdl->wb.buf);
+	if (hdl->wb.buf.len != 0 && end > attrs->filesize)
+		attrs->filesize = end;
+
+	PTHREAD_MUTEX_unlock(&hdl->io_lock);
+}
+
+/**
+ * @brief Start the readahead threads
+ */
+fsal_status_t rawb_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (RAWB.readahead_threads == 0 || rawb_fridge != NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = RAWB.readahead_threads;
+	frp.thr_min = 1;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&rawb_fridge, "RAWB_readahead", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize RAWB readahead fridge, error code %d.",
+			 rc);
+		rawb_fridge = NULL;
+	}
+
+	return posix2fsal_status(rc);
+}
+
+/**
+ * @brief Stop the readahead threads
+ */
+void rawb_pkgshutdown(void)
+{
+	int rc;
+
+	if (rawb_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(rawb_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(rawb_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down RAWB readahead threads: %d", rc);
+	}
+
+	fridgethr_destroy(rawb_fridge);
+	rawb_fridge = NULL;
+}
+
+/* rawb_close
+ * Close the file if it is still open.
+ * Yes, we ignor lock status.  Closing a file in POSIX
+ * releases all locks but that is state and cache inode's problem.
+ */
+
+fsal_status_t rawb_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	/* Data written behind without a state goes through the global fd */
+	PTHREAD_MUTEX_lock(&handle->io_lock);
+	if (handle->wb.buf.data != NULL && handle->wb.state == NULL)
+		(void) rawb_wb_release(handle, export, false);
+	PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close(handle->sub_handle);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t rawb_open2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state,
+			 fsal_openflags_t openflags,
+			 enum fsal_create_mode createmode,
+			 const char *name,
+			 struct attrlist *attrs_in,
+			 fsal_verifier_t verifier,
+			 struct fsal_obj_handle **new_obj,
+			 struct attrlist *attrs_out,
+			 bool *caller_perm_check)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+	struct fsal_obj_handle *sub_handle = NULL;
+
+	/* Opening the file itself (name == NULL) may truncate it */
+	if (name == NULL && (openflags & FSAL_O_TRUNC))
+		rawb_io_sync(handle, export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->open2(handle->sub_handle, state,
+						  openflags, createmode, name,
+						  attrs_in, verifier,
+						  &sub_handle, attrs_out,
+						  caller_perm_check);
+	op_ctx->fsal_export = &export->export;
+
+	if (sub_handle) {
+		/* wrap the subfsal handle in a rawb handle. */
+		return rawb_alloc_and_check_handle(export, sub_handle,
+						   obj_hdl->fs, new_obj,
+						   status);
+	}
+
+	return status;
+}
+
+bool rawb_check_verifier(struct fsal_obj_handle *obj_hdl,
+			 fsal_verifier_t verifier)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	bool result =
+		handle->sub_handle->obj_ops->check_verifier(handle->sub_handle,
+							   verifier);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_openflags_t rawb_status2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_openflags_t result =
+		handle->sub_handle->obj_ops->status2(handle->sub_handle,
+						    state);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_status_t rawb_reopen2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	if (openflags & FSAL_O_TRUNC)
+		rawb_io_sync(handle, export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->reopen2(handle->sub_handle,
+						    state, openflags);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+void rawb_read2(struct fsal_obj_handle *obj_hdl,
+		bool bypass,
+		fsal_async_cb done_cb,
+		struct fsal_io_arg *read_arg,
+		void *caller_arg)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+	struct rawb_stream *stream;
+	struct rawb_ra_req *ra = NULL;
+	size_t len;
+	bool hit = false;
+
+	if (obj_hdl->type != REGULAR_FILE ||
+	    (!export->readahead && !export->write_behind)) {
+		rawb_sub_read2(handle, export, bypass, done_cb, read_arg,
+			       caller_arg);
+		return;
+	}
+
+	len = rawb_iov_len(read_arg);
+
+	if (read_arg->info != NULL) {
+		/* READ_PLUS wants holes reported, leave it to the sub-FSAL
+		 * once it sees the data written behind.
+		 */
+		PTHREAD_MUTEX_lock(&handle->io_lock);
+		if (rawb_buf_overlaps(&handle->wb.buf, read_arg->offset, len))
+			(void) rawb_wb_flush(handle, export, true);
+		PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+		rawb_sub_read2(handle, export, bypass, done_cb, read_arg,
+			       caller_arg);
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&handle->io_lock);
+
+	/* Reads see data written behind */
+	if (rawb_buf_overlaps(&handle->wb.buf, read_arg->offset, len))
+		(void) rawb_wb_flush(handle, export, true);
+
+	if (export->readahead) {
+		rawb_ra_reap(handle);
+		stream = rawb_stream_get(handle, read_arg->state);
+		if (stream != NULL)
+			hit = rawb_stream_read(handle, export, stream,
+					       read_arg, len, &ra);
+	}
+
+	PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+	if (hit)
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg,
+			caller_arg);
+	else
+		rawb_sub_read2(handle, export, bypass, done_cb, read_arg,
+			       caller_arg);
+
+	if (ra != NULL)
+		rawb_ra_submit(ra);
+}
+
+void rawb_write2(struct fsal_obj_handle *obj_hdl,
+		 bool bypass,
+		 fsal_async_cb done_cb,
+		 struct fsal_io_arg *write_arg,
+		 void *caller_arg)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+	struct rawb_wbuf *wb = &handle->wb;
+	uint64_t offset = write_arg->offset;
+	uint32_t wb_size;
+	size_t len;
+
+	if (obj_hdl->type != REGULAR_FILE ||
+	    (!export->readahead && !export->write_behind)) {
+		rawb_sub_write2(handle, export, bypass, done_cb, write_arg,
+				caller_arg);
+		return;
+	}
+
+	len = rawb_iov_len(write_arg);
+	wb_size = atomic_fetch_uint32_t(&export->write_behind_size);
+
+	PTHREAD_MUTEX_lock(&handle->io_lock);
+
+	rawb_invalidate(handle, offset, len);
+
+	if (!export->write_behind || write_arg->fsal_stable || len >= wb_size)
+		goto passthrough;
+
+	/* Gather writes that extend or overwrite the dirty extent */
+	if (wb->buf.len != 0 &&
+	    (wb->state != write_arg->state || wb->bypass != bypass ||
+	     offset < wb->buf.offset || offset > rawb_buf_end(&wb->buf) ||
+	     offset + len > wb->buf.offset + wb->buf.size))
+		(void) rawb_wb_flush(handle, export, true);
+
+	if (wb->buf.data == NULL && !rawb_buf_alloc(&wb->buf, wb_size))
+		goto passthrough;
+
+	if (wb->buf.len == 0) {
+		wb->buf.offset = offset;
+		wb->state = write_arg->state;
+		wb->bypass = bypass;
+	}
+
+	rawb_copy_from_iov(wb->buf.data + (offset - wb->buf.offset),
+			   write_arg);
+	if (offset + len > rawb_buf_end(&wb->buf))
+		wb->buf.len = offset + len - wb->buf.offset;
+
+	if (wb->buf.len == wb->buf.size)
+		(void) rawb_wb_flush(handle, export, false);
+
+	PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+	write_arg->io_amount = len;
+	write_arg->fsal_stable = false;
+	done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg,
+		caller_arg);
+	return;
+
+passthrough:
+	/* Keep writes in order with the data written behind */
+	if (rawb_buf_overlaps(&wb->buf, offset, len))
+		(void) rawb_wb_flush(handle, export, true);
+
+	PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+	rawb_sub_write2(handle, export, bypass, done_cb, write_arg,
+			caller_arg);
+}
+
+fsal_status_t rawb_seek2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state,
+			 struct io_info *info)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->seek2(handle->sub_handle, state,
+						  info);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t rawb_io_advise2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      struct io_hints *hints)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->io_advise2(handle->sub_handle,
+						       state, hints);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t rawb_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			   size_t len)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+	fsal_status_t wb_status;
+
+	PTHREAD_MUTEX_lock(&handle->io_lock);
+	wb_status = rawb_wb_release(handle, export, true);
+	PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->commit2(handle->sub_handle, offset,
+						     len);
+	op_ctx->fsal_export = &export->export;
+
+	if (FSAL_IS_ERROR(wb_status) && !FSAL_IS_ERROR(status))
+		return wb_status;
+
+	return status;
+}
+
+fsal_status_t rawb_lock_op2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state,
+			    void *p_owner,
+			    fsal_lock_op_t lock_op,
+			    fsal_lock_param_t *req_lock,
+			    fsal_lock_param_t *conflicting_lock)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->lock_op2(handle->sub_handle, state,
+						     p_owner, lock_op, req_lock,
+						     conflicting_lock);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t rawb_close2(struct fsal_obj_handle *obj_hdl,
+			  struct state_t *state)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+	fsal_status_t wb_status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	struct rawb_stream *stream;
+
+	PTHREAD_MUTEX_lock(&handle->io_lock);
+
+	if (handle->wb.buf.data != NULL && handle->wb.state == state)
+		wb_status = rawb_wb_release(handle, export, true);
+
+	stream = rawb_stream_find(handle, state);
+	if (stream != NULL) {
+		/* A readahead in flight reads through the state */
+		if (stream->inflight)
+			rawb_ra_wait(handle);
+		rawb_stream_free(handle, stream);
+	}
+
+	PTHREAD_MUTEX_unlock(&handle->io_lock);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close2(handle->sub_handle, state);
+	op_ctx->fsal_export = &export->export;
+
+	if (FSAL_IS_ERROR(wb_status) && !FSAL_IS_ERROR(status))
+		return wb_status;
+
+	return status;
+}
+
+fsal_status_t rawb_fallocate(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state, uint64_t offset,
+			     uint64_t length, bool allocate)
+{
+	struct rawb_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct rawb_fsal_obj_handle,
+			     obj_handle);
+
+	struct rawb_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct rawb_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	rawb_io_sync(handle, export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->fallocate(handle->sub_handle,
+							state, offset, length,
+							allocate);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
@@ -0,0 +1,196 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* main.c
+ * Module core functions
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <libgen.h>		/* used for 'dirname' */
+#include <pthread.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include "gsh_list.h"
+#include "config_parsing.h"
+#include "FSAL/fsal_init.h"
+#include "rawb_methods.h"
+
+
+/* FSAL name determines name of shared library: libfsal<name>.so */
+const char myname[] = "RAWB";
+
+/* my module private storage
+ */
+
+struct rawb_fsal_module RAWB = {
+	.module = {
+		.fs_info = {
+			.maxfilesize = UINT64_MAX,
+			.maxlink = _POSIX_LINK_MAX,
+			.maxnamelen = 1024,
+			.maxpathlen = 1024,
+			.no_trunc = true,
+			.chown_restricted = true,
+			.case_insensitive = false,
+			.case_preserving = true,
+			.link_support = true,
+			.symlink_support = true,
+			.lock_support = true,
+			.lock_support_async_block = false,
+			.named_attr = true,
+			.unique_handles = true,
+			.acl_support = FSAL_ACLSUPPORT_ALLOW,
+			.cansettime = true,
+			.homogenous = true,
+			.supported_attrs = ALL_ATTRIBUTES,
+			.maxread = FSAL_MAXIOSIZE,
+			.maxwrite = FSAL_MAXIOSIZE,
+			.umask = 0,
+			.auth_exportpath_xdev = false,
+			.link_supports_permission_checks = true,
+		}
+	}
+};
+
+static struct config_item rawb_items[] = {
+	CONF_ITEM_UI32("Readahead_Threads", 0, 256, 4,
+		       rawb_fsal_module, readahead_threads),
+	CONF_ITEM_UI64("Max_Memory", 0, UINT64_MAX, 256 * 1024 * 1024,
+		       rawb_fsal_module, max_memory),
+	CONFIG_EOL
+};
+
+static struct config_block rawb_block = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.rawb",
+	.blk_desc.name = "RAWB",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = rawb_items,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/* Module methods
+ */
+
+/* init_config
+ * must be called with a reference taken (via lookup_fsal)
+ */
+
+static fsal_status_t init_config(struct fsal_module *rawb_fsal_module,
+				 config_file_t config_struct,
+				 struct config_error_type *err_type)
+{
+	/* Configuration setting options:
+	 * 1. the buffer memory bound and the readahead threads are
+	 *    shared by all exports and set here.
+	 *
+	 * 2. we set some here.  These must be independent of whatever
+	 *    may be set by lower level fsals.
+	 *
+	 * If there is any filtering or change of parameters in the stack,
+	 * this must be done in export data structures, not fsal params because
+	 * a stackable could be configured above multiple fsals for multiple
+	 * diverse exports.
+	 */
+	struct rawb_fsal_module *rawb_me =
+	    container_of(rawb_fsal_module, struct rawb_fsal_module, module);
+
+	(void) load_config_from_parse(config_struct,
+				      &rawb_block,
+				      rawb_me,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type))
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	display_fsinfo(rawb_fsal_module);
+	LogDebug(COMPONENT_FSAL,
+		 "FSAL INIT: Supported attributes mask = 0x%" PRIx64,
+		 rawb_fsal_module->fs_info.supported_attrs);
+	LogDebug(COMPONENT_FSAL,
+		 "FSAL INIT: Readahead threads %" PRIu32
+		 ", max buffer memory %" PRIu64,
+		 rawb_me->readahead_threads, rawb_me->max_memory);
+
+	return rawb_pkginit();
+}
+
+/* Internal RAWB method linkage to export object
+ */
+
+fsal_status_t rawb_create_export(struct fsal_module *fsal_hdl,
+				 void *parse_node,
+				 struct config_error_type *err_type,
+				 const struct fsal_up_vector *up_ops);
+
+fsal_status_t rawb_update_export(struct fsal_module *fsal_hdl,
+				 void *parse_node,
+				 struct config_error_type *err_type,
+				 struct fsal_export *original,
+				 struct fsal_module *updated_super);
+
+/* Module initialization.
+ * Called by dlopen() to register the module
+ * keep a private pointer to me in myself
+ */
+
+/* linkage to the exports and handle ops initializers
+ */
+MODULE_INIT void rawb_init(void)
+{
+	int retval;
+	struct fsal_module *myself = &RAWB.module;
+
+	retval = register_fsal(myself, myname, FSAL_MAJOR_VERSION,
+			       FSAL_MINOR_VERSION, FSAL_ID_NO_PNFS);
+	if (retval != 0) {
+		fprintf(stderr, "RAWB module failed to register");
+		return;
+	}
+	myself->m_ops.create_export = rawb_create_export;
+	myself->m_ops.update_export = rawb_update_export;
+	myself->m_ops.init_config = init_config;
+
+	/* Initialize the fsal_obj_handle ops for FSAL RAWB */
+	rawb_handle_ops_init(&RAWB.handle_ops);
+}
+
+MODULE_FINI void rawb_unload(void)
+{
+	int retval;
+
+	rawb_pkgshutdown();
+
+	retval = unregister_fsal(&RAWB.module);
+	if (retval != 0) {
+		fprintf(stderr, "RAWB module failed to unregister");
+		return;
+	}
+}
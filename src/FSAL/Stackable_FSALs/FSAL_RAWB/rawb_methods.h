@@ -0,0 +1,317 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published
+ *   by the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @brief RAWB methods for handles
+ *
+ * RAWB is a stackable FSAL that does readahead and write-behind on top
+ * of its sub-FSAL.  Sequential read streams are detected per open state
+ * and read ahead of the client with larger read2() calls to the
+ * sub-FSAL.  Small UNSTABLE writes are gathered into an aligned buffer
+ * per file that is written back when it fills, on COMMIT and on close.
+ */
+
+/* RAWB methods for handles
+ */
+
+#ifndef RAWB_METHODS_H
+#define RAWB_METHODS_H
+
+struct rawb_fsal_module {
+	struct fsal_module module;
+	struct fsal_obj_ops handle_ops;
+	/** Threads issuing readahead, 0 to read ahead in line */
+	uint32_t readahead_threads;
+	/** Bound on readahead and write-behind buffers, all exports */
+	uint64_t max_memory;
+	/** Bytes of buffers allocated, atomic */
+	uint64_t mem_used;
+};
+
+extern struct rawb_fsal_module RAWB;
+
+struct rawb_fsal_obj_handle;
+
+/**
+ * Structure used to store data for read_dirents callback.
+ *
+ * Before executing the upper level callback (it might be another
+ * stackable fsal or the inode cache), the context has to be restored.
+ */
+struct rawb_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct rawb_fsal_export *exp; /*< Export of the current rawbfsal. */
+	void *dir_state; /*< State to be sent to the next callback. */
+};
+
+extern struct fsal_up_vector fsal_up_top;
+void rawb_handle_ops_init(struct fsal_obj_ops *ops);
+
+/*
+ * RAWB internal export
+ */
+struct rawb_fsal_export {
+	struct fsal_export export;
+	/** Read ahead of sequential streams */
+	bool readahead;
+	/** Gather UNSTABLE writes */
+	bool write_behind;
+	/** Size of a readahead window */
+	uint32_t readahead_size;
+	/** Sequential reads in a row before reading ahead */
+	uint32_t sequential_reads;
+	/** Size of the write-behind buffer of a file */
+	uint32_t write_behind_size;
+	/** Alignment of write-behind flushes */
+	uint32_t write_alignment;
+	/** Bumped when a write-back error can't be returned to a COMMIT,
+	 *  so that clients write the data again.  Updated atomically.
+	 */
+	uint32_t write_verifier_gen;
+};
+
+fsal_status_t rawb_lookup_path(struct fsal_export *exp_hdl,
+			       const char *path,
+			       struct fsal_obj_handle **handle,
+			       struct attrlist *attrs_out);
+
+fsal_status_t rawb_create_handle(struct fsal_export *exp_hdl,
+				 struct gsh_buffdesc *hdl_desc,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out);
+
+fsal_status_t rawb_alloc_and_check_handle(
+		struct rawb_fsal_export *export,
+		struct fsal_obj_handle *sub_handle,
+		struct fsal_filesystem *fs,
+		struct fsal_obj_handle **new_handle,
+		fsal_status_t subfsal_status);
+
+/**
+ * @brief A buffer of file data
+ */
+
+struct rawb_buf {
+	char *data;
+	uint64_t offset;	/*< File offset of data[0] */
+	size_t len;		/*< Valid bytes */
+	size_t size;		/*< Allocated bytes */
+};
+
+/**
+ * @brief Readahead window of a stream
+ */
+
+struct rawb_window {
+	struct rawb_buf buf;
+	bool eof;		/*< End of file is at the end of buf */
+};
+
+/** @brief Readahead windows kept per stream */
+#define RAWB_WINDOWS 2
+
+/**
+ * @brief A sequential read stream
+ *
+ * There is one per open state reading the file, and one for reads
+ * without a state.
+ */
+
+struct rawb_stream {
+	struct glist_head list;
+	struct state_t *state;	/*< Open state, NULL for anonymous reads */
+	uint64_t id;		/*< Finds the stream from a readahead */
+	uint64_t next;		/*< Offset of the next sequential read */
+	uint32_t seq;		/*< Sequential reads in a row */
+	bool inflight;		/*< A readahead is outstanding */
+	bool eof;		/*< Read ahead up to end of file */
+	struct rawb_window win[RAWB_WINDOWS];
+};
+
+/** @brief Streams kept per file */
+#define RAWB_MAX_STREAMS 8
+
+/**
+ * @brief Write-behind buffer of a file
+ *
+ * Holds one contiguous dirty extent written UNSTABLE through state.
+ * A flush that fails drops the data and leaves the error to be
+ * returned by the next COMMIT or close.
+ */
+
+struct rawb_wbuf {
+	struct rawb_buf buf;
+	struct state_t *state;
+	bool bypass;
+	fsal_status_t error;
+};
+
+/*
+ * RAWB internal object handle
+ *
+ * It contains a pointer to the fsal_obj_handle used by the subfsal.
+ *
+ * AF_UNIX sockets are strange ducks.  I personally cannot see why they
+ * are here except for the ability of a client to see such an animal with
+ * an 'ls' or get rid of one with an 'rm'.  You can't open them in the
+ * usual file way so open_by_handle_at leads to a deadend.  To work around
+ * this, we save the args that were used to mknod or lookup the socket.
+ */
+
+struct rawb_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing rawb data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	int32_t refcnt;		/*< Reference count.  This is signed to make
+				   mistakes easy to see. */
+	/** Protects the fields below up to ra_lock.  It is held across
+	    write-back, so readahead completions do not take it. */
+	pthread_mutex_t io_lock;
+	/** Read streams, most recently used first */
+	struct glist_head streams;
+	uint32_t stream_count;
+	/** Identifier of the next stream */
+	uint64_t next_stream_id;
+	/** Bumped by every change to the data, stale readaheads are
+	    dropped */
+	uint64_t data_gen;
+	/** Write-behind buffer */
+	struct rawb_wbuf wb;
+	/** Protects ra_done and ra_inflight */
+	pthread_mutex_t ra_lock;
+	/** Signalled when the last readahead in flight completes */
+	pthread_cond_t ra_cond;
+	/** Completed readaheads not yet installed */
+	struct glist_head ra_done;
+	/** Readaheads in flight */
+	uint32_t ra_inflight;
+};
+
+int rawb_fsal_open(struct rawb_fsal_obj_handle *, int, fsal_errors_t *);
+int rawb_fsal_readlink(struct rawb_fsal_obj_handle *, fsal_errors_t *);
+
+static inline bool rawb_unopenable_type(object_file_type_t type)
+{
+	if ((type == SOCKET_FILE) || (type == CHARACTER_FILE)
+	    || (type == BLOCK_FILE)) {
+		return true;
+	} else {
+		return false;
+	}
+}
+
+/* I/O management */
+fsal_status_t rawb_close(struct fsal_obj_handle *obj_hdl);
+void rawb_io_init(struct rawb_fsal_obj_handle *hdl);
+void rawb_io_fini(struct rawb_fsal_obj_handle *hdl,
+		  struct rawb_fsal_export *export);
+void rawb_io_sync(struct rawb_fsal_obj_handle *hdl,
+		  struct rawb_fsal_export *export);
+void rawb_io_getattrs(struct rawb_fsal_obj_handle *hdl,
+		      struct attrlist *attrs);
+fsal_status_t rawb_pkginit(void);
+void rawb_pkgshutdown(void);
+
+/* Multi-FD */
+fsal_status_t rawb_open2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state,
+			 fsal_openflags_t openflags,
+			 enum fsal_create_mode createmode,
+			 const char *name,
+			 struct attrlist *attrs_in,
+			 fsal_verifier_t verifier,
+			 struct fsal_obj_handle **new_obj,
+			 struct attrlist *attrs_out,
+			 bool *caller_perm_check);
+bool rawb_check_verifier(struct fsal_obj_handle *obj_hdl,
+			 fsal_verifier_t verifier);
+fsal_openflags_t rawb_status2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state);
+fsal_status_t rawb_reopen2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags);
+void rawb_read2(struct fsal_obj_handle *obj_hdl,
+		bool bypass,
+		fsal_async_cb done_cb,
+		struct fsal_io_arg *read_arg,
+		void *caller_arg);
+void rawb_write2(struct fsal_obj_handle *obj_hdl,
+		 bool bypass,
+		 fsal_async_cb done_cb,
+		 struct fsal_io_arg *write_arg,
+		 void *caller_arg);
+fsal_status_t rawb_seek2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state,
+			 struct io_info *info);
+fsal_status_t rawb_io_advise2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      struct io_hints *hints);
+fsal_status_t rawb_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			   size_t len);
+fsal_status_t rawb_lock_op2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state,
+			    void *p_owner,
+			    fsal_lock_op_t lock_op,
+			    fsal_lock_param_t *req_lock,
+			    fsal_lock_param_t *conflicting_lock);
+fsal_status_t rawb_close2(struct fsal_obj_handle *obj_hdl,
+			  struct state_t *state);
+fsal_status_t rawb_fallocate(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state, uint64_t offset,
+			     uint64_t length, bool allocate);
+
+/* extended attributes management */
+fsal_status_t rawb_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				  unsigned int cookie,
+				  fsal_xattrent_t *xattrs_tab,
+				  unsigned int xattrs_tabsize,
+				  unsigned int *p_nb_returned,
+				  int *end_of_list);
+fsal_status_t rawb_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					 const char *xattr_name,
+					 unsigned int *pxattr_id);
+fsal_status_t rawb_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name,
+					    void *buffer_addr,
+					    size_t buffer_size,
+					    size_t *p_output_size);
+fsal_status_t rawb_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id,
+					  void *buffer_addr,
+					  size_t buffer_size,
+					  size_t *p_output_size);
+fsal_status_t rawb_setextattr_value(struct fsal_obj_handle *obj_hdl,
+				    const char *xattr_name,
+				    void *buffer_addr,
+				    size_t buffer_size,
+				    int create);
+fsal_status_t rawb_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id,
+					  void *buffer_addr,
+					  size_t buffer_size);
+fsal_status_t rawb_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					unsigned int xattr_id);
+fsal_status_t rawb_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					  const char *xattr_name);
+
+#endif			/* RAWB_METHODS_H */
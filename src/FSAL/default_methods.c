@@ -1390,16 +1390,14 @@ static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 }
 
 /* io io_advise2
- * default case not supported
+ * default case is the FSAL's io_advise, if any
  */
 
 static fsal_status_t io_advise2(struct fsal_obj_handle *obj_hdl,
 				struct state_t *fd,
 				struct io_hints *hints)
 {
-	hints->hints = 0;
-
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return obj_hdl->obj_ops->io_advise(obj_hdl, hints);
 }
 
 /* commit2
@@ -1481,6 +1479,123 @@ static bool is_referral(struct fsal_obj_handle *obj_hdl,
 	return false;
 }
 
+/** @brief Largest chunk the default copy reads and writes at once */
+#define DEFAULT_COPY_CHUNK (4 * 1024 * 1024)
+
+/* copy
+ * default case reads the source and writes the destination in large
+ * chunks with read2 and write2
+ */
+
+static fsal_status_t file_copy(struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state,
+			       uint64_t src_offset,
+			       struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state,
+			       uint64_t dst_offset,
+			       uint64_t count,
+			       uint64_t *copied)
+{
+	struct fsal_export *exp_hdl = op_ctx->fsal_export;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	struct async_process_data io_data;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct fsal_io_arg *arg;
+	size_t chunk, len, got, done;
+	bool eof;
+	char *buf;
+
+	*copied = 0;
+
+	chunk = exp_hdl->exp_ops.fs_maxread(exp_hdl);
+	if (exp_hdl->exp_ops.fs_maxwrite(exp_hdl) < chunk)
+		chunk = exp_hdl->exp_ops.fs_maxwrite(exp_hdl);
+	if (chunk == 0 || chunk > DEFAULT_COPY_CHUNK)
+		chunk = DEFAULT_COPY_CHUNK;
+
+	buf = gsh_malloc(chunk);
+	arg = gsh_malloc(sizeof(*arg) + sizeof(struct iovec));
+
+	PTHREAD_MUTEX_init(&mutex, NULL);
+	PTHREAD_COND_init(&cond, NULL);
+	io_data.mutex = &mutex;
+	io_data.cond = &cond;
+
+	while (*copied < count) {
+		len = count - *copied < chunk ? count - *copied : chunk;
+
+		memset(arg, 0, sizeof(*arg));
+		arg->state = src_state;
+		arg->offset = src_offset + *copied;
+		arg->iov_count = 1;
+		arg->iov[0].iov_base = buf;
+		arg->iov[0].iov_len = len;
+
+		io_data.ret = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		io_data.done = false;
+
+		fsal_read(src_hdl, false, arg, &io_data);
+
+		status = io_data.ret;
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		got = arg->io_amount;
+		eof = arg->end_of_file;
+
+		for (done = 0; done < got; done += arg->io_amount) {
+			memset(arg, 0, sizeof(*arg));
+			arg->state = dst_state;
+			arg->offset = dst_offset + *copied + done;
+			arg->fsal_stable = false;
+			arg->iov_count = 1;
+			arg->iov[0].iov_base = buf + done;
+			arg->iov[0].iov_len = got - done;
+
+			io_data.ret = fsalstat(ERR_FSAL_NO_ERROR, 0);
+			io_data.done = false;
+
+			fsal_write(dst_hdl, false, arg, &io_data);
+
+			status = io_data.ret;
+			if (!FSAL_IS_ERROR(status) && arg->io_amount == 0)
+				status = fsalstat(ERR_FSAL_IO, EIO);
+			if (FSAL_IS_ERROR(status))
+				goto out;
+		}
+
+		*copied += got;
+
+		if (got == 0 || eof)
+			break;
+	}
+
+ out:
+
+	PTHREAD_MUTEX_destroy(&mutex);
+	PTHREAD_COND_destroy(&cond);
+	gsh_free(arg);
+	gsh_free(buf);
+
+	return status;
+}
+
+/* clone
+ * default case not supported
+ */
+
+static fsal_status_t file_clone(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
 /* Default fsal handle object method vector.
  * copied to allocated vector at register time
  */
@@ -1539,6 +1654,8 @@ struct fsal_obj_ops def_handle_ops = {
 	.setattr2 = setattr2,
 	.close2 = close2,
 	.is_referral = is_referral,
+	.copy = file_copy,
+	.clone = file_clone,
 };
 
 /* fsal_pnfs_ds common methods */
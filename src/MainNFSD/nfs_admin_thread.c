@@ -48,6 +48,9 @@
 #include "pnfs_utils.h"
 #include "fsal.h"
 #include "netgroup_cache.h"
+#ifdef _HAVE_GSSAPI
+#include "gss_creds_cache.h"
+#endif
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #include "mdcache.h"
@@ -245,6 +248,9 @@ static bool admin_dbus_purge_gids(DBusMessageIter *args,
 	}
 
 	uid2grp_clear_cache();
+#ifdef _HAVE_GSSAPI
+	gss_creds_cache_clear();
+#endif
 
  out:
 	dbus_status_reply(&iter, success, errormsg);
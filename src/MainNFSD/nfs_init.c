@@ -40,6 +40,7 @@
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
 #include "config_parsing.h"
+#include "nfs_qos.h"
 #include "nfs4_acls.h"
 #include "nfs_rpc_callback.h"
 #ifdef USE_DBUS
@@ -68,6 +69,9 @@
 #include <sys/capability.h>	/* For capget/capset */
 #endif
 #include "uid2grp.h"
+#ifdef _HAVE_GSSAPI
+#include "gss_creds_cache.h"
+#endif
 #include "netgroup_cache.h"
 #include "pnfs_utils.h"
 #include "mdcache.h"
@@ -152,6 +156,7 @@ void reread_config(void)
 	int status = 0;
 	int i;
 	config_file_t config_struct;
+	struct timespec phase_start;
 
 	/* Clear out the flag indicating component was set from environment. */
 	for (i = COMPONENT_ALL; i < COMPONENT_COUNT; i++)
@@ -170,6 +175,7 @@ void reread_config(void)
 	if (!init_error_type(&err_type))
 		return;
 	/* Attempt to parse the new configuration file */
+	now(&phase_start);
 	config_struct = config_ParseFile(nfs_config_path, &err_type);
 	if (!config_error_no_error(&err_type)) {
 		config_Free(config_struct);
@@ -180,6 +186,8 @@ void reread_config(void)
 		return;
 	}
 
+	nfs_init_phase_done("Configuration reparse", &phase_start);
+
 	/* Update the logging configuration */
 	status = read_log_config(config_struct, &err_type);
 	if (status < 0)
@@ -428,6 +436,18 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 		return -1;
 	}
 
+	/* Request scheduler */
+	(void) load_config_from_parse(parse_tree,
+				      &nfs_qos_block,
+				      NULL,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing QOS configuration");
+		return -1;
+	}
+
 #ifdef _USE_9P
 	(void) load_config_from_parse(parse_tree,
 				      &_9p_param_blk,
@@ -464,6 +484,9 @@ int init_server_pkgs(void)
 
 	/* init uid2grp cache */
 	uid2grp_cache_init();
+#ifdef _HAVE_GSSAPI
+	gss_creds_cache_init();
+#endif
 
 	ng_cache_init(); /* netgroup cache */
 
@@ -524,6 +547,9 @@ static void nfs_Start_threads(void)
 	LogEvent(COMPONENT_THREAD, "Starting delayed executor.");
 	delayed_start();
 
+	/* Warm the ID mapper cache in the background, if configured */
+	idmapper_start_preload();
+
 	/* Starting the thread dedicated to signal handling */
 	rc = pthread_create(&sigmgr_thrid, &attr_thr, sigmgr_thread, NULL);
 	if (rc != 0) {
@@ -624,6 +650,7 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	OM_uint32 maj_stat, min_stat;
 	char GssError[MAXNAMLEN + 1];
 #endif
+	struct timespec phase_start;
 
 #ifdef USE_DBUS
 	/* DBUS init */
@@ -640,7 +667,9 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 
 	/* finish the job with exports by caching the root entries
 	 */
+	now(&phase_start);
 	exports_pkginit();
+	nfs_init_phase_done("Export root init", &phase_start);
 
 	nfs41_session_pool =
 	    pool_basic_init("NFSv4.1 session pool", sizeof(nfs41_session_t));
@@ -788,7 +817,10 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* Creates the pseudo fs */
 	LogDebug(COMPONENT_INIT, "Now building pseudo fs");
 
+	now(&phase_start);
 	create_pseudofs();
+	nfs_init_phase_done("Pseudo fs build", &phase_start);
+	pseudofs_log_stats();
 
 	LogInfo(COMPONENT_INIT,
 		"NFSv4 pseudo file system successfully initialized");
@@ -926,6 +958,12 @@ void nfs_start(nfs_start_info_t *p_start_info)
 
 	nfs_init_complete();
 
+	{
+		struct timespec boot_time = nfs_ServerBootTime;
+
+		nfs_init_phase_done("Server startup", &boot_time);
+	}
+
 #ifdef _USE_NLM
 	if (nfs_param.core_param.enable_NLM) {
 		/* NSM Unmonitor all */
@@ -953,6 +991,22 @@ void nfs_start(nfs_start_info_t *p_start_info)
 	/* let main return 0 to exit */
 }
 
+/**
+ * @brief Log how long a startup or reload phase took
+ *
+ * @param[in]     phase Name of the phase that just finished
+ * @param[in,out] start When it started, reset to now for the next phase
+ */
+void nfs_init_phase_done(const char *phase, struct timespec *start)
+{
+	struct timespec end;
+
+	now(&end);
+	LogEvent(COMPONENT_INIT, "%s took %" PRIu64 " ms",
+		 phase, timespec_diff(start, &end) / NS_PER_MSEC);
+	*start = end;
+}
+
 void nfs_init_init(void)
 {
 	PTHREAD_MUTEX_init(&nfs_init.init_mutex, NULL);
@@ -152,6 +152,7 @@ int main(int argc, char *argv[])
 #endif
 	sigset_t signals_to_block;
 	struct config_error_type err_type;
+	struct timespec phase_start;
 
 	/* Set the server's boot time and epoch */
 	now(&nfs_ServerBootTime);
@@ -414,6 +415,7 @@ int main(int argc, char *argv[])
 		goto fatal_die;
 
 	/* Parse the configuration file so we all know what is going on. */
+	now(&phase_start);
 
 	if (nfs_config_path == NULL || nfs_config_path[0] == '\0') {
 		LogWarn(COMPONENT_INIT,
@@ -449,11 +451,15 @@ int main(int argc, char *argv[])
 		goto fatal_die;
 	}
 
+	nfs_init_phase_done("Configuration parse", &phase_start);
+
 	/* We need all the fsal modules loaded so we can have
 	 * the list available at exports parsing time.
 	 */
 	start_fsals();
 
+	nfs_init_phase_done("FSAL module load", &phase_start);
+
 	/* parse configuration file */
 
 	if (nfs_set_param_from_conf(nfs_config_struct,
@@ -470,6 +476,8 @@ int main(int argc, char *argv[])
 			"Failed to initialize server packages");
 		goto fatal_die;
 	}
+
+	nfs_init_phase_done("Server packages init", &phase_start);
 	/* Load Data Server entries from parsed file
 	 * returns the number of DS entries.
 	 */
@@ -496,6 +504,8 @@ int main(int argc, char *argv[])
 	/* Wait for enforcement to begin */
 	nfs_wait_for_grace_enforcement();
 
+	nfs_init_phase_done("Recovery and grace start", &phase_start);
+
 	/* Load export entries from parsed file
 	 * returns the number of export entries.
 	 */
@@ -508,6 +518,8 @@ int main(int argc, char *argv[])
 	if (rc == 0 && dsc == 0)
 		LogWarn(COMPONENT_INIT,
 			"No export entries found in configuration file !!!");
+
+	nfs_init_phase_done("Export configuration", &phase_start);
 	report_config_errors(&err_type, NULL, config_errs_to_log);
 
 	/* freeing syntax tree : */
@@ -0,0 +1,657 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_qos.c
+ * @brief Request admission scheduler (QoS)
+ *
+ * Each client is a flow in a start time fair queue: a request gets the
+ * finish tag max(virtual clock, flow's last finish tag) + cost/weight,
+ * where the cost is one plus one per 64KiB of READ or WRITE data.
+ * Waiting requests are admitted in finish tag order, skipping (and
+ * keeping behind them the later requests of) flows whose token buckets
+ * are empty.  The virtual clock follows the start tag of the last
+ * request admitted, so a flow that was idle does not get to catch up.
+ *
+ * Waiting requests hold their worker thread, so a request is only
+ * queued while its client, its export and the whole queue are below
+ * their caps.  Beyond that the client is told to retry later.
+ *
+ * Locking: qos_mutex protects all scheduler and flow state.  A waiting
+ * request sleeps on its own condition variable; it is woken when it is
+ * granted, and wakes itself when its buckets should have refilled.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <time.h>
+#include "log.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_proto_data.h"
+#include "nfs_file_handle.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "nfs_qos.h"
+
+#define NFS_program nfs_param.core_param.program
+
+/** Default maximum requests in service */
+#define QOS_MAX_INFLIGHT 64
+/** Default maximum requests of a flow waiting */
+#define QOS_MAX_QUEUED_PER_FLOW 8
+/** Bytes of READ or WRITE data costing as much as one operation */
+#define QOS_COST_UNIT (64 * 1024)
+/** Scale of the fair queue tags, so a weight divides the cost evenly */
+#define QOS_TAG_SCALE 720720
+
+struct qos_param nfs_qos_param;
+
+/**
+ * @brief A request waiting for admission
+ */
+
+struct qos_waiter {
+	struct glist_head q;	/*< On qos_queue, in vfinish order */
+	pthread_cond_t cond;
+	struct qos_flow *cflow;	/*< Client flow */
+	struct qos_flow *eflow;	/*< Export flow, if any */
+	uint64_t bytes;		/*< READ and WRITE data */
+	uint64_t c_iops, c_bw;	/*< Client limits */
+	uint64_t e_iops, e_bw;	/*< Export limits */
+	uint64_t vstart, vfinish;
+	bool granted;
+};
+
+static pthread_mutex_t qos_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head qos_queue = {&qos_queue, &qos_queue};
+static struct glist_head qos_flows = {&qos_flows, &qos_flows};
+static uint64_t qos_vclock;
+static uint32_t qos_inflight;
+static uint32_t qos_queued;
+static uint32_t qos_pass;
+
+static struct config_item qos_params[] = {
+	CONF_ITEM_BOOL("Enable", false,
+		       qos_param, enable),
+	CONF_ITEM_UI32("Max_Inflight", 1, 65536, QOS_MAX_INFLIGHT,
+		       qos_param, max_inflight),
+	CONF_ITEM_UI32("Max_Queued", 0, 65536, 0,
+		       qos_param, max_queued),
+	CONF_ITEM_UI32("Max_Queued_Per_Flow", 1, 65536,
+		       QOS_MAX_QUEUED_PER_FLOW,
+		       qos_param, max_queued_per_flow),
+	CONFIG_EOL
+};
+
+static void *qos_init(void *link_mem, void *self_struct)
+{
+	if (self_struct == NULL)
+		return &nfs_qos_param;
+	else
+		return NULL;
+}
+
+struct config_block nfs_qos_block = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.qos",
+	.blk_desc.name = "QOS",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = qos_init,
+	.blk_desc.u.blk.params = qos_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+static inline uint64_t qos_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Maximum requests waiting for admission
+ *
+ * By default half the worker threads, so that throttled requests
+ * always leave some for the others.
+ */
+
+static inline uint32_t qos_max_queued(void)
+{
+	if (nfs_qos_param.max_queued != 0)
+		return nfs_qos_param.max_queued;
+
+	return MAX(nfs_param.core_param.rpc.ioq_thrd_max / 2, 1);
+}
+
+/**
+ * @brief Bring a bucket up to date with its current rate
+ */
+
+static void bucket_refill(struct qos_bucket *b, uint64_t rate, uint64_t now)
+{
+	if (rate == 0) {
+		b->rate = 0;
+		return;
+	}
+
+	if (b->rate == 0 || b->last == 0) {
+		/* Newly limited, start full */
+		b->rate = rate;
+		b->tokens = rate;
+		b->last = now;
+		return;
+	}
+
+	b->rate = rate;
+	if (now > b->last) {
+		b->tokens += (double)(now - b->last) * rate / NS_PER_SEC;
+		b->last = now;
+	}
+	if (b->tokens > rate)
+		b->tokens = rate;
+}
+
+/**
+ * @brief Time until a bucket can pay for a request
+ *
+ * A request bigger than the bucket only needs a full bucket, and then
+ * puts it into debt, so large I/O is not starved.
+ *
+ * @return Nanoseconds, 0 if it can pay now.
+ */
+
+static uint64_t bucket_delay(struct qos_bucket *b, uint64_t need)
+{
+	double want;
+
+	if (b->rate == 0)
+		return 0;
+
+	want = need < b->rate ? need : b->rate;
+	if (b->tokens >= want)
+		return 0;
+
+	return (uint64_t)((want - b->tokens) * NS_PER_SEC / b->rate) + 1;
+}
+
+static inline void bucket_take(struct qos_bucket *b, uint64_t n)
+{
+	if (b->rate != 0)
+		b->tokens -= n;
+}
+
+/**
+ * @brief Refill a waiter's buckets and check them
+ *
+ * @param[out] cdelay Time until the client buckets can pay
+ * @param[out] edelay Time until the export buckets can pay
+ */
+
+static void qos_delay(struct qos_waiter *w, uint64_t now,
+		      uint64_t *cdelay, uint64_t *edelay)
+{
+	uint64_t d;
+
+	bucket_refill(&w->cflow->iops, w->c_iops, now);
+	bucket_refill(&w->cflow->bw, w->c_bw, now);
+	*cdelay = bucket_delay(&w->cflow->iops, 1);
+	d = bucket_delay(&w->cflow->bw, w->bytes);
+	if (d > *cdelay)
+		*cdelay = d;
+
+	*edelay = 0;
+	if (w->eflow == NULL)
+		return;
+
+	bucket_refill(&w->eflow->iops, w->e_iops, now);
+	bucket_refill(&w->eflow->bw, w->e_bw, now);
+	*edelay = bucket_delay(&w->eflow->iops, 1);
+	d = bucket_delay(&w->eflow->bw, w->bytes);
+	if (d > *edelay)
+		*edelay = d;
+}
+
+static void qos_grant(struct qos_waiter *w)
+{
+	bucket_take(&w->cflow->iops, 1);
+	bucket_take(&w->cflow->bw, w->bytes);
+	w->cflow->dispatched++;
+
+	if (w->eflow != NULL) {
+		bucket_take(&w->eflow->iops, 1);
+		bucket_take(&w->eflow->bw, w->bytes);
+		w->eflow->dispatched++;
+	}
+
+	if (w->vstart > qos_vclock)
+		qos_vclock = w->vstart;
+
+	qos_inflight++;
+	w->granted = true;
+}
+
+/**
+ * @brief Admit waiting requests while there is room
+ *
+ * Called with qos_mutex held.
+ */
+
+static void qos_pick(uint64_t now)
+{
+	struct glist_head *glist, *glistn;
+	struct qos_waiter *w;
+	uint64_t cdelay, edelay;
+
+	qos_pass++;
+
+	glist_for_each_safe(glist, glistn, &qos_queue) {
+		if (qos_inflight >= nfs_qos_param.max_inflight)
+			break;
+
+		w = glist_entry(glist, struct qos_waiter, q);
+
+		/* Keep each flow in order */
+		if (w->cflow->pass == qos_pass ||
+		    (w->eflow != NULL && w->eflow->pass == qos_pass))
+			continue;
+
+		qos_delay(w, now, &cdelay, &edelay);
+		if (cdelay != 0 || edelay != 0) {
+			if (cdelay != 0)
+				w->cflow->pass = qos_pass;
+			if (edelay != 0)
+				w->eflow->pass = qos_pass;
+			continue;
+		}
+
+		glist_del(&w->q);
+		qos_queued--;
+		w->cflow->queued--;
+		if (w->eflow != NULL)
+			w->eflow->queued--;
+
+		qos_grant(w);
+		pthread_cond_signal(&w->cond);
+	}
+}
+
+static int qos_vfinish_cmpf(struct glist_head *a, struct glist_head *b)
+{
+	struct qos_waiter *wa = glist_entry(a, struct qos_waiter, q);
+	struct qos_waiter *wb = glist_entry(b, struct qos_waiter, q);
+
+	if (wa->vfinish < wb->vfinish)
+		return -1;
+	return wa->vfinish > wb->vfinish;
+}
+
+/**
+ * @brief Find or create a flow
+ *
+ * Called with qos_mutex held.
+ */
+
+static struct qos_flow *qos_get_flow(struct qos_flow **flow,
+				     const char *name)
+{
+	if (*flow != NULL)
+		return *flow;
+
+	*flow = gsh_calloc(1, sizeof(struct qos_flow));
+	(*flow)->name = gsh_strdup(name);
+	glist_add_tail(&qos_flows, &(*flow)->flows);
+
+	return *flow;
+}
+
+/**
+ * @brief Release the flow of a client or an export being freed
+ */
+
+void nfs_qos_release_flow(struct qos_flow **flow)
+{
+	if (*flow == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&qos_mutex);
+	glist_del(&(*flow)->flows);
+	PTHREAD_MUTEX_unlock(&qos_mutex);
+
+	gsh_free((*flow)->name);
+	gsh_free(*flow);
+	*flow = NULL;
+}
+
+/**
+ * @brief Work out the data size and export of a request
+ *
+ * For a COMPOUND the export is the one of the first PUTFH, and a
+ * reference is taken on it.
+ *
+ * @param[out] export Export, NULL if none
+ * @param[out] ref    A reference was taken on export
+ *
+ * @return READ and WRITE bytes.
+ */
+
+static uint64_t qos_classify(nfs_request_t *reqdata,
+			     struct gsh_export **export, bool *ref)
+{
+	nfs_arg_t *arg_nfs = &reqdata->arg_nfs;
+	uint64_t bytes = 0;
+
+	*export = op_ctx->ctx_export;
+	*ref = false;
+
+	switch (reqdata->svc.rq_msg.cb_vers) {
+#ifdef _USE_NFS3
+	case NFS_V3:
+		if (reqdata->svc.rq_msg.cb_proc == NFSPROC3_READ)
+			bytes = arg_nfs->arg_read3.count;
+		else if (reqdata->svc.rq_msg.cb_proc == NFSPROC3_WRITE)
+			bytes = arg_nfs->arg_write3.data.data_len;
+		break;
+#endif /* _USE_NFS3 */
+
+	case NFS_V4:
+	{
+		COMPOUND4args *args = &arg_nfs->arg_compound4;
+		nfs_argop4 *op;
+		u_int i;
+
+		for (i = 0; i < args->argarray.argarray_len; i++) {
+			op = &args->argarray.argarray_val[i];
+
+			switch (op->argop) {
+			case NFS4_OP_PUTFH:
+			{
+				nfs_fh4 *fh = &op->nfs_argop4_u.opputfh.object;
+				file_handle_v4_t *v4_handle;
+
+				if (*export != NULL ||
+				    nfs4_Is_Fh_Invalid(fh) != NFS4_OK ||
+				    nfs4_Is_Fh_DSHandle(fh))
+					break;
+
+				v4_handle = (file_handle_v4_t *)fh->nfs_fh4_val;
+				*export = get_gsh_export(
+						ntohs(v4_handle->id.exports));
+				*ref = *export != NULL;
+				break;
+			}
+			case NFS4_OP_READ:
+				bytes += op->nfs_argop4_u.opread.count;
+				break;
+			case NFS4_OP_WRITE:
+				bytes += op->nfs_argop4_u.opwrite.data.data_len;
+				break;
+			default:
+				break;
+			}
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return bytes;
+}
+
+/**
+ * @brief Admit a request
+ *
+ * Called between decode and dispatch, after the NFS v3 export checks.
+ * May wait.  A request that went through the scheduler is marked
+ * qos_admitted, and nfs_qos_done() must be called once it completes.
+ *
+ * @param[in] reqdata Request
+ *
+ * @return false if too many requests are waiting and the client should
+ *         be told to retry later.
+ */
+
+bool nfs_qos_admit(nfs_request_t *reqdata)
+{
+	struct qos_waiter w;
+	struct gsh_export *export;
+	struct export_perms perms, *pp = op_ctx->export_perms;
+	uint64_t start, now, cdelay, edelay, vfinish;
+	uint32_t weight;
+	bool ref;
+
+	if (!nfs_qos_param.enable || op_ctx->client == NULL ||
+	    reqdata->svc.rq_msg.cb_prog != NFS_program[P_NFS])
+		return true;
+
+	memset(&w, 0, sizeof(w));
+	w.bytes = qos_classify(reqdata, &export, &ref);
+
+	if (export != NULL && export != op_ctx->ctx_export) {
+		/* NFS v4, get this client's permissions on the export */
+		struct gsh_export *saved_export = op_ctx->ctx_export;
+		struct export_perms *saved_perms = op_ctx->export_perms;
+
+		op_ctx->ctx_export = export;
+		op_ctx->export_perms = &perms;
+		export_check_access();
+		op_ctx->ctx_export = saved_export;
+		op_ctx->export_perms = saved_perms;
+		pp = &perms;
+	}
+
+	/* Without an export, op_ctx->export_perms holds the defaults */
+	w.c_iops = pp->client_max_iops;
+	w.c_bw = pp->client_max_bw;
+	weight = pp->qos_weight > 0 ? pp->qos_weight : 1;
+
+	if (export != NULL) {
+		w.e_iops = atomic_fetch_uint64_t(&export->MaxIOPS);
+		w.e_bw = atomic_fetch_uint64_t(&export->MaxBandwidth);
+	}
+
+	start = now = qos_now();
+
+	PTHREAD_MUTEX_lock(&qos_mutex);
+
+	w.cflow = qos_get_flow(&op_ctx->client->qos_flow,
+			       op_ctx->client->hostaddr_str);
+	if (export != NULL) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "export %"PRIu16,
+			 export->export_id);
+		w.eflow = qos_get_flow(&export->qos_flow, name);
+	}
+
+	vfinish = w.cflow->vfinish;
+	w.vstart = vfinish > qos_vclock ? vfinish : qos_vclock;
+	w.vfinish = w.vstart +
+		QOS_TAG_SCALE * (1 + w.bytes / QOS_COST_UNIT) / weight;
+	w.cflow->vfinish = w.vfinish;
+
+	if (glist_empty(&qos_queue) &&
+	    qos_inflight < nfs_qos_param.max_inflight) {
+		qos_delay(&w, now, &cdelay, &edelay);
+		if (cdelay == 0 && edelay == 0) {
+			qos_grant(&w);
+			PTHREAD_MUTEX_unlock(&qos_mutex);
+			goto out;
+		}
+	}
+
+	if (qos_queued >= qos_max_queued() ||
+	    w.cflow->queued >= nfs_qos_param.max_queued_per_flow ||
+	    (w.eflow != NULL &&
+	     w.eflow->queued >= nfs_qos_param.max_queued_per_flow)) {
+		/* Don't tie up another worker, the client retries */
+		w.cflow->vfinish = vfinish;
+		w.cflow->refused++;
+		if (w.eflow != NULL)
+			w.eflow->refused++;
+		PTHREAD_MUTEX_unlock(&qos_mutex);
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Too many requests waiting, delaying request from %s",
+			     op_ctx->client->hostaddr_str);
+
+		if (ref)
+			put_gsh_export(export);
+
+		return false;
+	}
+
+	/* Queue and wait our turn */
+	PTHREAD_COND_init(&w.cond, NULL);
+	glist_insert_sorted(&qos_queue, &w.q, qos_vfinish_cmpf);
+	qos_queued++;
+	w.cflow->queued++;
+	w.cflow->throttled++;
+	if (w.eflow != NULL) {
+		w.eflow->queued++;
+		w.eflow->throttled++;
+	}
+
+	qos_pick(now);
+
+	while (!w.granted) {
+		qos_delay(&w, now, &cdelay, &edelay);
+		if (edelay > cdelay)
+			cdelay = edelay;
+
+		if (cdelay == 0) {
+			/* Waiting on a slot or on others, done wakes us */
+			pthread_cond_wait(&w.cond, &qos_mutex);
+		} else {
+			struct timespec ts;
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			timespec_add_nsecs(cdelay, &ts);
+			pthread_cond_timedwait(&w.cond, &qos_mutex, &ts);
+		}
+
+		now = qos_now();
+		if (!w.granted)
+			qos_pick(now);
+	}
+
+	w.cflow->wait += now - start;
+	if (w.eflow != NULL)
+		w.eflow->wait += now - start;
+
+	PTHREAD_MUTEX_unlock(&qos_mutex);
+	PTHREAD_COND_destroy(&w.cond);
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Request from %s waited %"PRIu64" nsecs for admission",
+		     op_ctx->client->hostaddr_str, now - start);
+
+ out:
+	if (ref)
+		put_gsh_export(export);
+
+	reqdata->qos_admitted = true;
+	return true;
+}
+
+/**
+ * @brief A request completed
+ *
+ * Releases the slot of a request admitted by nfs_qos_admit().  For a
+ * request that was suspended, this is when it is finally answered.
+ *
+ * @param[in] reqdata Request
+ */
+
+void nfs_qos_done(nfs_request_t *reqdata)
+{
+	if (!reqdata->qos_admitted)
+		return;
+
+	reqdata->qos_admitted = false;
+
+	PTHREAD_MUTEX_lock(&qos_mutex);
+	qos_inflight--;
+	if (!glist_empty(&qos_queue))
+		qos_pick(qos_now());
+	PTHREAD_MUTEX_unlock(&qos_mutex);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report scheduler state
+ *
+ * Requests in service and waiting, then for each client and export
+ * flow: name, requests waiting, requests admitted, requests that had
+ * to wait, their total wait in nsecs and requests told to retry later.
+ */
+
+void nfs_qos_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *glist;
+	struct qos_flow *flow;
+	uint64_t queued;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	PTHREAD_MUTEX_lock(&qos_mutex);
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &qos_inflight);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &qos_queued);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sttttt)",
+					 &array_iter);
+
+	glist_for_each(glist, &qos_flows) {
+		flow = glist_entry(glist, struct qos_flow, flows);
+		queued = flow->queued;
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &flow->name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &queued);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &flow->dispatched);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &flow->throttled);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &flow->wait);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &flow->refused);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	PTHREAD_MUTEX_unlock(&qos_mutex);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
@@ -60,6 +60,7 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include "uid2grp.h"
+#include "nfs_qos.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -721,6 +722,9 @@ void complete_request(nfs_request_t *reqdata,
 	nfs_res_t *res_nfs = reqdata->res_nfs;
 	const nfs_function_desc_t *reqdesc = reqdata->funcdesc;
 
+	/* Let the scheduler admit another request */
+	nfs_qos_done(reqdata);
+
 	/* NFSv4 stats are handled in nfs4_compound() */
 	if (reqdata->svc.rq_msg.cb_prog != NFS_program[P_NFS]
 	    || reqdata->svc.rq_msg.cb_vers != NFS_V4)
@@ -820,6 +824,38 @@ void nfs_rpc_complete_async_request(nfs_request_t *reqdata,
 	free_args(reqdata);
 }
 
+/**
+ * @brief Answer a request the scheduler turned away
+ *
+ * The client is told to retry later, with NFS3ERR_JUKEBOX or with an
+ * NFS4ERR_DELAY COMPOUND that has no results.
+ *
+ * @param[in,out] reqdata	NFS request
+ */
+static void nfs_qos_delay_reply(nfs_request_t *reqdata)
+{
+	nfs_res_t *res_nfs = reqdata->res_nfs;
+	COMPOUND4res *res_compound4;
+
+	switch (reqdata->svc.rq_msg.cb_vers) {
+#ifdef _USE_NFS3
+	case NFS_V3:
+		res_nfs->res_getattr3.status = NFS3ERR_JUKEBOX;
+		break;
+#endif /* _USE_NFS3 */
+
+	case NFS_V4:
+		res_nfs->res_compound4_extended =
+			gsh_calloc(1, sizeof(*res_nfs->res_compound4_extended));
+		res_nfs->res_compound4_extended->res_refcnt = 1;
+		res_compound4 = &res_nfs->res_compound4_extended->res_compound4;
+		res_compound4->status = NFS4ERR_DELAY;
+		copy_tag(&res_compound4->tag,
+			 &reqdata->arg_nfs.arg_compound4.tag);
+		break;
+	}
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
@@ -1443,6 +1479,13 @@ static enum xprt_stat nfs_rpc_process_request(nfs_request_t *reqdata)
 		 *        NLM4_STALE_FH (NLM doesn't have a BADHANDLE code)
 		 */
 
+		/* Wait for the scheduler to admit the request */
+		if (!nfs_qos_admit(reqdata)) {
+			nfs_qos_delay_reply(reqdata);
+			rc = NFS_REQ_OK;
+			goto reply;
+		}
+
 #ifdef _ERROR_INJECTION
 		if (worker_delay_time != 0)
 			sleep(worker_delay_time);
@@ -1501,6 +1544,7 @@ static enum xprt_stat nfs_rpc_process_request(nfs_request_t *reqdata)
 #ifdef _USE_NFS3
  req_error:
 #endif /* _USE_NFS3 */
+ reply:
 
 	complete_request(reqdata, rc, dpq_status);
 
@@ -66,6 +66,7 @@ int nfs3_commit(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
 	fsal_status_t fsal_status;
 	struct fsal_obj_handle *obj = NULL;
+	struct gsh_buffdesc verf_desc;
 	int rc = NFS_REQ_OK;
 
 	if (isDebug(COMPONENT_NFSPROTO)) {
@@ -109,8 +110,10 @@ int nfs3_commit(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		       &(res->res_commit3.COMMIT3res_u.resok.file_wcc));
 
 	/* Set the write verifier */
-	memcpy(res->res_commit3.COMMIT3res_u.resok.verf, NFS3_write_verifier,
-	       sizeof(writeverf3));
+	verf_desc.addr = res->res_commit3.COMMIT3res_u.resok.verf;
+	verf_desc.len = sizeof(writeverf3);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
 	res->res_commit3.status = NFS3_OK;
 
  out:
@@ -53,8 +53,6 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 					       uint64_t cookie,
 					       enum cb_state cb_state);
 
-static void free_entryplus3s(entryplus3 *entryplus3s);
-
 /**
  * @brief Opaque bookkeeping structure for NFSPROC3_READDIRPLUS
  *
@@ -63,13 +61,10 @@ static void free_entryplus3s(entryplus3 *entryplus3s);
  */
 
 struct nfs3_readdirplus_cb_data {
-	entryplus3 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
+	struct xdr_entries_buf eb;	/*< The entries, encoded as they come;
+					   limited to what fits in maxcount */
 	size_t count;		/*< The count of complete entries stored in the
 				   buffer */
-	size_t total_entries;	/*< The number of entires we allocated for
-				   the array. */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -116,15 +111,14 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	uint64_t fsal_cookie = 0;
 	cookieverf3 cookie_verifier;
 	unsigned int num_entries = 0;
-	unsigned long estimated_num_entries = 0;
+	size_t entries_room = 0;
 	object_file_type_t dir_filetype = 0;
 	bool eod_met = false;
 	fsal_status_t fsal_status = {0, 0};
 	fsal_status_t fsal_status_gethandle = {0, 0};
 	int rc = NFS_REQ_OK;
 	struct nfs3_readdirplus_cb_data tracker = {
-		.entries = NULL,
-		.mem_left = 0,
+		.eb = { .buf = NULL },
 		.count = 0,
 		.error = NFS3_OK,
 	};
@@ -161,26 +155,22 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
-	tracker.mem_left = (arg->arg_readdirplus3.maxcount * 9) / 10;
-	begin_cookie = arg->arg_readdirplus3.cookie;
-
-	tracker.mem_left -= sizeof(READDIRPLUS3resok);
-
-	/* Estimate assuming that we're going to send no names and no handles.
-	 * Don't count space for pointers for nextentry or
-	 * name_handle.data.data_val in entryplus3
+	/* Entries are encoded as they are read, so the only limit on
+	 * how many we send is the room the client gave us.
 	 */
-	estimated_num_entries = MIN((tracker.mem_left + sizeof(entryplus3 *))
-				    / (sizeof(entryplus3) - sizeof(char *) * 2),
-				    50);
+	entries_room = (arg->arg_readdirplus3.maxcount * 9) / 10;
+	begin_cookie = arg->arg_readdirplus3.cookie;
 
-	tracker.total_entries = estimated_num_entries;
+	if (entries_room > sizeof(READDIRPLUS3resok))
+		entries_room -= sizeof(READDIRPLUS3resok);
+	else
+		entries_room = 0;
 
 	LogDebug(COMPONENT_NFS_READDIR,
 		 "NFS3_READDIRPLUS: dircount=%u begin_cookie=%" PRIu64
-		 " estimated_num_entries=%lu, mem_left=%zd",
+		 " entries_room=%zu",
 		 arg->arg_readdirplus3.dircount, begin_cookie,
-		 estimated_num_entries, tracker.mem_left);
+		 entries_room);
 
 	/* Convert file handle into a vnode */
 	dir_obj = nfs3_FhandleToCache(&(arg->arg_readdirplus3.dir),
@@ -247,6 +237,8 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	resok->reply.entries = NULL;
+	resok->reply.entries_xdr = NULL;
+	resok->reply.entries_xdr_len = 0;
 	resok->reply.eof = FALSE;
 
 	/* Fudge cookie for "." and "..", if necessary */
@@ -255,8 +247,8 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	else
 		fsal_cookie = 0;
 
-	/* Allocate space for entries */
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entryplus3));
+	/* Prepare to encode the entries */
+	xdr_entries_buf_init(&tracker.eb, entries_room);
 
 	if (begin_cookie == 0) {
 		/* Fill in "." */
@@ -329,10 +321,12 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	if ((num_entries == 0) && (begin_cookie > 1)) {
 		res->res_readdirplus3.status = NFS3_OK;
-		resok->reply.entries = NULL;
 		resok->reply.eof = TRUE;
 	} else {
-		resok->reply.entries = tracker.entries;
+		if (tracker.count != 0)
+			resok->reply.entries_xdr =
+				xdr_entries_buf_take(&tracker.eb,
+					&resok->reply.entries_xdr_len);
 		resok->reply.eof = eod_met;
 	}
 
@@ -360,9 +354,7 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (dir_obj)
 		dir_obj->obj_ops->put_ref(dir_obj);
 
-	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK))
-	    && (tracker.entries != NULL))
-		free_entryplus3s(tracker.entries);
+	xdr_entries_buf_destroy(&tracker.eb);
 
 	return rc;
 }				/* nfs3_readdirplus */
@@ -378,20 +370,45 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 void nfs3_readdirplus_free(nfs_res_t *resp)
 {
 #define RESREADDIRPLUSREPLY resp->res_readdirplus3.READDIRPLUS3res_u.resok.reply
-	if ((resp->res_readdirplus3.status == NFS3_OK)
-	    && (RESREADDIRPLUSREPLY.entries != NULL))
-		free_entryplus3s(RESREADDIRPLUSREPLY.entries);
+	if (resp->res_readdirplus3.status == NFS3_OK)
+		gsh_free(RESREADDIRPLUSREPLY.entries_xdr);
 }
 
 /**
- * @brief Populate entryplus3s when called from fsal_readdir
+ * @brief Encode one entryplus3 in the READDIRPLUS reply
+ *
+ * The entry is preceded by the discriminant of the optional pointing at
+ * it, so entries can simply be appended to one another.
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entryplys3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * @param xdrs [in,out] Stream to encode to
+ * @param arg [in] The entryplus3, its nextentry is not encoded
+ *
+ * @return true if the entry was encoded.
+ */
+
+static bool nfs3_readdirplus_encode_entry(XDR *xdrs, void *arg)
+{
+	entryplus3 *entry = arg;
+	bool_t value_follows = TRUE;
+
+	return xdr_bool(xdrs, &value_follows) &&
+	       xdr_fileid3(xdrs, &entry->fileid) &&
+	       xdr_filename3(xdrs, &entry->name) &&
+	       xdr_cookie3(xdrs, &entry->cookie) &&
+	       xdr_post_op_attr(xdrs, &entry->name_attributes) &&
+	       xdr_post_op_fh3(xdrs, &entry->name_handle);
+}
+
+/**
+ * @brief Encode entryplus3s when called from fsal_readdir
+ *
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * each entry straight into the reply's entries buffer, growing it as
+ * needed up to maxcount, so neither the name nor the handle are
+ * copied in between.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdirplus_cb_data that is
- *                    gives the location of the array and other
+ *                    gives the location of the buffer and other
  *                    bookeeping information
  * @param name [in] The filename for the current obj
  * @param handle [in] The current obj's filehandle
@@ -409,101 +426,64 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	/* Not-so-opaque pointer to callback data` */
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs3_readdirplus_cb_data *tracker = cb_parms->opaque;
-	/* Length of the current filename */
-	size_t namelen = strlen(cb_parms->name);
-	entryplus3 *ep3 = tracker->entries + tracker->count;
-
-	if (tracker->count == tracker->total_entries) {
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
-	}
-
-	/* This is a pessimistic check, which assumes that we're going
-	 * to send attributes and full size handle - if it fails then
-	 * we're close enough to the buffer size limit and t's time to
-	 * stop anyway */
-	if (tracker->mem_left
-	    < (sizeof(entryplus3) + namelen + NFS3_FHSIZE)) {
-		if (tracker->count == 0)
-			tracker->error = NFS3ERR_TOOSMALL;
-
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
-	}
+	char fh_buf[NFS3_FHSIZE];
+	entryplus3 entry = {
+		.fileid = obj->fileid,
+		.name = (filename3) cb_parms->name,
+		.cookie = cookie,
+	};
+	post_op_attr *name_attributes = &entry.name_attributes;
+	post_op_fh3 *name_handle = &entry.name_handle;
 
 	LogDebug(COMPONENT_NFS_READDIR,
 		"Callback for %s cookie %"PRIu64,
 		cb_parms->name, cookie);
 
-	ep3->fileid = obj->fileid;
-	ep3->name = gsh_strdup(cb_parms->name);
-	ep3->cookie = cookie;
-
-	/* Account for file name + length + cookie */
-	tracker->mem_left -= sizeof(ep3->cookie) + RNDUP(namelen) +
-							BYTES_PER_XDR_UNIT;
-
 	if (cb_parms->attr_allowed) {
-		ep3->name_handle.handle_follows = TRUE;
+		name_handle->handle_follows = TRUE;
+		name_handle->post_op_fh3_u.handle.data.data_val = fh_buf;
 
-		if (!nfs3_FSALToFhandle(true,
-					&ep3->name_handle.post_op_fh3_u.handle,
+		if (!nfs3_FSALToFhandle(false,
+					&name_handle->post_op_fh3_u.handle,
 					obj,
 					op_ctx->ctx_export)) {
 			tracker->error = NFS3ERR_SERVERFAULT;
-			gsh_free(ep3->name);
 			cb_parms->in_result = false;
 			return ERR_FSAL_NO_ERROR;
 		}
 
-		/* Account for filehande + length + follows + nextentry */
-		tracker->mem_left -=
-		    ep3->name_handle.post_op_fh3_u.handle.data.data_len + 12;
-
 		/* Check if attributes follow and then place the attributes
 		 * that follow
 		 */
-		ep3->name_attributes.attributes_follow = nfs3_FSALattr_To_Fattr(
+		name_attributes->attributes_follow = nfs3_FSALattr_To_Fattr(
 			obj, attr,
-			&ep3->name_attributes.post_op_attr_u.attributes);
+			&name_attributes->post_op_attr_u.attributes);
 	} else {
-		ep3->name_handle.handle_follows = false;
-		ep3->name_attributes.attributes_follow = false;
-		tracker->mem_left -= sizeof(ep3->name_handle.handle_follows);
+		name_handle->handle_follows = false;
+		name_attributes->attributes_follow = false;
 	}
 
-	if (ep3->name_attributes.attributes_follow)
-		tracker->mem_left -= sizeof(ep3->name_attributes);
-	else
-		tracker->mem_left -=
-		    sizeof(ep3->name_attributes.attributes_follow);
+	switch (xdr_entries_buf_append(&tracker->eb,
+				       nfs3_readdirplus_encode_entry,
+				       &entry)) {
+	case XDR_ENTRIES_OK:
+		break;
+	case XDR_ENTRIES_FULL:
+		if (tracker->count == 0)
+			tracker->error = NFS3ERR_TOOSMALL;
 
-	if (tracker->count > 0)
-		tracker->entries[tracker->count - 1].nextentry = ep3;
+		cb_parms->in_result = false;
+		return ERR_FSAL_NO_ERROR;
+	case XDR_ENTRIES_FAILED:
+		LogCrit(COMPONENT_NFS_READDIR,
+			"Failed to encode entry %s", cb_parms->name);
+		tracker->error = NFS3ERR_SERVERFAULT;
+		cb_parms->in_result = false;
+		return ERR_FSAL_NO_ERROR;
+	}
 
 	++(tracker->count);
 	cb_parms->in_result = true;
 
 	return ERR_FSAL_NO_ERROR;
 }				/* nfs3_readdirplus_callback */
-
-/**
- * @brief Clean up memory allocated to serve NFSv3 READDIRPLUS
- *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
- *
- * @param entryplus3s [in] Pointer to first obj
- */
-
-static void free_entryplus3s(entryplus3 *entryplus3s)
-{
-	entryplus3 *entry = NULL;
-
-	for (entry = entryplus3s; entry != NULL; entry = entry->nextentry) {
-		gsh_free(entry->name);
-		gsh_free(entry->name_handle.post_op_fh3_u.handle.data.data_val);
-	}
-
-	gsh_free(entryplus3s);
-}
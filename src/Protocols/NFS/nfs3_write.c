@@ -67,6 +67,7 @@ static int nfs3_complete_write(struct nfs3_write_data *data)
 	struct fsal_io_arg *write_arg = &data->write_arg;
 	WRITE3resfail *resfail = &data->res->res_write3.WRITE3res_u.resfail;
 	WRITE3resok *resok = &data->res->res_write3.WRITE3res_u.resok;
+	struct gsh_buffdesc verf_desc;
 
 	if (data->rc == NFS_REQ_OK) {
 		/* Build Weak Cache Coherency data */
@@ -82,7 +83,10 @@ static int nfs3_complete_write(struct nfs3_write_data *data)
 			resok->committed = UNSTABLE;
 
 		/* Set the write verifier */
-		memcpy(resok->verf, NFS3_write_verifier, sizeof(writeverf3));
+		verf_desc.addr = resok->verf;
+		verf_desc.len = sizeof(writeverf3);
+		op_ctx->fsal_export->exp_ops.get_write_verifier(
+					op_ctx->fsal_export, &verf_desc);
 	} else if (data->rc == NFS_REQ_ERROR) {
 		/* If we are here, there was an error */
 		nfs_SetWccData(NULL, data->obj, &resfail->file_wcc);
@@ -0,0 +1,895 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief Routines used for managing the NFS4 COMPOUND functions.
+ *
+ * Routines used for managing the NFS4 COMPOUND functions COPY,
+ * OFFLOAD_STATUS, OFFLOAD_CANCEL and CLONE.
+ *
+ * Only intra-server copies are supported.  The source file is the
+ * saved filehandle and the destination the current filehandle, both
+ * must be in the same export.  Small copies, and copies the client
+ * wants synchronous, are done while processing the COPY.  Others are
+ * handed to the general fridge, the client polls them with
+ * OFFLOAD_STATUS and is told of their completion with CB_OFFLOAD.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_file_handle.h"
+#include "nfs_rpc_callback.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+
+/** @brief Copies up to this size are always done synchronously */
+#define NFS4_COPY_SYNC_MAX (16 * 1024 * 1024)
+
+/** @brief Size of each FSAL copy call of an asynchronous copy */
+#define NFS4_COPY_CHUNK (64 * 1024 * 1024)
+
+/** @brief Asynchronous copies in progress, more are done synchronously */
+#define NFS4_COPY_MAX_ASYNC 16
+
+/**
+ * @brief An asynchronous copy
+ *
+ * Owned by the thread doing the copy, then by the CB_OFFLOAD
+ * completion.  It is on copy_list from COPY until it is freed, the
+ * fields other than the arguments are protected by copy_mutex.
+ */
+
+struct nfs4_copy {
+	struct glist_head list;
+	stateid4 stateid;		/*< Returned in wr_callback_id */
+	nfs_client_id_t *clientid;
+	struct gsh_export *export;
+	struct fsal_obj_handle *src_obj;
+	struct fsal_obj_handle *dst_obj;
+	uint64_t src_offset;
+	uint64_t dst_offset;
+	uint64_t count;
+	uint64_t copied;		/*< Bytes copied so far */
+	bool cancelled;			/*< OFFLOAD_CANCEL was received */
+	bool done;
+	nfsstat4 status;		/*< Result once done */
+};
+
+static struct glist_head copy_list = GLIST_HEAD_INIT(copy_list);
+static pthread_mutex_t copy_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t copy_count;
+
+/**
+ * @brief Check one of the stateids of a COPY or CLONE
+ *
+ * As for READ or WRITE, a lock stateid stands for its open stateid and
+ * a delegation must allow the access.
+ *
+ * @param[in]  data	Compound request's data
+ * @param[in]  stateid	Stateid from the client
+ * @param[in]  obj	File the stateid is for
+ * @param[in]  write	The file is written
+ * @param[out] state	Open state found, NULL for a special stateid
+ * @param[in]  tag	Operation name for logging
+ *
+ * @return NFS4_OK or the error to return.
+ */
+static nfsstat4 copy_check_stateid(compound_data_t *data, stateid4 *stateid,
+				   struct fsal_obj_handle *obj, bool write,
+				   state_t **state, const char *tag)
+{
+	state_t *state_found = NULL;
+	state_t *state_open;
+	struct state_deleg *sdeleg;
+	uint32_t share_access = write ? OPEN4_SHARE_ACCESS_WRITE
+				      : OPEN4_SHARE_ACCESS_READ;
+	nfsstat4 status;
+
+	*state = NULL;
+
+	status = nfs4_Check_Stateid(stateid, obj, &state_found, data,
+				    STATEID_SPECIAL_ANY, 0, false, tag);
+
+	if (status != NFS4_OK)
+		return status;
+
+	if (state_found == NULL) {
+		/* An anonymous stateid must not conflict with an
+		 * outstanding delegation.
+		 */
+		if (state_deleg_conflict(obj, write))
+			return NFS4ERR_DELAY;
+
+		return NFS4_OK;
+	}
+
+	switch (state_found->state_type) {
+	case STATE_TYPE_SHARE:
+		break;
+
+	case STATE_TYPE_LOCK:
+		state_open = state_found->state_data.lock.openstate;
+		inc_state_t_ref(state_open);
+		dec_state_t_ref(state_found);
+		state_found = state_open;
+		break;
+
+	case STATE_TYPE_DELEG:
+		sdeleg = &state_found->state_data.deleg;
+		if (write && !(sdeleg->sd_type & OPEN_DELEGATE_WRITE)) {
+			LogDebug(COMPONENT_STATE,
+				 "Delegation type:%d state:%d",
+				 sdeleg->sd_type, sdeleg->sd_state);
+			status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+		/* The delegation is not an open state the FSAL can use */
+		dec_state_t_ref(state_found);
+		return NFS4_OK;
+
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s with invalid stateid of type %d",
+			 tag, (int)state_found->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	if ((state_found->state_data.share.share_access & share_access) ==
+	    0) {
+		if (isDebug(COMPONENT_NFS_V4_LOCK)) {
+			char str[LOG_BUFF_LEN] = "\0";
+			struct display_buffer dspbuf = {sizeof(str), str, str};
+
+			display_stateid(&dspbuf, state_found);
+			LogDebug(COMPONENT_NFS_V4_LOCK,
+				 "%s %s doesn't have OPEN4_SHARE_ACCESS_%s",
+				 tag, str, write ? "WRITE" : "READ");
+		}
+		status = NFS4ERR_OPENMODE;
+		goto out;
+	}
+
+	*state = state_found;
+	return NFS4_OK;
+
+ out:
+
+	dec_state_t_ref(state_found);
+	return status;
+}
+
+/**
+ * @brief Check the arguments of a COPY or CLONE
+ *
+ * On success the caller releases the states returned.
+ *
+ * @param[in]     data		Compound request's data
+ * @param[in]     src_stateid	Stateid of the source (saved) file
+ * @param[in]     dst_stateid	Stateid of the destination (current) file
+ * @param[in]     src_offset	Offset in the source file
+ * @param[in]     dst_offset	Offset in the destination file
+ * @param[in,out] count		Bytes to copy, 0 is replaced with up to
+ *				the end of the source file
+ * @param[out]    src_state	Source open state, or NULL
+ * @param[out]    dst_state	Destination open state, or NULL
+ * @param[in]     tag		Operation name for logging
+ *
+ * @return NFS4_OK or the error to return.
+ */
+static nfsstat4 copy_check_args(compound_data_t *data,
+				stateid4 *src_stateid, stateid4 *dst_stateid,
+				uint64_t src_offset, uint64_t dst_offset,
+				uint64_t *count, state_t **src_state,
+				state_t **dst_state, const char *tag)
+{
+	struct fsal_obj_handle *src_obj, *dst_obj;
+	fsal_status_t fsal_status;
+	struct attrlist attrs;
+	uint64_t size;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	nfsstat4 status;
+
+	*src_state = NULL;
+	*dst_state = NULL;
+
+	/* The destination is the current filehandle, the source the
+	 * saved one, and both must be files.
+	 */
+	status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	/* Only copies within an export are supported */
+	if (op_ctx->ctx_export != NULL && data->saved_export != NULL &&
+	    op_ctx->ctx_export->export_id != data->saved_export->export_id)
+		return NFS4ERR_XDEV;
+
+	src_obj = data->saved_obj;
+	dst_obj = data->current_obj;
+
+	fsal_status = op_ctx->fsal_export->exp_ops.check_quota(
+						op_ctx->fsal_export,
+						op_ctx->ctx_export->fullpath,
+						FSAL_QUOTA_BLOCKS);
+	if (FSAL_IS_ERROR(fsal_status))
+		return NFS4ERR_DQUOT;
+
+	status = copy_check_stateid(data, src_stateid, src_obj, false,
+				    src_state, tag);
+	if (status != NFS4_OK)
+		return status;
+
+	status = copy_check_stateid(data, dst_stateid, dst_obj, true,
+				    dst_state, tag);
+	if (status != NFS4_OK)
+		goto out;
+
+	/* Same permissions as required for a READ and a WRITE */
+	fsal_status = src_obj->obj_ops->test_access(src_obj, FSAL_READ_ACCESS,
+						    NULL, NULL, true);
+	if (!FSAL_IS_ERROR(fsal_status))
+		fsal_status = dst_obj->obj_ops->test_access(dst_obj,
+							    FSAL_WRITE_ACCESS,
+							    NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+	fsal_status = src_obj->obj_ops->getattrs(src_obj, &attrs);
+	size = attrs.filesize;
+
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	/* RFC 7862 15.2.3, a count of 0 copies up to the end of the
+	 * source, a range going past it is invalid.
+	 */
+	if (src_offset > size) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (*count == 0)
+		*count = size - src_offset;
+	else if (*count > size - src_offset) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (dst_offset + *count < dst_offset) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (src_obj == dst_obj &&
+	    src_offset < dst_offset + *count &&
+	    dst_offset < src_offset + *count) {
+		LogDebug(COMPONENT_NFS_V4,
+			 "%s overlapping ranges in the same file", tag);
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (MaxOffsetWrite < UINT64_MAX &&
+	    dst_offset + *count > MaxOffsetWrite) {
+		LogEvent(COMPONENT_NFS_V4,
+			 "A client tried to violate max file size %"
+			 PRIu64 " for exportid #%hu",
+			 MaxOffsetWrite, op_ctx->ctx_export->export_id);
+		status = NFS4ERR_FBIG;
+		goto out;
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "%s src_offset = %" PRIu64 " dst_offset = %" PRIu64
+		     " count = %" PRIu64,
+		     tag, src_offset, dst_offset, *count);
+
+	return NFS4_OK;
+
+ out:
+
+	if (*src_state != NULL) {
+		dec_state_t_ref(*src_state);
+		*src_state = NULL;
+	}
+
+	if (*dst_state != NULL) {
+		dec_state_t_ref(*dst_state);
+		*dst_state = NULL;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Find an asynchronous copy of a client
+ *
+ * Called with copy_mutex held.
+ *
+ * @param[in] clientid	Client that asked for the copy
+ * @param[in] stateid	Stateid returned by COPY
+ *
+ * @return The copy or NULL.
+ */
+static struct nfs4_copy *copy_lookup(nfs_client_id_t *clientid,
+				     stateid4 *stateid)
+{
+	struct glist_head *glist;
+	struct nfs4_copy *copy;
+
+	glist_for_each(glist, &copy_list) {
+		copy = glist_entry(glist, struct nfs4_copy, list);
+
+		if (copy->clientid == clientid &&
+		    memcmp(copy->stateid.other, stateid->other,
+			   OTHERSIZE) == 0)
+			return copy;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Remove and free an asynchronous copy
+ *
+ * @param[in] copy	The copy
+ */
+static void copy_release(struct nfs4_copy *copy)
+{
+	PTHREAD_MUTEX_lock(&copy_mutex);
+	glist_del(&copy->list);
+	copy_count--;
+	PTHREAD_MUTEX_unlock(&copy_mutex);
+
+	copy->src_obj->obj_ops->put_ref(copy->src_obj);
+	copy->dst_obj->obj_ops->put_ref(copy->dst_obj);
+	put_gsh_export(copy->export);
+	dec_client_id_ref(copy->clientid);
+
+	gsh_free(copy);
+}
+
+/**
+ * @brief Completion of CB_OFFLOAD
+ *
+ * @param[in] call	The callback
+ */
+static void copy_cb_offload_completion(rpc_call_t *call)
+{
+	struct nfs4_copy *copy = call->call_arg;
+	CB_OFFLOAD4args *arg =
+		&call->cbt.v_u.v4.args.argarray.argarray_val[1]
+					.nfs_cb_argop4_u.opcboffload;
+
+	if (call->states & NFS_CB_CALL_ABORTED ||
+	    call->cbt.v_u.v4.res.status != NFS4_OK)
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_OFFLOAD to client %s failed, status %d",
+			 copy->clientid->gsh_client->hostaddr_str,
+			 call->cbt.v_u.v4.res.status);
+
+	nfs4_freeFH(&arg->coa_fh);
+	nfs41_release_single(call);
+
+	copy_release(copy);
+}
+
+/**
+ * @brief Tell the client an asynchronous copy is over
+ *
+ * Called in the op context of the copy.  On success the copy is
+ * released by the completion.
+ *
+ * @param[in] copy	The copy
+ *
+ * @return true if CB_OFFLOAD was sent.
+ */
+static bool copy_cb_offload(struct nfs4_copy *copy)
+{
+	nfs_cb_argop4 argop;
+	CB_OFFLOAD4args *arg = &argop.nfs_cb_argop4_u.opcboffload;
+	write_response4 *resok = &arg->coa_offload_info.offload_info4_u
+								.coa_resok4;
+	int rc;
+
+	memset(&argop, 0, sizeof(argop));
+	argop.argop = NFS4_OP_CB_OFFLOAD;
+
+	if (!nfs4_FSALToFhandle(true, &arg->coa_fh, copy->dst_obj,
+				copy->export)) {
+		LogCrit(COMPONENT_NFS_CB,
+			"nfs4_FSALToFhandle failed, can not send CB_OFFLOAD");
+		return false;
+	}
+
+	arg->coa_stateid = copy->stateid;
+	arg->coa_offload_info.coa_status = copy->status;
+
+	if (copy->status == NFS4_OK) {
+		resok->wr_ids = 0;
+		resok->wr_count = copy->copied;
+		resok->wr_committed = UNSTABLE4;
+		op_ctx->fsal_export->exp_ops.get_write_verifier(
+				op_ctx->fsal_export,
+				&(struct gsh_buffdesc) {
+					.addr = resok->wr_writeverf,
+					.len = sizeof(resok->wr_writeverf) });
+	} else {
+		arg->coa_offload_info.offload_info4_u.coa_bytes_copied =
+								copy->copied;
+	}
+
+	rc = nfs_rpc_cb_single(copy->clientid, &argop, NULL,
+			       copy_cb_offload_completion, copy);
+
+	if (rc != 0) {
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_OFFLOAD nfs_rpc_cb_single returned %d", rc);
+		nfs4_freeFH(&arg->coa_fh);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Run an asynchronous copy
+ *
+ * The copy is done in chunks so OFFLOAD_STATUS sees progress and
+ * OFFLOAD_CANCEL and shutdown stop it.  The open states were checked by
+ * COPY but may be closed before the copy ends, so the FSAL is called
+ * without them.  Access was checked by COPY too, the copy is done with
+ * root credentials.
+ *
+ * @param[in] ctx	Thread context, the argument is the copy
+ */
+static void copy_run(struct fridgethr_context *ctx)
+{
+	struct nfs4_copy *copy = ctx->arg;
+	struct root_op_context root_ctx;
+	fsal_status_t fsal_status = {ERR_FSAL_NO_ERROR, 0};
+	uint64_t copied = 0, len, done;
+	bool cancelled = false;
+
+	init_root_op_context(&root_ctx, copy->export,
+			     copy->export->fsal_export, NFS_V4, 2,
+			     NFS_REQUEST);
+
+	while (copied < copy->count && !cancelled && !admin_shutdown) {
+		len = MIN(copy->count - copied, NFS4_COPY_CHUNK);
+		done = 0;
+
+		fsal_status = copy->dst_obj->obj_ops->copy(
+						copy->src_obj, NULL,
+						copy->src_offset + copied,
+						copy->dst_obj, NULL,
+						copy->dst_offset + copied,
+						len, &done);
+
+		copied += done;
+
+		PTHREAD_MUTEX_lock(&copy_mutex);
+		copy->copied = copied;
+		cancelled = copy->cancelled;
+		PTHREAD_MUTEX_unlock(&copy_mutex);
+
+		if (FSAL_IS_ERROR(fsal_status) || done == 0)
+			break;
+	}
+
+	PTHREAD_MUTEX_lock(&copy_mutex);
+	copy->done = true;
+	/* A short copy is not an error, the client is told how much was
+	 * copied.
+	 */
+	if (FSAL_IS_ERROR(fsal_status) && copied == 0)
+		copy->status = nfs4_Errno_status(fsal_status);
+	else
+		copy->status = NFS4_OK;
+	cancelled = copy->cancelled;
+	PTHREAD_MUTEX_unlock(&copy_mutex);
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "Copy of %" PRIu64 " bytes ended, %" PRIu64
+		     " copied, status %s%s",
+		     copy->count, copied, nfsstat4_to_str(copy->status),
+		     cancelled ? ", cancelled" : "");
+
+	/* A cancelled copy is not reported, RFC 7862 15.8.3 */
+	if (cancelled || !copy_cb_offload(copy))
+		copy_release(copy);
+
+	release_root_op_context();
+}
+
+/**
+ * @brief Start an asynchronous copy
+ *
+ * @param[in]  data		Compound request's data
+ * @param[in]  arg		Arguments of the COPY
+ * @param[in]  count		Bytes to copy
+ * @param[out] stateid		Stateid of the copy
+ *
+ * @return true if the copy was started, false to do it synchronously.
+ */
+static bool copy_start_async(compound_data_t *data, COPY4args *arg,
+			     uint64_t count, stateid4 *stateid)
+{
+	nfs_client_id_t *clientid = data->session->clientid_record;
+	struct nfs4_copy *copy;
+	int rc;
+
+	if (clientid->cid_minorversion == 0 ||
+	    !(atomic_fetch_uint32_t(&data->session->flags) & session_bc_up))
+		return false;
+
+	copy = gsh_calloc(1, sizeof(*copy));
+
+	copy->clientid = clientid;
+	copy->export = op_ctx->ctx_export;
+	copy->src_obj = data->saved_obj;
+	copy->dst_obj = data->current_obj;
+	copy->src_offset = arg->ca_src_offset;
+	copy->dst_offset = arg->ca_dst_offset;
+	copy->count = count;
+	copy->stateid.seqid = 1;
+	nfs4_BuildStateId_Other(clientid, copy->stateid.other);
+
+	/* The copy may be over before fridgethr_submit() returns */
+	*stateid = copy->stateid;
+
+	PTHREAD_MUTEX_lock(&copy_mutex);
+
+	if (copy_count >= NFS4_COPY_MAX_ASYNC) {
+		PTHREAD_MUTEX_unlock(&copy_mutex);
+		gsh_free(copy);
+		return false;
+	}
+
+	glist_add_tail(&copy_list, &copy->list);
+	copy_count++;
+
+	PTHREAD_MUTEX_unlock(&copy_mutex);
+
+	inc_client_id_ref(clientid);
+	get_gsh_export_ref(copy->export);
+	copy->src_obj->obj_ops->get_ref(copy->src_obj);
+	copy->dst_obj->obj_ops->get_ref(copy->dst_obj);
+
+	rc = fridgethr_submit(general_fridge, copy_run, copy);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to start copy, error %d", rc);
+		copy_release(copy);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * This functions handles the NFS4_OP_COPY operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+enum nfs_req_result nfs4_op_copy(struct nfs_argop4 *op,
+				 compound_data_t *data,
+				 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY4 = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY4 = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY4->COPY4res_u.cr_resok4;
+	write_response4 *response = &resok->cr_response;
+	state_t *src_state = NULL;
+	state_t *dst_state = NULL;
+	fsal_status_t fsal_status;
+	uint64_t count = arg_COPY4->ca_count;
+	uint64_t copied = 0;
+
+	resp->resop = NFS4_OP_COPY;
+
+	/* Inter-server copy is not supported, COPY_NOTIFY never hands out
+	 * the source servers a client would list here.
+	 */
+	if (arg_COPY4->ca_source_server.ca_source_server_len != 0) {
+		res_COPY4->cr_status = NFS4ERR_NOTSUPP;
+		return NFS_REQ_ERROR;
+	}
+
+	res_COPY4->cr_status = copy_check_args(data,
+					       &arg_COPY4->ca_src_stateid,
+					       &arg_COPY4->ca_dst_stateid,
+					       arg_COPY4->ca_src_offset,
+					       arg_COPY4->ca_dst_offset,
+					       &count, &src_state, &dst_state,
+					       "COPY");
+
+	if (res_COPY4->cr_status != NFS4_OK)
+		return NFS_REQ_ERROR;
+
+	memset(resok, 0, sizeof(*resok));
+
+	/* Every copy is done from the start of the range on */
+	resok->cr_requirements.cr_consecutive = true;
+	response->wr_committed = UNSTABLE4;
+
+	op_ctx->fsal_export->exp_ops.get_write_verifier(
+			op_ctx->fsal_export,
+			&(struct gsh_buffdesc) {
+				.addr = response->wr_writeverf,
+				.len = sizeof(response->wr_writeverf) });
+
+	if (!arg_COPY4->ca_synchronous && count > NFS4_COPY_SYNC_MAX &&
+	    copy_start_async(data, arg_COPY4, count,
+			     &response->wr_callback_id)) {
+		response->wr_ids = 1;
+		resok->cr_requirements.cr_synchronous = false;
+		goto out;
+	}
+
+	resok->cr_requirements.cr_synchronous = true;
+
+	if (count != 0) {
+		fsal_status = data->current_obj->obj_ops->copy(
+						data->saved_obj, src_state,
+						arg_COPY4->ca_src_offset,
+						data->current_obj, dst_state,
+						arg_COPY4->ca_dst_offset,
+						count, &copied);
+
+		/* Data already copied is reported, as a short copy */
+		if (FSAL_IS_ERROR(fsal_status) && copied == 0)
+			res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+	}
+
+	response->wr_count = copied;
+
+ out:
+
+	if (src_state != NULL)
+		dec_state_t_ref(src_state);
+
+	if (dst_state != NULL)
+		dec_state_t_ref(dst_state);
+
+	return nfsstat4_to_nfs_req_result(res_COPY4->cr_status);
+}				/* nfs4_op_copy */
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_STATUS operation in
+ * NFSv4.2. This function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+enum nfs_req_result nfs4_op_offload_status(struct nfs_argop4 *op,
+					   compound_data_t *data,
+					   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_STATUS4 =
+					&op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_STATUS4 =
+					&resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok = &res_STATUS4->OFFLOAD_STATUS4res_u
+								.osr_resok4;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	res_STATUS4->osr_status = nfs4_sanity_check_FH(data, REGULAR_FILE,
+						       false);
+	if (res_STATUS4->osr_status != NFS4_OK)
+		return NFS_REQ_ERROR;
+
+	PTHREAD_MUTEX_lock(&copy_mutex);
+
+	copy = copy_lookup(data->session->clientid_record,
+			   &arg_STATUS4->osa_stateid);
+
+	if (copy == NULL) {
+		res_STATUS4->osr_status = NFS4ERR_BAD_STATEID;
+	} else {
+		resok->osr_count = copy->copied;
+		resok->osr_complete_len = copy->done ? 1 : 0;
+		resok->osr_complete = copy->status;
+	}
+
+	PTHREAD_MUTEX_unlock(&copy_mutex);
+
+	return nfsstat4_to_nfs_req_result(res_STATUS4->osr_status);
+}				/* nfs4_op_offload_status */
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_CANCEL operation in
+ * NFSv4.2. This function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+enum nfs_req_result nfs4_op_offload_cancel(struct nfs_argop4 *op,
+					   compound_data_t *data,
+					   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_CANCEL4 =
+					&op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_CANCEL4 =
+					&resp->nfs_resop4_u.opoffload_cancel;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	res_CANCEL4->ocr_status = nfs4_sanity_check_FH(data, REGULAR_FILE,
+						       false);
+	if (res_CANCEL4->ocr_status != NFS4_OK)
+		return NFS_REQ_ERROR;
+
+	PTHREAD_MUTEX_lock(&copy_mutex);
+
+	copy = copy_lookup(data->session->clientid_record,
+			   &arg_CANCEL4->oca_stateid);
+
+	if (copy == NULL)
+		res_CANCEL4->ocr_status = NFS4ERR_BAD_STATEID;
+	else if (copy->done)
+		res_CANCEL4->ocr_status = NFS4ERR_COMPLETE_ALREADY;
+	else
+		copy->cancelled = true;
+
+	PTHREAD_MUTEX_unlock(&copy_mutex);
+
+	return nfsstat4_to_nfs_req_result(res_CANCEL4->ocr_status);
+}				/* nfs4_op_offload_cancel */
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * This functions handles the NFS4_OP_CLONE operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+enum nfs_req_result nfs4_op_clone(struct nfs_argop4 *op,
+				  compound_data_t *data,
+				  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE4 = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE4 = &resp->nfs_resop4_u.opclone;
+	state_t *src_state = NULL;
+	state_t *dst_state = NULL;
+	fsal_status_t fsal_status;
+	uint64_t count = arg_CLONE4->cl_count;
+
+	resp->resop = NFS4_OP_CLONE;
+
+	res_CLONE4->cl_status = copy_check_args(data,
+						&arg_CLONE4->cl_src_stateid,
+						&arg_CLONE4->cl_dst_stateid,
+						arg_CLONE4->cl_src_offset,
+						arg_CLONE4->cl_dst_offset,
+						&count, &src_state,
+						&dst_state, "CLONE");
+
+	if (res_CLONE4->cl_status != NFS4_OK)
+		return NFS_REQ_ERROR;
+
+	if (count != 0) {
+		fsal_status = data->current_obj->obj_ops->clone(
+						data->saved_obj, src_state,
+						arg_CLONE4->cl_src_offset,
+						data->current_obj, dst_state,
+						arg_CLONE4->cl_dst_offset,
+						count);
+
+		if (FSAL_IS_ERROR(fsal_status))
+			res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+	}
+
+	if (src_state != NULL)
+		dec_state_t_ref(src_state);
+
+	if (dst_state != NULL)
+		dec_state_t_ref(dst_state);
+
+	return nfsstat4_to_nfs_req_result(res_CLONE4->cl_status);
+}				/* nfs4_op_clone */
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
@@ -144,32 +144,77 @@ static enum nfs_req_result nfs4_complete_read(struct nfs4_read_data *data)
 	return nfsstat4_to_nfs_req_result(data->res_READ4->status);
 }
 
+/**
+ * @brief Fill in the contents of a READ_PLUS reply
+ *
+ * The reply owns the read buffer if a data segment uses it, the data of
+ * the first data segment must then start at the buffer.
+ *
+ * @param[out] res_RPLUS	Reply
+ * @param[in]  segs		Data and hole segments
+ * @param[in]  count		Number of segments
+ * @param[in]  buffer		Read buffer
+ * @param[in]  eof		End of file reached
+ */
+static void nfs4_read_plus_contents(READ_PLUS4res *res_RPLUS,
+				    const contents *segs, uint32_t count,
+				    void *buffer, bool eof)
+{
+	bool has_data = false;
+	uint32_t i;
+
+	res_RPLUS->rpr_resok4.rpr_eof = eof;
+	res_RPLUS->rpr_resok4.rpr_contents_count = count;
+	res_RPLUS->rpr_resok4.rpr_contents = NULL;
+
+	if (count > 0) {
+		res_RPLUS->rpr_resok4.rpr_contents =
+			gsh_malloc(count * sizeof(contents));
+		memcpy(res_RPLUS->rpr_resok4.rpr_contents, segs,
+		       count * sizeof(contents));
+	}
+
+	for (i = 0; i < count; i++)
+		if (segs[i].what == NFS4_CONTENT_DATA)
+			has_data = true;
+
+	if (!has_data)
+		gsh_free(buffer);
+}
+
 static void nfs4_complete_read_plus(struct nfs_resop4 *resp,
-				    struct io_info *info)
+				    struct nfs4_read_data *read_data)
 {
 	READ4res * const res_READ4 = &resp->nfs_resop4_u.opread;
 	READ_PLUS4res * const res_RPLUS = &resp->nfs_resop4_u.opread_plus;
-	contents *contentp = &res_RPLUS->rpr_resok4.rpr_contents;
+	/* res_RPLUS overlays res_READ4, get what was read first */
+	bool eof = res_READ4->READ4res_u.resok4.eof;
+	char *buffer = res_READ4->READ4res_u.resok4.data.data_val;
+	struct fsal_io_arg *read_arg;
+	contents seg;
 
-	/* Fixup the eof status from the res_READ4 that res_RPLUS overlays. */
-	res_RPLUS->rpr_resok4.rpr_eof = res_READ4->READ4res_u.resok4.eof;
+	if (read_data == NULL) {
+		/* Nothing was read */
+		nfs4_read_plus_contents(res_RPLUS, NULL, 0, buffer, eof);
+		return;
+	}
 
-	/* Now fill in the rest of res_RPLUS */
-	contentp->what = info->io_content.what;
-	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
+	read_arg = &read_data->read_arg;
 
-	if (info->io_content.what == NFS4_CONTENT_HOLE) {
-		contentp->hole.di_offset = info->io_content.hole.di_offset;
-		contentp->hole.di_length = info->io_content.hole.di_length;
+	if (read_arg->info != NULL) {
+		/* The FSAL split it into data and holes */
+		nfs4_read_plus_contents(res_RPLUS, read_arg->info->io_segs,
+					read_arg->info->io_seg_count, buffer,
+					eof);
+		return;
 	}
 
-	if (info->io_content.what == NFS4_CONTENT_DATA) {
-		contentp->data.d_offset = info->io_content.data.d_offset;
-		contentp->data.d_data.data_len =
-					info->io_content.data.d_data.data_len;
-		contentp->data.d_data.data_val =
-					info->io_content.data.d_data.data_val;
-	}
+	seg.what = NFS4_CONTENT_DATA;
+	seg.data.d_offset = read_arg->offset;
+	seg.data.d_data.data_len = read_arg->io_amount;
+	seg.data.d_data.data_val = buffer;
+
+	nfs4_read_plus_contents(res_RPLUS, &seg, 1, buffer, eof);
 }
 
 enum nfs_req_result nfs4_op_read_resume(struct nfs_argop4 *op,
@@ -199,9 +244,8 @@ enum nfs_req_result nfs4_op_read_plus_resume(struct nfs_argop4 *op,
 	struct nfs4_read_data *read_data = data->op_data;
 	enum nfs_req_result rc = nfs4_complete_read(read_data);
 
-	if (rc == NFS_REQ_OK) {
-		nfs4_complete_read_plus(resp, &read_data->info);
-	}
+	if (rc == NFS_REQ_OK)
+		nfs4_complete_read_plus(resp, read_data);
 
 	if (rc != NFS_REQ_ASYNC_WAIT) {
 		/* We are completely done with the request. This test wasn't
@@ -337,7 +381,6 @@ static enum nfs_req_result op_dsread_plus(struct nfs_argop4 *op,
 {
 	READ4args * const arg_READ4 = &op->nfs_argop4_u.opread;
 	READ_PLUS4res * const res_RPLUS = &resp->nfs_resop4_u.opread_plus;
-	contents *contentp = &res_RPLUS->rpr_resok4.rpr_contents;
 	/* NFSv4 return code */
 	nfsstat4 nfs_status = 0;
 	/* Buffer into which data is to be read */
@@ -348,12 +391,7 @@ static enum nfs_req_result op_dsread_plus(struct nfs_argop4 *op,
 	/* Don't bother calling the FSAL if the read length is 0. */
 
 	if (arg_READ4->count == 0) {
-		res_RPLUS->rpr_resok4.rpr_contents_count = 1;
-		res_RPLUS->rpr_resok4.rpr_eof = FALSE;
-		contentp->what = NFS4_CONTENT_DATA;
-		contentp->data.d_offset = arg_READ4->offset;
-		contentp->data.d_data.data_len =  0;
-		contentp->data.d_data.data_val = NULL;
+		nfs4_read_plus_contents(res_RPLUS, NULL, 0, NULL, false);
 		res_RPLUS->rpr_status = NFS4_OK;
 		return NFS_REQ_OK;
 	}
@@ -378,21 +416,8 @@ static enum nfs_req_result op_dsread_plus(struct nfs_argop4 *op,
 		return NFS_REQ_ERROR;
 	}
 
-	contentp->what = info->io_content.what;
-	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
-	res_RPLUS->rpr_resok4.rpr_eof = eof;
+	nfs4_read_plus_contents(res_RPLUS, &info->io_content, 1, buffer, eof);
 
-	if (info->io_content.what == NFS4_CONTENT_HOLE) {
-		contentp->hole.di_offset = info->io_content.hole.di_offset;
-		contentp->hole.di_length = info->io_content.hole.di_length;
-	}
-	if (info->io_content.what == NFS4_CONTENT_DATA) {
-		contentp->data.d_offset = info->io_content.data.d_offset;
-		contentp->data.d_data.data_len =
-					info->io_content.data.d_data.data_len;
-		contentp->data.d_data.data_val =
-					info->io_content.data.d_data.data_val;
-	}
 	return nfsstat4_to_nfs_req_result(res_RPLUS->rpr_status);
 }
 
@@ -637,6 +662,10 @@ static enum nfs_req_result nfs4_read(struct nfs_argop4 *op,
 	 */
 	resp_size = RNDUP(size) + sizeof(nfsstat4) + 2 * sizeof(uint32_t);
 
+	/* READ_PLUS segments take up to type, offset and length each */
+	if (io == IO_READ_PLUS)
+		resp_size += IO_INFO_MAX_SEGS * 5 * sizeof(uint32_t);
+
 	res_READ4->status = check_resp_room(data, resp_size);
 
 	if (res_READ4->status != NFS4_OK)
@@ -689,6 +718,11 @@ static enum nfs_req_result nfs4_read(struct nfs_argop4 *op,
 	if (info != NULL) {
 		/* We will be using the io_info that is part of read_data */
 		read_data->info.io_advise = info->io_advise;
+
+		/* Have holes reported if the FSAL can */
+		if (op_ctx->fsal_export->exp_ops.fs_supports(
+				op_ctx->fsal_export, fso_read_plus))
+			read_arg->info = &read_data->info;
 	}
 
 	/* Do the actual read */
@@ -829,13 +863,8 @@ enum nfs_req_result nfs4_op_read_plus(struct nfs_argop4 *op,
 		req_result = nfs4_complete_read(data->op_data);
 	}
 
-	if (req_result == NFS_REQ_OK) {
-		struct nfs4_read_data *read_data = data->op_data;
-
-		nfs4_complete_read_plus(resp, read_data != NULL
-					      ? &read_data->info
-					      : &info);
-	}
+	if (req_result == NFS_REQ_OK)
+		nfs4_complete_read_plus(resp, data->op_data);
 
 	if (req_result != NFS_REQ_ASYNC_WAIT && data->op_data != NULL) {
 		/* We are completely done with the request. This test wasn't
@@ -854,11 +883,21 @@ enum nfs_req_result nfs4_op_read_plus(struct nfs_argop4 *op,
 void nfs4_op_read_plus_Free(nfs_resop4 *res)
 {
 	READ_PLUS4res *resp = &res->nfs_resop4_u.opread_plus;
-	contents *conp = &resp->rpr_resok4.rpr_contents;
+	contents *conp = resp->rpr_resok4.rpr_contents;
+	uint32_t i;
+
+	if (resp->rpr_status != NFS4_OK)
+		return;
+
+	/* The data segments share the buffer the first one starts */
+	for (i = 0; i < resp->rpr_resok4.rpr_contents_count; i++) {
+		if (conp[i].what == NFS4_CONTENT_DATA) {
+			gsh_free(conp[i].data.d_data.data_val);
+			break;
+		}
+	}
 
-	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
-		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+	gsh_free(conp);
 }
 
 /**
@@ -920,7 +959,8 @@ enum nfs_req_result nfs4_op_io_advise(struct nfs_argop4 *op,
 		hints.offset = arg_IO_ADVISE->iaa_offset;
 		hints.count = arg_IO_ADVISE->iaa_count;
 
-		fsal_status = obj->obj_ops->io_advise(obj, &hints);
+		fsal_status = obj->obj_ops->io_advise2(obj, state_found,
+							&hints);
 		if (FSAL_IS_ERROR(fsal_status)) {
 			res_IO_ADVISE->iaa_status = NFS4ERR_NOTSUPP;
 			goto done;
@@ -43,13 +43,10 @@
  */
 
 struct nfs4_readdir_cb_data {
-	entry4 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
+	struct xdr_entries_buf eb;	/*< The entries, encoded as they come;
+					   limited to what fits in maxcount */
 	size_t count;		/*< The count of complete entries stored in the
 				   buffer */
-	size_t total_entries;	/*< The total number of entries available
-				   in the array */
 	nfsstat4 error;		/*< Set to a value other than NFS4_OK if the
 				   callback function finds a fatal error. */
 	struct bitmap4 *req_attr;	/*< The requested attributes */
@@ -81,20 +78,61 @@ static void restore_data(struct nfs4_readdir_cb_data *tracker)
 	}
 }
 
-/* The base size of a readdir entry includes cookie, name length, and the
- * indicator if a next entry follows.
+/**
+ * @brief An entry4 to encode
  */
-#define BASE_ENTRY_SIZE (sizeof(nfs_cookie4) + 2 * sizeof(uint32_t))
+
+struct nfs4_readdir_entry {
+	nfs_cookie4 cookie;		/*< Cookie of the entry */
+	const char *name;		/*< Name of the entry */
+	struct bitmap4 *req_attr;	/*< Attributes requested */
+	struct xdr_attrs_args *args;	/*< Attribute encoding arguments */
+	fattr4 *err_attrs;		/*< Attributes to send instead, if any */
+};
 
 /**
- * @brief Populate entry4s when called from fsal_readdir
+ * @brief Encode one entry4 in the READDIR reply
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entry4 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * The entry is preceded by the discriminant of the optional pointing at
+ * it, so entries can simply be appended to one another.
+ *
+ * @param[in,out] xdrs  Stream to encode to
+ * @param[in]     arg   The struct nfs4_readdir_entry
+ *
+ * @return true if the entry was encoded.
+ */
+
+static bool nfs4_readdir_encode_entry(XDR *xdrs, void *arg)
+{
+	struct nfs4_readdir_entry *entry = arg;
+	bool_t value_follows = true;
+	component4 entry_name = {
+		.utf8string_len = strlen(entry->name),
+		.utf8string_val = (char *)entry->name
+	};
+
+	if (!inline_xdr_bool(xdrs, &value_follows) ||
+	    !xdr_nfs_cookie4(xdrs, &entry->cookie) ||
+	    !xdr_component4(xdrs, &entry_name))
+		return false;
+
+	if (entry->err_attrs != NULL)
+		return xdr_fattr4(xdrs, entry->err_attrs);
+
+	return nfs4_FSALattr_To_Fattr_xdr(entry->args, entry->req_attr,
+					  xdrs) == 0;
+}
+
+/**
+ * @brief Encode entry4s when called from fsal_readdir
+ *
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * each entry straight into the reply's entries buffer, growing it as
+ * needed up to maxcount, so neither the name nor the attributes are
+ * copied in between.
  *
  * @param[in,out] opaque A struct nfs4_readdir_cb_data that stores the
- *                       location of the array and other bookeeping
+ *                       entries buffer and other bookeeping
  *                       information
  * @param[in]     obj	 Current file
  * @param[in]     attrs  The current file's attributes
@@ -110,7 +148,6 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 {
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs4_readdir_cb_data *tracker = cb_parms->opaque;
-	size_t namelen = 0;
 	char val_fh[NFS4_FHSIZE];
 	nfs_fh4 entryFH = {
 		.nfs_fh4_len = 0,
@@ -119,10 +156,11 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	struct xdr_attrs_args args;
 	compound_data_t *data = tracker->data;
 	nfsstat4 rdattr_error = NFS4_OK;
-	entry4 *tracker_entry = tracker->entries + tracker->count;
+	fattr4 err_attrs;
+	bool have_err_attrs = false;
+	struct nfs4_readdir_entry entry;
 	fsal_status_t fsal_status;
 	fsal_accessflags_t access_mask_attr = 0;
-	size_t initial_mem_left = tracker->mem_left;
 
 	/* Cleanup after problem with junction processing. */
 	if (cb_state == CB_PROBLEM) {
@@ -131,9 +169,6 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 		return ERR_FSAL_NO_ERROR;
 	}
 
-	if (tracker->total_entries == tracker->count)
-		goto not_inresult;
-
 	/* Test if this is a junction.
 	 *
 	 * NOTE: If there is a junction within a file system (perhaps setting
@@ -293,38 +328,8 @@ not_junction:
 	/* Now process the entry */
 	memset(val_fh, 0, NFS4_FHSIZE);
 
-	/* Bits that don't require allocation */
-	if (tracker->mem_left < BASE_ENTRY_SIZE) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= BASE_ENTRY_SIZE;
-	tracker_entry->cookie = cookie;
-	tracker_entry->nextentry = NULL;
-
-	/* The filename.  We don't use str2utf8 because that has an
-	 * additional copy into a buffer before copying into the
-	 * destination.
-	 */
-	namelen = strlen(cb_parms->name);
-
-	if (tracker->mem_left < RNDUP(namelen)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= RNDUP(namelen);
-	tracker_entry->name.utf8string_len = namelen;
-	tracker_entry->name.utf8string_val = gsh_strdup(cb_parms->name);
-
-	/* If we carried an error from above, now that we have
-	 * the name set up, go ahead and try and put error in
-	 * results.
+	/* If we carried an error from above, go ahead and try and put
+	 * error in results.
 	 */
 	if (rdattr_error != NFS4_OK) {
 		LogDebug(COMPONENT_NFS_READDIR,
@@ -371,14 +376,6 @@ not_junction:
 		goto skip;
 	}
 
-	if (nfs4_FSALattr_To_Fattr(&args,
-				   tracker->req_attr,
-				   &tracker_entry->attrs) != 0) {
-		LogCrit(COMPONENT_NFS_READDIR,
-			"nfs4_FSALattr_To_Fattr failed to convert attr");
-		goto server_fault;
-	}
-
 	/* Do not cache attrs, it will affect readdir performance */
 	if (obj->obj_ops->is_referral(obj, (struct attrlist *) attr,
 		false /*cache_attrs*/)) {
@@ -386,8 +383,6 @@ not_junction:
 		LogDebug(COMPONENT_NFS_READDIR,
 			 "Skipping because of %s",
 			 nfsstat4_to_str(rdattr_error));
-		/* Discard the attributes we had retrieved. */
-		nfs4_Fattr_Free(&tracker_entry->attrs);
 	}
 
  skip:
@@ -402,28 +397,37 @@ not_junction:
 			goto failure;
 		}
 
-		if (nfs4_Fattr_Fill_Error(data, &tracker_entry->attrs,
+		if (nfs4_Fattr_Fill_Error(data, &err_attrs,
 					  rdattr_error,
 					  tracker->req_attr, &args) == -1)
 			goto server_fault;
+
+		have_err_attrs = true;
 	}
 
-	if (tracker->mem_left <
-	    ((tracker_entry->attrs.attrmask.bitmap4_len * sizeof(uint32_t))
-	     + (tracker_entry->attrs.attr_vals.attrlist4_len))) {
+	entry.cookie = cookie;
+	entry.name = cb_parms->name;
+	entry.req_attr = tracker->req_attr;
+	entry.args = &args;
+	entry.err_attrs = have_err_attrs ? &err_attrs : NULL;
+
+	switch (xdr_entries_buf_append(&tracker->eb, nfs4_readdir_encode_entry,
+				       &entry)) {
+	case XDR_ENTRIES_OK:
+		break;
+	case XDR_ENTRIES_FULL:
 		if (tracker->count == 0)
 			tracker->error = NFS4ERR_TOOSMALL;
 
 		goto failure;
+	case XDR_ENTRIES_FAILED:
+		LogCrit(COMPONENT_NFS_READDIR,
+			"Failed to encode entry %s", cb_parms->name);
+		goto server_fault;
 	}
 
-	tracker->mem_left -= tracker_entry->attrs.attrmask.bitmap4_len *
-			     sizeof(uint32_t);
-
-	tracker->mem_left -= tracker_entry->attrs.attr_vals.attrlist4_len;
-
-	if (tracker->count != 0)
-		tracker->entries[tracker->count - 1].nextentry = tracker_entry;
+	if (have_err_attrs)
+		nfs4_Fattr_Free(&err_attrs);
 
 	++(tracker->count);
 	cb_parms->in_result = true;
@@ -435,15 +439,8 @@ not_junction:
 
  failure:
 
-	tracker->mem_left = initial_mem_left;
-	nfs4_Fattr_Free(&tracker_entry->attrs);
-
-	if (tracker_entry->name.utf8string_val != NULL) {
-		gsh_free(tracker_entry->name.utf8string_val);
-		tracker_entry->name.utf8string_val = NULL;
-	}
-
- not_inresult:
+	if (have_err_attrs)
+		nfs4_Fattr_Free(&err_attrs);
 
 	cb_parms->in_result = false;
 
@@ -458,28 +455,6 @@ not_junction:
 #define READDIR_RESP_BASE_SIZE (sizeof(nfsstat4) + sizeof(verifier4) + \
 				2 * BYTES_PER_XDR_UNIT)
 
-/**
- * @brief Free a list of entry4s
- *
- * This function frees a list of entry4s and all dependent strctures.
- *
- * @param[in,out] entries The entries to be freed
- */
-
-static void free_entries(entry4 *entries)
-{
-	entry4 *entry = NULL;
-
-	for (entry = entries; entry != NULL; entry = entry->nextentry) {
-		if (entry->attrs.attr_vals.attrlist4_val != NULL)
-			gsh_free(entry->attrs.attr_vals.attrlist4_val);
-
-		if (entry->name.utf8string_val != NULL)
-			gsh_free(entry->name.utf8string_val);
-	}
-	gsh_free(entries);
-}
-
 /**
  * @brief NFS4_OP_READDIR
  *
@@ -503,10 +478,8 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	bool eod_met = false;
 	unsigned long dircount = 0;
 	unsigned long maxcount = 0;
-	entry4 *entries = NULL;
 	verifier4 cookie_verifier;
 	uint64_t cookie = 0;
-	unsigned int estimated_num_entries = 0;
 	unsigned int num_entries = 0;
 	struct nfs4_readdir_cb_data tracker;
 	fsal_status_t fsal_status = {0, 0};
@@ -517,13 +490,13 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	resp->resop = NFS4_OP_READDIR;
 	res_READDIR4->status = NFS4_OK;
 
+	memset(&tracker, 0, sizeof(tracker));
+
 	res_READDIR4->status = nfs4_sanity_check_FH(data, DIRECTORY, false);
 
 	if (res_READDIR4->status != NFS4_OK)
 		goto out;
 
-	memset(&tracker, 0, sizeof(tracker));
-
 	dir_obj = data->current_obj;
 
 	/* get the characteristic value for readdir operation */
@@ -537,26 +510,12 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 		maxcount = arg_READDIR4->maxcount + sizeof(nfsstat4);
 
 	/* Dircount is considered meaningless by many nfsv4 client (like the
-	 * CITI one).  we use maxcount instead.
+	 * CITI one).  we use maxcount instead.  Entries are encoded as they
+	 * are read, so there is no limit on their number beyond that.
 	 */
-	/** @todo FSF - I think we could increase this, alll it does is
-	 *              control how many entry4 we allocate. They aren't
-	 *              that big:
-	 *              cookie
-	 *              name length
-	 *              name pointer
-	 *              pointer to next entry
-	 *              bitmap4
-	 *              attr_vals length
-	 *              attr_vals pointer
-	 */
-	estimated_num_entries = 50;
-	tracker.total_entries = estimated_num_entries;
-
 	LogDebug(COMPONENT_NFS_READDIR,
-		 "dircount=%lu maxcount=%lu cookie=%" PRIu64
-		 " estimated_num_entries=%u",
-		 dircount, maxcount, cookie, estimated_num_entries);
+		 "dircount=%lu maxcount=%lu cookie=%" PRIu64,
+		 dircount, maxcount, cookie);
 
 	/* Since we never send a cookie of 1 or 2, we shouldn't ever get
 	 * them back.
@@ -578,11 +537,11 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	/* If maxcount is too short (14 should be enough for an empty
 	 * directory) return NFS4ERR_TOOSMALL
 	 */
-	if (maxcount < READDIR_RESP_BASE_SIZE || estimated_num_entries == 0) {
+	if (maxcount < READDIR_RESP_BASE_SIZE) {
 		res_READDIR4->status = NFS4ERR_TOOSMALL;
 		LogInfo(COMPONENT_NFS_READDIR,
-			"Response too small maxcount = %lu, estimated_num_entries = %u",
-			maxcount - sizeof(nfsstat4), estimated_num_entries);
+			"Response too small maxcount = %lu",
+			maxcount - sizeof(nfsstat4));
 		goto out;
 	}
 
@@ -640,9 +599,7 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	}
 
 	/* Prepare to read the entries */
-	entries = gsh_calloc(estimated_num_entries, sizeof(entry4));
-	tracker.entries = entries;
-	tracker.mem_left = maxcount - READDIR_RESP_BASE_SIZE;
+	xdr_entries_buf_init(&tracker.eb, maxcount - READDIR_RESP_BASE_SIZE);
 	tracker.count = 0;
 	tracker.error = NFS4_OK;
 	tracker.req_attr = &arg_READDIR4->attr_request;
@@ -690,27 +647,24 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 		goto out;
 	}
 
-	/* Set the op response size to be accounted for, maxcount was the
-	 * maximum space that mem_left started from before we deducted
-	 * READDIR_RESP_BASE_SIZE and the space used for each entry.
-	 *
-	 * So the formula below is equivalent to:
-	 *
-	 *     maxcount - maxcount + READDIR_RESP_BASE_SIZE + space for entries
-	 *
-	 * So maxcount disappears and all that is left is the actual size.
+	/* Set the op response size to be accounted for, that is
+	 * READDIR_RESP_BASE_SIZE and the space used by the entries.
 	 */
-	data->op_resp_size = maxcount - tracker.mem_left;
+	data->op_resp_size = READDIR_RESP_BASE_SIZE +
+			     xdr_getpos(&tracker.eb.xdrs);
+
+	res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
+	res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr = NULL;
+	res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr_len = 0;
 
 	if (tracker.count != 0) {
-		/* Put the entry's list in the READDIR reply if
+		/* Hand the encoded entries to the READDIR reply if
 		 * there were any.
 		 */
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = entries;
-	} else {
-		gsh_free(entries);
-		entries = NULL;
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
+		res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr =
+			xdr_entries_buf_take(&tracker.eb,
+			    &res_READDIR4->READDIR4res_u.resok4.reply
+							.entries_xdr_len);
 	}
 
 	/* This slight bit of oddness is caused by most booleans
@@ -731,8 +685,7 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	res_READDIR4->status = NFS4_OK;
 
  out:
-	if ((res_READDIR4->status != NFS4_OK) && (entries != NULL))
-		free_entries(entries);
+	xdr_entries_buf_destroy(&tracker.eb);
 
 	LogDebug(COMPONENT_NFS_READDIR,
 		 "Returning %s",
@@ -753,5 +706,6 @@ void nfs4_op_readdir_Free(nfs_resop4 *res)
 {
 	READDIR4res *resp = &res->nfs_resop4_u.opreaddir;
 
-	free_entries(resp->READDIR4res_u.resok4.reply.entries);
+	if (resp->status == NFS4_OK)
+		gsh_free(resp->READDIR4res_u.resok4.reply.entries_xdr);
 }				/* nfs4_op_readdir_Free */
@@ -81,105 +81,197 @@ static bool is_export_pseudo(struct gsh_export *export)
 }
 
 /**
- * @brief Delete the unecessary directories from pseudo FS
+ * @brief A directory on the way to a junction
  *
- * @param pseudopath [IN] full path of the node
- * @param entry [IN] cache entry for the last directory in the path
+ * The directories found or created between the root of an export and the
+ * junctions of the exports mounted on it are kept in a trie of path
+ * components hanging off that export.  Mounting an export only looks up
+ * the components not in the trie yet, and unmounting it knows from the
+ * counts which directories are no longer needed, without looking up the
+ * parents or probing them for NOTEMPTY.  The root node is the root of the
+ * export.
+ */
+
+struct pseudofs_node {
+	struct avltree_node node_k;	/*< In the parent's children */
+	struct avltree children;	/*< Nodes for the next component */
+	struct pseudofs_node *parent;	/*< NULL for the export root */
+	struct fsal_obj_handle *obj;	/*< The directory, a reference held */
+	uint32_t mounts;		/*< Junctions at or below this node */
+	size_t len;			/*< Length of name */
+	char *name;			/*< This component */
+};
+
+/** Protects the pseudo fs tries, their counters and exp_junction_node */
+static pthread_mutex_t pseudofs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+	uint64_t nodes;		/*< Nodes in the tries */
+	uint64_t mounts;	/*< Exports mounted */
+	uint64_t unmounts;	/*< Exports unmounted */
+	uint64_t reused;	/*< Components found in the tries */
+	uint64_t lookups;	/*< Components looked up or created */
+	uint64_t removes;	/*< Directories removed */
+	uint64_t mount_ns;	/*< Time spent mounting */
+	uint64_t unmount_ns;	/*< Time spent unmounting */
+} pseudofs_st;
+
+static inline int pseudofs_node_cmpf(const struct avltree_node *lhs,
+				     const struct avltree_node *rhs)
+{
+	struct pseudofs_node *lk, *rk;
+	int rc;
+
+	lk = avltree_container_of(lhs, struct pseudofs_node, node_k);
+	rk = avltree_container_of(rhs, struct pseudofs_node, node_k);
+
+	rc = memcmp(lk->name, rk->name, MIN(lk->len, rk->len));
+	if (rc != 0)
+		return rc;
+	if (lk->len != rk->len)
+		return lk->len < rk->len ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief Add a node to a pseudo fs trie
  *
- * If this entry is present is pseudo FSAL, and is unnecessary, then remove it.
- * Check recursively if the parent entry is needed.
+ * Called with pseudofs_lock held.
  *
- * The pseudopath is deconstructed in place to create the subsequently shorter
- * pseudo paths.
+ * @param[in] parent Parent node, NULL for the export root
+ * @param[in] name   Path component
+ * @param[in] obj    The directory, a reference is taken
  *
- * When called the first time, entry is the mount point of an export that has
- * been unmounted from the PseudoFS. By definition, it is NOT the root of a
- * PseudoFS. Also, the PseudoFS root filesystem is NOT mounted and thus this
- * function will not be called for it. The req_op_context references the
- * export for the PseudoFS entry is within. Note that the caller is
- * responsible for checking if it is an FSAL_PSEUDO export (we only clean up
- * directories in FSAL_PSEUDO filesystems).
+ * @return The new node, with no mount counted.
  */
-void cleanup_pseudofs_node(char *pseudopath,
-			   struct fsal_obj_handle *obj)
-{
-	struct fsal_obj_handle *parent_obj;
-	char *pos = pseudopath + strlen(pseudopath) - 1;
-	char *name;
-	fsal_status_t fsal_status;
 
-	/* Strip trailing / from pseudopath */
-	while (*pos == '/')
-		pos--;
+static struct pseudofs_node *pseudofs_node_new(struct pseudofs_node *parent,
+					       const char *name,
+					       struct fsal_obj_handle *obj)
+{
+	size_t len = strlen(name);
+	struct pseudofs_node *node = gsh_calloc(1, sizeof(*node) + len + 1);
+
+	avltree_init(&node->children, pseudofs_node_cmpf, 0);
+	node->parent = parent;
+	node->name = (char *)(node + 1);
+	memcpy(node->name, name, len + 1);
+	node->len = len;
+	node->obj = obj;
+	obj->obj_ops->get_ref(obj);
+
+	if (parent != NULL)
+		avltree_inline_insert(&node->node_k, &parent->children,
+				      pseudofs_node_cmpf);
+	pseudofs_st.nodes++;
+
+	return node;
+}
 
-	/* Replace first trailing / if any with NUL */
-	pos[1] = '\0';
+/**
+ * @brief Find the child of a node for a path component
+ *
+ * Called with pseudofs_lock held.
+ */
 
-	/* Find the previous slash.
-	 * We will NEVER back up PAST the root, so no need to check
-	 * for walking off the beginning of the string.
-	 */
-	while (*pos != '/')
-		pos--;
+static struct pseudofs_node *pseudofs_node_find(struct pseudofs_node *parent,
+						char *name)
+{
+	struct pseudofs_node key;
+	struct avltree_node *found;
 
-	/* Remember the element name for remove */
-	name = pos + 1;
+	key.name = name;
+	key.len = strlen(name);
 
-	LogDebug(COMPONENT_EXPORT,
-		 "Checking if pseudo node %s is needed", pseudopath);
+	found = avltree_inline_lookup(&key.node_k, &parent->children,
+				      pseudofs_node_cmpf);
+	if (found == NULL)
+		return NULL;
 
-	fsal_status = fsal_lookupp(obj, &parent_obj, NULL);
+	return avltree_container_of(found, struct pseudofs_node, node_k);
+}
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		/* Truncate the pseudopath to be the path to the parent */
-		*pos = '\0';
-		LogCrit(COMPONENT_EXPORT,
-			"Could not find cache entry for parent directory %s",
-			pseudopath);
-		return;
-	}
+/**
+ * @brief Drop a junction from a pseudo fs trie
+ *
+ * The mount counts of the node and its ancestors are decremented.  The
+ * nodes no longer leading to a junction are freed, and their directories
+ * removed if the export is PSEUDO.  A node that still leads to a junction
+ * has ancestors that do too, so removal stops at the first of them.
+ *
+ * Called with pseudofs_lock held and op_ctx set up for the export.
+ *
+ * @param[in] export The export holding the trie
+ * @param[in] node   The node of the junction
+ * @param[in] remove Remove the directories no longer needed
+ */
 
-	fsal_status = fsal_remove(parent_obj, name);
+static void pseudofs_node_put(struct gsh_export *export,
+			      struct pseudofs_node *node,
+			      bool remove)
+{
+	struct pseudofs_node *parent;
+	fsal_status_t fsal_status;
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		/* Bailout if we get directory not empty error */
-		if (fsal_status.major == ERR_FSAL_NOTEMPTY) {
-			LogDebug(COMPONENT_EXPORT,
-				 "PseudoFS parent directory %s is not empty",
-				 pseudopath);
+	for (; node != NULL; node = parent) {
+		parent = node->parent;
+
+		if (--node->mounts != 0)
+			continue;
+
+		if (parent != NULL) {
+			avltree_remove(&node->node_k, &parent->children);
+
+			if (remove) {
+				LogDebug(COMPONENT_EXPORT,
+					 "Removing pseudo node %s from %s",
+					 node->name, export->pseudopath);
+
+				fsal_status = fsal_remove(parent->obj,
+							  node->name);
+				pseudofs_st.removes++;
+
+				if (fsal_status.major == ERR_FSAL_NOTEMPTY) {
+					LogDebug(COMPONENT_EXPORT,
+						 "PseudoFS directory %s is not empty",
+						 node->name);
+				} else if (FSAL_IS_ERROR(fsal_status)) {
+					LogCrit(COMPONENT_EXPORT,
+						"Removing pseudo node %s from %s failed with %s",
+						node->name, export->pseudopath,
+						msg_fsal_err(fsal_status.major));
+				}
+			}
 		} else {
-			LogCrit(COMPONENT_EXPORT,
-				"Removing pseudo node %s failed with %s",
-				pseudopath, msg_fsal_err(fsal_status.major));
+			export->exp_pseudofs_root = NULL;
 		}
-		goto out;
-	}
-
-	/* Before recursing the check the parent, get export lock for looking at
-	 * exp_root_obj so we can check if we have reached the root of
-	 * the mounted on export.
-	 */
-	PTHREAD_RWLOCK_rdlock(&op_ctx->ctx_export->lock);
-
-	if (parent_obj == op_ctx->ctx_export->exp_root_obj) {
-		LogDebug(COMPONENT_EXPORT,
-			 "Reached root of PseudoFS %s",
-			 op_ctx->ctx_export->pseudopath);
 
-		PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
-		goto out;
+		node->obj->obj_ops->put_ref(node->obj);
+		pseudofs_st.nodes--;
+		gsh_free(node);
 	}
+}
 
-	PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
-
-	/* Truncate the pseudopath to be the path to the parent */
-	*pos = '\0';
-
-	/* check if the parent directory is needed */
-	cleanup_pseudofs_node(pseudopath, parent_obj);
+/**
+ * @brief Log the pseudo fs counters
+ */
 
-out:
-	parent_obj->obj_ops->put_ref(parent_obj);
+void pseudofs_log_stats(void)
+{
+	PTHREAD_MUTEX_lock(&pseudofs_lock);
+
+	LogEvent(COMPONENT_EXPORT,
+		 "PseudoFS: %" PRIu64 " nodes, %" PRIu64 " mounts in %" PRIu64
+		 " ms, %" PRIu64 " unmounts in %" PRIu64 " ms, %" PRIu64
+		 " components reused, %" PRIu64 " looked up, %" PRIu64
+		 " removed",
+		 pseudofs_st.nodes,
+		 pseudofs_st.mounts, pseudofs_st.mount_ns / NS_PER_MSEC,
+		 pseudofs_st.unmounts, pseudofs_st.unmount_ns / NS_PER_MSEC,
+		 pseudofs_st.reused, pseudofs_st.lookups,
+		 pseudofs_st.removes);
+
+	PTHREAD_MUTEX_unlock(&pseudofs_lock);
 }
 
 bool make_pseudofs_node(char *name, struct pseudofs_state *state)
@@ -304,6 +396,8 @@ retry:
 bool pseudo_mount_export(struct gsh_export *export)
 {
 	struct pseudofs_state state;
+	struct pseudofs_node *node, *child;
+	struct timespec start, end;
 	char *tmp_pseudopath;
 	char *last_slash;
 	char *p;
@@ -379,35 +473,72 @@ bool pseudo_mount_export(struct gsh_export *export)
 		 export->export_id, export->fullpath,
 		 export->pseudopath, rest);
 
-	/* Get the root inode of the mounted on export */
-	fsal_status = nfs_export_get_root_entry(op_ctx->ctx_export, &state.obj);
+	PTHREAD_MUTEX_lock(&pseudofs_lock);
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		LogCrit(COMPONENT_EXPORT,
-			"BUILDING PSEUDOFS: Could not get root entry for Export_Id %d Path %s Pseudo Path %s",
-			export->export_id, export->fullpath,
-			export->pseudopath);
+	now(&start);
 
-		/* Release the reference on the mounted on export. */
-		put_gsh_export(op_ctx->ctx_export);
-		return false;
+	/* Start from the root of the mounted on export */
+	node = op_ctx->ctx_export->exp_pseudofs_root;
+
+	if (node == NULL) {
+		fsal_status = nfs_export_get_root_entry(op_ctx->ctx_export,
+							&state.obj);
+
+		if (FSAL_IS_ERROR(fsal_status)) {
+			LogCrit(COMPONENT_EXPORT,
+				"BUILDING PSEUDOFS: Could not get root entry for Export_Id %d Path %s Pseudo Path %s",
+				export->export_id, export->fullpath,
+				export->pseudopath);
+
+			PTHREAD_MUTEX_unlock(&pseudofs_lock);
+
+			/* Release the reference on the mounted on export. */
+			put_gsh_export(op_ctx->ctx_export);
+			return false;
+		}
+
+		node = pseudofs_node_new(NULL, "", state.obj);
+		op_ctx->ctx_export->exp_pseudofs_root = node;
+	} else {
+		state.obj = node->obj;
+		state.obj->obj_ops->get_ref(state.obj);
 	}
 
-	/* Now we need to process the rest of the path, creating directories
-	 * if necessary.
+	node->mounts++;
+
+	/* Now we need to process the rest of the path, only looking up or
+	 * creating the directories not in the trie yet.
 	 */
 	for (tok = strtok_r(rest, "/", &saveptr);
 	     tok;
 	     tok = strtok_r(NULL, "/", &saveptr)) {
-		rc = make_pseudofs_node(tok, &state);
-		if (!rc) {
-			/* Release reference on mount point inode
-			 * and the mounted on export
-			 */
+		child = pseudofs_node_find(node, tok);
+
+		if (child != NULL) {
+			pseudofs_st.reused++;
 			state.obj->obj_ops->put_ref(state.obj);
-			put_gsh_export(op_ctx->ctx_export);
-			return false;
+			state.obj = child->obj;
+			state.obj->obj_ops->get_ref(state.obj);
+		} else {
+			pseudofs_st.lookups++;
+			rc = make_pseudofs_node(tok, &state);
+			if (!rc) {
+				/* Release reference on mount point inode,
+				 * the nodes only counted for us and the
+				 * mounted on export
+				 */
+				state.obj->obj_ops->put_ref(state.obj);
+				pseudofs_node_put(op_ctx->ctx_export, node,
+						  false);
+				PTHREAD_MUTEX_unlock(&pseudofs_lock);
+				put_gsh_export(op_ctx->ctx_export);
+				return false;
+			}
+			child = pseudofs_node_new(node, tok, state.obj);
 		}
+
+		child->mounts++;
+		node = child;
 	}
 
 	/* Now that all entries are added to pseudofs tree, and we are pointing
@@ -417,6 +548,8 @@ bool pseudo_mount_export(struct gsh_export *export)
 	state.obj->state_hdl->dir.junction_export = export;
 	PTHREAD_RWLOCK_unlock(&state.obj->state_hdl->state_lock);
 
+	export->exp_junction_node = node;
+
 	/* And fill in the mounted on information for the export. */
 	PTHREAD_RWLOCK_wrlock(&export->lock);
 
@@ -433,6 +566,12 @@ bool pseudo_mount_export(struct gsh_export *export)
 
 	PTHREAD_RWLOCK_unlock(&export->lock);
 
+	now(&end);
+	pseudofs_st.mounts++;
+	pseudofs_st.mount_ns += timespec_diff(&start, &end);
+
+	PTHREAD_MUTEX_unlock(&pseudofs_lock);
+
 	LogDebug(COMPONENT_EXPORT,
 		 "BUILDING PSEUDOFS: Export_Id %d Path %s Pseudo Path %s junction %p",
 		 state.export->export_id,
@@ -482,6 +621,8 @@ void pseudo_unmount_export(struct gsh_export *export)
 	struct gsh_export *sub_mounted_export;
 	struct fsal_obj_handle *junction_inode;
 	struct root_op_context root_op_context;
+	struct pseudofs_node *node;
+	struct timespec start, end;
 
 	/* Unmount any exports mounted on us */
 	while (true) {
@@ -561,24 +702,31 @@ void pseudo_unmount_export(struct gsh_export *export)
 	PTHREAD_RWLOCK_unlock(&export->lock);
 
 	if (mounted_on_export != NULL) {
-		if (is_export_pseudo(mounted_on_export)
-		    && junction_inode != NULL) {
-			char *pseudopath = gsh_strdup(export->pseudopath);
-
-			/* Initialize req_ctx */
-			init_root_op_context(
-				&root_op_context,
-				mounted_on_export,
-				mounted_on_export->fsal_export,
-				NFS_V4, 0, NFS_REQUEST);
-
-			/* Remove the unused PseudoFS nodes */
-			cleanup_pseudofs_node(pseudopath,
-					      junction_inode);
-
-			gsh_free(pseudopath);
-			release_root_op_context();
-		}
+		/* Initialize req_ctx */
+		init_root_op_context(&root_op_context,
+				     mounted_on_export,
+				     mounted_on_export->fsal_export,
+				     NFS_V4, 0, NFS_REQUEST);
+
+		PTHREAD_MUTEX_lock(&pseudofs_lock);
+
+		now(&start);
+
+		node = export->exp_junction_node;
+		export->exp_junction_node = NULL;
+
+		/* Remove the unused PseudoFS nodes */
+		if (node != NULL)
+			pseudofs_node_put(mounted_on_export, node,
+					  is_export_pseudo(mounted_on_export));
+
+		now(&end);
+		pseudofs_st.unmounts++;
+		pseudofs_st.unmount_ns += timespec_diff(&start, &end);
+
+		PTHREAD_MUTEX_unlock(&pseudofs_lock);
+
+		release_root_op_context();
 
 		/* Release our reference to the export we are mounted on. */
 		put_gsh_export(mounted_on_export);
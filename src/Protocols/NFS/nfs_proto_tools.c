@@ -3598,6 +3598,74 @@ int nfs4_Fattr_Fill_Error(compound_data_t *data, fattr4 *Fattr,
 	return nfs4_FSALattr_To_Fattr(args, &restricted_attrmask, Fattr);
 }
 
+/**
+ * @brief Encode the values of the requested attributes
+ *
+ * @param[in]     args     XDR attribute arguments
+ * @param[in]     Bitmap   Bitmap of attributes being requested
+ * @param[in,out] attrmask Bitmap of the attributes actually encoded
+ * @param[in,out] attr_body XDR stream to encode the values in
+ *
+ * @return -1 if failed, 0 if successful.
+ */
+
+static int nfs4_encode_attr_vals(struct xdr_attrs_args *args,
+				 struct bitmap4 *Bitmap,
+				 struct bitmap4 *attrmask,
+				 XDR *attr_body)
+{
+	int attribute_to_set = 0;
+	int max_attr_idx;
+	int rc = 0;
+	fsal_dynamicfsinfo_t dynamicinfo;
+	fattr_xdr_result xdr_res;
+
+	max_attr_idx = nfs4_max_attr_index(args->data);
+	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
+		 max_attr_idx);
+
+	if (args->dynamicinfo == NULL)
+		args->dynamicinfo = &dynamicinfo;
+
+	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
+	     attribute_to_set != -1;
+	     attribute_to_set =
+	     next_attr_from_bitmap(Bitmap, attribute_to_set)) {
+		if (attribute_to_set > max_attr_idx)
+			break;	/* skip out of bounds */
+
+		xdr_res = fattr4tab[attribute_to_set].encode(attr_body, args);
+		if (xdr_res == FATTR_XDR_SUCCESS) {
+			bool res = set_attribute_in_bitmap(attrmask,
+							   attribute_to_set);
+			assert(res);
+			LogFullDebug(COMPONENT_NFS_V4,
+				     "Encoded attr %d, name = %s",
+				     attribute_to_set,
+				     fattr4tab[attribute_to_set].name);
+		} else if (xdr_res == FATTR_XDR_NOOP) {
+			LogFullDebug(COMPONENT_NFS_V4,
+				     "Attr not supported %d name=%s",
+				     attribute_to_set,
+				     fattr4tab[attribute_to_set].name);
+			continue;
+		} else {
+			LogEvent(COMPONENT_NFS_V4,
+				     "Encode FAILED for attr %d, name = %s",
+				     attribute_to_set,
+				     fattr4tab[attribute_to_set].name);
+			rc = -1;
+			break;
+		}
+		/* mark the attribute in the bitmap should be new bitmap btw */
+	}
+
+	if (args->dynamicinfo == &dynamicinfo)
+		args->dynamicinfo = NULL;
+
+	return rc;
+}
+
 /**
  * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
  *
@@ -3617,12 +3685,8 @@ int nfs4_Fattr_Fill_Error(compound_data_t *data, fattr4 *Fattr,
 int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 			   fattr4 *Fattr)
 {
-	int attribute_to_set = 0;
-	int max_attr_idx;
 	u_int LastOffset;
-	fsal_dynamicfsinfo_t dynamicinfo;
 	XDR attr_body;
-	fattr_xdr_result xdr_res;
 	uint32_t attrvals_buflen;
 
 	/* basic init */
@@ -3646,51 +3710,18 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 
 	Fattr->attr_vals.attrlist4_val = gsh_malloc(attrvals_buflen);
 
-	max_attr_idx = nfs4_max_attr_index(args->data);
-	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
-		 max_attr_idx);
-
 	LastOffset = 0;
 	memset(&attr_body, 0, sizeof(attr_body));
 	xdrmem_create(&attr_body, Fattr->attr_vals.attrlist4_val,
 		      attrvals_buflen, XDR_ENCODE);
 
-	if (args->dynamicinfo == NULL)
-		args->dynamicinfo = &dynamicinfo;
-
-	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
-	     attribute_to_set != -1;
-	     attribute_to_set =
-	     next_attr_from_bitmap(Bitmap, attribute_to_set)) {
-		if (attribute_to_set > max_attr_idx)
-			break;	/* skip out of bounds */
-
-		xdr_res = fattr4tab[attribute_to_set].encode(&attr_body, args);
-		if (xdr_res == FATTR_XDR_SUCCESS) {
-			bool res = set_attribute_in_bitmap(&Fattr->attrmask,
-							   attribute_to_set);
-			assert(res);
-			LogFullDebug(COMPONENT_NFS_V4,
-				     "Encoded attr %d, name = %s",
-				     attribute_to_set,
-				     fattr4tab[attribute_to_set].name);
-		} else if (xdr_res == FATTR_XDR_NOOP) {
-			LogFullDebug(COMPONENT_NFS_V4,
-				     "Attr not supported %d name=%s",
-				     attribute_to_set,
-				     fattr4tab[attribute_to_set].name);
-			continue;
-		} else {
-			LogEvent(COMPONENT_NFS_V4,
-				     "Encode FAILED for attr %d, name = %s",
-				     attribute_to_set,
-				     fattr4tab[attribute_to_set].name);
-
-			/* signal fail so if(LastOffset > 0) works right */
-			goto err;
-		}
-		/* mark the attribute in the bitmap should be new bitmap btw */
+	if (nfs4_encode_attr_vals(args, Bitmap, &Fattr->attrmask,
+				  &attr_body) != 0) {
+		/* signal fail so if(LastOffset > 0) works right */
+		xdr_destroy(&attr_body);
+		goto err;
 	}
+
 	LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
 	xdr_destroy(&attr_body);
 
@@ -3707,6 +3738,181 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	return -1;
 }
 
+/**
+ * @brief Encode FSAL Attributes straight into an XDR stream as a fattr4
+ *
+ * Equivalent to nfs4_FSALattr_To_Fattr followed by xdr_fattr4, without
+ * the intermediate buffer.  Room for the bitmap and the length of the
+ * attribute values is reserved up front and filled in once the values
+ * are encoded, so the stream must support xdr_setpos.  The bitmap sent
+ * is as long as the one requested, with the unsupported bits clear.
+ *
+ * @param[in]     args    XDR attribute arguments
+ * @param[in]     Bitmap  Bitmap of attributes being requested
+ * @param[in,out] xdrs    Stream to encode to
+ *
+ * @return -1 if failed (the stream position is then undefined),
+ *         0 if successful.
+ */
+
+int nfs4_FSALattr_To_Fattr_xdr(struct xdr_attrs_args *args,
+			       struct bitmap4 *Bitmap, XDR *xdrs)
+{
+	struct bitmap4 attrmask;
+	u_int start, vals_start, end, vals_len;
+
+	memset(&attrmask, 0, sizeof(attrmask));
+	attrmask.bitmap4_len = MIN(Bitmap->bitmap4_len, BITMAP4_MAPLEN);
+
+	start = xdr_getpos(xdrs);
+	vals_start = start +
+		     (attrmask.bitmap4_len + 2) * BYTES_PER_XDR_UNIT;
+
+	if (!xdr_setpos(xdrs, vals_start))
+		return -1;
+
+	if (attrmask.bitmap4_len != 0 &&
+	    nfs4_encode_attr_vals(args, Bitmap, &attrmask, xdrs) != 0)
+		return -1;
+
+	end = xdr_getpos(xdrs);
+	vals_len = end - vals_start;
+
+	if (!xdr_setpos(xdrs, start) ||
+	    !xdr_bitmap4(xdrs, &attrmask) ||
+	    !inline_xdr_u_int(xdrs, &vals_len) ||
+	    !xdr_setpos(xdrs, end))
+		return -1;
+
+	return 0;
+}
+
+/**
+ * @brief Set up a growable buffer to encode directory entries in
+ *
+ * READDIR and READDIRPLUS encode each entry into this buffer as the
+ * FSAL hands it over, and the reply encoder copies the whole thing
+ * out.  It starts small and doubles as needed.  Entries must end within
+ * the space the client allowed for them, but the buffer may grow past
+ * it, up to the largest reply we send, to tell an entry that is too big
+ * from one that cannot be encoded.
+ *
+ * @param[out] eb    The buffer
+ * @param[in]  limit Maximum size of the entries in bytes
+ */
+
+void xdr_entries_buf_init(struct xdr_entries_buf *eb, u_int limit)
+{
+	eb->max = nfs_param.core_param.rpc.max_send_buffer_size;
+	eb->limit = MIN(limit, eb->max);
+	eb->size = MIN(eb->limit, XDR_ENTRIES_BUF_INITIAL);
+	if (eb->size < BYTES_PER_XDR_UNIT)
+		eb->size = BYTES_PER_XDR_UNIT;	/* No entry will fit */
+	eb->buf = gsh_malloc(eb->size);
+	xdrmem_create(&eb->xdrs, eb->buf, eb->size, XDR_ENCODE);
+}
+
+/**
+ * @brief Double the entries buffer
+ *
+ * @param[in,out] eb  The buffer
+ * @param[in]     pos Where the stream is left
+ */
+
+static void xdr_entries_buf_grow(struct xdr_entries_buf *eb, u_int pos)
+{
+	eb->size = MIN((uint64_t) eb->size * 2, eb->max);
+	eb->buf = gsh_realloc(eb->buf, eb->size);
+
+	xdr_destroy(&eb->xdrs);
+	xdrmem_create(&eb->xdrs, eb->buf, eb->size, XDR_ENCODE);
+	(void) xdr_setpos(&eb->xdrs, pos);
+}
+
+/**
+ * @brief Append an entry to the entries buffer
+ *
+ * The entry is encoded in place, and the stream rewound to the end of
+ * the last whole entry if it fails or ends past the limit.  A memory
+ * stream fails the same way whether it ran out of room or the entry
+ * could not be encoded, so a failure that stopped short of the limit
+ * grows the buffer and encodes the entry again; that only happens as
+ * often as the buffer doubles.  An entry that fails in the largest
+ * buffer ends the listing there, or fails it if it is the first one.
+ *
+ * @param[in,out] eb     The buffer
+ * @param[in]     encode Function encoding the entry
+ * @param[in]     arg    Passed to @c encode
+ *
+ * @retval XDR_ENTRIES_OK if the entry was appended.
+ * @retval XDR_ENTRIES_FULL if it would not fit within the limit.
+ * @retval XDR_ENTRIES_FAILED if it could not be encoded.
+ * The stream is left where it was unless the entry was appended.
+ */
+
+enum xdr_entries_res xdr_entries_buf_append(struct xdr_entries_buf *eb,
+					    xdr_entry_encoder_t encode,
+					    void *arg)
+{
+	u_int pos = xdr_getpos(&eb->xdrs);
+	u_int end;
+
+	while (!encode(&eb->xdrs, arg)) {
+		end = xdr_getpos(&eb->xdrs);
+		(void) xdr_setpos(&eb->xdrs, pos);
+
+		if (end > eb->limit)
+			return XDR_ENTRIES_FULL;
+
+		if (eb->size == eb->max)
+			return pos == 0 ? XDR_ENTRIES_FAILED : XDR_ENTRIES_FULL;
+
+		xdr_entries_buf_grow(eb, pos);
+	}
+
+	if (xdr_getpos(&eb->xdrs) > eb->limit) {
+		(void) xdr_setpos(&eb->xdrs, pos);
+		return XDR_ENTRIES_FULL;
+	}
+
+	return XDR_ENTRIES_OK;
+}
+
+/**
+ * @brief Take the encoded entries out of the buffer
+ *
+ * @param[in,out] eb  The buffer, left empty
+ * @param[out]    len Number of bytes encoded
+ *
+ * @return The encoded entries, to be freed with gsh_free.
+ */
+
+char *xdr_entries_buf_take(struct xdr_entries_buf *eb, u_int *len)
+{
+	char *buf = eb->buf;
+
+	*len = xdr_getpos(&eb->xdrs);
+	xdr_destroy(&eb->xdrs);
+	eb->buf = NULL;
+	return buf;
+}
+
+/**
+ * @brief Release the entries buffer, if not taken
+ *
+ * @param[in,out] eb The buffer
+ */
+
+void xdr_entries_buf_destroy(struct xdr_entries_buf *eb)
+{
+	if (eb->buf == NULL)
+		return;
+
+	xdr_destroy(&eb->xdrs);
+	gsh_free(eb->buf);
+	eb->buf = NULL;
+}
+
 /**
  *
  * nfs3_Sattr_To_FSALattr: Converts NFSv3 Sattr to FSAL Attributes.
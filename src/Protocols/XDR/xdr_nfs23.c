@@ -208,11 +208,34 @@ bool xdr_specdata3(XDR *xdrs, specdata3 *objp)
 	return (true);
 }
 
+/*
+ * Handles of requests are decoded into data_buf, saving an allocation and
+ * free per handle.  Handles set up by callers still go through xdr_bytes.
+ */
 bool xdr_nfs_fh3(XDR *xdrs, nfs_fh3 *objp)
 {
+	switch (xdrs->x_op) {
+	case XDR_DECODE:
+		if (objp->data.data_val != NULL)
+			break;
+		if (!xdr_opaque_decode_fixed(xdrs, objp->data_buf,
+					     &objp->data.data_len,
+					     NFS3_FHSIZE))
+			return (false);
+		objp->data.data_val = objp->data_buf;
+		return (true);
+	case XDR_FREE:
+		if (objp->data.data_val != objp->data_buf)
+			break;
+		objp->data.data_val = NULL;
+		return (true);
+	default:
+		break;
+	}
+
 	if (!xdr_bytes
 	    (xdrs, (char **)&objp->data.data_val,
-	     (u_int *) & objp->data.data_len, 64))
+	     (u_int *) & objp->data.data_len, NFS3_FHSIZE))
 		return (false);
 
 	return (true);
@@ -227,8 +250,63 @@ bool xdr_nfstime3(XDR *xdrs, nfstime3 *objp)
 	return (true);
 }
 
+/* Number of XDR units in an encoded fattr3 */
+#define FATTR3_XDR_UNITS 21
+
 bool xdr_fattr3(XDR *xdrs, fattr3 *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs,
+					FATTR3_XDR_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			IXDR_PUT_U_INT32(buf, objp->type);
+			IXDR_PUT_U_INT32(buf, objp->mode);
+			IXDR_PUT_U_INT32(buf, objp->nlink);
+			IXDR_PUT_U_INT32(buf, objp->uid);
+			IXDR_PUT_U_INT32(buf, objp->gid);
+			ixdr_put_u_int64(&buf, objp->size);
+			ixdr_put_u_int64(&buf, objp->used);
+			IXDR_PUT_U_INT32(buf, objp->rdev.specdata1);
+			IXDR_PUT_U_INT32(buf, objp->rdev.specdata2);
+			ixdr_put_u_int64(&buf, objp->fsid);
+			ixdr_put_u_int64(&buf, objp->fileid);
+			IXDR_PUT_U_INT32(buf, objp->atime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->atime.tv_nsec);
+			IXDR_PUT_U_INT32(buf, objp->mtime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->mtime.tv_nsec);
+			IXDR_PUT_U_INT32(buf, objp->ctime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->ctime.tv_nsec);
+			return (true);
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs,
+					FATTR3_XDR_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			objp->type = IXDR_GET_U_INT32(buf);
+			objp->mode = IXDR_GET_U_INT32(buf);
+			objp->nlink = IXDR_GET_U_INT32(buf);
+			objp->uid = IXDR_GET_U_INT32(buf);
+			objp->gid = IXDR_GET_U_INT32(buf);
+			objp->size = ixdr_get_u_int64(&buf);
+			objp->used = ixdr_get_u_int64(&buf);
+			objp->rdev.specdata1 = IXDR_GET_U_INT32(buf);
+			objp->rdev.specdata2 = IXDR_GET_U_INT32(buf);
+			objp->fsid = ixdr_get_u_int64(&buf);
+			objp->fileid = ixdr_get_u_int64(&buf);
+			objp->atime.tv_sec = IXDR_GET_U_INT32(buf);
+			objp->atime.tv_nsec = IXDR_GET_U_INT32(buf);
+			objp->mtime.tv_sec = IXDR_GET_U_INT32(buf);
+			objp->mtime.tv_nsec = IXDR_GET_U_INT32(buf);
+			objp->ctime.tv_sec = IXDR_GET_U_INT32(buf);
+			objp->ctime.tv_nsec = IXDR_GET_U_INT32(buf);
+			return (true);
+		}
+	}
+
 	if (!xdr_ftype3(xdrs, &objp->type))
 		return (false);
 	if (!xdr_mode3(xdrs, &objp->mode))
@@ -579,8 +657,18 @@ bool xdr_LOOKUP3res(XDR *xdrs, LOOKUP3res *objp)
 
 bool xdr_ACCESS3args(XDR *xdrs, ACCESS3args *objp)
 {
+	int32_t *buf;
+
 	if (!xdr_nfs_fh3(xdrs, &objp->object))
 		return (false);
+	if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			objp->access = IXDR_GET_U_INT32(buf);
+			return (true);
+		}
+	}
 	if (!xdr_nfs3_uint32(xdrs, &objp->access))
 		return (false);
 	return (true);
@@ -664,13 +752,22 @@ bool xdr_READ3args(XDR *xdrs, READ3args *objp)
 	struct nfs_request_lookahead *lkhd =
 	    xdrs->x_public ? (struct nfs_request_lookahead *)xdrs->
 	    x_public : &dummy_lookahead;
+	int32_t *buf = NULL;
 
 	if (!xdr_nfs_fh3(xdrs, &objp->file))
 		return (false);
-	if (!xdr_offset3(xdrs, &objp->offset))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
-		return (false);
+	if (xdrs->x_op == XDR_DECODE)
+		buf = xdr_inline_decode(xdrs, 3 * BYTES_PER_XDR_UNIT);
+	if (buf != NULL) {
+		/* most likely */
+		objp->offset = ixdr_get_u_int64(&buf);
+		objp->count = IXDR_GET_U_INT32(buf);
+	} else {
+		if (!xdr_offset3(xdrs, &objp->offset))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+	}
 	lkhd->flags = NFS_LOOKAHEAD_READ;
 	(lkhd->read)++;
 	return (true);
@@ -727,15 +824,25 @@ bool xdr_WRITE3args(XDR *xdrs, WRITE3args *objp)
 	struct nfs_request_lookahead *lkhd =
 	    xdrs->x_public ? (struct nfs_request_lookahead *)xdrs->
 	    x_public : &dummy_lookahead;
+	int32_t *buf = NULL;
 
 	if (!xdr_nfs_fh3(xdrs, &objp->file))
 		return (false);
-	if (!xdr_offset3(xdrs, &objp->offset))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
-		return (false);
-	if (!xdr_stable_how(xdrs, &objp->stable))
-		return (false);
+	if (xdrs->x_op == XDR_DECODE)
+		buf = xdr_inline_decode(xdrs, 4 * BYTES_PER_XDR_UNIT);
+	if (buf != NULL) {
+		/* most likely */
+		objp->offset = ixdr_get_u_int64(&buf);
+		objp->count = IXDR_GET_U_INT32(buf);
+		objp->stable = IXDR_GET_U_INT32(buf);
+	} else {
+		if (!xdr_offset3(xdrs, &objp->offset))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+		if (!xdr_stable_how(xdrs, &objp->stable))
+			return (false);
+	}
 	if (!xdr_bytes
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
@@ -1321,6 +1428,21 @@ bool xdr_entryplus3(XDR *xdrs, entryplus3 *objp)
 
 bool xdr_dirlistplus3(XDR *xdrs, dirlistplus3 *objp)
 {
+	if (xdrs->x_op == XDR_ENCODE && objp->entries_xdr != NULL) {
+		bool_t no_more = false;
+
+		/* Each pre-encoded entry already carries the discriminant
+		 * of the optional that precedes it, so terminate the list.
+		 */
+		if (!xdr_opaque(xdrs, objp->entries_xdr,
+				objp->entries_xdr_len))
+			return (false);
+		if (!xdr_bool(xdrs, &no_more))
+			return (false);
+		if (!xdr_bool(xdrs, &objp->eof))
+			return (false);
+		return (true);
+	}
 	if (!xdr_pointer(xdrs, (void **)&objp->entries, sizeof(entryplus3),
 			 (xdrproc_t) xdr_entryplus3))
 		return (false);
@@ -7,6 +7,7 @@
 
 extern char v4_recov_dir[PATH_MAX];
 
+void fs_create_clid_name(nfs_client_id_t *clientid);
 void fs_add_clid(nfs_client_id_t *clientid);
 void fs_rm_clid(nfs_client_id_t *clientid);
 void fs_add_revoke_fh(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle);
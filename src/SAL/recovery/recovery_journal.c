@@ -0,0 +1,1066 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file recovery_journal.c
+ * @brief Append-only journal recovery backend
+ *
+ * Client additions, removals and revoked delegations are appended as
+ * records to a journal file.  Callers append under a mutex and wait for
+ * their record to be on stable storage; the first waiter writes and
+ * fsyncs everything appended so far for all of them, so a reclaim storm
+ * costs one fsync per batch instead of a few synchronous metadata
+ * operations per client.
+ *
+ * The clients known are also kept in memory.  When the journal grows
+ * past Recovery_Journal_Compact records, and past twice the clients
+ * known, they are written to a snapshot and the journal is emptied.
+ *
+ * A database is a generation: snapshot.<gen> and journal.<gen>, the
+ * CURRENT file names the generation to recover from.  A server starts a
+ * new generation and only makes it current at the end of grace, so the
+ * clients of the previous one stay allowed to reclaim if the server
+ * restarts during grace, as with fs_ng.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <netdb.h>
+#include "bsd-base64.h"
+#include "client_mgr.h"
+#include "fsal.h"
+#include "avltree.h"
+#include "city.h"
+#include "recovery_fs.h"
+
+#define JOURNAL_CURRENT "CURRENT"
+#define JOURNAL_SNAPSHOT "snapshot"
+#define JOURNAL_JOURNAL "journal"
+
+/**
+ * @brief Record types
+ */
+
+enum journal_rec_type {
+	JOURNAL_ADD_CLID = 1,	/*< Payload is the client name */
+	JOURNAL_RM_CLID = 2,	/*< Payload is the client name */
+	JOURNAL_ADD_RFH = 3,	/*< Payload is the client name, a NUL and
+				    the encoded revoked handle */
+};
+
+/**
+ * @brief Header of a record, followed by len bytes of payload
+ *
+ * Records are only read back by the server that wrote them, they are
+ * in host byte order.  A record whose checksum does not match ends the
+ * replay, it was torn by a crash.
+ */
+
+struct journal_rec_hdr {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t len;
+	uint64_t csum;
+};
+
+/**
+ * @brief A client known to a database
+ */
+
+struct journal_clid {
+	struct avltree_node node;
+	struct glist_head rfh_list;	/*< struct journal_rfh */
+	char *name;
+};
+
+/**
+ * @brief A revoked handle of a client
+ */
+
+struct journal_rfh {
+	struct glist_head list;
+	char handle[];
+};
+
+/**
+ * @brief State of the backend
+ */
+
+static struct {
+	/** Protects everything below */
+	pthread_mutex_t mutex;
+	/** Signalled when a flush ends */
+	pthread_cond_t cond;
+	/** Directory of this server's databases */
+	char dir[PATH_MAX];
+	/** Generation written to */
+	uint32_t gen;
+	/** Generation recovered from, 0 for none */
+	uint32_t old_gen;
+	/** Journal of gen, opened O_APPEND */
+	int fd;
+	/** Records appended and not yet written */
+	char *buf;
+	size_t len;
+	size_t size;
+	/** Sequence of the last record appended */
+	uint64_t append_seq;
+	/** Sequence of the last record on stable storage */
+	uint64_t durable_seq;
+	/** A thread is writing and syncing */
+	bool flushing;
+	/** A flush failed, the journal may end with a torn batch and the
+	 *  next flush writes a snapshot instead
+	 */
+	bool torn;
+	/** Bumped by each failed flush */
+	uint32_t fail_count;
+	/** Sequence covered by the last failed flush */
+	uint64_t failed_seq;
+	/** Error of the last failed flush, -errno */
+	int failed_err;
+	/** Records in the journal since the last snapshot */
+	uint64_t nrecs;
+	/** Clients of gen */
+	struct avltree clids;
+	uint64_t nclids;
+} jrnl = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+};
+
+static int journal_clid_cmpf(const struct avltree_node *lhs,
+			     const struct avltree_node *rhs)
+{
+	struct journal_clid *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct journal_clid, node);
+	rk = avltree_container_of(rhs, struct journal_clid, node);
+
+	return strcmp(lk->name, rk->name);
+}
+
+static struct journal_clid *journal_clid_lookup(struct avltree *tree,
+						const char *name)
+{
+	struct journal_clid key;
+	struct avltree_node *node;
+
+	key.name = (char *)name;
+	node = avltree_lookup(&key.node, tree);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct journal_clid, node);
+}
+
+static void journal_clid_free(struct journal_clid *clid)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &clid->rfh_list) {
+		glist_del(glist);
+		gsh_free(glist_entry(glist, struct journal_rfh, list));
+	}
+
+	gsh_free(clid->name);
+	gsh_free(clid);
+}
+
+static void journal_clids_clear(struct avltree *tree)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(tree)) != NULL) {
+		avltree_remove(node, tree);
+		journal_clid_free(avltree_container_of(node,
+						       struct journal_clid,
+						       node));
+	}
+}
+
+/**
+ * @brief Apply a record to a set of clients
+ *
+ * Applying records is idempotent, so a journal may be replayed on top
+ * of a snapshot that already contains it.
+ *
+ * @param[in] tree	Clients
+ * @param[in] count	Number of clients, updated
+ * @param[in] type	Record type
+ * @param[in] name	Client name
+ * @param[in] handle	Revoked handle for JOURNAL_ADD_RFH
+ */
+static void journal_apply(struct avltree *tree, uint64_t *count,
+			  enum journal_rec_type type, const char *name,
+			  const char *handle)
+{
+	struct journal_clid *clid = journal_clid_lookup(tree, name);
+	struct journal_rfh *rfh;
+	struct glist_head *glist;
+	size_t len;
+
+	switch (type) {
+	case JOURNAL_ADD_CLID:
+		if (clid != NULL)
+			return;
+
+		clid = gsh_calloc(1, sizeof(*clid));
+		clid->name = gsh_strdup(name);
+		glist_init(&clid->rfh_list);
+		avltree_insert(&clid->node, tree);
+		(*count)++;
+		return;
+
+	case JOURNAL_RM_CLID:
+		if (clid == NULL)
+			return;
+
+		avltree_remove(&clid->node, tree);
+		journal_clid_free(clid);
+		(*count)--;
+		return;
+
+	case JOURNAL_ADD_RFH:
+		if (clid == NULL)
+			return;
+
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct journal_rfh, list);
+			if (strcmp(rfh->handle, handle) == 0)
+				return;
+		}
+
+		len = strlen(handle) + 1;
+		rfh = gsh_malloc(sizeof(*rfh) + len);
+		memcpy(rfh->handle, handle, len);
+		glist_add_tail(&clid->rfh_list, &rfh->list);
+		return;
+	}
+}
+
+/**
+ * @brief Append a record to a buffer
+ *
+ * @param[in,out] buf	Buffer, grown as needed
+ * @param[in,out] len	Bytes used
+ * @param[in,out] size	Bytes allocated
+ * @param[in]     type	Record type
+ * @param[in]     name	Client name
+ * @param[in]     handle	Revoked handle for JOURNAL_ADD_RFH
+ */
+static void journal_encode(char **buf, size_t *len, size_t *size,
+			   enum journal_rec_type type, const char *name,
+			   const char *handle)
+{
+	struct journal_rec_hdr hdr;
+	size_t name_len = strlen(name);
+	size_t payload = name_len;
+	char *p;
+
+	if (type == JOURNAL_ADD_RFH)
+		payload += 1 + strlen(handle);
+
+	if (*len + sizeof(hdr) + payload > *size) {
+		*size = MAX(*size * 2, *len + sizeof(hdr) + payload);
+		*buf = gsh_realloc(*buf, *size);
+	}
+
+	p = *buf + *len + sizeof(hdr);
+	memcpy(p, name, name_len);
+	if (type == JOURNAL_ADD_RFH) {
+		p[name_len] = '\0';
+		memcpy(p + name_len + 1, handle, payload - name_len - 1);
+	}
+
+	hdr.type = type;
+	hdr.reserved = 0;
+	hdr.len = payload;
+	hdr.csum = CityHash64WithSeed(p, payload, type);
+	memcpy(*buf + *len, &hdr, sizeof(hdr));
+
+	*len += sizeof(hdr) + payload;
+}
+
+static void journal_path(char *path, size_t size, const char *dir,
+			 const char *file, uint32_t gen)
+{
+	snprintf(path, size, "%s/%s.%" PRIu32, dir, file, gen);
+}
+
+/**
+ * @brief Replay a snapshot or journal
+ *
+ * The file is read whole and parsed in memory.
+ *
+ * @param[in] path	File to replay
+ * @param[in] tree	Clients to apply it to
+ * @param[in] count	Number of clients, updated
+ *
+ * @return Records replayed, or -1 if the file could not be read.
+ */
+static int64_t journal_replay(const char *path, struct avltree *tree,
+			      uint64_t *count)
+{
+	struct journal_rec_hdr hdr;
+	struct stat st;
+	char *buf, *name, *handle;
+	size_t off = 0;
+	ssize_t got;
+	int64_t nrecs = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 0;
+		LogEvent(COMPONENT_CLIENTID, "Failed to open %s: %s",
+			 path, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	buf = gsh_malloc(st.st_size + 1);
+
+	for (got = 0; got < st.st_size; ) {
+		ssize_t ret = pread(fd, buf + got, st.st_size - got, got);
+
+		if (ret <= 0)
+			break;
+		got += ret;
+	}
+
+	close(fd);
+
+	while (off + sizeof(hdr) <= got) {
+		memcpy(&hdr, buf + off, sizeof(hdr));
+
+		if (hdr.len > got - off - sizeof(hdr) ||
+		    hdr.type < JOURNAL_ADD_CLID || hdr.type > JOURNAL_ADD_RFH ||
+		    CityHash64WithSeed(buf + off + sizeof(hdr), hdr.len,
+				       hdr.type) != hdr.csum)
+			break;
+
+		/* Make the payload strings, the byte after it is the
+		 * next header or the extra byte allocated.
+		 */
+		name = buf + off + sizeof(hdr);
+		off += sizeof(hdr) + hdr.len;
+		memmove(name - 1, name, hdr.len);
+		name--;
+		name[hdr.len] = '\0';
+
+		handle = NULL;
+		if (hdr.type == JOURNAL_ADD_RFH) {
+			handle = memchr(name, '\0', hdr.len);
+			if (handle == NULL || handle == name + hdr.len)
+				break;
+			handle++;
+		}
+
+		journal_apply(tree, count, hdr.type, name, handle);
+		nrecs++;
+	}
+
+	if (off != got)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Ignoring %zu bytes of torn records at the end of %s",
+			 (size_t)(got - off), path);
+
+	gsh_free(buf);
+
+	return nrecs;
+}
+
+/**
+ * @brief Load a database
+ *
+ * @param[in] dir	Directory of the database
+ * @param[in] gen	Generation
+ * @param[in] tree	Clients to load into
+ * @param[in] count	Number of clients, updated
+ *
+ * @return Records in the journal, or -1 on error.
+ */
+static int64_t journal_load(const char *dir, uint32_t gen,
+			    struct avltree *tree, uint64_t *count)
+{
+	char path[PATH_MAX];
+	int64_t nrecs;
+
+	journal_path(path, sizeof(path), dir, JOURNAL_SNAPSHOT, gen);
+	if (journal_replay(path, tree, count) < 0)
+		return -1;
+
+	journal_path(path, sizeof(path), dir, JOURNAL_JOURNAL, gen);
+	nrecs = journal_replay(path, tree, count);
+
+	return nrecs;
+}
+
+/**
+ * @brief Read the generation a directory recovers from
+ *
+ * @param[in] dir	Directory
+ *
+ * @return The generation, 0 for none.
+ */
+static uint32_t journal_read_current(const char *dir)
+{
+	char path[PATH_MAX];
+	char buf[32];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, JOURNAL_CURRENT);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+
+	if (len <= 0)
+		return 0;
+
+	buf[len] = '\0';
+
+	return strtoul(buf, NULL, 10);
+}
+
+static int journal_fsync_dir(const char *dir)
+{
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	int rc = 0;
+
+	if (fd < 0)
+		return -errno;
+
+	if (fsync(fd) < 0)
+		rc = -errno;
+
+	close(fd);
+
+	return rc;
+}
+
+/**
+ * @brief Atomically replace a file of the database directory
+ *
+ * @param[in] dir	Directory
+ * @param[in] path	File to replace
+ * @param[in] data	New contents
+ * @param[in] len	Length of data
+ *
+ * @return 0 or -errno.
+ */
+static int journal_replace_file(const char *dir, const char *path,
+				const char *data, size_t len)
+{
+	char tmp[PATH_MAX];
+	size_t off;
+	ssize_t ret;
+	int fd, rc = 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -errno;
+
+	for (off = 0; off < len; off += ret) {
+		ret = write(fd, data + off, len - off);
+		if (ret < 0) {
+			rc = -errno;
+			break;
+		}
+	}
+
+	if (rc == 0 && fdatasync(fd) < 0)
+		rc = -errno;
+
+	close(fd);
+
+	if (rc == 0 && rename(tmp, path) < 0)
+		rc = -errno;
+
+	if (rc == 0)
+		rc = journal_fsync_dir(dir);
+	else
+		unlink(tmp);
+
+	return rc;
+}
+
+/**
+ * @brief Remove the files of generations other than two
+ *
+ * @param[in] keep1	Generation to keep
+ * @param[in] keep2	Generation to keep
+ */
+static void journal_remove_other_gens(uint32_t keep1, uint32_t keep2)
+{
+	struct dirent *dentp;
+	char path[PATH_MAX];
+	const char *dot;
+	uint32_t gen;
+	DIR *dp;
+
+	dp = opendir(jrnl.dir);
+	if (dp == NULL)
+		return;
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		if (strncmp(dentp->d_name, JOURNAL_SNAPSHOT ".",
+			    sizeof(JOURNAL_SNAPSHOT)) != 0 &&
+		    strncmp(dentp->d_name, JOURNAL_JOURNAL ".",
+			    sizeof(JOURNAL_JOURNAL)) != 0)
+			continue;
+
+		dot = strchr(dentp->d_name, '.');
+		gen = strtoul(dot + 1, NULL, 10);
+
+		if (gen == keep1 || gen == keep2)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", jrnl.dir,
+			 dentp->d_name);
+		if (unlink(path) < 0)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to remove %s: %s",
+				 path, strerror(errno));
+	}
+
+	(void)closedir(dp);
+}
+
+/**
+ * @brief Write the clients known to a snapshot and empty the journal
+ *
+ * Called by the flushing thread, without the mutex.
+ *
+ * @param[in] snap	Encoded clients
+ * @param[in] len	Length of snap
+ *
+ * @return 0 or -errno.
+ */
+static int journal_compact(const char *snap, size_t len)
+{
+	char path[PATH_MAX];
+	int rc;
+
+	journal_path(path, sizeof(path), jrnl.dir, JOURNAL_SNAPSHOT,
+		     jrnl.gen);
+
+	rc = journal_replace_file(jrnl.dir, path, snap, len);
+	if (rc != 0)
+		return rc;
+
+	/* A crash before the truncate replays the journal over the
+	 * snapshot, which is harmless.
+	 */
+	if (ftruncate(jrnl.fd, 0) < 0 || fdatasync(jrnl.fd) < 0)
+		return -errno;
+
+	return 0;
+}
+
+/**
+ * @brief Encode the clients known as a snapshot
+ *
+ * Called with the mutex held.
+ *
+ * @param[out] len	Length of the snapshot
+ *
+ * @return The snapshot.
+ */
+static char *journal_encode_snapshot(size_t *len)
+{
+	struct avltree_node *node;
+	struct journal_clid *clid;
+	struct journal_rfh *rfh;
+	struct glist_head *glist;
+	size_t size = 4096;
+	char *snap = gsh_malloc(size);
+
+	*len = 0;
+
+	for (node = avltree_first(&jrnl.clids); node != NULL;
+	     node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct journal_clid, node);
+
+		journal_encode(&snap, len, &size, JOURNAL_ADD_CLID,
+			       clid->name, NULL);
+
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct journal_rfh, list);
+			journal_encode(&snap, len, &size, JOURNAL_ADD_RFH,
+				       clid->name, rfh->handle);
+		}
+	}
+
+	return snap;
+}
+
+/**
+ * @brief Wait for a record to be on stable storage
+ *
+ * Called with the mutex held.  If no thread is flushing, this one
+ * writes every record appended so far with one write and one fdatasync
+ * and wakes the others it covered.
+ *
+ * A failed flush fails all the records it covered.  What it wrote may
+ * end with a torn record, which would end the replay before any record
+ * appended after it, so the next flush writes a snapshot of the clients
+ * known, which include the failed records, and empties the journal.
+ *
+ * @param[in] seq	Sequence of the record
+ *
+ * @return 0 or -errno.
+ */
+static int journal_wait(uint64_t seq)
+{
+	char *buf, *snap;
+	size_t len, snap_len;
+	uint64_t target;
+	uint32_t fails = jrnl.fail_count;
+	ssize_t ret;
+	size_t off;
+	int rc = 0;
+
+	while (jrnl.durable_seq < seq) {
+		if (jrnl.fail_count != fails && jrnl.failed_seq >= seq) {
+			/* The flush covering our record failed */
+			rc = jrnl.failed_err;
+			break;
+		}
+
+		if (jrnl.flushing) {
+			pthread_cond_wait(&jrnl.cond, &jrnl.mutex);
+			continue;
+		}
+
+		/* Become the flusher for everything appended so far */
+		jrnl.flushing = true;
+		target = jrnl.append_seq;
+		buf = jrnl.buf;
+		len = jrnl.len;
+		jrnl.buf = NULL;
+		jrnl.len = 0;
+		jrnl.size = 0;
+
+		snap = NULL;
+		jrnl.nrecs += target - jrnl.durable_seq;
+		if (jrnl.torn ||
+		    (jrnl.nrecs >
+			nfs_param.nfsv4_param.recovery_journal_compact &&
+		     jrnl.nrecs > 2 * jrnl.nclids)) {
+			/* The clients known already include this batch */
+			snap = journal_encode_snapshot(&snap_len);
+			jrnl.nrecs = 0;
+		}
+
+		PTHREAD_MUTEX_unlock(&jrnl.mutex);
+
+		rc = 0;
+		if (snap != NULL) {
+			rc = journal_compact(snap, snap_len);
+			gsh_free(snap);
+			LogDebug(COMPONENT_CLIENTID,
+				 "Compacted recovery journal, rc=%d", rc);
+		} else {
+			for (off = 0; off < len; off += ret) {
+				ret = write(jrnl.fd, buf + off, len - off);
+				if (ret < 0) {
+					rc = -errno;
+					break;
+				}
+			}
+
+			if (rc == 0 && fdatasync(jrnl.fd) < 0)
+				rc = -errno;
+		}
+
+		gsh_free(buf);
+
+		if (rc != 0)
+			LogCrit(COMPONENT_CLIENTID,
+				"Failed to write recovery journal: %s",
+				strerror(-rc));
+
+		PTHREAD_MUTEX_lock(&jrnl.mutex);
+
+		if (rc == 0) {
+			jrnl.durable_seq = target;
+			jrnl.torn = false;
+		} else {
+			jrnl.torn = true;
+			jrnl.fail_count++;
+			jrnl.failed_seq = target;
+			jrnl.failed_err = rc;
+		}
+
+		jrnl.flushing = false;
+		pthread_cond_broadcast(&jrnl.cond);
+
+		if (rc != 0)
+			break;
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Log a record and wait for it to be stable
+ *
+ * @param[in] type	Record type
+ * @param[in] name	Client name
+ * @param[in] handle	Revoked handle for JOURNAL_ADD_RFH
+ *
+ * @return 0 or -errno if the record may not be on stable storage.
+ */
+static int journal_log(enum journal_rec_type type, const char *name,
+		       const char *handle)
+{
+	uint64_t seq;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&jrnl.mutex);
+
+	if (jrnl.fd < 0) {
+		PTHREAD_MUTEX_unlock(&jrnl.mutex);
+		return -EBADF;
+	}
+
+	journal_encode(&jrnl.buf, &jrnl.len, &jrnl.size, type, name, handle);
+	journal_apply(&jrnl.clids, &jrnl.nclids, type, name, handle);
+	seq = ++jrnl.append_seq;
+
+	rc = journal_wait(seq);
+
+	PTHREAD_MUTEX_unlock(&jrnl.mutex);
+
+	return rc;
+}
+
+static int journal_init(void)
+{
+	char host[NI_MAXHOST];
+	char path[PATH_MAX];
+	const char *root = nfs_param.nfsv4_param.recovery_journal_dir;
+	int err;
+
+	err = mkdir(root, 0700);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s): %s",
+			 root, strerror(errno));
+		return -errno;
+	}
+
+	if (nfs_param.core_param.clustered) {
+		snprintf(host, sizeof(host), "node%d", g_nodeid);
+	} else {
+		err = gethostname(host, sizeof(host));
+		if (err) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to gethostname: %s",
+				 strerror(errno));
+			return -errno;
+		}
+	}
+
+	snprintf(jrnl.dir, sizeof(jrnl.dir), "%s/%s", root, host);
+	err = mkdir(jrnl.dir, 0700);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s): %s",
+			 jrnl.dir, strerror(errno));
+		return -errno;
+	}
+
+	/* Generations left by a restart during grace are dropped, the
+	 * clients they hold are in the current one or reclaim again.
+	 */
+	jrnl.old_gen = journal_read_current(jrnl.dir);
+	jrnl.gen = jrnl.old_gen + 1;
+	journal_remove_other_gens(jrnl.old_gen, jrnl.old_gen);
+
+	avltree_init(&jrnl.clids, journal_clid_cmpf, 0);
+	jrnl.nclids = 0;
+	jrnl.nrecs = 0;
+
+	journal_path(path, sizeof(path), jrnl.dir, JOURNAL_JOURNAL, jrnl.gen);
+	jrnl.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+	if (jrnl.fd < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create recovery journal (%s): %s",
+			 path, strerror(errno));
+		return -errno;
+	}
+
+	LogEvent(COMPONENT_CLIENTID,
+		 "Recovery journal %s, generation %" PRIu32,
+		 jrnl.dir, jrnl.gen);
+
+	return 0;
+}
+
+static void journal_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&jrnl.mutex);
+
+	(void) journal_wait(jrnl.append_seq);
+
+	if (jrnl.fd >= 0) {
+		close(jrnl.fd);
+		jrnl.fd = -1;
+	}
+
+	journal_clids_clear(&jrnl.clids);
+	jrnl.nclids = 0;
+
+	PTHREAD_MUTEX_unlock(&jrnl.mutex);
+}
+
+/**
+ * @brief Make the generation written to current
+ *
+ * Once grace is over the clients that did not reclaim are forgotten.
+ */
+static void journal_end_grace(void)
+{
+	char path[PATH_MAX];
+	char buf[32];
+	int len, rc;
+
+	PTHREAD_MUTEX_lock(&jrnl.mutex);
+
+	if (jrnl.fd < 0 || jrnl.old_gen == jrnl.gen) {
+		PTHREAD_MUTEX_unlock(&jrnl.mutex);
+		return;
+	}
+
+	/* Only make a generation current once all of it is stable */
+	rc = journal_wait(jrnl.append_seq);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Recovery journal generation %" PRIu32
+			" not made current: %s", jrnl.gen, strerror(-rc));
+		PTHREAD_MUTEX_unlock(&jrnl.mutex);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", jrnl.dir, JOURNAL_CURRENT);
+	len = snprintf(buf, sizeof(buf), "%" PRIu32 "\n", jrnl.gen);
+
+	rc = journal_replace_file(jrnl.dir, path, buf, len);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to update %s: %s", path, strerror(-rc));
+		PTHREAD_MUTEX_unlock(&jrnl.mutex);
+		return;
+	}
+
+	jrnl.old_gen = jrnl.gen;
+	journal_remove_other_gens(jrnl.gen, jrnl.gen);
+
+	PTHREAD_MUTEX_unlock(&jrnl.mutex);
+}
+
+/**
+ * @brief Hand the clients of a database to the recovery code
+ *
+ * @param[in] dir		Directory of the database
+ * @param[in] add_clid_entry	Hook adding a client
+ * @param[in] add_rfh_entry	Hook adding a revoked handle
+ */
+static void journal_read_dir(const char *dir,
+			     add_clid_entry_hook add_clid_entry,
+			     add_rfh_entry_hook add_rfh_entry)
+{
+	struct avltree tree;
+	struct avltree_node *node;
+	struct journal_clid *clid;
+	struct journal_rfh *rfh;
+	struct glist_head *glist;
+	clid_entry_t *clid_ent;
+	uint64_t count = 0;
+	uint32_t gen = journal_read_current(dir);
+
+	if (gen == 0)
+		return;
+
+	avltree_init(&tree, journal_clid_cmpf, 0);
+
+	if (journal_load(dir, gen, &tree, &count) < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to read recovery journal (%s)", dir);
+
+	for (node = avltree_first(&tree); node != NULL;
+	     node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct journal_clid, node);
+
+		if (strlen(clid->name) >= PATH_MAX) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "invalid clid format: %s, too long",
+				 clid->name);
+			continue;
+		}
+
+		clid_ent = add_clid_entry(clid->name);
+
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct journal_rfh, list);
+			add_rfh_entry(clid_ent, rfh->handle);
+		}
+	}
+
+	LogEvent(COMPONENT_CLIENTID,
+		 "Recovered %" PRIu64 " clients from %s generation %" PRIu32,
+		 count, dir, gen);
+
+	journal_clids_clear(&tree);
+}
+
+/**
+ * @brief Load clients for recovery
+ *
+ * @param[in] gsp		Grace start, NULL at startup
+ * @param[in] add_clid_entry	Hook adding a client
+ * @param[in] add_rfh_entry	Hook adding a revoked handle
+ */
+static void journal_read_clids(nfs_grace_start_t *gsp,
+			       add_clid_entry_hook add_clid_entry,
+			       add_rfh_entry_hook add_rfh_entry)
+{
+	char path[PATH_MAX];
+
+	if (!gsp) {
+		journal_read_dir(jrnl.dir, add_clid_entry, add_rfh_entry);
+		return;
+	}
+
+	switch (gsp->event) {
+	case EVENT_TAKE_NODEID:
+		snprintf(path, sizeof(path), "%s/node%d",
+			 nfs_param.nfsv4_param.recovery_journal_dir,
+			 gsp->nodeid);
+		break;
+	default:
+		LogWarn(COMPONENT_STATE, "Recovery unknown event: %d",
+			gsp->event);
+		return;
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d dir (%s)",
+		 gsp->nodeid, path);
+
+	journal_read_dir(path, add_clid_entry, add_rfh_entry);
+}
+
+static void journal_add_clid(nfs_client_id_t *clientid)
+{
+	int rc;
+
+	fs_create_clid_name(clientid);
+
+	if (clientid->cid_recov_tag == NULL)
+		return;
+
+	rc = journal_log(JOURNAL_ADD_CLID, clientid->cid_recov_tag, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to log client [%s], it may not reclaim after a restart: %s",
+			clientid->cid_recov_tag, strerror(-rc));
+		return;
+	}
+
+	LogDebug(COMPONENT_CLIENTID, "Logged client [%s]",
+		 clientid->cid_recov_tag);
+}
+
+static void journal_rm_clid(nfs_client_id_t *clientid)
+{
+	char *recov_tag = clientid->cid_recov_tag;
+	int rc;
+
+	if (recov_tag == NULL)
+		return;
+
+	clientid->cid_recov_tag = NULL;
+	rc = journal_log(JOURNAL_RM_CLID, recov_tag, NULL);
+	if (rc != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to log removal of client [%s]: %s",
+			 recov_tag, strerror(-rc));
+	gsh_free(recov_tag);
+}
+
+static void journal_add_revoke_fh(nfs_client_id_t *delr_clid,
+				  nfs_fh4 *delr_handle)
+{
+	char rhdlstr[NAME_MAX];
+	int retval;
+
+	if (delr_clid->cid_recov_tag == NULL)
+		return;
+
+	/* Convert nfs_fh4_val into base64 encoded string */
+	retval = base64url_encode(delr_handle->nfs_fh4_val,
+				  delr_handle->nfs_fh4_len,
+				  rhdlstr, sizeof(rhdlstr));
+	assert(retval != -1);
+
+	retval = journal_log(JOURNAL_ADD_RFH, delr_clid->cid_recov_tag,
+			     rhdlstr);
+	if (retval != 0)
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to log revoked handle of client [%s]: %s",
+			delr_clid->cid_recov_tag, strerror(-retval));
+}
+
+static struct nfs4_recovery_backend journal_backend = {
+	.recovery_init = journal_init,
+	.recovery_shutdown = journal_shutdown,
+	.end_grace = journal_end_grace,
+	.recovery_read_clids = journal_read_clids,
+	.add_clid = journal_add_clid,
+	.rm_clid = journal_rm_clid,
+	.add_revoke_fh = journal_add_revoke_fh,
+};
+
+void journal_backend_init(struct nfs4_recovery_backend **backend)
+{
+	*backend = &journal_backend;
+}
@@ -44,6 +44,10 @@ struct rados_kv_parameter {
 	char *grace_oid;
 	/** rados_cluster node_id */
 	char *nodeid;
+	/** Time for omap updates to gather in one write op */
+	uint32_t batch_delay_ms;
+	/** Maximum omap updates in one write op */
+	uint32_t batch_max_keys;
 };
 extern struct rados_kv_parameter rados_kv_param;
 
@@ -61,6 +65,9 @@ int rados_kv_connect(rados_ioctx_t *io_ctx, const char *userid,
 void rados_kv_shutdown(void);
 int rados_kv_put(char *key, char *val, char *object);
 int rados_kv_get(char *key, char *val, char *object);
+int rados_kv_batch_put(char *key, char *val, char *object);
+int rados_kv_batch_del(char *key, char *object);
+void rados_kv_batch_drain(void);
 void rados_kv_add_clid(nfs_client_id_t *clientid);
 void rados_kv_rm_clid(nfs_client_id_t *clientid);
 void rados_kv_add_revoke_fh(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle);
@@ -0,0 +1,346 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file recovery_rados_batch.c
+ * @brief Batched omap updates for the RADOS recovery backends
+ *
+ * Client records are set and removed one key at a time, and each of
+ * those used to be a synchronous write op.  Here they are gathered into
+ * a batch instead: updates arriving while a write op is in flight join
+ * the open batch, which is sent as one write op with an async
+ * completion once that op completes, batch_delay_ms have passed or
+ * batch_max_keys are pending.  An update arriving when nothing is in
+ * flight is sent right away.  Each caller returns once the batch
+ * holding its key is committed, with the result of the batch.
+ *
+ * A batch only updates one object, a key for another object sends the
+ * open batch first.  Updates in a batch are applied in order.
+ */
+
+#include "config.h"
+#include <rados/librados.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "recovery_rados.h"
+
+/**
+ * @brief A pending update, on the stack of its caller
+ */
+
+struct rados_batch_op {
+	struct glist_head list;
+	char *key;
+	char *val;	/*< NULL to remove the key */
+};
+
+/**
+ * @brief A write op being built or in flight
+ */
+
+struct rados_batch {
+	/** Updates, in order */
+	struct glist_head ops;
+	/** Object updated */
+	char *object;
+	/** Number of updates */
+	uint32_t nkeys;
+	/** Callers waiting for the batch */
+	uint32_t refcnt;
+	/** No more updates may join */
+	bool sealed;
+	/** The write op is complete */
+	bool done;
+	/** Result of the write op */
+	int ret;
+	rados_write_op_t write_op;
+	rados_completion_t comp;
+};
+
+static pthread_mutex_t rados_batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rados_batch_cond = PTHREAD_COND_INITIALIZER;
+/** Batch updates may join, protected by rados_batch_mutex */
+static struct rados_batch *rados_batch_open;
+/** Batches sent and not complete, protected by rados_batch_mutex */
+static uint32_t rados_batch_inflight;
+
+static void rados_batch_complete(rados_completion_t comp, void *arg)
+{
+	struct rados_batch *batch = arg;
+	int ret = rados_aio_get_return_value(comp);
+
+	PTHREAD_MUTEX_lock(&rados_batch_mutex);
+
+	batch->ret = ret;
+	batch->done = true;
+	rados_batch_inflight--;
+	pthread_cond_broadcast(&rados_batch_cond);
+
+	PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+}
+
+/**
+ * @brief Close a batch to new updates
+ *
+ * Called with rados_batch_mutex held.  The caller must send the batch.
+ *
+ * @param[in] batch	The open batch
+ */
+static void rados_batch_seal(struct rados_batch *batch)
+{
+	batch->sealed = true;
+	rados_batch_inflight++;
+	if (rados_batch_open == batch)
+		rados_batch_open = NULL;
+	pthread_cond_broadcast(&rados_batch_cond);
+}
+
+/**
+ * @brief Send a sealed batch as one write op
+ *
+ * Called without rados_batch_mutex.  Consecutive updates of the same
+ * kind are added as one omap operation.
+ *
+ * @param[in] batch	The sealed batch
+ */
+static void rados_batch_send(struct rados_batch *batch)
+{
+	const char **keys = gsh_malloc(batch->nkeys * sizeof(*keys));
+	const char **vals = gsh_malloc(batch->nkeys * sizeof(*vals));
+	size_t *lens = gsh_malloc(batch->nkeys * sizeof(*lens));
+	struct rados_batch_op *op;
+	struct glist_head *glist;
+	uint32_t n = 0;
+	bool set = false;
+	int ret;
+
+	batch->write_op = rados_create_write_op();
+
+	glist_for_each(glist, &batch->ops) {
+		op = glist_entry(glist, struct rados_batch_op, list);
+
+		if (n > 0 && set != (op->val != NULL)) {
+			if (set)
+				rados_write_op_omap_set(batch->write_op, keys,
+							vals, lens, n);
+			else
+				rados_write_op_omap_rm_keys(batch->write_op,
+							    keys, n);
+			n = 0;
+		}
+
+		set = op->val != NULL;
+		keys[n] = op->key;
+		if (set) {
+			vals[n] = op->val;
+			lens[n] = strlen(op->val);
+		}
+		n++;
+	}
+
+	if (set)
+		rados_write_op_omap_set(batch->write_op, keys, vals, lens, n);
+	else
+		rados_write_op_omap_rm_keys(batch->write_op, keys, n);
+
+	gsh_free(keys);
+	gsh_free(vals);
+	gsh_free(lens);
+
+	LogDebug(COMPONENT_CLIENTID, "Sending %" PRIu32 " keys to %s",
+		 batch->nkeys, batch->object);
+
+	ret = rados_aio_create_completion(batch, rados_batch_complete, NULL,
+					  &batch->comp);
+	if (ret == 0) {
+		ret = rados_aio_write_op_operate(batch->write_op,
+						 rados_recov_io_ctx,
+						 batch->comp, batch->object,
+						 NULL, 0);
+		if (ret == 0)
+			return;
+	}
+
+	/* Complete it here, the callback will not be called */
+	PTHREAD_MUTEX_lock(&rados_batch_mutex);
+	batch->ret = ret;
+	batch->done = true;
+	rados_batch_inflight--;
+	pthread_cond_broadcast(&rados_batch_cond);
+	PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+}
+
+static void rados_batch_free(struct rados_batch *batch)
+{
+	if (batch->comp != NULL)
+		rados_aio_release(batch->comp);
+	if (batch->write_op != NULL)
+		rados_release_write_op(batch->write_op);
+	gsh_free(batch->object);
+	gsh_free(batch);
+}
+
+/**
+ * @brief Add an update to a batch and wait for it to be committed
+ *
+ * @param[in] key	Key to update
+ * @param[in] val	Value to set, NULL to remove the key
+ * @param[in] object	Object holding the key
+ *
+ * @return 0 or the negative error of the write op.
+ */
+static int rados_batch_update(char *key, char *val, char *object)
+{
+	struct rados_batch_op op = { .key = key, .val = val };
+	struct rados_batch *batch, *other = NULL;
+	struct timespec deadline;
+	bool opener = false;
+	int ret;
+
+	PTHREAD_MUTEX_lock(&rados_batch_mutex);
+
+	batch = rados_batch_open;
+	if (batch != NULL && strcmp(batch->object, object) != 0) {
+		/* Updates of another object go in another write op */
+		other = batch;
+		rados_batch_seal(other);
+		batch = NULL;
+	}
+
+	if (batch == NULL) {
+		batch = gsh_calloc(1, sizeof(*batch));
+		glist_init(&batch->ops);
+		batch->object = gsh_strdup(object);
+		rados_batch_open = batch;
+		opener = true;
+	}
+
+	glist_add_tail(&batch->ops, &op.list);
+	batch->nkeys++;
+	batch->refcnt++;
+
+	if (other != NULL) {
+		PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+		rados_batch_send(other);
+		PTHREAD_MUTEX_lock(&rados_batch_mutex);
+	}
+
+	if (!batch->sealed &&
+	    (batch->nkeys >= rados_kv_param.batch_max_keys ||
+	     rados_kv_param.batch_delay_ms == 0)) {
+		rados_batch_seal(batch);
+		PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+		rados_batch_send(batch);
+		PTHREAD_MUTEX_lock(&rados_batch_mutex);
+	} else if (opener) {
+		/* Let other updates join while a previous write op is in
+		 * flight, for batch_delay_ms at most.
+		 */
+		now(&deadline);
+		timespec_add_nsecs(rados_kv_param.batch_delay_ms *
+				   NS_PER_MSEC, &deadline);
+
+		while (!batch->sealed) {
+			ret = ETIMEDOUT;
+			if (rados_batch_inflight != 0)
+				ret = pthread_cond_timedwait(&rados_batch_cond,
+							     &rados_batch_mutex,
+							     &deadline);
+			if ((ret == ETIMEDOUT || rados_batch_inflight == 0) &&
+			    !batch->sealed) {
+				rados_batch_seal(batch);
+				PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+				rados_batch_send(batch);
+				PTHREAD_MUTEX_lock(&rados_batch_mutex);
+			}
+		}
+	}
+
+	while (!batch->done)
+		pthread_cond_wait(&rados_batch_cond, &rados_batch_mutex);
+
+	ret = batch->ret;
+
+	if (--batch->refcnt == 0)
+		rados_batch_free(batch);
+
+	PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Set a key, batched with concurrent updates
+ *
+ * @param[in] key	Key to set
+ * @param[in] val	Value
+ * @param[in] object	Object holding the key
+ *
+ * @return 0 or negative error.
+ */
+int rados_kv_batch_put(char *key, char *val, char *object)
+{
+	int ret = rados_batch_update(key, val, object);
+
+	if (ret < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to put kv ret=%d, key=%s, val=%s",
+			 ret, key, val);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Remove a key, batched with concurrent updates
+ *
+ * @param[in] key	Key to remove
+ * @param[in] object	Object holding the key
+ *
+ * @return 0 or negative error.
+ */
+int rados_kv_batch_del(char *key, char *object)
+{
+	int ret = rados_batch_update(key, NULL, object);
+
+	if (ret < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to del kv ret=%d, key=%s",
+			 ret, key);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Wait for the batches sent to complete
+ *
+ * Called before the I/O context is destroyed.  Updates still arriving
+ * at that point are a bug of the caller.
+ */
+void rados_kv_batch_drain(void)
+{
+	PTHREAD_MUTEX_lock(&rados_batch_mutex);
+
+	while (rados_batch_open != NULL || rados_batch_inflight != 0)
+		pthread_cond_wait(&rados_batch_cond, &rados_batch_mutex);
+
+	PTHREAD_MUTEX_unlock(&rados_batch_mutex);
+}
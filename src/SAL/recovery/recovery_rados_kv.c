@@ -38,6 +38,10 @@ static struct config_item rados_kv_params[] = {
 		       rados_kv_parameter, grace_oid),
 	CONF_ITEM_STR("nodeid", 1, NI_MAXHOST, NULL, rados_kv_parameter,
 			nodeid),
+	CONF_ITEM_UI32("batch_delay_ms", 0, 1000, 2,
+		       rados_kv_parameter, batch_delay_ms),
+	CONF_ITEM_UI32("batch_max_keys", 1, 1024, 64,
+		       rados_kv_parameter, batch_max_keys),
 	CONFIG_EOL
 };
 
@@ -139,29 +143,7 @@ void rados_kv_create_val(nfs_client_id_t *clientid, char *val)
 
 int rados_kv_put(char *key, char *val, char *object)
 {
-	int ret;
-	char *keys[1];
-	char *vals[1];
-	size_t lens[1];
-	rados_write_op_t write_op;
-
-	keys[0] = key;
-	vals[0] = val;
-	lens[0] = strlen(val);
-	write_op = rados_create_write_op();
-
-	rados_write_op_omap_set(write_op, (const char * const*)keys,
-					  (const char * const*)vals, lens, 1);
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
-	if (ret < 0) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to put kv ret=%d, key=%s, val=%s",
-			 ret, key, val);
-	}
-	rados_release_write_op(write_op);
-
-	return ret;
+	return rados_kv_batch_put(key, val, object);
 }
 
 int rados_kv_get(char *key, char *val, char *object)
@@ -206,24 +188,7 @@ out:
 
 static int rados_kv_del(char *key, char *object)
 {
-	int ret;
-	char *keys[1];
-	rados_write_op_t write_op;
-
-	keys[0] = key;
-	write_op = rados_create_write_op();
-
-	rados_write_op_omap_rm_keys(write_op, (const char * const*)keys, 1);
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
-	if (ret < 0) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to del kv ret=%d, key=%s",
-			 ret, key);
-	}
-	rados_release_write_op(write_op);
-
-	return ret;
+	return rados_kv_batch_del(key, object);
 }
 
 int rados_kv_traverse(pop_clid_entry_t callback, struct pop_args *args,
@@ -349,6 +314,8 @@ void rados_kv_shutdown(void)
 {
 	struct gsh_refstr *recov_oid;
 
+	rados_kv_batch_drain();
+
 	if (rados_recov_io_ctx) {
 		rados_ioctx_destroy(rados_recov_io_ctx);
 		rados_recov_io_ctx = NULL;
@@ -48,11 +48,9 @@ static pthread_mutex_t grace_op_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int rados_ng_put(char *key, char *val, char *object)
 {
-	int ret;
 	char *keys[1];
 	char *vals[1];
 	size_t lens[1];
-	rados_write_op_t write_op = NULL;
 	bool in_grace;
 
 	keys[0] = key;
@@ -62,54 +60,35 @@ static int rados_ng_put(char *key, char *val, char *object)
 	/* When there is an active grace_op, spool up the changes to it */
 	PTHREAD_MUTEX_lock(&grace_op_lock);
 	in_grace = grace_op;
-	write_op = grace_op;
-	if (!write_op)
-		write_op = rados_create_write_op();
-	rados_write_op_omap_set(write_op, (const char * const*)keys,
-					  (const char * const*)vals, lens, 1);
+	if (in_grace)
+		rados_write_op_omap_set(grace_op, (const char * const*)keys,
+					(const char * const*)vals, lens, 1);
 	PTHREAD_MUTEX_unlock(&grace_op_lock);
 	if (in_grace)
 		return 0;
 
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
-	if (ret < 0) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to put kv ret=%d, key=%s, val=%s",
-			 ret, key, val);
-	}
-	rados_release_write_op(write_op);
-
-	return ret;
+	/* Otherwise batch them with the concurrent updates */
+	return rados_kv_batch_put(key, val, object);
 }
 
 static int rados_ng_del(char *key, char *object)
 {
-	int ret;
 	char *keys[1];
-	rados_write_op_t write_op;
 	bool in_grace;
 
 	keys[0] = key;
 
 	PTHREAD_MUTEX_lock(&grace_op_lock);
 	in_grace = grace_op;
-	write_op = in_grace ? grace_op : rados_create_write_op();
-	rados_write_op_omap_rm_keys(write_op, (const char * const*)keys, 1);
+	if (in_grace)
+		rados_write_op_omap_rm_keys(grace_op,
+					    (const char * const*)keys, 1);
 	PTHREAD_MUTEX_unlock(&grace_op_lock);
 
 	if (in_grace)
 		return 0;
 
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
-	if (ret < 0) {
-		LogEvent(COMPONENT_CLIENTID, "Failed to del kv ret=%d, key=%s",
-			 ret, key);
-	}
-	rados_release_write_op(write_op);
-
-	return ret;
+	return rados_kv_batch_del(key, object);
 }
 
 static int rados_ng_init(void)
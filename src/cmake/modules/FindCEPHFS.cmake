@@ -94,6 +94,14 @@ else (NOT CEPH_FS)
     set(USE_FSAL_CEPH_LL_SYNC_INODE ON)
   endif(NOT CEPH_FS_SYNC_INODE)
 
+  check_library_exists(cephfs ceph_ll_nonblocking_readv_writev ${CEPHFS_LIBRARY_DIR} CEPH_FS_NONBLOCKING_IO)
+  if(NOT CEPH_FS_NONBLOCKING_IO)
+    message("Cannot find ceph_ll_nonblocking_readv_writev. READ and WRITE will block a worker thread.")
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_IO OFF)
+  else(NOT CEPH_FS_NONBLOCKING_IO)
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_IO ON)
+  endif(NOT CEPH_FS_NONBLOCKING_IO)
+
   check_library_exists(cephfs ceph_ll_fallocate ${CEPHFS_LIBRARY_DIR} CEPH_FALLOCATE)
   if(NOT CEPH_FALLOCATE)
     message("Cannot find ceph_ll_fallocate. No ALLOCATE or DEALLOCATE support!")
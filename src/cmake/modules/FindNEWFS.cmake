@@ -53,6 +53,26 @@ find_library(NEWFS_LIBRARY newfs PATH ${NEWFS_LIBRARY_DIR} NO_DEFAULT_PATH)
 set(NEWFS_LIBRARY ${NEWFS_LIBRARY})
 message(STATUS "Found newfs libraries: ${NEWFS_LIBRARIES}")
 
+if (NEWFS_LIBRARY)
+  include(CheckLibraryExists)
+  check_library_exists(newfs newfs_readdir_batch ${NEWFS_LIBRARY_DIR}
+    NEWFS_READDIR_BATCH)
+  if(NOT NEWFS_READDIR_BATCH)
+    message("Cannot find newfs_readdir_batch. READDIR will read one entry per call.")
+    set(USE_NEWFS_READDIR_BATCH OFF)
+  else(NOT NEWFS_READDIR_BATCH)
+    set(USE_NEWFS_READDIR_BATCH ON)
+  endif(NOT NEWFS_READDIR_BATCH)
+  check_library_exists(newfs newfs_watch ${NEWFS_LIBRARY_DIR}
+    NEWFS_WATCH)
+  if(NOT NEWFS_WATCH)
+    message("Cannot find newfs_watch. Attributes will not be cached.")
+    set(USE_NEWFS_WATCH OFF)
+  else(NOT NEWFS_WATCH)
+    set(USE_NEWFS_WATCH ON)
+  endif(NOT NEWFS_WATCH)
+endif (NEWFS_LIBRARY)
+
 # handle the QUIELY and REQUIRED arguments and set PRELUDE_FOUND to TRUE if
 # all listed variables are TRUE
 include(FindPackageHandleStandardArgs)
@@ -0,0 +1,169 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "cephfs_mock.h"
+
+extern "C" {
+#include <cephfs/libcephfs.h>
+} /* extern "C" */
+
+namespace {
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<struct ceph_ll_io_info *> queue;
+  bool held;
+  bool in_line;
+  bool have_result;
+  ssize_t result;
+  uint32_t running;
+  uint64_t nsubmitted;
+  uint64_t ncloses;
+  std::thread *worker;
+
+  void run_worker()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    for (;;) {
+      cv.wait(lock, [] { return !held && !queue.empty(); });
+
+      struct ceph_ll_io_info *io_info = queue.front();
+
+      queue.pop_front();
+      running++;
+
+      lock.unlock();
+      io_info->callback(io_info);
+      lock.lock();
+
+      running--;
+      cv.notify_all();
+    }
+  }
+
+} /* namespace */
+
+namespace cephfs_mock {
+
+  void hold()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    held = true;
+  }
+
+  void release()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    held = false;
+    cv.notify_all();
+  }
+
+  void set_inline(bool inl)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    in_line = inl;
+  }
+
+  void set_result(ssize_t res)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    have_result = true;
+    result = res;
+  }
+
+  uint64_t submitted()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nsubmitted;
+  }
+
+  uint64_t closes()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return ncloses;
+  }
+
+  std::thread::id thread_id()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (!worker)
+      worker = new std::thread(run_worker);
+
+    return worker->get_id();
+  }
+
+  void reset()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    held = false;
+    cv.notify_all();
+    cv.wait(lock, [] { return queue.empty() && running == 0; });
+    in_line = false;
+    have_result = false;
+    nsubmitted = 0;
+    ncloses = 0;
+  }
+
+} /* namespace cephfs_mock */
+
+extern "C" {
+
+int64_t ceph_ll_nonblocking_readv_writev(struct ceph_mount_info *cmount,
+					 struct ceph_ll_io_info *io_info)
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  int64_t len = 0;
+
+  for (int i = 0; i < io_info->iovcnt; ++i)
+    len += io_info->iov[i].iov_len;
+
+  io_info->result = have_result ? result : len;
+  nsubmitted++;
+
+  if (in_line) {
+    /* As libcephfs does when it need not wait */
+    lock.unlock();
+    io_info->callback(io_info);
+    return 0;
+  }
+
+  if (!worker)
+    worker = new std::thread(run_worker);
+
+  queue.push_back(io_info);
+  cv.notify_all();
+  return 0;
+}
+
+int ceph_ll_close(struct ceph_mount_info *cmount, struct Fh *filehandle)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  ncloses++;
+  return 0;
+}
+
+} /* extern "C" */
@@ -0,0 +1,66 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Stand-in for the libcephfs calls FSAL_CEPH makes on a read or write.
+ *
+ * Linking cephfs_mock.cc into a test replaces
+ * ceph_ll_nonblocking_readv_writev and ceph_ll_close.  Submitted I/O is
+ * completed by a thread of the mock, as a libcephfs finisher would,
+ * unless the test holds it back, or on the submitting thread if the
+ * test asks for inline completion.
+ */
+
+#ifndef CEPHFS_MOCK_H
+#define CEPHFS_MOCK_H
+
+#include <sys/types.h>
+#include <cstdint>
+#include <thread>
+
+namespace cephfs_mock {
+
+  /* Queue submitted I/O until release() */
+  void hold();
+
+  /* Complete the queued I/O and stop holding it back */
+  void release();
+
+  /* Complete the next I/Os before submission returns */
+  void set_inline(bool in_line);
+
+  /* Result of the next I/Os: bytes done, or -errno.  By default all
+   * of the request is done. */
+  void set_result(ssize_t result);
+
+  /* I/Os submitted and ceph_ll_close calls since the last reset */
+  uint64_t submitted();
+  uint64_t closes();
+
+  /* Thread completing the I/O */
+  std::thread::id thread_id();
+
+  /* Stop holding, wait for queued I/O and clear the counters */
+  void reset();
+
+} /* namespace cephfs_mock */
+
+#endif /* CEPHFS_MOCK_H */
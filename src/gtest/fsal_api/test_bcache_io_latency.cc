@@ -0,0 +1,361 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "nfs_core.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+/*
+ * Compares read latency of a BCACHE export stacked on FSAL_MEM with a
+ * plain MEM export.  Both MEM exports should emulate a slow backend, e.g.
+ *
+ * EXPORT { Export_Id = 77; Path = /bcache; Pseudo = /bcache;
+ *	    FSAL { Name = BCACHE;
+ *		   FSAL { Name = MEM; Async_Type = fixed;
+ *			  Async_Delay = 500; } } }
+ * EXPORT { Export_Id = 78; Path = /mem; Pseudo = /mem;
+ *	    FSAL { Name = MEM; Async_Type = fixed; Async_Delay = 500; } }
+ * BCACHE { Cache_Path = /var/tmp/bcache; Cache_Size = 1G; }
+ */
+
+#define TEST_ROOT "bcache_io_latency"
+#define TEST_FILE "test_file"
+#define FILE_SIZE (32 * 1024 * 1024UL)
+#define IO_SIZE (64 * 1024UL)
+#define READ_COUNT (FILE_SIZE / IO_SIZE)
+
+/* Mirrors enum bcache_stat_op of FSAL_BCACHE */
+#define BCACHE_STAT_HIT 0
+#define BCACHE_STAT_MISS 1
+#define BCACHE_STAT_BYTES_SERVED 2
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  uint16_t mem_export_id = 78;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+  inline char pattern(uint64_t offset)
+  {
+    return (char) ((offset * 31 + (offset >> 20)) & 0xff);
+  }
+
+  uint64_t bcache_stat(int op)
+  {
+    struct fsal_module *fsal_hdl = lookup_fsal("BCACHE");
+    uint64_t val = 0;
+
+    if (fsal_hdl == NULL)
+      return 0;
+
+    if (fsal_hdl->stats != NULL)
+      val = fsal_hdl->stats->op_stats[op].num_ops;
+
+    fsal_put(fsal_hdl);
+    return val;
+  }
+
+  class BCacheIOLatencyTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      nfs_param.core_param.enable_FSALSTATS = true;
+
+      buffer = (char *) malloc(IO_SIZE);
+      ASSERT_NE(buffer, nullptr);
+    }
+
+    virtual void TearDown() {
+      free(buffer);
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    fsal_status_t do_io(struct fsal_obj_handle *obj, bool write,
+			uint64_t offset, size_t len, size_t *amount) {
+      struct fsal_io_arg *arg;
+      struct async_process_data io_data;
+
+      arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					sizeof(struct iovec));
+      arg->info = NULL;
+      arg->state = NULL;
+      arg->offset = offset;
+      arg->iov_count = 1;
+      arg->iov[0].iov_len = len;
+      arg->iov[0].iov_base = buffer;
+      arg->io_amount = 0;
+      arg->fsal_stable = false;
+
+      io_data.ret.major = ERR_FSAL_NO_ERROR;
+      io_data.ret.minor = 0;
+      io_data.done = false;
+      io_data.cond = &cond;
+      io_data.mutex = &mutex;
+
+      if (write)
+	fsal_write(obj, true, arg, &io_data);
+      else
+	fsal_read(obj, true, arg, &io_data);
+
+      *amount = arg->io_amount;
+      return io_data.ret;
+    }
+
+    /* Read the whole file, return the average latency of a read in ns */
+    uint64_t read_pass(struct fsal_obj_handle *obj) {
+      struct timespec s_time, e_time;
+      fsal_status_t status;
+      size_t amount;
+
+      now(&s_time);
+
+      for (uint64_t off = 0; off < FILE_SIZE; off += IO_SIZE) {
+	status = do_io(obj, false, off, IO_SIZE, &amount);
+	EXPECT_EQ(status.major, 0);
+	EXPECT_EQ(amount, IO_SIZE);
+	EXPECT_EQ(buffer[0], pattern(off)) << "offset " << off;
+      }
+
+      now(&e_time);
+
+      return timespec_diff(&s_time, &e_time) / READ_COUNT;
+    }
+
+    /* Create and fill the test file in dir, then read it twice */
+    void measure(struct fsal_obj_handle *dir, const char *label,
+		 uint64_t *cold, uint64_t *warm) {
+      struct fsal_obj_handle *obj = nullptr;
+      struct attrlist attrs_out;
+      fsal_status_t status;
+      size_t amount;
+
+      fsal_prepare_attrs(&attrs_out, 0);
+      status = fsal_create(dir, TEST_FILE, REGULAR_FILE, &attrs, NULL,
+			   &obj, &attrs_out);
+      ASSERT_EQ(status.major, 0);
+      fsal_release_attrs(&attrs_out);
+
+      for (uint64_t off = 0; off < FILE_SIZE; off += IO_SIZE) {
+	for (size_t i = 0; i < IO_SIZE; i++)
+	  buffer[i] = pattern(off + i);
+	status = do_io(obj, true, off, IO_SIZE, &amount);
+	ASSERT_EQ(status.major, 0);
+	ASSERT_EQ(amount, IO_SIZE);
+      }
+
+      *cold = read_pass(obj);
+      *warm = read_pass(obj);
+
+      fprintf(stderr, "%s: cold read %" PRIu64 " ns, warm read %" PRIu64
+	      " ns\n", label, *cold, *warm);
+
+      obj->obj_ops->put_ref(obj);
+      status = fsal_remove(dir, TEST_FILE);
+      EXPECT_EQ(status.major, 0);
+    }
+
+    char *buffer = nullptr;
+  };
+
+} /* namespace */
+
+TEST_F(BCacheIOLatencyTest, HIT_RATE)
+{
+  uint64_t hit, miss, served, cold, warm;
+
+  hit = bcache_stat(BCACHE_STAT_HIT);
+  miss = bcache_stat(BCACHE_STAT_MISS);
+  served = bcache_stat(BCACHE_STAT_BYTES_SERVED);
+
+  measure(test_root, "BCACHE", &cold, &warm);
+
+  hit = bcache_stat(BCACHE_STAT_HIT) - hit;
+  miss = bcache_stat(BCACHE_STAT_MISS) - miss;
+  served = bcache_stat(BCACHE_STAT_BYTES_SERVED) - served;
+
+  fprintf(stderr, "BCACHE: %" PRIu64 " hits, %" PRIu64 " misses, %"
+	  PRIu64 " bytes served from cache\n", hit, miss, served);
+
+  /* The second pass is served from the cache entirely */
+  EXPECT_GE(hit, READ_COUNT);
+  EXPECT_GE(served, FILE_SIZE);
+  EXPECT_LE(warm, cold);
+}
+
+TEST_F(BCacheIOLatencyTest, VERSUS_MEM)
+{
+  struct gsh_export *mem_export;
+  struct fsal_obj_handle *mem_root;
+  uint64_t cold, warm, mem_cold, mem_warm;
+  fsal_status_t status;
+
+  measure(test_root, "BCACHE", &cold, &warm);
+
+  mem_export = get_gsh_export(mem_export_id);
+  ASSERT_NE(mem_export, nullptr);
+
+  status = nfs_export_get_root_entry(mem_export, &mem_root);
+  ASSERT_EQ(status.major, 0);
+
+  req_ctx.ctx_export = mem_export;
+  req_ctx.fsal_export = mem_export->fsal_export;
+
+  measure(mem_root, "MEM", &mem_cold, &mem_warm);
+
+  req_ctx.ctx_export = a_export;
+  req_ctx.fsal_export = a_export->fsal_export;
+
+  mem_root->obj_ops->put_ref(mem_root);
+  put_gsh_export(mem_export);
+
+  /* Every MEM read pays the backend latency, warm BCACHE reads do not */
+  EXPECT_LT(warm, mem_warm);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of the BCACHE export on which to operate (must exist)")
+
+      ("mem-export", po::value<uint16_t>(),
+       "id of a plain MEM export to compare with (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("mem-export");
+    if (vm_iter != vm.end()) {
+      mem_export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
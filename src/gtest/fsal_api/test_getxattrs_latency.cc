@@ -0,0 +1,300 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ * Contributor : Girjesh Rajoria <grajoria@redhat.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+/* For MDCACHE bypass.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "getxattrs_latency"
+#define LOOP_COUNT 1000000
+#define XATTR_NAME "user.getxattrs_latency"
+#define XATTR_VALUE "system_u:object_r:nfs_t:s0"
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  class GetxattrsLatencyTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      name.utf8string_val = (char *) XATTR_NAME;
+      name.utf8string_len = strlen(XATTR_NAME);
+      set_value((char *) XATTR_VALUE);
+
+      /* Left over by an earlier run */
+      test_root->obj_ops->removexattrs(test_root, &name);
+
+      status = test_root->obj_ops->setxattrs(test_root, SETXATTR4_CREATE,
+					     &name, &value);
+      supported = status.major == ERR_FSAL_NO_ERROR;
+    }
+
+    virtual void TearDown() {
+      if (supported)
+        test_root->obj_ops->removexattrs(test_root, &name);
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    void set_value(char *val) {
+      value.utf8string_val = val;
+      value.utf8string_len = strlen(val);
+    }
+
+    fsal_status_t get(struct fsal_obj_handle *obj, xattrname4 *xa_name) {
+      value.utf8string_val = buf;
+      value.utf8string_len = sizeof(buf);
+
+      return obj->obj_ops->getxattrs(obj, xa_name, &value);
+    }
+
+    void loop(struct fsal_obj_handle *obj, xattrname4 *xa_name,
+	      fsal_errors_t expected, const char *what) {
+      struct timespec s_time, e_time;
+
+      now(&s_time);
+
+      for (int i = 0; i < LOOP_COUNT; ++i)
+        EXPECT_EQ(get(obj, xa_name).major, expected);
+
+      now(&e_time);
+
+      fprintf(stderr, "Average time per getxattrs%s: %" PRIu64 " ns\n",
+              what, timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+    }
+
+    bool supported;
+    xattrname4 name;
+    xattrvalue4 value;
+    char buf[1024];
+  };
+
+} /* namespace */
+
+TEST_F(GetxattrsLatencyTest, SIMPLE)
+{
+  if (!supported)
+    return;
+
+  ASSERT_EQ(get(test_root, &name).major, 0);
+  ASSERT_EQ(value.utf8string_len, strlen(XATTR_VALUE));
+  EXPECT_EQ(memcmp(buf, XATTR_VALUE, value.utf8string_len), 0);
+
+  /* Cached now, and still the same */
+  ASSERT_EQ(get(test_root, &name).major, 0);
+  ASSERT_EQ(value.utf8string_len, strlen(XATTR_VALUE));
+  EXPECT_EQ(memcmp(buf, XATTR_VALUE, value.utf8string_len), 0);
+}
+
+TEST_F(GetxattrsLatencyTest, SET_INVALIDATES)
+{
+  char other[] = "system_u:object_r:user_home_t:s0";
+  fsal_status_t status;
+
+  if (!supported)
+    return;
+
+  ASSERT_EQ(get(test_root, &name).major, 0);
+
+  set_value(other);
+  status = test_root->obj_ops->setxattrs(test_root, SETXATTR4_REPLACE,
+					 &name, &value);
+  ASSERT_EQ(status.major, 0);
+
+  ASSERT_EQ(get(test_root, &name).major, 0);
+  ASSERT_EQ(value.utf8string_len, strlen(other));
+  EXPECT_EQ(memcmp(buf, other, value.utf8string_len), 0);
+
+  status = test_root->obj_ops->removexattrs(test_root, &name);
+  ASSERT_EQ(status.major, 0);
+
+  EXPECT_EQ(get(test_root, &name).major, ERR_FSAL_NOENT);
+
+  set_value((char *) XATTR_VALUE);
+  status = test_root->obj_ops->setxattrs(test_root, SETXATTR4_CREATE,
+					 &name, &value);
+  ASSERT_EQ(status.major, 0);
+
+  EXPECT_EQ(get(test_root, &name).major, 0);
+}
+
+TEST_F(GetxattrsLatencyTest, LOOP)
+{
+  if (!supported)
+    return;
+
+  loop(test_root, &name, ERR_FSAL_NO_ERROR, "");
+}
+
+TEST_F(GetxattrsLatencyTest, LOOP_BYPASS)
+{
+  struct fsal_obj_handle *sub_hdl;
+
+  if (!supported)
+    return;
+
+  sub_hdl = mdcdb_get_sub_handle(test_root);
+  ASSERT_NE(sub_hdl, nullptr);
+
+  loop(sub_hdl, &name, ERR_FSAL_NO_ERROR, " bypass");
+}
+
+TEST_F(GetxattrsLatencyTest, LOOP_NOENT)
+{
+  xattrname4 missing;
+
+  if (!supported)
+    return;
+
+  /* As probed by clients for names that are never set */
+  missing.utf8string_val = (char *) "com.apple.FinderInfo";
+  missing.utf8string_len = strlen(missing.utf8string_val);
+
+  loop(test_root, &missing, ERR_FSAL_NOENT, " of a missing name");
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,411 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "newfs_io_throughput"
+#define TEST_FILE "test_file"
+#define FILE_SIZE (64 * 1024 * 1024UL)
+#define IO_SIZE (1024 * 1024UL)
+#define SMALL_IO_SIZE 4096UL
+#define RANDOM_COUNT 10000
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+  /* Byte expected at a file offset, varies within and across chunks */
+  inline char pattern(uint64_t offset)
+  {
+    return (char) ((offset * 31 + (offset >> 20)) & 0xff);
+  }
+
+  void fill(char *buf, uint64_t offset, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+      buf[i] = pattern(offset + i);
+  }
+
+  bool check(const char *buf, uint64_t offset, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+      if (buf[i] != pattern(offset + i))
+	return false;
+    return true;
+  }
+
+  uint64_t mbps(uint64_t bytes, struct timespec *s, struct timespec *e)
+  {
+    uint64_t ns = timespec_diff(s, e);
+
+    return ns ? bytes * 1000 / ns : 0;
+  }
+
+  class NewFSIOThroughputTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      bool caller_perm_check = false;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      test_file_state = op_ctx->fsal_export->exp_ops.alloc_state(
+						op_ctx->fsal_export,
+						STATE_TYPE_SHARE,
+						NULL);
+      ASSERT_NE(test_file_state, nullptr);
+
+      status = test_root->obj_ops->open2(test_root, test_file_state,
+                      FSAL_O_RDWR, FSAL_UNCHECKED, TEST_FILE, NULL, NULL,
+                      &test_file, NULL, &caller_perm_check);
+      ASSERT_EQ(status.major, 0);
+
+      buffer = (char *) malloc(IO_SIZE);
+      ASSERT_NE(buffer, nullptr);
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+
+      free(buffer);
+
+      status = test_file->obj_ops->close2(test_file, test_file_state);
+      EXPECT_EQ(0, status.major);
+
+      op_ctx->fsal_export->exp_ops.free_state(op_ctx->fsal_export,
+					      test_file_state);
+
+      status = fsal_remove(test_root, TEST_FILE);
+      EXPECT_EQ(status.major, 0);
+      test_file->obj_ops->put_ref(test_file);
+      test_file = NULL;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    fsal_status_t do_io(bool write, uint64_t offset, size_t len,
+			bool stable, size_t *amount, bool *eof) {
+      struct fsal_io_arg *arg;
+      struct async_process_data io_data;
+
+      arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					sizeof(struct iovec));
+      arg->info = NULL;
+      arg->state = NULL;
+      arg->offset = offset;
+      arg->iov_count = 1;
+      arg->iov[0].iov_len = len;
+      arg->iov[0].iov_base = buffer;
+      arg->io_amount = 0;
+      arg->fsal_stable = write && stable;
+
+      io_data.ret.major = ERR_FSAL_NO_ERROR;
+      io_data.ret.minor = 0;
+      io_data.done = false;
+      io_data.cond = &cond;
+      io_data.mutex = &mutex;
+
+      if (write)
+	fsal_write(test_file, true, arg, &io_data);
+      else
+	fsal_read(test_file, true, arg, &io_data);
+
+      *amount = arg->io_amount;
+      if (eof != NULL)
+	*eof = !write && arg->end_of_file;
+      return io_data.ret;
+    }
+
+    /* Write the whole file in io_size pieces */
+    void write_file(size_t io_size, bool stable) {
+      fsal_status_t status;
+      size_t amount;
+
+      for (uint64_t off = 0; off < FILE_SIZE; off += io_size) {
+	fill(buffer, off, io_size);
+	status = do_io(true, off, io_size, stable, &amount, NULL);
+	ASSERT_EQ(status.major, 0);
+	ASSERT_EQ(amount, io_size);
+      }
+    }
+
+    /* Read the whole file back in io_size pieces and compare */
+    void verify_file(size_t io_size) {
+      fsal_status_t status;
+      size_t amount;
+
+      for (uint64_t off = 0; off < FILE_SIZE; off += io_size) {
+	status = do_io(false, off, io_size, false, &amount, NULL);
+	ASSERT_EQ(status.major, 0);
+	ASSERT_EQ(amount, io_size);
+	ASSERT_TRUE(check(buffer, off, io_size)) << "offset " << off;
+      }
+    }
+
+    struct fsal_obj_handle *test_file = nullptr;
+    struct state_t* test_file_state;
+    char *buffer = nullptr;
+  };
+
+} /* namespace */
+
+TEST_F(NewFSIOThroughputTest, LARGE_FILE)
+{
+  struct attrlist attrs;
+  fsal_status_t status;
+  size_t amount;
+  bool eof;
+
+  /* Well past the old 20 MiB limit */
+  write_file(IO_SIZE, false);
+  verify_file(IO_SIZE);
+
+  fsal_prepare_attrs(&attrs, ATTR_SIZE);
+  status = test_file->obj_ops->getattrs(test_file, &attrs);
+  EXPECT_EQ(status.major, 0);
+  EXPECT_EQ(attrs.filesize, FILE_SIZE);
+  fsal_release_attrs(&attrs);
+
+  status = do_io(false, FILE_SIZE - 100, IO_SIZE, false, &amount, &eof);
+  EXPECT_EQ(status.major, 0);
+  EXPECT_EQ(amount, 100UL);
+  EXPECT_TRUE(eof);
+  EXPECT_TRUE(check(buffer, FILE_SIZE - 100, 100));
+}
+
+TEST_F(NewFSIOThroughputTest, SEQUENTIAL_WRITE)
+{
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+  write_file(IO_SIZE, true);
+  now(&e_time);
+
+  fprintf(stderr, "Sequential stable write: %" PRIu64 " MB/s\n",
+          mbps(FILE_SIZE, &s_time, &e_time));
+}
+
+TEST_F(NewFSIOThroughputTest, SEQUENTIAL_READ)
+{
+  struct timespec s_time, e_time;
+
+  write_file(IO_SIZE, false);
+
+  now(&s_time);
+  verify_file(IO_SIZE);
+  now(&e_time);
+
+  fprintf(stderr, "Sequential read: %" PRIu64 " MB/s\n",
+          mbps(FILE_SIZE, &s_time, &e_time));
+}
+
+TEST_F(NewFSIOThroughputTest, RANDOM_READ)
+{
+  std::mt19937_64 rng(FILE_SIZE);
+  std::uniform_int_distribution<uint64_t> dist(0, FILE_SIZE - SMALL_IO_SIZE);
+  struct timespec s_time, e_time;
+  fsal_status_t status;
+  size_t amount;
+
+  write_file(IO_SIZE, false);
+
+  now(&s_time);
+
+  for (int i = 0; i < RANDOM_COUNT; ++i) {
+    uint64_t off = dist(rng);
+
+    status = do_io(false, off, SMALL_IO_SIZE, false, &amount, NULL);
+    ASSERT_EQ(status.major, 0);
+    ASSERT_EQ(amount, SMALL_IO_SIZE);
+    ASSERT_TRUE(check(buffer, off, SMALL_IO_SIZE)) << "offset " << off;
+  }
+
+  now(&e_time);
+
+  fprintf(stderr, "Average time per random read2: %" PRIu64 " ns\n",
+          timespec_diff(&s_time, &e_time) / RANDOM_COUNT);
+}
+
+TEST_F(NewFSIOThroughputTest, SMALL_UNSTABLE_WRITES)
+{
+  struct timespec s_time, e_time;
+  fsal_status_t status;
+
+  /* Coalesced into larger backend writes */
+  now(&s_time);
+  write_file(SMALL_IO_SIZE, false);
+  status = test_file->obj_ops->commit2(test_file, 0, FILE_SIZE);
+  now(&e_time);
+  EXPECT_EQ(status.major, 0);
+
+  fprintf(stderr, "Small unstable write + commit: %" PRIu64 " MB/s\n",
+          mbps(FILE_SIZE, &s_time, &e_time));
+
+  verify_file(IO_SIZE);
+}
+
+TEST_F(NewFSIOThroughputTest, OVERWRITE_AFTER_READAHEAD)
+{
+  fsal_status_t status;
+  size_t amount;
+
+  write_file(IO_SIZE, false);
+
+  /* Get readahead going past the range we overwrite */
+  for (uint64_t off = 0; off < 4 * IO_SIZE; off += IO_SIZE) {
+    status = do_io(false, off, IO_SIZE, false, &amount, NULL);
+    ASSERT_EQ(status.major, 0);
+  }
+
+  memset(buffer, 'z', SMALL_IO_SIZE);
+  status = do_io(true, 4 * IO_SIZE, SMALL_IO_SIZE, false, &amount, NULL);
+  ASSERT_EQ(status.major, 0);
+
+  status = do_io(false, 4 * IO_SIZE, SMALL_IO_SIZE, false, &amount, NULL);
+  ASSERT_EQ(status.major, 0);
+  ASSERT_EQ(amount, SMALL_IO_SIZE);
+  for (size_t i = 0; i < SMALL_IO_SIZE; i++)
+    ASSERT_EQ(buffer[i], 'z');
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
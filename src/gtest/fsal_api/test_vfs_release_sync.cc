@@ -0,0 +1,364 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+/* For MDCACHE bypass.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#include "gtest.hh"
+
+/*
+ * An UNSTABLE write whose VFS handle is evicted before the COMMIT.  The
+ * COMMIT reaches a new handle that knows nothing of the write, so the
+ * release must have made it stable, or changed the write verifier.
+ * Needs a VFS export, e.g.
+ *
+ * EXPORT { Export_Id = 77; Path = /export; Pseudo = /export;
+ *	    FSAL { Name = VFS; } }
+ *
+ * fdatasync() is interposed below to count the flushes and fail them.
+ */
+
+#define TEST_ROOT "vfs_release_sync"
+#define TEST_FILE "test_file"
+#define OFFSET 0
+#define LENGTH 64
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+  std::atomic<int> fdatasync_calls;
+  std::atomic<bool> fdatasync_fail;
+
+} /* namespace */
+
+extern "C" int fdatasync(int fd)
+{
+  fdatasync_calls++;
+
+  if (fdatasync_fail) {
+    errno = EIO;
+    return -1;
+  }
+
+  return syscall(SYS_fdatasync, fd);
+}
+
+namespace {
+
+  class VFSReleaseSyncTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct attrlist attrs;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      sub_export = op_ctx->fsal_export->sub_export;
+      ASSERT_NE(sub_export, nullptr);
+      ASSERT_STREQ(sub_export->fsal->name, "VFS");
+
+      memset(&attrs, 0, sizeof(attrs));
+      FSAL_SET_MASK(attrs.valid_mask, ATTR_MODE);
+      attrs.mode = 0644;
+
+      status = fsal_create(test_root, TEST_FILE, REGULAR_FILE, &attrs,
+			   NULL, &test_file, NULL);
+      ASSERT_EQ(status.major, 0);
+      ASSERT_NE(test_file, nullptr);
+
+      fdatasync_calls = 0;
+      fdatasync_fail = false;
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+
+      fdatasync_fail = false;
+
+      status = fsal_remove(test_root, TEST_FILE);
+      EXPECT_EQ(status.major, 0);
+      test_file->obj_ops->put_ref(test_file);
+      test_file = NULL;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    /* A VFS handle of the test file of its own, as after an eviction */
+    struct fsal_obj_handle *vfs_handle() {
+      struct fsal_obj_handle *sub_hdl = mdcdb_get_sub_handle(test_file);
+      struct fsal_obj_handle *vfs_hdl = nullptr;
+      char fh[NFS4_FHSIZE];
+      struct gsh_buffdesc fh_desc = { fh, sizeof(fh) };
+      struct fsal_export *save_exp = op_ctx->fsal_export;
+      fsal_status_t status;
+
+      op_ctx->fsal_export = sub_export;
+
+      status = sub_hdl->obj_ops->handle_to_wire(sub_hdl, FSAL_DIGEST_NFSV4,
+						&fh_desc);
+      EXPECT_EQ(status.major, 0);
+      status = sub_export->exp_ops.wire_to_host(sub_export,
+						FSAL_DIGEST_NFSV4,
+						&fh_desc, 0);
+      EXPECT_EQ(status.major, 0);
+      status = sub_export->exp_ops.create_handle(sub_export, &fh_desc,
+						 &vfs_hdl, NULL);
+      EXPECT_EQ(status.major, 0);
+
+      op_ctx->fsal_export = save_exp;
+
+      return vfs_hdl;
+    }
+
+    fsal_status_t unstable_write(struct fsal_obj_handle *vfs_hdl) {
+      struct fsal_io_arg *arg;
+      struct async_process_data io_data;
+      struct fsal_export *save_exp = op_ctx->fsal_export;
+      char buffer[LENGTH];
+
+      memset(buffer, 'a', sizeof(buffer));
+
+      arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					sizeof(struct iovec));
+      arg->info = NULL;
+      arg->state = NULL;
+      arg->offset = OFFSET;
+      arg->iov_count = 1;
+      arg->iov[0].iov_len = sizeof(buffer);
+      arg->iov[0].iov_base = buffer;
+      arg->io_amount = 0;
+      arg->fsal_stable = false;
+
+      io_data.ret.major = ERR_FSAL_NO_ERROR;
+      io_data.ret.minor = 0;
+      io_data.done = false;
+      io_data.cond = &cond;
+      io_data.mutex = &mutex;
+
+      op_ctx->fsal_export = sub_export;
+      fsal_write(vfs_hdl, true, arg, &io_data);
+      op_ctx->fsal_export = save_exp;
+
+      EXPECT_EQ(arg->io_amount, sizeof(buffer));
+      return io_data.ret;
+    }
+
+    fsal_status_t commit(struct fsal_obj_handle *vfs_hdl) {
+      struct fsal_export *save_exp = op_ctx->fsal_export;
+      fsal_status_t status;
+
+      op_ctx->fsal_export = sub_export;
+      status = vfs_hdl->obj_ops->commit2(vfs_hdl, OFFSET, LENGTH);
+      op_ctx->fsal_export = save_exp;
+
+      return status;
+    }
+
+    void release(struct fsal_obj_handle *vfs_hdl) {
+      struct fsal_export *save_exp = op_ctx->fsal_export;
+
+      op_ctx->fsal_export = sub_export;
+      vfs_hdl->obj_ops->release(vfs_hdl);
+      op_ctx->fsal_export = save_exp;
+    }
+
+    uint64_t verifier() {
+      uint64_t verf = 0;
+      struct gsh_buffdesc verf_desc = { &verf, sizeof(verf) };
+
+      sub_export->exp_ops.get_write_verifier(sub_export, &verf_desc);
+      return verf;
+    }
+
+    struct fsal_export *sub_export = nullptr;
+    struct fsal_obj_handle *test_file = nullptr;
+  };
+
+} /* namespace */
+
+TEST_F(VFSReleaseSyncTest, RELEASE_CLEAN)
+{
+  struct fsal_obj_handle *vfs_hdl = vfs_handle();
+
+  ASSERT_NE(vfs_hdl, nullptr);
+
+  release(vfs_hdl);
+  EXPECT_EQ(fdatasync_calls, 0);
+}
+
+TEST_F(VFSReleaseSyncTest, EVICT_BETWEEN_WRITE_AND_COMMIT)
+{
+  struct fsal_obj_handle *vfs_hdl = vfs_handle();
+  fsal_status_t status;
+  uint64_t verf;
+
+  ASSERT_NE(vfs_hdl, nullptr);
+
+  verf = verifier();
+  status = unstable_write(vfs_hdl);
+  ASSERT_EQ(status.major, 0);
+  EXPECT_EQ(fdatasync_calls, 0);
+
+  /* Evicted, the write must reach stable storage now */
+  release(vfs_hdl);
+  EXPECT_EQ(fdatasync_calls, 1);
+
+  vfs_hdl = vfs_handle();
+  ASSERT_NE(vfs_hdl, nullptr);
+
+  status = commit(vfs_hdl);
+  EXPECT_EQ(status.major, 0);
+  EXPECT_EQ(verifier(), verf);
+
+  release(vfs_hdl);
+}
+
+TEST_F(VFSReleaseSyncTest, EVICT_FAILED_FLUSH)
+{
+  struct fsal_obj_handle *vfs_hdl = vfs_handle();
+  fsal_status_t status;
+  uint64_t verf;
+
+  ASSERT_NE(vfs_hdl, nullptr);
+
+  verf = verifier();
+  status = unstable_write(vfs_hdl);
+  ASSERT_EQ(status.major, 0);
+
+  fdatasync_fail = true;
+  release(vfs_hdl);
+  fdatasync_fail = false;
+  EXPECT_EQ(fdatasync_calls, 1);
+
+  vfs_hdl = vfs_handle();
+  ASSERT_NE(vfs_hdl, nullptr);
+
+  /* The COMMIT succeeds, but the client must see the write was lost */
+  status = commit(vfs_hdl);
+  EXPECT_EQ(status.major, 0);
+  EXPECT_NE(verifier(), verf);
+
+  release(vfs_hdl);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
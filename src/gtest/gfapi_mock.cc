@@ -0,0 +1,229 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <errno.h>
+#include <sys/uio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "gfapi_mock.h"
+
+extern "C" {
+#include "config.h"
+} /* extern "C" */
+
+/* The gfapi types the mocked calls use.  glfs.h is not included, its
+ * prototypes carry attributes these definitions need not repeat. */
+
+extern "C" {
+
+struct glfs_fd;
+struct glfs_stat;
+
+#ifdef USE_GLUSTER_STAT_FETCH_API
+typedef void (*glfs_io_cbk)(struct glfs_fd *fd, ssize_t ret,
+			    struct glfs_stat *prestat,
+			    struct glfs_stat *poststat, void *data);
+#else
+typedef void (*glfs_io_cbk)(struct glfs_fd *fd, ssize_t ret, void *data);
+#endif
+
+} /* extern "C" */
+
+namespace {
+
+  struct pending {
+    struct glfs_fd *fd;
+    ssize_t ret;
+    glfs_io_cbk fn;
+    void *data;
+  };
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<pending> queue;
+  bool held;
+  bool have_result;
+  ssize_t result;
+  uint32_t running;
+  uint64_t nsubmitted;
+  uint64_t ncloses;
+  std::thread *worker;
+
+  /* Call back the completed I/O as a gfapi event thread would */
+  void complete(const pending& p)
+  {
+    ssize_t ret = p.ret;
+
+    if (ret < 0) {
+      errno = -ret;
+      ret = -1;
+    }
+
+#ifdef USE_GLUSTER_STAT_FETCH_API
+    p.fn(p.fd, ret, nullptr, nullptr, p.data);
+#else
+    p.fn(p.fd, ret, p.data);
+#endif
+  }
+
+  void run_worker()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    for (;;) {
+      cv.wait(lock, [] { return !held && !queue.empty(); });
+
+      pending p = queue.front();
+
+      queue.pop_front();
+      running++;
+
+      lock.unlock();
+      complete(p);
+      lock.lock();
+
+      running--;
+      cv.notify_all();
+    }
+  }
+
+  int submit(struct glfs_fd *fd, const struct iovec *iov, int count,
+	     glfs_io_cbk fn, void *data)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    ssize_t len = 0;
+
+    for (int i = 0; i < count; ++i)
+      len += iov[i].iov_len;
+
+    if (!worker)
+      worker = new std::thread(run_worker);
+
+    queue.push_back(pending{fd, have_result ? result : len, fn, data});
+    nsubmitted++;
+    cv.notify_all();
+    return 0;
+  }
+
+} /* namespace */
+
+namespace gfapi_mock {
+
+  void hold()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    held = true;
+  }
+
+  void release()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    held = false;
+    cv.notify_all();
+  }
+
+  void set_result(ssize_t res)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    have_result = true;
+    result = res;
+  }
+
+  uint64_t submitted()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nsubmitted;
+  }
+
+  uint64_t closes()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return ncloses;
+  }
+
+  std::thread::id thread_id()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (!worker)
+      worker = new std::thread(run_worker);
+
+    return worker->get_id();
+  }
+
+  void reset()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    held = false;
+    cv.notify_all();
+    cv.wait(lock, [] { return queue.empty() && running == 0; });
+    have_result = false;
+    nsubmitted = 0;
+    ncloses = 0;
+  }
+
+} /* namespace gfapi_mock */
+
+extern "C" {
+
+int glfs_preadv_async(struct glfs_fd *fd, const struct iovec *iov, int count,
+		      off_t offset, int flags, glfs_io_cbk fn, void *data)
+{
+  return submit(fd, iov, count, fn, data);
+}
+
+int glfs_pwritev_async(struct glfs_fd *fd, const struct iovec *iov,
+		       int count, off_t offset, int flags, glfs_io_cbk fn,
+		       void *data)
+{
+  return submit(fd, iov, count, fn, data);
+}
+
+int glfs_close(struct glfs_fd *fd)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  ncloses++;
+  return 0;
+}
+
+int glfs_setfsuid(uid_t fsuid)
+{
+  return 0;
+}
+
+int glfs_setfsgid(gid_t fsgid)
+{
+  return 0;
+}
+
+int glfs_setfsgroups(size_t size, const gid_t *list)
+{
+  return 0;
+}
+
+int glfs_setfsleaseid(char *leaseid)
+{
+  return 0;
+}
+
+} /* extern "C" */
@@ -29,6 +29,7 @@ extern "C" {
 #include "nfs_lib.h"
 #include "nfs_file_handle.h"
 #include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
 }
 
 #ifndef GTEST_GTEST_NFS4_HH
@@ -179,6 +180,25 @@ namespace gtest {
       ops[pos].nfs_argop4_u.oplink.newname.utf8string_val = nullptr;
     }
 
+    void setup_readdir(int pos, nfs_cookie4 cookie, count4 maxcount) {
+      READDIR4args *args = &ops[pos].nfs_argop4_u.opreaddir;
+
+      ops[pos].argop = NFS4_OP_READDIR;
+      args->cookie = cookie;
+      args->dircount = maxcount;
+      args->maxcount = maxcount;
+      memset(&args->attr_request, 0, sizeof(args->attr_request));
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_TYPE);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_CHANGE);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_SIZE);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_FILEID);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_MODE);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_NUMLINKS);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_OWNER);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_OWNER_GROUP);
+      set_attribute_in_bitmap(&args->attr_request, FATTR4_TIME_MODIFY);
+    }
+
     compound_data_t *data;
     struct nfs_argop4 *ops;
     nfs_arg_t arg;
@@ -48,6 +48,7 @@ void admin_halt(void);
 #define TEST_ROOT "nfs4_putfh_latency"
 #define FILE_COUNT 100000
 #define LOOP_COUNT 1000000
+#define HOT_COUNT 8
 
 namespace {
 
@@ -73,6 +74,29 @@ namespace {
       GaeshaNFS4BaseTest::TearDown();
     }
 
+    /* PUTFH over the first HOT_COUNT objects, as a client working on a
+     * few files does */
+    uint64_t hot_putfh() {
+      int rc;
+      struct timespec s_time, e_time;
+
+      now(&s_time);
+
+      for (int i = 0; i < LOOP_COUNT; ++i) {
+        int n = i % HOT_COUNT;
+
+        setup_putfh(0, objs[n]);
+        rc = nfs4_op_putfh(&ops[0], data, &resp);
+        EXPECT_EQ(rc, NFS4_OK);
+        EXPECT_EQ(objs[n], data->current_obj);
+        cleanup_putfh(0);
+      }
+
+      now(&e_time);
+
+      return timespec_diff(&s_time, &e_time) / LOOP_COUNT;
+    }
+
     struct fsal_obj_handle *objs[FILE_COUNT];
   };
 
@@ -174,6 +198,36 @@ TEST_F(PutfhFullLatencyTest, BIG)
           timespec_diff(&s_time, &e_time) / LOOP_COUNT);
 }
 
+TEST_F(PutfhFullLatencyTest, HOT_SET)
+{
+  uint32_t slots = mdcache_param.handle_cache_slots;
+  uint64_t hits, misses, uncached, cached;
+
+  enableEvents(event_list);
+
+  /* Every handle looked up in the handle hash table */
+  mdcache_param.handle_cache_slots = 0;
+  uncached = hot_putfh();
+
+  /* Then found in the handle cache of this thread */
+  mdcache_param.handle_cache_slots = slots ? slots : 16;
+  hits = cache_stp->handle_cache_hit;
+  misses = cache_stp->handle_cache_miss;
+  cached = hot_putfh();
+  hits = cache_stp->handle_cache_hit - hits;
+  misses = cache_stp->handle_cache_miss - misses;
+
+  mdcache_param.handle_cache_slots = slots;
+
+  disableEvents(event_list);
+
+  EXPECT_GT(hits, misses);
+
+  fprintf(stderr, "Average time per putfh: %" PRIu64 " ns without handle "
+          "cache, %" PRIu64 " ns with it (%" PRIu64 " hits, %" PRIu64
+          " misses)\n", uncached, cached, hits, misses);
+}
+
 int main(int argc, char *argv[])
 {
   int code = 0;
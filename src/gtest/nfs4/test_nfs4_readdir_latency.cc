@@ -0,0 +1,285 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ * Contributor : Frank Filz <ffilzlnx@mindspring.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+#include "gtest_nfs4.hh"
+
+extern "C" {
+/* Manually forward this, an 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+//#include "sal_data.h"
+//#include "common_utils.h"
+/* For MDCACHE bypass.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#define TEST_ROOT "nfs4_readdir_latency"
+#define FILE_COUNT 100000
+#define LOOP_COUNT 10
+#define READDIR_MAXCOUNT 32768
+
+namespace {
+
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  class ReaddirEmptyLatencyTest : public gtest::GaeshaNFS4BaseTest {
+
+  protected:
+
+    /* Put the reply on the wire and decode it back the way a client
+     * would, returning the number of entries and the last cookie.
+     */
+    int decode_readdir(nfs_cookie4 *last_cookie, bool *eof) {
+      static char wire[READDIR_MAXCOUNT + 1024];
+      READDIR4res decoded;
+      XDR xdrs;
+      int count = 0;
+
+      xdrmem_create(&xdrs, wire, sizeof(wire), XDR_ENCODE);
+      EXPECT_TRUE(xdr_READDIR4res(&xdrs, &resp.nfs_resop4_u.opreaddir));
+      xdr_destroy(&xdrs);
+
+      memset(&decoded, 0, sizeof(decoded));
+      xdrmem_create(&xdrs, wire, sizeof(wire), XDR_DECODE);
+      EXPECT_TRUE(xdr_READDIR4res(&xdrs, &decoded));
+      xdr_destroy(&xdrs);
+
+      EXPECT_EQ(decoded.status, NFS4_OK);
+
+      for (entry4 *e = decoded.READDIR4res_u.resok4.reply.entries; e;
+           e = e->nextentry) {
+        *last_cookie = e->cookie;
+        ++count;
+      }
+      *eof = decoded.READDIR4res_u.resok4.reply.eof;
+
+      xdr_free((xdrproc_t) xdr_READDIR4res, &decoded);
+      return count;
+    }
+
+    /* Read the whole of the current directory, returning the number of
+     * entries and READDIR calls.
+     */
+    int readdir_all(int *calls) {
+      nfs_cookie4 cookie = 0;
+      bool eof = false;
+      int total = 0;
+      int rc;
+
+      *calls = 0;
+      while (!eof) {
+        setup_readdir(0, cookie, READDIR_MAXCOUNT);
+        rc = nfs4_op_readdir(&ops[0], data, &resp);
+        EXPECT_EQ(rc, NFS_REQ_OK);
+        if (rc != NFS_REQ_OK)
+          break;
+
+        total += decode_readdir(&cookie, &eof);
+        nfs4_op_readdir_Free(&resp);
+        resp.nfs_resop4_u.opreaddir.READDIR4res_u.resok4.reply.entries_xdr =
+                                                                     nullptr;
+        ++(*calls);
+      }
+
+      return total;
+    }
+  };
+
+  class ReaddirFullLatencyTest : public ReaddirEmptyLatencyTest {
+
+  protected:
+
+    virtual void SetUp() {
+      ReaddirEmptyLatencyTest::SetUp();
+
+      create_and_prime_many(FILE_COUNT, objs);
+    }
+
+    virtual void TearDown() {
+      remove_many(FILE_COUNT, objs);
+
+      ReaddirEmptyLatencyTest::TearDown();
+    }
+
+    struct fsal_obj_handle *objs[FILE_COUNT];
+  };
+
+} /* namespace */
+
+TEST_F(ReaddirEmptyLatencyTest, SIMPLE)
+{
+  int calls;
+
+  setCurrentFH(test_root);
+
+  enableEvents(event_list);
+
+  EXPECT_EQ(readdir_all(&calls), 0);
+  EXPECT_EQ(calls, 1);
+
+  disableEvents(event_list);
+}
+
+TEST_F(ReaddirFullLatencyTest, BIG)
+{
+  int calls = 0;
+  int total_calls = 0;
+  struct timespec s_time, e_time;
+
+  setCurrentFH(test_root);
+
+  enableEvents(event_list);
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  now(&s_time);
+
+  for (int i = 0; i < LOOP_COUNT; ++i) {
+    EXPECT_EQ(readdir_all(&calls), FILE_COUNT);
+    total_calls += calls;
+  }
+
+  now(&e_time);
+
+  if (profile_out)
+    ProfilerStop();
+  disableEvents(event_list);
+
+  fprintf(stderr, "Average time per directory listing: %" PRIu64 " ns\n",
+          timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+  fprintf(stderr, "Average time per readdir: %" PRIu64 " ns (%d calls)\n",
+          timespec_diff(&s_time, &e_time) / total_calls, calls);
+  fprintf(stderr, "Average time per entry: %" PRIu64 " ns\n",
+          timespec_diff(&s_time, &e_time) / ((uint64_t) FILE_COUNT *
+                                             LOOP_COUNT));
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+       "LTTng session name")
+
+      ("event-list", po::value<string>(),
+       "LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+       "Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+         (char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+                                        session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,217 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "rados_mock.h"
+
+extern "C" {
+#include <rados/librados.h>
+} /* extern "C" */
+
+namespace {
+
+  typedef std::map<std::string, std::string> omap_t;
+
+  struct write_op {
+    std::vector<std::function<void(omap_t&)>> steps;
+  };
+
+  struct completion {
+    void *arg;
+    rados_callback_t cb;
+    int ret;
+  };
+
+  struct pending {
+    write_op *op;
+    completion *comp;
+    std::string oid;
+  };
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::map<std::string, omap_t> objects;
+  std::deque<pending> queue;
+  uint32_t latency_us = 500;
+  uint64_t nops;
+  std::thread *worker;
+
+  /* Complete the queued write ops in order, as an OSD would */
+  void run_worker()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    for (;;) {
+      cv.wait(lock, [] { return !queue.empty(); });
+
+      pending p = queue.front();
+      uint32_t usecs = latency_us;
+
+      queue.pop_front();
+
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+      lock.lock();
+
+      for (auto& step : p.op->steps)
+	step(objects[p.oid]);
+      nops++;
+      p.comp->ret = 0;
+
+      lock.unlock();
+      if (p.comp->cb)
+	p.comp->cb(p.comp, p.comp->arg);
+      lock.lock();
+    }
+  }
+
+} /* namespace */
+
+namespace rados_mock {
+
+  void set_latency(uint32_t usecs)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    latency_us = usecs;
+  }
+
+  uint64_t ops()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nops;
+  }
+
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    objects.clear();
+    nops = 0;
+  }
+
+  std::map<std::string, std::string> omap(const std::string& oid)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return objects[oid];
+  }
+
+} /* namespace rados_mock */
+
+extern "C" {
+
+rados_write_op_t rados_create_write_op(void)
+{
+  return new write_op;
+}
+
+void rados_release_write_op(rados_write_op_t op)
+{
+  delete static_cast<write_op *>(op);
+}
+
+void rados_write_op_omap_set(rados_write_op_t op, char const *const *keys,
+			     char const *const *vals, const size_t *lens,
+			     size_t num)
+{
+  std::vector<std::pair<std::string, std::string>> kvs;
+
+  for (size_t i = 0; i < num; ++i)
+    kvs.emplace_back(keys[i], std::string(vals[i], lens[i]));
+
+  static_cast<write_op *>(op)->steps.push_back([kvs](omap_t& m) {
+      for (auto& kv : kvs)
+	m[kv.first] = kv.second;
+    });
+}
+
+void rados_write_op_omap_rm_keys(rados_write_op_t op, char const *const *keys,
+				 size_t num)
+{
+  std::vector<std::string> ks(keys, keys + num);
+
+  static_cast<write_op *>(op)->steps.push_back([ks](omap_t& m) {
+      for (auto& k : ks)
+	m.erase(k);
+    });
+}
+
+void rados_write_op_omap_clear(rados_write_op_t op)
+{
+  static_cast<write_op *>(op)->steps.push_back([](omap_t& m) {
+      m.clear();
+    });
+}
+
+int rados_aio_create_completion(void *cb_arg, rados_callback_t cb_complete,
+				rados_callback_t cb_safe,
+				rados_completion_t *pc)
+{
+  *pc = new completion{cb_arg, cb_complete, 0};
+  return 0;
+}
+
+int rados_aio_get_return_value(rados_completion_t c)
+{
+  return static_cast<completion *>(c)->ret;
+}
+
+void rados_aio_release(rados_completion_t c)
+{
+  delete static_cast<completion *>(c);
+}
+
+int rados_aio_write_op_operate(rados_write_op_t op, rados_ioctx_t io,
+			       rados_completion_t c, const char *oid,
+			       time_t *mtime, int flags)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+
+  if (!worker)
+    worker = new std::thread(run_worker);
+
+  queue.push_back(pending{static_cast<write_op *>(op),
+			  static_cast<completion *>(c), oid});
+  cv.notify_one();
+  return 0;
+}
+
+int rados_write_op_operate(rados_write_op_t op, rados_ioctx_t io,
+			   const char *oid, time_t *mtime, int flags)
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  uint32_t usecs = latency_us;
+
+  lock.unlock();
+  std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+  lock.lock();
+
+  for (auto& step : static_cast<write_op *>(op)->steps)
+    step(objects[oid]);
+  nops++;
+  return 0;
+}
+
+} /* extern "C" */
@@ -0,0 +1,54 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * In-memory stand-in for the omap write ops of librados.
+ *
+ * Linking rados_mock.cc into a test replaces the librados write op
+ * calls with ones applying to a map in memory, completed after a fixed
+ * latency by a thread of the mock, so RADOS code can run without a
+ * cluster.
+ */
+
+#ifndef RADOS_MOCK_H
+#define RADOS_MOCK_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace rados_mock {
+
+  /* Latency of a write op, in microseconds */
+  void set_latency(uint32_t usecs);
+
+  /* Write ops completed since the last reset */
+  uint64_t ops();
+
+  /* Clear the objects and counters */
+  void reset();
+
+  /* Copy of the omap of an object */
+  std::map<std::string, std::string> omap(const std::string& oid);
+
+} /* namespace rados_mock */
+
+#endif /* RADOS_MOCK_H */
@@ -0,0 +1,177 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "nfs_core.h"
+#include "export_mgr.h"
+
+/* gperf headers */
+#include <gperftools/profiler.h>
+} /* extern "C" */
+
+namespace {
+
+  char* profile_out = nullptr;
+
+  static constexpr uint16_t num_exports = 10000;
+  static constexpr uint32_t num_lookups = 1000000;
+
+  /* Exports are spread over a two level tree, /export/dNN/eNNNNN, with
+   * pseudo paths mirroring them under /pseudo. */
+  void export_path_of(char *buf, const char *top, uint16_t id)
+  {
+    sprintf(buf, "/%s/d%02u/e%05u", top, id % 64, id);
+  }
+
+  class ExportLookupLatency : public ::testing::Test {
+
+    virtual void SetUp() {
+      char path[64];
+
+      for (uint16_t id = 1; id <= num_exports; ++id) {
+	struct gsh_export *exp = alloc_export();
+
+	exp->export_id = id;
+	export_path_of(path, "export", id);
+	exp->fullpath = gsh_strdup(path);
+	export_path_of(path, "pseudo", id);
+	exp->pseudopath = gsh_strdup(path);
+	ASSERT_TRUE(insert_gsh_export(exp));
+	put_gsh_export(exp);
+      }
+    }
+
+    virtual void TearDown() {
+      for (uint16_t id = 1; id <= num_exports; ++id)
+	remove_gsh_export(id);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(ExportLookupLatency, BY_PATH_EXACT)
+{
+  char path[64];
+  struct gsh_export *exp;
+  struct timespec s_time, e_time;
+
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  now(&s_time);
+
+  for (uint32_t i = 0; i < num_lookups; ++i) {
+    uint16_t id = i % num_exports + 1;
+
+    export_path_of(path, "export", id);
+    exp = get_gsh_export_by_path(path, true);
+    ASSERT_NE(exp, nullptr);
+    ASSERT_EQ(exp->export_id, id);
+    put_gsh_export(exp);
+  }
+
+  now(&e_time);
+
+  if (profile_out)
+    ProfilerStop();
+
+  fprintf(stderr, "Average time per exact path lookup: %" PRIu64 " ns\n",
+	  timespec_diff(&s_time, &e_time) / num_lookups);
+}
+
+TEST_F(ExportLookupLatency, BY_PSEUDO_PREFIX)
+{
+  char path[96];
+  struct gsh_export *exp;
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+
+  for (uint32_t i = 0; i < num_lookups; ++i) {
+    uint16_t id = i % num_exports + 1;
+
+    export_path_of(path, "pseudo", id);
+    strcat(path, "/sub/dir");
+    exp = get_gsh_export_by_pseudo(path, false);
+    ASSERT_NE(exp, nullptr);
+    ASSERT_EQ(exp->export_id, id);
+    put_gsh_export(exp);
+  }
+
+  now(&e_time);
+
+  fprintf(stderr, "Average time per pseudo prefix lookup: %" PRIu64
+	  " ns\n", timespec_diff(&s_time, &e_time) / num_lookups);
+}
+
+TEST_F(ExportLookupLatency, MATCH_RULES)
+{
+  struct gsh_export *exp;
+
+  /* Component boundaries, not substrings */
+  EXPECT_EQ(get_gsh_export_by_path((char *) "/export/d01/e00001x", false),
+	    nullptr);
+  /* Partial paths only match when asked to */
+  EXPECT_EQ(get_gsh_export_by_path((char *) "/export/d01/e00001/a", true),
+	    nullptr);
+  /* Trailing slash is ignored */
+  exp = get_gsh_export_by_path((char *) "/export/d01/e00001/", true);
+  ASSERT_NE(exp, nullptr);
+  EXPECT_EQ(exp->export_id, 1);
+  put_gsh_export(exp);
+
+  /* A root export catches everything else */
+  exp = alloc_export();
+  exp->export_id = num_exports + 1;
+  exp->fullpath = gsh_strdup("/");
+  exp->pseudopath = gsh_strdup("/");
+  ASSERT_TRUE(insert_gsh_export(exp));
+  put_gsh_export(exp);
+
+  exp = get_gsh_export_by_path((char *) "/export/d01/e00001x", false);
+  ASSERT_NE(exp, nullptr);
+  EXPECT_EQ(exp->export_id, num_exports + 1);
+  put_gsh_export(exp);
+
+  exp = get_gsh_export_by_pseudo((char *) "", true);
+  ASSERT_NE(exp, nullptr);
+  EXPECT_EQ(exp->export_id, num_exports + 1);
+  put_gsh_export(exp);
+
+  remove_gsh_export(num_exports + 1);
+  EXPECT_EQ(get_gsh_export_by_pseudo((char *) "/", true), nullptr);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  export_pkginit();
+
+  ::testing::InitGoogleTest(&argc, argv);
+  code = RUN_ALL_TESTS();
+
+  return code;
+}
@@ -0,0 +1,308 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Asynchronous read2/write2 completion, as done by FSAL_GLUSTER and
+ * FSAL_CEPH, against a fake backend that completes I/O on its own
+ * thread some time after submission (or in line, as libcephfs may).
+ * The caller side mimics the ASYNC_PROC_DONE/ASYNC_PROC_EXIT handshake
+ * of the NFS protocol layer.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "common_utils.h"
+#include "nfs_proto_data.h"
+} /* extern "C" */
+
+namespace {
+
+  static constexpr uint32_t num_ios = 10000;
+  static constexpr size_t io_size = 4096;
+
+  /* A backend I/O: the FSAL's per I/O structure */
+  struct fake_io {
+    struct fsal_async_io aio;
+    ssize_t result;
+  };
+
+  /* Completes submitted I/O from its own thread, in order, after a
+   * delay. */
+  class FakeBackend {
+  public:
+    FakeBackend(std::chrono::microseconds delay) : delay(delay), stop(false) {
+      thr = std::thread([this]() { run(); });
+    }
+
+    ~FakeBackend() {
+      {
+	std::lock_guard<std::mutex> lk(mtx);
+	stop = true;
+      }
+      cv.notify_all();
+      thr.join();
+    }
+
+    void submit(struct fake_io *io) {
+      {
+	std::lock_guard<std::mutex> lk(mtx);
+	queue.push_back(io);
+      }
+      cv.notify_one();
+    }
+
+    std::thread::id id() { return thr.get_id(); }
+
+    static void complete(struct fake_io *io) {
+      fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+      if (io->result < 0)
+	status = fsalstat(posix2fsal_error(-io->result), -io->result);
+      else
+	io->aio.io_arg->io_amount = io->result;
+
+      fsal_async_io_done(&io->aio, status);
+      delete io;
+    }
+
+  private:
+    void run() {
+      std::unique_lock<std::mutex> lk(mtx);
+
+      for (;;) {
+	cv.wait(lk, [this]() { return stop || !queue.empty(); });
+	if (queue.empty())
+	  return;
+
+	struct fake_io *io = queue.front();
+	queue.pop_front();
+	lk.unlock();
+	std::this_thread::sleep_for(delay);
+	complete(io);
+	lk.lock();
+      }
+    }
+
+    std::chrono::microseconds delay;
+    bool stop;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<struct fake_io *> queue;
+    std::thread thr;
+  };
+
+  FakeBackend *backend;
+  bool inline_completion;
+  ssize_t next_result;
+
+  /* read2 of a FSAL on the fake backend */
+  void fake_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
+		  fsal_async_cb done_cb, struct fsal_io_arg *read_arg,
+		  void *caller_arg)
+  {
+    struct fake_io *io = new fake_io();
+
+    fsal_async_io_init(&io->aio, obj_hdl, done_cb, read_arg, caller_arg);
+    io->result = next_result;
+
+    if (inline_completion)
+      FakeBackend::complete(io);
+    else
+      backend->submit(io);
+  }
+
+  /* Protocol layer side of one request */
+  struct request {
+    struct req_op_context ctx;
+    std::atomic<uint32_t> flags;
+    std::atomic<bool> resumed;
+    std::thread::id done_thread;
+    struct req_op_context *done_ctx;
+    struct fsal_export *done_export;
+    fsal_status_t status;
+    struct fsal_io_arg *read_arg;
+    char buf[io_size];
+  };
+
+  std::atomic<uint32_t> resumes;
+
+  void read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+	       void *read_data, void *caller_data)
+  {
+    struct request *req = (struct request *) caller_data;
+
+    req->done_thread = std::this_thread::get_id();
+    req->done_ctx = op_ctx;
+    req->done_export = op_ctx->fsal_export;
+    req->status = ret;
+
+    if (req->flags.fetch_or(ASYNC_PROC_DONE) & ASYNC_PROC_EXIT) {
+      /* The submitter already went async, reschedule */
+      req->resumed = true;
+      resumes++;
+    }
+  }
+
+  /* Issue a read as nfs4_op_read does.  Returns true if the request
+   * would have been suspended. */
+  bool issue(struct request *req, struct fsal_export *exp)
+  {
+    memset(&req->ctx, 0, sizeof(req->ctx));
+    req->ctx.fsal_export = exp;
+    req->flags = 0;
+    req->resumed = false;
+    req->read_arg = (struct fsal_io_arg *)
+      calloc(1, sizeof(struct fsal_io_arg) + sizeof(struct iovec));
+    req->read_arg->iov_count = 1;
+    req->read_arg->iov[0].iov_base = req->buf;
+    req->read_arg->iov[0].iov_len = io_size;
+
+    op_ctx = &req->ctx;
+    fake_read2(nullptr, false, read_cb, req->read_arg, req);
+    /* A stacked FSAL restores its own export once the call returns */
+    req->ctx.fsal_export = nullptr;
+    op_ctx = nullptr;
+
+    return !(req->flags.fetch_or(ASYNC_PROC_EXIT) & ASYNC_PROC_DONE);
+  }
+
+  void finish(struct request *req)
+  {
+    free(req->read_arg);
+  }
+
+  void wait_done(struct request *req)
+  {
+    while (!(req->flags.load() & ASYNC_PROC_DONE))
+      std::this_thread::yield();
+  }
+
+  class FsalAsync : public ::testing::Test {
+
+    virtual void SetUp() {
+      backend = new FakeBackend(std::chrono::microseconds(10));
+      inline_completion = false;
+      next_result = io_size;
+      resumes = 0;
+    }
+
+    virtual void TearDown() {
+      delete backend;
+      backend = nullptr;
+    }
+  };
+
+} /* namespace */
+
+TEST_F(FsalAsync, COMPLETES_ON_BACKEND_THREAD)
+{
+  struct request req;
+  struct fsal_export *exp = (struct fsal_export *) &req;
+  bool suspended = issue(&req, exp);
+
+  wait_done(&req);
+
+  EXPECT_EQ(req.done_thread, backend->id());
+  EXPECT_EQ(req.status.major, ERR_FSAL_NO_ERROR);
+  EXPECT_EQ(req.read_arg->io_amount, io_size);
+  /* done_cb saw a copy of the context taken at submission */
+  EXPECT_NE(req.done_ctx, &req.ctx);
+  EXPECT_EQ(req.done_export, exp);
+  EXPECT_EQ(suspended, req.resumed.load());
+  finish(&req);
+}
+
+TEST_F(FsalAsync, INLINE_COMPLETION)
+{
+  struct request req;
+  struct fsal_export *exp = (struct fsal_export *) &req;
+
+  inline_completion = true;
+
+  EXPECT_FALSE(issue(&req, exp));
+  EXPECT_FALSE(req.resumed);
+  EXPECT_EQ(req.done_thread, std::this_thread::get_id());
+  EXPECT_EQ(req.done_export, exp);
+  EXPECT_EQ(op_ctx, nullptr);
+  finish(&req);
+}
+
+TEST_F(FsalAsync, ERROR)
+{
+  struct request req;
+
+  next_result = -EIO;
+  issue(&req, nullptr);
+  wait_done(&req);
+
+  EXPECT_EQ(req.status.major, ERR_FSAL_IO);
+  EXPECT_EQ(req.status.minor, EIO);
+  EXPECT_EQ(req.read_arg->io_amount, 0U);
+  finish(&req);
+}
+
+TEST_F(FsalAsync, MANY_INFLIGHT)
+{
+  std::vector<struct request> reqs(num_ios);
+  uint32_t suspended = 0;
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+
+  /* One submitting thread keeps all of them in flight */
+  for (uint32_t i = 0; i < num_ios; ++i)
+    if (issue(&reqs[i], nullptr))
+      suspended++;
+
+  for (uint32_t i = 0; i < num_ios; ++i)
+    wait_done(&reqs[i]);
+
+  now(&e_time);
+
+  fprintf(stderr, "%u I/Os, %u suspended, %" PRIu64 " ns per I/O\n",
+	  num_ios, suspended,
+	  timespec_diff(&s_time, &e_time) / num_ios);
+
+  EXPECT_EQ(resumes.load(), suspended);
+  for (uint32_t i = 0; i < num_ios; ++i) {
+    EXPECT_EQ(reqs[i].status.major, ERR_FSAL_NO_ERROR);
+    EXPECT_EQ(reqs[i].read_arg->io_amount, io_size);
+    finish(&reqs[i]);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
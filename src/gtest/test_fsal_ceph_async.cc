@@ -0,0 +1,297 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * FSAL_CEPH read2/write2 on a state's fd, completed by ceph_io_cb from
+ * the thread of a stubbed libcephfs, or in line.  The fdlock must not
+ * be held once the I/O is submitted, and closing the state must wait
+ * for the I/O in flight.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "cephfs_mock.h"
+
+extern "C" {
+#include "fsal.h"
+#include "client_mgr.h"
+#include "FSAL/fsal_commonlib.h"
+#include "internal.h"
+} /* extern "C" */
+
+namespace {
+
+  static constexpr size_t io_size = 4096;
+  static constexpr uint32_t num_ios = 1000;
+
+  struct request {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done;
+    std::thread::id done_thread;
+    fsal_status_t status;
+    struct fsal_io_arg *io_arg;
+    char buf[io_size];
+
+    request() : done(false) {
+      io_arg = (struct fsal_io_arg *)
+	calloc(1, sizeof(struct fsal_io_arg) + sizeof(struct iovec));
+      io_arg->iov_count = 1;
+      io_arg->iov[0].iov_base = buf;
+      io_arg->iov[0].iov_len = io_size;
+    }
+
+    ~request() {
+      free(io_arg);
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this] { return done; });
+    }
+  };
+
+  void io_done(struct fsal_obj_handle *obj, fsal_status_t ret,
+	       void *io_data, void *caller_data)
+  {
+    struct request *req = (struct request *) caller_data;
+    std::lock_guard<std::mutex> lock(req->mtx);
+
+    req->done_thread = std::this_thread::get_id();
+    req->status = ret;
+    req->done = true;
+    req->cv.notify_all();
+  }
+
+  class CephAsync : public ::testing::Test {
+
+    virtual void SetUp() {
+      cephfs_mock::reset();
+
+      memset(&cexport, 0, sizeof(cexport));
+
+      memset(&handle, 0, sizeof(handle));
+      handle.handle.type = REGULAR_FILE;
+      handle.handle.obj_ops = &CephFSM.handle_ops;
+      handle.export = &cexport;
+      PTHREAD_RWLOCK_init(&handle.handle.obj_lock, NULL);
+      update_share_counters(&handle.share, FSAL_O_CLOSED, FSAL_O_RDWR);
+
+      state = ceph_alloc_state(&cexport.export, STATE_TYPE_SHARE, NULL);
+      fd = &container_of(state, struct ceph_state_fd, state)->ceph_fd;
+      fd->openflags = FSAL_O_RDWR;
+      /* Never dereferenced by the mock */
+      fd->fd = (Fh *) &cexport;
+
+      client = (struct gsh_client *) calloc(1, sizeof(*client));
+      memset(&creds, 0, sizeof(creds));
+      memset(&ctx, 0, sizeof(ctx));
+      ctx.fsal_export = &cexport.export;
+      ctx.creds = &creds;
+      ctx.client = client;
+      op_ctx = &ctx;
+    }
+
+    virtual void TearDown() {
+      cephfs_mock::reset();
+      ceph_free_state(&cexport.export, state);
+      PTHREAD_RWLOCK_destroy(&handle.handle.obj_lock);
+      free(client);
+      op_ctx = nullptr;
+    }
+
+  protected:
+    void submit_read(struct request *req) {
+      handle.handle.obj_ops->read2(&handle.handle, false, io_done,
+				   req->io_arg, req);
+    }
+
+    void submit_write(struct request *req) {
+      handle.handle.obj_ops->write2(&handle.handle, false, io_done,
+				    req->io_arg, req);
+    }
+
+    /* Only the thread submitting or closing may hold the fdlock */
+    bool fdlock_free() {
+      if (pthread_rwlock_trywrlock(&fd->fdlock) != 0)
+	return false;
+      PTHREAD_RWLOCK_unlock(&fd->fdlock);
+      return true;
+    }
+
+    uint32_t pins() {
+      uint32_t count;
+
+      PTHREAD_MUTEX_lock(&fd->pins.mutex);
+      count = fd->pins.count;
+      PTHREAD_MUTEX_unlock(&fd->pins.mutex);
+      return count;
+    }
+
+    struct ceph_export cexport;
+    struct ceph_handle handle;
+    struct state_t *state;
+    struct ceph_fd *fd;
+    struct gsh_client *client;
+    struct user_cred creds;
+    struct req_op_context ctx;
+  };
+
+} /* namespace */
+
+TEST_F(CephAsync, READ_COMPLETES_ON_FINISHER_THREAD)
+{
+  struct request req;
+
+  cephfs_mock::hold();
+  submit_read(&req);
+
+  EXPECT_EQ(cephfs_mock::submitted(), 1U);
+  EXPECT_FALSE(req.done);
+  EXPECT_TRUE(fdlock_free());
+  EXPECT_EQ(pins(), 1U);
+
+  cephfs_mock::release();
+  req.wait();
+
+  EXPECT_EQ(req.done_thread, cephfs_mock::thread_id());
+  EXPECT_EQ(req.status.major, ERR_FSAL_NO_ERROR);
+  EXPECT_EQ(req.io_arg->io_amount, io_size);
+  EXPECT_FALSE(req.io_arg->end_of_file);
+  EXPECT_EQ(pins(), 0U);
+}
+
+TEST_F(CephAsync, INLINE_COMPLETION)
+{
+  struct request req;
+
+  /* The callback runs before submission returns, on this thread */
+  cephfs_mock::set_inline(true);
+  submit_read(&req);
+
+  EXPECT_TRUE(req.done);
+  EXPECT_EQ(req.done_thread, std::this_thread::get_id());
+  EXPECT_EQ(req.status.major, ERR_FSAL_NO_ERROR);
+  EXPECT_EQ(req.io_arg->io_amount, io_size);
+  EXPECT_EQ(pins(), 0U);
+  EXPECT_TRUE(fdlock_free());
+}
+
+TEST_F(CephAsync, SHORT_READ)
+{
+  struct request req;
+
+  cephfs_mock::set_result(io_size / 2);
+  submit_read(&req);
+  req.wait();
+
+  EXPECT_EQ(req.status.major, ERR_FSAL_NO_ERROR);
+  EXPECT_EQ(req.io_arg->io_amount, io_size / 2);
+  EXPECT_TRUE(req.io_arg->end_of_file);
+  EXPECT_EQ(pins(), 0U);
+}
+
+TEST_F(CephAsync, WRITE_ERROR)
+{
+  struct request req;
+
+  cephfs_mock::set_result(-EIO);
+  submit_write(&req);
+  req.wait();
+
+  EXPECT_EQ(req.done_thread, cephfs_mock::thread_id());
+  EXPECT_EQ(req.status.major, ERR_FSAL_IO);
+  EXPECT_EQ(req.status.minor, EIO);
+  EXPECT_EQ(pins(), 0U);
+  EXPECT_TRUE(fdlock_free());
+}
+
+TEST_F(CephAsync, CLOSE_WAITS_FOR_IO)
+{
+  struct request req;
+  std::atomic<bool> closed(false);
+  fsal_status_t status;
+
+  cephfs_mock::hold();
+  submit_write(&req);
+
+  std::thread closer([&] {
+      op_ctx = &ctx;
+      status = handle.handle.obj_ops->close2(&handle.handle, state);
+      op_ctx = nullptr;
+      closed = true;
+    });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  /* The fd is pinned by the write */
+  EXPECT_FALSE(closed);
+  EXPECT_EQ(cephfs_mock::closes(), 0U);
+
+  cephfs_mock::release();
+  closer.join();
+  req.wait();
+
+  EXPECT_EQ(status.major, ERR_FSAL_NO_ERROR);
+  EXPECT_EQ(req.status.major, ERR_FSAL_NO_ERROR);
+  EXPECT_EQ(cephfs_mock::closes(), 1U);
+  EXPECT_EQ(fd->openflags, FSAL_O_CLOSED);
+}
+
+TEST_F(CephAsync, MANY_INFLIGHT)
+{
+  std::vector<struct request> reqs(num_ios);
+
+  cephfs_mock::hold();
+
+  for (uint32_t i = 0; i < num_ios; ++i) {
+    if (i & 1)
+      submit_write(&reqs[i]);
+    else
+      submit_read(&reqs[i]);
+  }
+
+  EXPECT_EQ(pins(), num_ios);
+  EXPECT_TRUE(fdlock_free());
+
+  cephfs_mock::release();
+
+  for (uint32_t i = 0; i < num_ios; ++i) {
+    reqs[i].wait();
+    EXPECT_EQ(reqs[i].status.major, ERR_FSAL_NO_ERROR);
+    EXPECT_EQ(reqs[i].io_arg->io_amount, io_size);
+  }
+
+  EXPECT_EQ(pins(), 0U);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
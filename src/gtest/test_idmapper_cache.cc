@@ -0,0 +1,166 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include <urcu-bp.h>
+#include "nfs_core.h"
+#include "idmapper.h"
+
+/* gperf headers */
+#include <gperftools/profiler.h>
+} /* extern "C" */
+
+namespace {
+
+  char* profile_out = nullptr;
+
+  static constexpr uint32_t num_ids = 10000;
+  static constexpr uint32_t dir_owners = 8;
+  static constexpr uint32_t num_lookups = 1000000;
+
+  /* Encode the owners of a READDIR-like stream of entries, most of
+   * which share a handful of owners, plus a sprinkle of others. */
+  void encode_owners(uint32_t seed, uint32_t count)
+  {
+    char buf[128];
+    XDR xdrs;
+
+    for (uint32_t i = 0; i < count; ++i) {
+      uid_t uid = (i % 16) ? (seed + i) % dir_owners : (seed + i) % num_ids;
+
+      xdrmem_create(&xdrs, buf, sizeof(buf), XDR_ENCODE);
+      ASSERT_TRUE(xdr_encode_nfs4_owner(&xdrs, uid));
+      ASSERT_TRUE(xdr_encode_nfs4_group(&xdrs, uid));
+      xdr_destroy(&xdrs);
+    }
+  }
+
+  class IdmapperCacheLatency : public ::testing::Test {
+
+    virtual void SetUp() {
+      char name[64];
+      struct gsh_buffdesc desc;
+
+      nfs_param.core_param.manage_gids_expiration = 3600;
+      nfs_param.nfsv4_param.idmap_negative_expiration = 60;
+      nfs_param.nfsv4_param.use_getpwnam = true;
+      nfs_param.nfsv4_param.domainname = (char *) "localdomain";
+      ASSERT_TRUE(idmapper_init());
+
+      for (uint32_t id = 0; id < num_ids; ++id) {
+	desc.addr = name;
+	desc.len = sprintf(name, "user%u@localdomain", id);
+	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
+	idmapper_add_user(&desc, id, &id, IDMAP_BY_NAME | IDMAP_BY_ID);
+	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+
+	desc.len = sprintf(name, "group%u@localdomain", id);
+	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
+	idmapper_add_group(&desc, id, IDMAP_BY_NAME | IDMAP_BY_ID);
+	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
+      }
+    }
+
+    virtual void TearDown() {
+      idmapper_clear_cache();
+    }
+
+  protected:
+    void run(uint32_t nthreads) {
+      struct timespec s_time, e_time;
+      std::vector<std::thread> threads;
+
+      now(&s_time);
+
+      for (uint32_t t = 0; t < nthreads; ++t)
+	threads.emplace_back(encode_owners, t * 7919, num_lookups);
+      for (auto& thr : threads)
+	thr.join();
+
+      now(&e_time);
+
+      uint64_t dt = timespec_diff(&s_time, &e_time);
+      uint64_t reqs_s = (2ULL * num_lookups * nthreads) /
+	(double(dt) / 1000000000);
+
+      fprintf(stderr, "%u threads: total run time: %" PRIu64
+	      " ns (%" PRIu64 " lookups/s)\n", nthreads, dt, reqs_s);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(IdmapperCacheLatency, ENCODE_1)
+{
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  run(1);
+
+  if (profile_out)
+    ProfilerStop();
+}
+
+TEST_F(IdmapperCacheLatency, ENCODE_SCALING)
+{
+  for (uint32_t nthreads = 2; nthreads <= 16; nthreads *= 2)
+    run(nthreads);
+
+  fprintf(stderr, "hits %" PRIu64 " misses %" PRIu64 " expired %" PRIu64
+	  "\n", idmapper_cache_st.hits, idmapper_cache_st.misses,
+	  idmapper_cache_st.expired);
+}
+
+TEST_F(IdmapperCacheLatency, NAME2UID)
+{
+  char name[64];
+  struct gsh_buffdesc desc;
+  struct timespec s_time, e_time;
+  uid_t uid;
+
+  desc.addr = name;
+
+  now(&s_time);
+
+  for (uint32_t i = 0; i < num_lookups; ++i) {
+    desc.len = sprintf(name, "user%u@localdomain", i % num_ids);
+    ASSERT_TRUE(name2uid(&desc, &uid, 65534));
+    ASSERT_EQ(uid, i % num_ids);
+  }
+
+  now(&e_time);
+
+  fprintf(stderr, "Average time per name2uid: %" PRIu64 " ns\n",
+	  timespec_diff(&s_time, &e_time) / num_lookups);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,152 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "common_utils.h"
+#include "abstract_mem.h"
+
+/* gperf headers */
+#include <gperftools/profiler.h>
+} /* extern "C" */
+
+namespace {
+
+  char* profile_out = nullptr;
+
+  static constexpr uint32_t num_objs = 1000;
+  static constexpr uint32_t num_rounds = 1000;
+  static constexpr size_t obj_size = 344; /* ~ a state owner */
+
+  /* Allocate a window of objects, dirty them, free them, repeat.
+   * Every object handed out must be zeroed. */
+  void churn(pool_t *pool, uint32_t rounds)
+  {
+    std::vector<void *> objs(num_objs);
+
+    for (uint32_t r = 0; r < rounds; ++r) {
+      for (uint32_t i = 0; i < num_objs; ++i) {
+	unsigned char *p = (unsigned char *) pool_alloc(pool);
+
+	ASSERT_EQ(p[0], 0);
+	ASSERT_EQ(p[obj_size - 1], 0);
+	memset(p, 0xa5, obj_size);
+	objs[i] = p;
+      }
+      for (uint32_t i = 0; i < num_objs; ++i)
+	pool_free(pool, objs[i]);
+    }
+  }
+
+  class MemPool : public ::testing::Test {
+
+    virtual void SetUp() {
+      pool = pool_basic_init("test pool", obj_size);
+    }
+
+    virtual void TearDown() {
+      pool_destroy(pool);
+    }
+
+  protected:
+    pool_t *pool;
+
+    void run(uint32_t nthreads) {
+      struct timespec s_time, e_time;
+      std::vector<std::thread> threads;
+
+      now(&s_time);
+
+      for (uint32_t t = 0; t < nthreads; ++t)
+	threads.emplace_back(churn, pool, num_rounds);
+      for (auto& thr : threads)
+	thr.join();
+
+      now(&e_time);
+
+      fprintf(stderr, "%u threads: average time per alloc/free: %" PRIu64
+	      " ns\n", nthreads, timespec_diff(&s_time, &e_time) /
+	      (uint64_t(num_objs) * num_rounds * nthreads));
+    }
+  };
+
+} /* namespace */
+
+TEST_F(MemPool, CHURN_1)
+{
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  run(1);
+
+  if (profile_out)
+    ProfilerStop();
+
+  EXPECT_EQ(pool->allocs, pool->frees);
+  EXPECT_EQ(pool->allocs, uint64_t(num_objs) * num_rounds);
+}
+
+TEST_F(MemPool, CHURN_SCALING)
+{
+  for (uint32_t nthreads = 2; nthreads <= 16; nthreads *= 2)
+    run(nthreads);
+
+  EXPECT_EQ(pool->allocs, pool->frees);
+  fprintf(stderr, "magazine hit rate: %.2f%%\n",
+	  100.0 * (pool->allocs - pool->misses) / pool->allocs);
+}
+
+TEST_F(MemPool, CROSS_THREAD_FREE)
+{
+  std::vector<void *> objs(num_objs);
+
+  for (uint32_t i = 0; i < num_objs; ++i)
+    objs[i] = pool_alloc(pool);
+
+  std::thread thr([&]() {
+      for (uint32_t i = 0; i < num_objs; ++i)
+	pool_free(pool, objs[i]);
+    });
+  thr.join();
+
+  EXPECT_EQ(pool->allocs, pool->frees);
+}
+
+TEST_F(MemPool, LARGE_OBJECTS)
+{
+  pool_t *big = pool_basic_init("big pool", POOL_MAX_OBJECT_SIZE + 1);
+  unsigned char *p = (unsigned char *) pool_alloc(big);
+
+  EXPECT_EQ(p[POOL_MAX_OBJECT_SIZE], 0);
+  pool_free(big, p);
+  pool_destroy(big);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
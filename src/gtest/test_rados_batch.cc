@@ -0,0 +1,148 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "gtest/gtest.h"
+#include "rados_mock.h"
+
+extern "C" {
+#include <rados/librados.h>
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "recovery_rados.h"
+} /* extern "C" */
+
+namespace {
+
+  static constexpr uint32_t num_keys = 4096;
+  static char object[] = "test_recov";
+
+  /* Set, then for odd keys remove, the keys from first to first +
+   * count, as clients being confirmed and expired. */
+  void update_keys(uint32_t first, uint32_t count)
+  {
+    char key[32];
+    char val[64];
+
+    for (uint32_t i = first; i < first + count; ++i) {
+      sprintf(key, "%u", i);
+      sprintf(val, "192.168.0.1-(10:client%u)", i);
+      ASSERT_EQ(rados_kv_batch_put(key, val, object), 0);
+      if (i & 1)
+	ASSERT_EQ(rados_kv_batch_del(key, object), 0);
+    }
+  }
+
+  class RadosBatchLatency : public ::testing::Test {
+
+    virtual void SetUp() {
+      rados_mock::reset();
+      rados_mock::set_latency(500);
+      rados_kv_param.batch_delay_ms = 2;
+      rados_kv_param.batch_max_keys = 64;
+    }
+
+    virtual void TearDown() {
+      rados_kv_batch_drain();
+    }
+
+  protected:
+    void run(uint32_t nthreads) {
+      struct timespec s_time, e_time;
+      std::vector<std::thread> threads;
+      uint32_t per_thread = num_keys / nthreads;
+
+      rados_mock::reset();
+
+      now(&s_time);
+
+      for (uint32_t t = 0; t < nthreads; ++t)
+	threads.emplace_back(update_keys, t * per_thread, per_thread);
+      for (auto& thr : threads)
+	thr.join();
+
+      now(&e_time);
+
+      uint64_t dt = timespec_diff(&s_time, &e_time);
+      uint64_t updates = uint64_t(per_thread) * nthreads * 3 / 2;
+
+      fprintf(stderr, "%u threads: total run time: %" PRIu64
+	      " ns (%" PRIu64 " updates/s, %" PRIu64 " write ops)\n",
+	      nthreads, dt, uint64_t(updates / (double(dt) / 1000000000)),
+	      rados_mock::ops());
+
+      /* Only the even keys are left */
+      auto omap = rados_mock::omap(object);
+
+      ASSERT_EQ(omap.size(), per_thread * nthreads / 2);
+      for (auto& kv : omap)
+	ASSERT_EQ(std::stoul(kv.first) & 1, 0UL);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(RadosBatchLatency, UNBATCHED)
+{
+  rados_kv_param.batch_max_keys = 1;
+
+  run(16);
+  EXPECT_EQ(rados_mock::ops(), num_keys * 3 / 2);
+}
+
+TEST_F(RadosBatchLatency, BATCHED_SCALING)
+{
+  for (uint32_t nthreads = 1; nthreads <= 64; nthreads *= 4) {
+    run(nthreads);
+    /* A lone thread waits for each update, others share the writes */
+    if (nthreads > 1)
+      EXPECT_LT(rados_mock::ops(), num_keys);
+    else
+      EXPECT_LE(rados_mock::ops(), num_keys * 3 / 2);
+  }
+}
+
+TEST_F(RadosBatchLatency, TWO_OBJECTS)
+{
+  char other[] = "test_old";
+  char key[32];
+
+  std::thread thr(update_keys, 0, 256);
+
+  for (uint32_t i = 0; i < 256; ++i) {
+    sprintf(key, "%u", i);
+    ASSERT_EQ(rados_kv_batch_put(key, key, other), 0);
+  }
+
+  thr.join();
+
+  EXPECT_EQ(rados_mock::omap(object).size(), 128UL);
+  EXPECT_EQ(rados_mock::omap(other).size(), 256UL);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
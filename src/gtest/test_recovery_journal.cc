@@ -0,0 +1,192 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "nfs_core.h"
+#include "sal_functions.h"
+
+/* gperf headers */
+#include <gperftools/profiler.h>
+} /* extern "C" */
+
+namespace {
+
+  char* profile_out = nullptr;
+
+  static constexpr uint32_t num_clients = 20000;
+
+  struct fake_client {
+    nfs_client_record_t record;
+    nfs_client_id_t clientid;
+    char name[64];
+  };
+
+  uint32_t recovered;
+
+  clid_entry_t *count_clid_entry(char *name)
+  {
+    static clid_entry_t entry;
+
+    recovered++;
+    return &entry;
+  }
+
+  rdel_fh_t *count_rfh_entry(clid_entry_t *entry, char *handle)
+  {
+    return nullptr;
+  }
+
+  /* Add the clients from first to first + count, as a reclaim storm
+   * after a restart does. */
+  void add_clients(struct nfs4_recovery_backend *backend,
+		   std::vector<fake_client> *clients,
+		   uint32_t first, uint32_t count)
+  {
+    for (uint32_t i = first; i < first + count; ++i)
+      backend->add_clid(&(*clients)[i].clientid);
+  }
+
+  class RecoveryJournalLatency : public ::testing::Test {
+
+    virtual void SetUp() {
+      ASSERT_NE(mkdtemp(dir), nullptr);
+      nfs_param.nfsv4_param.recovery_journal_dir = dir;
+      nfs_param.nfsv4_param.recovery_journal_compact = 65536;
+      nfs_param.core_param.clustered = false;
+
+      clients.resize(num_clients);
+      for (uint32_t i = 0; i < num_clients; ++i) {
+	fake_client &fc = clients[i];
+
+	fc.record.cr_client_val_len =
+	  sprintf(fc.name, "Linux NFSv4.1 client%u.localdomain", i);
+	fc.record.cr_client_val = fc.name;
+	fc.clientid.cid_client_record = &fc.record;
+	fc.clientid.cid_clientid = i + 1;
+      }
+
+      journal_backend_init(&backend);
+      ASSERT_EQ(backend->recovery_init(), 0);
+    }
+
+    virtual void TearDown() {
+      backend->recovery_shutdown();
+
+      for (auto& fc : clients) {
+	gsh_free(fc.clientid.cid_recov_tag);
+	fc.clientid.cid_recov_tag = nullptr;
+      }
+
+      std::string cmd = std::string("rm -rf ") + dir;
+      ASSERT_EQ(system(cmd.c_str()), 0);
+    }
+
+  protected:
+    char dir[32] = "/tmp/test_recovery_XXXXXX";
+    struct nfs4_recovery_backend *backend;
+    std::vector<fake_client> clients;
+
+    void run(uint32_t nthreads) {
+      struct timespec s_time, e_time;
+      std::vector<std::thread> threads;
+      uint32_t per_thread = num_clients / nthreads;
+
+      now(&s_time);
+
+      for (uint32_t t = 0; t < nthreads; ++t)
+	threads.emplace_back(add_clients, backend, &clients,
+			     t * per_thread, per_thread);
+      for (auto& thr : threads)
+	thr.join();
+
+      now(&e_time);
+
+      uint64_t dt = timespec_diff(&s_time, &e_time);
+      uint64_t clients_s = (uint64_t(per_thread) * nthreads) /
+	(double(dt) / 1000000000);
+
+      fprintf(stderr, "%u threads: total run time: %" PRIu64
+	      " ns (%" PRIu64 " clients/s)\n", nthreads, dt, clients_s);
+    }
+
+    void restart() {
+      backend->recovery_shutdown();
+      for (auto& fc : clients) {
+	gsh_free(fc.clientid.cid_recov_tag);
+	fc.clientid.cid_recov_tag = nullptr;
+      }
+      ASSERT_EQ(backend->recovery_init(), 0);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(RecoveryJournalLatency, RECLAIM_1)
+{
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  run(1);
+
+  if (profile_out)
+    ProfilerStop();
+}
+
+TEST_F(RecoveryJournalLatency, RECLAIM_SCALING)
+{
+  for (uint32_t nthreads = 2; nthreads <= 16; nthreads *= 2) {
+    run(nthreads);
+    restart();
+  }
+}
+
+TEST_F(RecoveryJournalLatency, REPLAY)
+{
+  struct timespec s_time, e_time;
+
+  run(8);
+  backend->end_grace();
+  restart();
+
+  recovered = 0;
+
+  now(&s_time);
+  backend->recovery_read_clids(nullptr, count_clid_entry, count_rfh_entry);
+  now(&e_time);
+
+  ASSERT_EQ(recovered, num_clients);
+
+  fprintf(stderr, "Replay of %u clients: %" PRIu64 " ns\n",
+	  recovered, timespec_diff(&s_time, &e_time));
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
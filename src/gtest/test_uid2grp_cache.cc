@@ -0,0 +1,199 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <pwd.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include <urcu-bp.h>
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "uid2grp.h"
+} /* extern "C" */
+
+namespace {
+
+  static constexpr uid_t first_uid = 100000;
+  static constexpr uint32_t num_ids = 10000;
+  static constexpr uint32_t num_lookups = 1000000;
+
+  /* Group data as uid2grp_allocate_by_uid() would build it, without
+   * asking the directory. */
+  struct group_data *fake_gdata(uid_t uid, const char *name, time_t epoch)
+  {
+    size_t len = strlen(name);
+    struct group_data *gdata = (struct group_data *)
+      gsh_calloc(1, sizeof(struct group_data) + len);
+
+    gdata->uid = uid;
+    gdata->gid = uid;
+    gdata->uname.addr = (char *)gdata + sizeof(struct group_data);
+    gdata->uname.len = len;
+    memcpy(gdata->uname.addr, name, len);
+    gdata->epoch = epoch;
+    gdata->nbgroups = 1;
+    gdata->groups = (gid_t *) gsh_malloc(sizeof(gid_t));
+    gdata->groups[0] = uid;
+
+    return gdata;
+  }
+
+  void lookup_uids(uint32_t seed, uint32_t count)
+  {
+    struct group_data *gdata;
+
+    for (uint32_t i = 0; i < count; ++i) {
+      uid_t uid = first_uid + (seed + i) % num_ids;
+
+      ASSERT_TRUE(uid2grp(uid, &gdata));
+      ASSERT_EQ(gdata->uid, uid);
+      uid2grp_unref(gdata);
+    }
+  }
+
+  class Uid2grpCache : public ::testing::Test {
+
+    static void SetUpTestCase() {
+      ASSERT_EQ(general_fridge_init(), 0);
+    }
+
+    static void TearDownTestCase() {
+      (void) general_fridge_shutdown();
+    }
+
+    virtual void SetUp() {
+      char name[64];
+
+      nfs_param.core_param.manage_gids_expiration = 3600;
+      uid2grp_cache_init();
+
+      for (uint32_t i = 0; i < num_ids; ++i) {
+	sprintf(name, "user%u", first_uid + i);
+	uid2grp_add_user(fake_gdata(first_uid + i, name, time(NULL)));
+      }
+    }
+
+    virtual void TearDown() {
+      uid2grp_clear_cache();
+    }
+
+  protected:
+    void run(uint32_t nthreads) {
+      struct timespec s_time, e_time;
+      std::vector<std::thread> threads;
+
+      now(&s_time);
+
+      for (uint32_t t = 0; t < nthreads; ++t)
+	threads.emplace_back(lookup_uids, t * 7919, num_lookups);
+      for (auto& thr : threads)
+	thr.join();
+
+      now(&e_time);
+
+      uint64_t dt = timespec_diff(&s_time, &e_time);
+      uint64_t reqs_s = (1ULL * num_lookups * nthreads) /
+	(double(dt) / 1000000000);
+
+      fprintf(stderr, "%u threads: total run time: %" PRIu64
+	      " ns (%" PRIu64 " lookups/s)\n", nthreads, dt, reqs_s);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(Uid2grpCache, LOOKUP_SCALING)
+{
+  for (uint32_t nthreads = 1; nthreads <= 16; nthreads *= 2)
+    run(nthreads);
+}
+
+TEST_F(Uid2grpCache, STALE_WHILE_REFRESH)
+{
+  struct group_data *stale, *gdata;
+  struct passwd *pw = getpwuid(0);
+  uint64_t stale_hits = uid2grp_cache_st.stale_hits;
+  uint64_t refreshes = uid2grp_cache_st.refreshes;
+
+  ASSERT_NE(pw, nullptr);
+
+  /* An entry for root, well past its expiry */
+  stale = fake_gdata(0, pw->pw_name, time(NULL) - 7200);
+  uid2grp_add_user(stale);
+
+  /* The expired groups are returned right away */
+  ASSERT_TRUE(uid2grp(0, &gdata));
+  EXPECT_EQ(gdata, stale);
+  EXPECT_EQ(uid2grp_cache_st.stale_hits, stale_hits + 1);
+  uid2grp_unref(gdata);
+
+  /* And replaced once the background refresh is done */
+  for (int i = 0; i < 500; ++i) {
+    if (atomic_fetch_uint64_t(&uid2grp_cache_st.refreshes) != refreshes)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(uid2grp_cache_st.refreshes, refreshes + 1);
+
+  ASSERT_TRUE(uid2grp(0, &gdata));
+  EXPECT_NE(gdata, stale);
+  EXPECT_EQ(gdata->uid, 0);
+  EXPECT_GE(gdata->epoch, time(NULL) - 60);
+  uid2grp_unref(gdata);
+
+  fprintf(stderr, "refresh took %" PRIu64 " ns\n",
+	  uid2grp_cache_st.refresh_max_ns);
+}
+
+TEST_F(Uid2grpCache, NAME2GRP)
+{
+  char name[64];
+  struct gsh_buffdesc desc;
+  struct group_data *gdata;
+  struct timespec s_time, e_time;
+
+  desc.addr = name;
+
+  now(&s_time);
+
+  for (uint32_t i = 0; i < num_lookups; ++i) {
+    desc.len = sprintf(name, "user%u", first_uid + i % num_ids);
+    ASSERT_TRUE(name2grp(&desc, &gdata));
+    ASSERT_EQ(gdata->uid, first_uid + i % num_ids);
+    uid2grp_unref(gdata);
+  }
+
+  now(&e_time);
+
+  fprintf(stderr, "Average time per name2grp: %" PRIu64 " ns\n",
+	  timespec_diff(&s_time, &e_time) / num_lookups);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
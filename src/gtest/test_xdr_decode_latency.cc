@@ -0,0 +1,318 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "nfs_core.h"
+#include "nfs23.h"
+#include "nfsv41.h"
+} /* extern "C" */
+
+namespace {
+
+  static constexpr uint32_t num_decodes = 1000000;
+  static constexpr uint32_t buf_size = 4096;
+
+  /* The decoders as they were before the fast paths: every field goes
+   * through the stream, and handles are allocated. */
+
+  bool generic_READ3args(XDR *xdrs, READ3args *objp)
+  {
+    return xdr_bytes(xdrs, (char **)&objp->file.data.data_val,
+		     &objp->file.data.data_len, NFS3_FHSIZE) &&
+      xdr_u_longlong_t(xdrs, &objp->offset) &&
+      xdr_u_int32_t(xdrs, &objp->count);
+  }
+
+  bool generic_PUTFH4args(XDR *xdrs, PUTFH4args *objp)
+  {
+    return xdr_bytes(xdrs, (char **)&objp->object.nfs_fh4_val,
+		     &objp->object.nfs_fh4_len, NFS4_FHSIZE);
+  }
+
+  bool generic_READ4args(XDR *xdrs, READ4args *objp)
+  {
+    return xdr_u_int32_t(xdrs, &objp->stateid.seqid) &&
+      xdr_opaque(xdrs, objp->stateid.other, 12) &&
+      xdr_u_int64_t(xdrs, &objp->offset) &&
+      xdr_u_int32_t(xdrs, &objp->count);
+  }
+
+  bool generic_SEQUENCE4args(XDR *xdrs, SEQUENCE4args *objp)
+  {
+    return xdr_opaque(xdrs, objp->sa_sessionid, NFS4_SESSIONID_SIZE) &&
+      xdr_u_int32_t(xdrs, &objp->sa_sequenceid) &&
+      xdr_u_int32_t(xdrs, &objp->sa_slotid) &&
+      xdr_u_int32_t(xdrs, &objp->sa_highest_slotid) &&
+      xdr_bool(xdrs, &objp->sa_cachethis);
+  }
+
+  bool generic_fattr3(XDR *xdrs, fattr3 *objp)
+  {
+    return xdr_enum(xdrs, (enum_t *)&objp->type) &&
+      xdr_u_int32_t(xdrs, &objp->mode) &&
+      xdr_u_int32_t(xdrs, &objp->nlink) &&
+      xdr_u_int32_t(xdrs, &objp->uid) &&
+      xdr_u_int32_t(xdrs, &objp->gid) &&
+      xdr_u_longlong_t(xdrs, &objp->size) &&
+      xdr_u_longlong_t(xdrs, &objp->used) &&
+      xdr_u_int32_t(xdrs, &objp->rdev.specdata1) &&
+      xdr_u_int32_t(xdrs, &objp->rdev.specdata2) &&
+      xdr_u_longlong_t(xdrs, &objp->fsid) &&
+      xdr_u_longlong_t(xdrs, &objp->fileid) &&
+      xdr_u_int32_t(xdrs, &objp->atime.tv_sec) &&
+      xdr_u_int32_t(xdrs, &objp->atime.tv_nsec) &&
+      xdr_u_int32_t(xdrs, &objp->mtime.tv_sec) &&
+      xdr_u_int32_t(xdrs, &objp->mtime.tv_nsec) &&
+      xdr_u_int32_t(xdrs, &objp->ctime.tv_sec) &&
+      xdr_u_int32_t(xdrs, &objp->ctime.tv_nsec);
+  }
+
+  class XdrDecodeLatency : public ::testing::Test {
+
+    virtual void SetUp() {
+      for (uint32_t i = 0; i < sizeof(fh); ++i)
+	fh[i] = i * 7 + 1;
+      memset(&read3, 0, sizeof(read3));
+      read3.file.data.data_len = 36;
+      read3.file.data.data_val = fh;
+      read3.offset = 0x123456789abcULL;
+      read3.count = 1048576;
+
+      memset(&putfh4, 0, sizeof(putfh4));
+      putfh4.object.nfs_fh4_len = 42;
+      putfh4.object.nfs_fh4_val = fh;
+
+      memset(&read4, 0, sizeof(read4));
+      read4.stateid.seqid = 3;
+      memcpy(read4.stateid.other, fh, sizeof(read4.stateid.other));
+      read4.offset = 0xfedcba987654ULL;
+      read4.count = 65536;
+
+      memset(&seq4, 0, sizeof(seq4));
+      memcpy(seq4.sa_sessionid, fh + 16, NFS4_SESSIONID_SIZE);
+      seq4.sa_sequenceid = 77;
+      seq4.sa_slotid = 5;
+      seq4.sa_highest_slotid = 63;
+      seq4.sa_cachethis = true;
+    }
+
+  protected:
+    /* Encode an object, returning its length in buf */
+    u_int encode(xdrproc_t proc, void *objp) {
+      XDR xdrs;
+
+      xdrmem_create(&xdrs, buf, buf_size, XDR_ENCODE);
+      EXPECT_TRUE(proc(&xdrs, objp));
+      return xdr_getpos(&xdrs);
+    }
+
+    /* Decode the object in buf num_decodes times, returning the
+     * average time per decode in ns.  Each decode is freed except the
+     * last, left in objp for the caller to check and free. */
+    uint64_t decode(xdrproc_t proc, void *objp, size_t size, u_int len) {
+      struct timespec s_time, e_time;
+      XDR xdrs;
+
+      now(&s_time);
+
+      for (uint32_t i = 0; i < num_decodes; ++i) {
+	memset(objp, 0, size);
+	xdrmem_create(&xdrs, buf, len, XDR_DECODE);
+	if (!proc(&xdrs, objp)) {
+	  ADD_FAILURE() << "decode failed";
+	  break;
+	}
+	if (i + 1 < num_decodes)
+	  xdr_free(proc, objp);
+      }
+
+      now(&e_time);
+
+      return timespec_diff(&s_time, &e_time) / num_decodes;
+    }
+
+    void report(const char *what, uint64_t fast, uint64_t generic) {
+      fprintf(stderr, "%s: %" PRIu64 " ns fast, %" PRIu64
+	      " ns generic per decode\n", what, fast, generic);
+    }
+
+    char buf[buf_size];
+    char fh[NFS4_FHSIZE];
+    READ3args read3;
+    PUTFH4args putfh4;
+    READ4args read4;
+    SEQUENCE4args seq4;
+  };
+
+} /* namespace */
+
+TEST_F(XdrDecodeLatency, READ3ARGS)
+{
+  READ3args fast, generic;
+  u_int len = encode((xdrproc_t) xdr_READ3args, &read3);
+  uint64_t t_fast, t_generic;
+
+  t_fast = decode((xdrproc_t) xdr_READ3args, &fast, sizeof(fast), len);
+  t_generic = decode((xdrproc_t) generic_READ3args, &generic,
+		     sizeof(generic), len);
+  report("READ3args", t_fast, t_generic);
+
+  /* The handle is decoded into the inline storage */
+  EXPECT_EQ(fast.file.data.data_val, fast.file.data_buf);
+  ASSERT_EQ(fast.file.data.data_len, generic.file.data.data_len);
+  EXPECT_EQ(memcmp(fast.file.data.data_val, generic.file.data.data_val,
+		   fast.file.data.data_len), 0);
+  EXPECT_EQ(fast.offset, generic.offset);
+  EXPECT_EQ(fast.count, generic.count);
+
+  xdr_free((xdrproc_t) xdr_READ3args, &fast);
+  EXPECT_EQ(fast.file.data.data_val, nullptr);
+  xdr_free((xdrproc_t) generic_READ3args, &generic);
+}
+
+TEST_F(XdrDecodeLatency, PUTFH4_READ4)
+{
+  PUTFH4args fh_fast, fh_generic;
+  READ4args rd_fast, rd_generic;
+  u_int len;
+
+  len = encode((xdrproc_t) xdr_PUTFH4args, &putfh4);
+  report("PUTFH4args",
+	 decode((xdrproc_t) xdr_PUTFH4args, &fh_fast, sizeof(fh_fast), len),
+	 decode((xdrproc_t) generic_PUTFH4args, &fh_generic,
+		sizeof(fh_generic), len));
+
+  EXPECT_EQ(fh_fast.object.nfs_fh4_val, fh_fast.object_buf);
+  ASSERT_EQ(fh_fast.object.nfs_fh4_len, fh_generic.object.nfs_fh4_len);
+  EXPECT_EQ(memcmp(fh_fast.object.nfs_fh4_val, fh_generic.object.nfs_fh4_val,
+		   fh_fast.object.nfs_fh4_len), 0);
+  xdr_free((xdrproc_t) xdr_PUTFH4args, &fh_fast);
+  xdr_free((xdrproc_t) generic_PUTFH4args, &fh_generic);
+
+  len = encode((xdrproc_t) xdr_READ4args, &read4);
+  report("READ4args",
+	 decode((xdrproc_t) xdr_READ4args, &rd_fast, sizeof(rd_fast), len),
+	 decode((xdrproc_t) generic_READ4args, &rd_generic,
+		sizeof(rd_generic), len));
+
+  EXPECT_EQ(rd_fast.stateid.seqid, rd_generic.stateid.seqid);
+  EXPECT_EQ(memcmp(rd_fast.stateid.other, rd_generic.stateid.other,
+		   sizeof(rd_fast.stateid.other)), 0);
+  EXPECT_EQ(rd_fast.offset, rd_generic.offset);
+  EXPECT_EQ(rd_fast.count, rd_generic.count);
+}
+
+TEST_F(XdrDecodeLatency, SEQUENCE4ARGS)
+{
+  SEQUENCE4args fast, generic;
+  u_int len = encode((xdrproc_t) xdr_SEQUENCE4args, &seq4);
+
+  report("SEQUENCE4args",
+	 decode((xdrproc_t) xdr_SEQUENCE4args, &fast, sizeof(fast), len),
+	 decode((xdrproc_t) generic_SEQUENCE4args, &generic,
+		sizeof(generic), len));
+
+  EXPECT_EQ(memcmp(fast.sa_sessionid, generic.sa_sessionid,
+		   NFS4_SESSIONID_SIZE), 0);
+  EXPECT_EQ(fast.sa_sequenceid, generic.sa_sequenceid);
+  EXPECT_EQ(fast.sa_slotid, generic.sa_slotid);
+  EXPECT_EQ(fast.sa_highest_slotid, generic.sa_highest_slotid);
+  EXPECT_EQ(fast.sa_cachethis, generic.sa_cachethis);
+}
+
+TEST_F(XdrDecodeLatency, FATTR3_ENCODE)
+{
+  fattr3 attr;
+  char generic_buf[buf_size];
+  struct timespec s_time, e_time;
+  u_int len, generic_len;
+  uint64_t t_fast, t_generic;
+  XDR xdrs;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = NF3REG;
+  attr.mode = 0644;
+  attr.nlink = 1;
+  attr.uid = 1000;
+  attr.gid = 100;
+  attr.size = 0x1234567890ULL;
+  attr.used = 0x1234568000ULL;
+  attr.fsid = 0xabcdef;
+  attr.fileid = 0x1122334455667788ULL;
+  attr.mtime.tv_sec = 1500000000;
+  attr.mtime.tv_nsec = 999999999;
+
+  now(&s_time);
+  for (uint32_t i = 0; i < num_decodes; ++i) {
+    xdrmem_create(&xdrs, buf, buf_size, XDR_ENCODE);
+    ASSERT_TRUE(xdr_fattr3(&xdrs, &attr));
+  }
+  now(&e_time);
+  len = xdr_getpos(&xdrs);
+  t_fast = timespec_diff(&s_time, &e_time) / num_decodes;
+
+  now(&s_time);
+  for (uint32_t i = 0; i < num_decodes; ++i) {
+    xdrmem_create(&xdrs, generic_buf, buf_size, XDR_ENCODE);
+    ASSERT_TRUE(generic_fattr3(&xdrs, &attr));
+  }
+  now(&e_time);
+  generic_len = xdr_getpos(&xdrs);
+  t_generic = timespec_diff(&s_time, &e_time) / num_decodes;
+
+  fprintf(stderr, "fattr3: %" PRIu64 " ns fast, %" PRIu64
+	  " ns generic per encode\n", t_fast, t_generic);
+
+  ASSERT_EQ(len, generic_len);
+  EXPECT_EQ(memcmp(buf, generic_buf, len), 0);
+}
+
+TEST_F(XdrDecodeLatency, SHORT_AND_OVERSIZED)
+{
+  READ3args args;
+  u_int len = encode((xdrproc_t) xdr_READ3args, &read3);
+  XDR xdrs;
+
+  /* Every truncation fails cleanly */
+  for (u_int cut = 0; cut < len; ++cut) {
+    memset(&args, 0, sizeof(args));
+    xdrmem_create(&xdrs, buf, cut, XDR_DECODE);
+    EXPECT_FALSE(xdr_READ3args(&xdrs, &args));
+    xdr_free((xdrproc_t) xdr_READ3args, &args);
+  }
+
+  /* A handle longer than NFS3_FHSIZE is refused */
+  buf[0] = buf[1] = buf[2] = 0;
+  buf[3] = NFS3_FHSIZE + 4;
+  memset(&args, 0, sizeof(args));
+  xdrmem_create(&xdrs, buf, buf_size, XDR_DECODE);
+  EXPECT_FALSE(xdr_READ3args(&xdrs, &args));
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -49,10 +49,12 @@
 #ifdef _MSPAC_SUPPORT
 #include <wbclient.h>
 #endif
+#include <urcu-bp.h>
 #include "common_utils.h"
 #include "gsh_rpc.h"
 #include "nfs_core.h"
 #include "idmapper.h"
+#include "delayed_exec.h"
 
 static struct gsh_buffdesc owner_domain;
 
@@ -90,6 +92,171 @@ bool idmapper_init(void)
 	return true;
 }
 
+/**
+ * @brief Build "name@domain" in the caller's buffer
+ *
+ * @param[in]  name   The bare account name
+ * @param[out] buf    Buffer, at least strlen(name) + owner_domain.len + 2
+ * @param[out] result Descriptor for the result
+ */
+
+static void qualify_name(const char *name, char *buf,
+			 struct gsh_buffdesc *result)
+{
+	size_t len = strlen(name);
+
+	memcpy(buf, name, len);
+	buf[len++] = '@';
+	memcpy(buf + len, owner_domain.addr, owner_domain.len);
+	result->addr = buf;
+	result->len = len + owner_domain.len;
+}
+
+/**
+ * @brief Grow the buffers of the preload after ERANGE
+ *
+ * Just like getgrnam_r, give up past 64MB in case the database keeps
+ * returning ERANGE.
+ *
+ * @param[in,out] buf     Entry buffer
+ * @param[in,out] namebuf Qualified name buffer
+ * @param[in,out] size    Size of @c buf
+ *
+ * @return false if the buffer would be too large.
+ */
+
+static bool idmapper_preload_grow(char **buf, char **namebuf, long *size)
+{
+	if (*size * 2 > 64 * 1024 * 1024)
+		return false;
+
+	*size *= 2;
+	*buf = gsh_realloc(*buf, *size);
+	*namebuf = gsh_realloc(*namebuf, *size + owner_domain.len + 2);
+
+	return true;
+}
+
+/**
+ * @brief Fill the cache from the passwd and group databases
+ *
+ * Runs once on the delayed executor so that the first GETATTR or
+ * READDIR of a large tree doesn't pay for a getpwuid_r per owner.
+ * Entries found this way are ordinary cache entries and expire and
+ * refresh like any other.
+ *
+ * @param[in] arg Unused
+ */
+
+static void idmapper_preload(void *arg)
+{
+	long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+	char *buf, *namebuf;
+	struct passwd p, *pres;
+	struct group g, *gres;
+	struct gsh_buffdesc name;
+	uint64_t users = 0, groups = 0;
+	struct timespec s_time, e_time;
+	int rc;
+
+	if (sysconf(_SC_GETGR_R_SIZE_MAX) > size)
+		size = sysconf(_SC_GETGR_R_SIZE_MAX);
+	if (size <= 0)
+		size = PWENT_BEST_GUESS_LEN;
+
+	/* getgrent_r may need much more room for large member lists */
+	size *= 16;
+	buf = gsh_malloc(size);
+	namebuf = gsh_malloc(size + owner_domain.len + 2);
+
+	now(&s_time);
+
+	setpwent();
+	for (;;) {
+		rc = getpwent_r(&p, buf, size, &pres);
+
+		/* The same entry is returned again with a larger buffer */
+		if (rc == ERANGE && idmapper_preload_grow(&buf, &namebuf,
+							  &size))
+			continue;
+
+		if (rc != 0 || pres == NULL) {
+			if (rc != 0 && rc != ENOENT)
+				LogWarn(COMPONENT_IDMAPPER,
+					"Preloading users stopped: %s",
+					strerror(rc));
+			break;
+		}
+
+		qualify_name(pres->pw_name, namebuf, &name);
+		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
+		(void) idmapper_add_user(&name, pres->pw_uid, &pres->pw_gid,
+					 IDMAP_BY_NAME | IDMAP_BY_ID);
+		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+		users++;
+	}
+	endpwent();
+
+	setgrent();
+	for (;;) {
+		rc = getgrent_r(&g, buf, size, &gres);
+
+		if (rc == ERANGE && idmapper_preload_grow(&buf, &namebuf,
+							  &size))
+			continue;
+
+		if (rc != 0 || gres == NULL) {
+			if (rc != 0 && rc != ENOENT)
+				LogWarn(COMPONENT_IDMAPPER,
+					"Preloading groups stopped: %s",
+					strerror(rc));
+			break;
+		}
+
+		qualify_name(gres->gr_name, namebuf, &name);
+		PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
+		(void) idmapper_add_group(&name, gres->gr_gid,
+					  IDMAP_BY_NAME | IDMAP_BY_ID);
+		PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
+		groups++;
+	}
+	endgrent();
+
+	now(&e_time);
+
+	(void) atomic_add_uint64_t(&idmapper_cache_st.preloaded,
+				   users + groups);
+
+	gsh_free(namebuf);
+	gsh_free(buf);
+
+	LogEvent(COMPONENT_IDMAPPER,
+		 "Preloaded %"PRIu64" users and %"PRIu64" groups in %"
+		 PRIu64" ms",
+		 users, groups, timespec_diff(&s_time, &e_time) / NS_PER_MSEC);
+}
+
+/**
+ * @brief Schedule the bulk preload of the cache, if configured
+ *
+ * Must be called after the delayed executor is started.
+ */
+
+void idmapper_start_preload(void)
+{
+	if (!nfs_param.nfsv4_param.idmap_preload ||
+	    nfs_param.nfsv4_param.only_numeric_owners)
+		return;
+
+	if (!nfs_param.nfsv4_param.use_getpwnam) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Idmap_Preload requires UseGetpwnam, not preloading");
+		return;
+	}
+
+	(void) delayed_submit(idmapper_preload, NULL, 0);
+}
+
 /**
  * @brief Encode a UID or GID as a string
  *
@@ -120,8 +287,7 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 					&not_a_size_t, UINT32_MAX);
 	}
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
+	rcu_read_lock();
 	if (group)
 		success = idmapper_lookup_by_gid(id, &found);
 	else
@@ -135,17 +301,16 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 		success =
 		    inline_xdr_bytes(xdrs, (char **)&found->addr, &not_a_size_t,
 				     UINT32_MAX);
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+		rcu_read_unlock();
 		return success;
 	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+		rcu_read_unlock();
 		int rc;
 		int size;
 		bool looked_up = false;
 		char *namebuff = NULL;
 		struct gsh_buffdesc new_name;
+		uint32_t flags = IDMAP_BY_NAME | IDMAP_BY_ID;
 
 		if (nfs_param.nfsv4_param.use_getpwnam) {
 			if (group)
@@ -225,6 +390,10 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 		}
 
 		if (!looked_up) {
+			/* The fallback name is shared by every id that
+			 * fails, so only cache it by id, and not for long.
+			 */
+			flags = IDMAP_BY_ID | IDMAP_NEGATIVE;
 			if (nfs_param.nfsv4_param.allow_numeric_owners) {
 				LogInfo(COMPONENT_IDMAPPER,
 					"Lookup for %d failed, using numeric %s",
@@ -245,9 +414,9 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
 		if (group)
-			success = idmapper_add_group(&new_name, id);
+			success = idmapper_add_group(&new_name, id, flags);
 		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
+			success = idmapper_add_user(&new_name, id, NULL, flags);
 
 		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
@@ -262,6 +431,102 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 	}
 }
 
+/**
+ * @brief Number of slots in the per-thread encoded owner cache
+ *
+ * Must be a power of two.  Most directories have only a handful of
+ * distinct owners and groups.
+ */
+
+#define ENCODED_OWNER_SLOTS 32
+
+/**
+ * @brief Longest XDR encoding (length word and padded string) kept in
+ *        the per-thread cache; longer names are encoded every time.
+ */
+
+#define ENCODED_OWNER_MAXLEN 124
+
+/**
+ * @brief An owner or group string, already XDR encoded
+ */
+
+struct encoded_owner {
+	uint64_t generation;	/*< idmapper_generation when encoded */
+	time_t epoch;		/*< When it was encoded */
+	uint32_t id;		/*< UID or GID */
+	bool group;		/*< True if id is a GID */
+	uint32_t len;		/*< Length of xdr, 0 if slot is empty */
+	char xdr[ENCODED_OWNER_MAXLEN];	/*< Length word and string */
+};
+
+/**
+ * @brief Per-thread cache of encoded owners and groups
+ *
+ * Encoding attributes for a READDIR reply asks for the same few owners
+ * over and over; a hit here is a single memcpy into the stream with no
+ * locking or shared cache lines at all.
+ */
+
+static __thread struct encoded_owner encoded_owners[ENCODED_OWNER_SLOTS];
+
+/**
+ * @brief Encode a UID or GID, through the per-thread cache
+ *
+ * A slot is reused only if nothing in the idmapper cache has been
+ * removed or replaced since it was filled and it is younger than the
+ * shortest idmapper cache lifetime, so expired mappings still get
+ * looked up again in due course.
+ *
+ * @param[in,out] xdrs  XDR stream to which to encode
+ * @param[in]     id    UID or GID
+ * @param[in]     group True if this is a GID, false for a UID
+ *
+ * @retval true on success.
+ * @retval false on failure.
+ */
+
+static bool xdr_encode_nfs4_princ_cached(XDR *xdrs, uint32_t id, bool group)
+{
+	struct encoded_owner *slot =
+		&encoded_owners[(id * 2 + group) & (ENCODED_OWNER_SLOTS - 1)];
+	uint64_t generation = atomic_fetch_uint64_t(&idmapper_generation);
+	time_t lifetime = MIN(nfs_param.core_param.manage_gids_expiration,
+			      nfs_param.nfsv4_param.idmap_negative_expiration);
+	time_t now_time = time(NULL);
+	XDR slot_xdrs;
+	void *dest;
+
+	if (slot->len == 0 || slot->id != id || slot->group != group ||
+	    slot->generation != generation ||
+	    now_time - slot->epoch > lifetime) {
+		/* Fill the slot.  Read the generation before looking up
+		 * so that a concurrent change makes the slot stale.
+		 */
+		slot->len = 0;
+		xdrmem_create(&slot_xdrs, slot->xdr, sizeof(slot->xdr),
+			      XDR_ENCODE);
+		if (!xdr_encode_nfs4_princ(&slot_xdrs, id, group)) {
+			/* Probably too long to cache */
+			xdr_destroy(&slot_xdrs);
+			return xdr_encode_nfs4_princ(xdrs, id, group);
+		}
+		slot->len = xdr_getpos(&slot_xdrs);
+		xdr_destroy(&slot_xdrs);
+		slot->id = id;
+		slot->group = group;
+		slot->generation = generation;
+		slot->epoch = now_time;
+	}
+
+	dest = xdr_inline_encode(xdrs, slot->len);
+	if (dest == NULL)
+		return false;
+
+	memcpy(dest, slot->xdr, slot->len);
+	return true;
+}
+
 /**
  * @brief Encode a UID as a string
  *
@@ -274,7 +539,7 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 
 bool xdr_encode_nfs4_owner(XDR *xdrs, uid_t uid)
 {
-	return xdr_encode_nfs4_princ(xdrs, uid, false);
+	return xdr_encode_nfs4_princ_cached(xdrs, uid, false);
 }
 
 /**
@@ -289,7 +554,7 @@ bool xdr_encode_nfs4_owner(XDR *xdrs, uid_t uid)
 
 bool xdr_encode_nfs4_group(XDR *xdrs, gid_t gid)
 {
-	return xdr_encode_nfs4_princ(xdrs, gid, true);
+	return xdr_encode_nfs4_princ_cached(xdrs, gid, true);
 }
 
 /**
@@ -522,14 +787,12 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 {
 	bool success;
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
+	rcu_read_lock();
 	if (group)
 		success = idmapper_lookup_by_gname(name, id);
 	else
-		success = idmapper_lookup_by_uname(name, id, NULL, false);
-	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
+		success = idmapper_lookup_by_uname(name, id, NULL);
+	rcu_read_unlock();
 
 	if (success)
 		return true;
@@ -540,6 +803,7 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		char *namebuff = alloca(name->len + 1);
 		char *at;
 		bool looked_up = false;
+		uint32_t flags = IDMAP_BY_NAME | IDMAP_BY_ID;
 
 		memcpy(namebuff, name->addr, name->len);
 		*(namebuff + name->len) = '\0';
@@ -569,16 +833,18 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 				"All lookups failed for %s, using anonymous.",
 				namebuff);
 			*id = anon;
+			/* Don't map the anonymous id back to this name */
+			flags = IDMAP_BY_NAME | IDMAP_NEGATIVE;
 		}
 
 		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
 		if (group)
-			success = idmapper_add_group(name, *id);
+			success = idmapper_add_group(name, *id, flags);
 		else
 			success =
 			    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
-					      false);
+					      flags);
 
 		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
@@ -661,9 +927,9 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		return false;
 
 #ifdef USE_NFSIDMAP
-	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
+	rcu_read_lock();
 	success =
-	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true);
+	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres);
 
 	/* We do need uid and gid. If gid is not in the cache, treat it as a
 	 * failure.
@@ -672,7 +938,7 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		gss_gid = *gss_gidres;
 	else
 		success = false;
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+	rcu_read_unlock();
 	if (unlikely(!success)) {
 		if ((princbuff.len >= 4)
 		    && (!memcmp(princbuff.addr, "nfs/", 4)
@@ -772,7 +1038,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 
 		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
 		success =
-		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true);
+		    idmapper_add_user(&princbuff, gss_uid, &gss_gid,
+				      IDMAP_BY_NAME);
 		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 
 		if (!success) {
@@ -37,13 +37,27 @@
 #include <string.h>
 #include <pwd.h>
 #include <grp.h>
+#include <urcu-bp.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
 #include "common_utils.h"
-#include "avltree.h"
+#include "city.h"
 #include "idmapper.h"
 #include "nfs_core.h"
 #include "abstract_atomic.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/**
+ * The cache is made of four hash indexes (user name, UID, group name
+ * and GID).  Each bucket is a singly linked chain published with
+ * rcu_assign_pointer, so lookups only need rcu_read_lock and never
+ * contend with each other.  Writers serialize on idmapper_user_lock
+ * or idmapper_group_lock, and unlinked entries are freed after a
+ * grace period with call_rcu.
+ */
 
 /**
  * @brief User entry in the IDMapper cache
@@ -54,15 +68,15 @@ struct cache_user {
 	uid_t uid;		/*< Corresponding UID */
 	gid_t gid;		/*< Corresponding GID */
 	bool gid_set;		/*< if the GID has been set */
-	struct avltree_node uname_node;	/*< Node in the name tree */
-	struct avltree_node uid_node;	/*< Node in the UID tree */
-	bool in_uidtree;		/* true iff this is in uid_tree */
+	bool in_uname_hash;	/*< true iff this is in uname_hash */
+	bool in_uid_hash;	/*< true iff this is in uid_hash */
+	bool negative;		/*< Fallback mapping after a failed lookup */
+	struct cache_user *uname_next;	/*< Next in the name chain */
+	struct cache_user *uid_next;	/*< Next in the UID chain */
 	time_t epoch;
+	struct rcu_head rcu;	/*< For deferred free */
 };
 
-#define user_expired(user) (time(NULL) - (user)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
-
 /**
  * @brief Group entry in the IDMapper cache
  */
@@ -70,208 +84,220 @@ struct cache_user {
 struct cache_group {
 	struct gsh_buffdesc gname;	/*< Group name */
 	gid_t gid;		/*< Group ID */
-	struct avltree_node gname_node;	/*< Node in the name tree */
-	struct avltree_node gid_node;	/*< Node in the GID tree */
+	bool in_gname_hash;	/*< true iff this is in gname_hash */
+	bool in_gid_hash;	/*< true iff this is in gid_hash */
+	bool negative;		/*< Fallback mapping after a failed lookup */
+	struct cache_group *gname_next;	/*< Next in the name chain */
+	struct cache_group *gid_next;	/*< Next in the GID chain */
 	time_t epoch;
+	struct rcu_head rcu;	/*< For deferred free */
 };
 
-#define group_expired(group) (time(NULL) - (group)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
-
 /**
- * @brief Number of entires in the UID cache, should be prime.
+ * @brief Check whether a cache entry has outlived its welcome
+ *
+ * Negative entries use their own, usually much shorter, lifetime so
+ * that a directory server hiccup doesn't pin "nobody" for long.
  */
 
-#define id_cache_size 1009
+static inline bool entry_expired(time_t epoch, bool negative)
+{
+	time_t lifetime = negative ?
+		nfs_param.nfsv4_param.idmap_negative_expiration :
+		nfs_param.core_param.manage_gids_expiration;
+
+	return time(NULL) - epoch > lifetime;
+}
 
 /**
- * @brief UID cache, may only be accessed with idmapper_user_lock
- * held.  If idmapper_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief Number of buckets in each index, should be prime.
+ *
+ * Sized so that a bulk preload of a few hundred thousand accounts
+ * still gives short chains.
  */
 
-static struct avltree_node *uid_cache[id_cache_size];
+#define id_cache_size 16381
 
 /**
- * @brief GID cache, may only be accessed with idmapper_group_lock
- * held.  If idmapper_group_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief Users, by name.  Chains are modified with
+ * idmapper_user_lock held for write and read under rcu_read_lock.
  */
 
-static struct avltree_node *gid_cache[id_cache_size];
+static struct cache_user *uname_hash[id_cache_size];
 
 /**
- * @brief Lock that protects the idmapper user cache
+ * @brief Users, by ID
  */
 
-pthread_rwlock_t idmapper_user_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct cache_user *uid_hash[id_cache_size];
 
 /**
- * @brief Lock that protects the idmapper group cache
+ * @brief Groups, by name.  Chains are modified with
+ * idmapper_group_lock held for write and read under rcu_read_lock.
  */
 
-pthread_rwlock_t idmapper_group_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct cache_group *gname_hash[id_cache_size];
 
 /**
- * @brief Tree of users, by name
+ * @brief Groups, by ID
  */
 
-static struct avltree uname_tree;
+static struct cache_group *gid_hash[id_cache_size];
 
 /**
- * @brief Tree of users, by ID
+ * @brief Lock that serializes modifications of the user cache
  */
 
-static struct avltree uid_tree;
+pthread_rwlock_t idmapper_user_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 /**
- * @brief Tree of groups, by name
+ * @brief Lock that serializes modifications of the group cache
  */
-static struct avltree gname_tree;
+
+pthread_rwlock_t idmapper_group_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 /**
- * @brief Tree of groups, by ID
+ * @brief Cache statistics, updated atomically
  */
 
-static struct avltree gid_tree;
+struct idmapper_cache_stats idmapper_cache_st;
 
 /**
- * @brief Compare two buffers
- *
- * Handle the case where one buffer is a left sub-buffer of another
- * buffer by counting the longer one as larger.
- *
- * @param[in] buff1 A buffer
- * @param[in] buffa Another buffer
- *
- * @retval -1 if buff1 is less than buffa
- * @retval 0 if buff1 and buffa are equal
- * @retval 1 if buff1 is greater than buffa
+ * @brief Bumped whenever a mapping is removed or replaced, so that
+ *        copies made outside the cache know to refresh.
  */
 
-static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
-				      const struct gsh_buffdesc *buff1)
+uint64_t idmapper_generation;
+
+static inline uint32_t name_bucket(const struct gsh_buffdesc *name)
 {
-	int mr = memcmp(buff1->addr, buffa->addr, MIN(buff1->len,
-						      buffa->len));
-	if (unlikely(mr == 0)) {
-		if (buff1->len < buffa->len)
-			return -1;
-		else if (buff1->len > buffa->len)
-			return 1;
-		else
-			return 0;
-	} else {
-		return mr;
-	}
+	return CityHash64(name->addr, name->len) % id_cache_size;
 }
 
-/**
- * @brief Comparison for user names
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+static inline uint32_t id_bucket(uint32_t id)
+{
+	return id % id_cache_size;
+}
 
-static int uname_comparator(const struct avltree_node *node1,
-			    const struct avltree_node *nodea)
+static inline bool buffdesc_equal(const struct gsh_buffdesc *buffa,
+				  const struct gsh_buffdesc *buff1)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uname_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uname_node);
-
-	return buffdesc_comparator(&user1->uname, &usera->uname);
+	return buffa->len == buff1->len &&
+	       memcmp(buffa->addr, buff1->addr, buffa->len) == 0;
 }
 
-/**
- * @brief Comparison for UIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+static void free_user_rcu(struct rcu_head *head)
+{
+	gsh_free(container_of(head, struct cache_user, rcu));
+}
 
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static void free_group_rcu(struct rcu_head *head)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uid_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uid_node);
-
-	if (user1->uid < usera->uid)
-		return -1;
-	else if (user1->uid > usera->uid)
-		return 1;
-	else
-		return 0;
+	gsh_free(container_of(head, struct cache_group, rcu));
 }
 
 /**
- * @brief Comparison for group names
+ * @brief Unlink a user from every index it is in and schedule its free
  *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @note The caller must hold idmapper_user_lock for write.
  */
 
-static inline int gname_comparator(const struct avltree_node *node1,
-				   const struct avltree_node *nodea)
+static void remove_user(struct cache_user *user)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gname_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gname_node);
-
-	return buffdesc_comparator(&group1->gname, &groupa->gname);
+	struct cache_user **pp;
+
+	if (user->in_uname_hash) {
+		for (pp = &uname_hash[name_bucket(&user->uname)];
+		     *pp != user; pp = &(*pp)->uname_next)
+			assert(*pp != NULL);
+		rcu_assign_pointer(*pp, user->uname_next);
+	}
+
+	if (user->in_uid_hash) {
+		for (pp = &uid_hash[id_bucket(user->uid)];
+		     *pp != user; pp = &(*pp)->uid_next)
+			assert(*pp != NULL);
+		rcu_assign_pointer(*pp, user->uid_next);
+	}
+
+	(void) atomic_inc_uint64_t(&idmapper_generation);
+	call_rcu(&user->rcu, free_user_rcu);
 }
 
 /**
- * @brief Comparison for GIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
+ * @brief Unlink a group from every index it is in and schedule its free
  *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @note The caller must hold idmapper_group_lock for write.
  */
 
-static int gid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static void remove_group(struct cache_group *group)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gid_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gid_node);
-
-	if (group1->gid < groupa->gid)
-		return -1;
-	else if (group1->gid > groupa->gid)
-		return 1;
-	else
-		return 0;
+	struct cache_group **pp;
+
+	if (group->in_gname_hash) {
+		for (pp = &gname_hash[name_bucket(&group->gname)];
+		     *pp != group; pp = &(*pp)->gname_next)
+			assert(*pp != NULL);
+		rcu_assign_pointer(*pp, group->gname_next);
+	}
+
+	if (group->in_gid_hash) {
+		for (pp = &gid_hash[id_bucket(group->gid)];
+		     *pp != group; pp = &(*pp)->gid_next)
+			assert(*pp != NULL);
+		rcu_assign_pointer(*pp, group->gid_next);
+	}
+
+	(void) atomic_inc_uint64_t(&idmapper_generation);
+	call_rcu(&group->rcu, free_group_rcu);
+}
+
+static struct cache_user *find_uname(const struct gsh_buffdesc *name)
+{
+	struct cache_user *user;
+
+	for (user = rcu_dereference(uname_hash[name_bucket(name)]);
+	     user != NULL; user = rcu_dereference(user->uname_next)) {
+		if (buffdesc_equal(&user->uname, name))
+			return user;
+	}
+	return NULL;
+}
+
+static struct cache_user *find_uid(uid_t uid)
+{
+	struct cache_user *user;
+
+	for (user = rcu_dereference(uid_hash[id_bucket(uid)]);
+	     user != NULL; user = rcu_dereference(user->uid_next)) {
+		if (user->uid == uid)
+			return user;
+	}
+	return NULL;
+}
+
+static struct cache_group *find_gname(const struct gsh_buffdesc *name)
+{
+	struct cache_group *group;
+
+	for (group = rcu_dereference(gname_hash[name_bucket(name)]);
+	     group != NULL; group = rcu_dereference(group->gname_next)) {
+		if (buffdesc_equal(&group->gname, name))
+			return group;
+	}
+	return NULL;
+}
+
+static struct cache_group *find_gid(gid_t gid)
+{
+	struct cache_group *group;
+
+	for (group = rcu_dereference(gid_hash[id_bucket(gid)]);
+	     group != NULL; group = rcu_dereference(group->gid_next)) {
+		if (group->gid == gid)
+			return group;
+	}
+	return NULL;
 }
 
 /**
@@ -280,13 +306,11 @@ static int gid_comparator(const struct avltree_node *node1,
 
 void idmapper_cache_init(void)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	avltree_init(&gname_tree, gname_comparator, 0);
-	avltree_init(&gid_tree, gid_comparator, 0);
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	memset(uname_hash, 0, sizeof(uname_hash));
+	memset(uid_hash, 0, sizeof(uid_hash));
+	memset(gname_hash, 0, sizeof(gname_hash));
+	memset(gid_hash, 0, sizeof(gid_hash));
+	memset(&idmapper_cache_st, 0, sizeof(idmapper_cache_st));
 }
 
 /**
@@ -294,25 +318,26 @@ void idmapper_cache_init(void)
  *
  * @note The caller must hold idmapper_user_lock for write.
  *
- * @param[in] name The user name
- * @param[in] uid  The user ID
- * @param[in] gid  Optional.  Set to NULL if no gid is known.
- * @param[in] gss_princ true when name is gss principal.
- *                      The uid to name map is not added for gss principals.
+ * @param[in] name  The user name
+ * @param[in] uid   The user ID
+ * @param[in] gid   Optional.  Set to NULL if no gid is known.
+ * @param[in] flags IDMAP_BY_NAME and/or IDMAP_BY_ID select the
+ *                  indexes the entry goes in, IDMAP_NEGATIVE marks
+ *                  a fallback mapping.  GSS principals are added
+ *                  with IDMAP_BY_NAME only.
  *
  * @retval true on success.
  * @retval false if our reach exceeds our grasp.
  */
 
 bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
-		       const gid_t *gid, bool gss_princ)
+		       const gid_t *gid, uint32_t flags)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
 	struct cache_user *old;
 	struct cache_user *new;
+	uint32_t bucket;
 
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
+	new = gsh_calloc(1, sizeof(struct cache_user) + name->len);
 	new->epoch = time(NULL);
 	new->uname.addr = (char *)new + sizeof(struct cache_user);
 	new->uname.len = name->len;
@@ -325,18 +350,17 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		new->gid = -1;
 		new->gid_set = false;
 	}
-	new->in_uidtree = (gss_princ) ? false : true;
+	new->in_uname_hash = (flags & IDMAP_BY_NAME) != 0;
+	new->in_uid_hash = (flags & IDMAP_BY_ID) != 0;
+	new->negative = (flags & IDMAP_NEGATIVE) != 0;
 
 	/*
 	 * There are 3 cases why we find an existing cache entry.
 	 *
 	 * Case 1:
-	 * The threads that lookup by-name or by-id use the read lock.
-	 * If they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping.
+	 * Lookups don't take idmapper_user_lock, so several threads
+	 * may miss on the same name or id and all try to add it.  In
+	 * this case, we will be trying to insert same name,id mapping.
 	 *
 	 * Case 2:
 	 * It is also possible that name got a different id or an id got
@@ -354,47 +378,46 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 	 *
 	 * Note that the 3rd case happens if and only if IDMAPD_DOMAIN
 	 * and LOCAL_REALMS are set to the same value!
+	 *
+	 * The new entry is fully built before it is published, so
+	 * concurrent readers see either the old or the new mapping.
 	 */
-	found_name = avltree_insert(&new->uname_node, &uname_tree);
-	if (unlikely(found_name)) {
-		old = avltree_container_of(found_name, struct cache_user,
-					   uname_node);
-		/* Combine old into new if uid's match */
-		if (old->uid == new->uid) {
-			if (!new->gid_set && old->gid_set) {
-				new->gid = old->gid;
-				new->gid_set = true;
+	if (new->in_uname_hash) {
+		old = find_uname(name);
+		if (unlikely(old != NULL)) {
+			/* Combine old into new if uid's match */
+			if (old->uid == new->uid && !new->negative) {
+				if (!new->gid_set && old->gid_set) {
+					new->gid = old->gid;
+					new->gid_set = true;
+				}
+				if (!new->in_uid_hash && old->in_uid_hash)
+					new->in_uid_hash = true;
 			}
-			if (!new->in_uidtree && old->in_uidtree)
-				new->in_uidtree = true;
+			remove_user(old);
 		}
+	}
 
-		/* Remove the old and insert the new */
-		avltree_remove(found_name, &uname_tree);
-		if (old->in_uidtree) {
-			uid_cache[old->uid % id_cache_size] = NULL;
-			avltree_remove(&old->uid_node, &uid_tree);
-		}
-		gsh_free(old);
-		found_name = avltree_insert(&new->uname_node, &uname_tree);
-		assert(found_name == NULL);
+	if (new->in_uid_hash) {
+		old = find_uid(uid);
+		if (unlikely(old != NULL))
+			remove_user(old);
+	}
+
+	if (new->in_uname_hash) {
+		bucket = name_bucket(name);
+		new->uname_next = uname_hash[bucket];
+		rcu_assign_pointer(uname_hash[bucket], new);
 	}
 
-	if (!new->in_uidtree) /* all done */
-		return true;
-
-	found_id = avltree_insert(&new->uid_node, &uid_tree);
-	if (unlikely(found_id)) {
-		old = avltree_container_of(found_id, struct cache_user,
-					   uid_node);
-		uid_cache[old->uid % id_cache_size] = NULL;
-		avltree_remove(found_id, &uid_tree);
-		avltree_remove(&old->uname_node, &uname_tree);
-		gsh_free(old);
-		found_id = avltree_insert(&new->uid_node, &uid_tree);
-		assert(found_id == NULL);
+	if (new->in_uid_hash) {
+		bucket = id_bucket(uid);
+		new->uid_next = uid_hash[bucket];
+		rcu_assign_pointer(uid_hash[bucket], new);
 	}
-	uid_cache[uid % id_cache_size] = &new->uid_node;
+
+	if (new->negative)
+		atomic_inc_uint64_t(&idmapper_cache_st.negative_added);
 
 	return true;
 }
@@ -404,74 +427,91 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
  *
  * @note The caller must hold idmapper_group_lock for write.
  *
- * @param[in] name The user name
- * @param[in] gid  The group id
+ * @param[in] name  The group name
+ * @param[in] gid   The group id
+ * @param[in] flags As for idmapper_add_user
  *
  * @retval true on success.
  * @retval false if our reach exceeds our grasp.
  */
 
-bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
+bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid,
+			uint32_t flags)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_group *tmp;
+	struct cache_group *old;
 	struct cache_group *new;
+	uint32_t bucket;
 
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
+	new = gsh_calloc(1, sizeof(struct cache_group) + name->len);
 	new->epoch = time(NULL);
 	new->gname.addr = (char *)new + sizeof(struct cache_group);
 	new->gname.len = name->len;
 	new->gid = gid;
 	memcpy(new->gname.addr, name->addr, name->len);
+	new->in_gname_hash = (flags & IDMAP_BY_NAME) != 0;
+	new->in_gid_hash = (flags & IDMAP_BY_ID) != 0;
+	new->negative = (flags & IDMAP_NEGATIVE) != 0;
 
 	/*
-	 * The threads that lookup by-name or by-id use the read lock. If
-	 * they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping. It is also possible
-	 * that name got a different id or an id got a different name
-	 * causing us to find an existing entry when we are trying to
-	 * add an entry!
-	 *
-	 * If we find an existing entry, we remove it from both the name
-	 * and the id AVL trees, and then add the new entry.
+	 * Several threads may miss on the same name or id and all try
+	 * to add it, or a name may have got a different id (or the
+	 * other way around).  Either way, any existing entry for the
+	 * name or the id is stale: unlink it from all indexes and
+	 * publish the new one.
 	 */
-	found_name = avltree_insert(&new->gname_node, &gname_tree);
-	if (unlikely(found_name)) {
-		tmp = avltree_container_of(found_name, struct cache_group,
-					   gname_node);
-		avltree_remove(found_name, &gname_tree);
-		avltree_remove(&tmp->gid_node, &gid_tree);
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		gsh_free(tmp);
-		found_name = avltree_insert(&new->gname_node, &gname_tree);
-		assert(found_name == NULL);
+	if (new->in_gname_hash) {
+		old = find_gname(name);
+		if (unlikely(old != NULL))
+			remove_group(old);
+	}
+
+	if (new->in_gid_hash) {
+		old = find_gid(gid);
+		if (unlikely(old != NULL))
+			remove_group(old);
 	}
 
-	found_id = avltree_insert(&new->gid_node, &gid_tree);
-	if (unlikely(found_id)) {
-		tmp = avltree_container_of(found_id, struct cache_group,
-					   gid_node);
-
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		avltree_remove(found_id, &gid_tree);
-		avltree_remove(&tmp->gname_node, &gname_tree);
-		gsh_free(tmp);
-		found_id = avltree_insert(&new->gid_node, &gid_tree);
-		assert(found_id == NULL);
+	if (new->in_gname_hash) {
+		bucket = name_bucket(name);
+		new->gname_next = gname_hash[bucket];
+		rcu_assign_pointer(gname_hash[bucket], new);
 	}
-	gid_cache[gid % id_cache_size] = &new->gid_node;
+
+	if (new->in_gid_hash) {
+		bucket = id_bucket(gid);
+		new->gid_next = gid_hash[bucket];
+		rcu_assign_pointer(gid_hash[bucket], new);
+	}
+
+	if (new->negative)
+		atomic_inc_uint64_t(&idmapper_cache_st.negative_added);
 
 	return true;
 }
 
+/**
+ * @brief Record the outcome of a lookup in the cache statistics
+ */
+
+static inline bool count_lookup(bool found, bool expired, bool negative)
+{
+	if (!found)
+		atomic_inc_uint64_t(&idmapper_cache_st.misses);
+	else if (expired)
+		atomic_inc_uint64_t(&idmapper_cache_st.expired);
+	else if (negative)
+		atomic_inc_uint64_t(&idmapper_cache_st.negative_hits);
+	else
+		atomic_inc_uint64_t(&idmapper_cache_st.hits);
+
+	return found && !expired;
+}
+
 /**
  * @brief Look up a user by name
  *
- * @note The caller must hold idmapper_user_lock for read.
+ * @note The caller must hold rcu_read_lock across this call and any
+ *       use of the returned gid pointer.
  *
  * @param[in]  name The user name to look up.
  * @param[out] uid  The user ID found.  May be NULL if the caller
@@ -486,33 +526,12 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
  */
 
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
-			      const gid_t **gid, bool gss_princ)
+			      const gid_t **gid)
 {
-	struct cache_user prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_user *found_user;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_user =
-	    avltree_container_of(found_node, struct cache_user, uname_node);
-	if (!gss_princ) {
-		/* I assume that if someone likes this user enough to look it
-		   up by name, they'll like it enough to look it up by ID
-		   later.
-
-		   If the name is gss principal it does not have entry
-		   in uid tree */
-
-		cache_slot = (void **)
-			&uid_cache[found_user->uid % id_cache_size];
-		atomic_store_voidptr(cache_slot, &found_user->uid_node);
-	}
+	struct cache_user *found_user = find_uname(name);
+
+	if (unlikely(!found_user))
+		return count_lookup(false, false, false);
 
 	if (likely(uid))
 		*uid = found_user->uid;
@@ -520,13 +539,17 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 	if (unlikely(gid))
 		*gid = (found_user->gid_set ? &found_user->gid : NULL);
 
-	return user_expired(found_user) ? false : true;
+	return count_lookup(true,
+			    entry_expired(found_user->epoch,
+					  found_user->negative),
+			    found_user->negative);
 }
 
 /**
  * @brief Look up a user by ID
  *
- * @note The caller must hold idmapper_user_lock for read.
+ * @note The caller must hold rcu_read_lock across this call and any
+ *       use of the returned name and gid.
  *
  * @param[in]  uid  The user ID to look up.
  * @param[out] name The user name to look up. (May be NULL if the user
@@ -542,32 +565,10 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 			    const gid_t **gid)
 {
-	struct cache_user prototype = {
-		.uid = uid
-	};
-	void **cache_slot = (void **)&uid_cache[uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_user *found_user;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
-		if (found_user->uid == uid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
+	struct cache_user *found_user = find_uid(uid);
 
-		atomic_store_voidptr(cache_slot, found_node);
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
-	}
+	if (unlikely(!found_user))
+		return count_lookup(false, false, false);
 
 	if (likely(name))
 		*name = &found_user->uname;
@@ -575,13 +576,16 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 	if (gid)
 		*gid = (found_user->gid_set ? &found_user->gid : NULL);
 
-	return user_expired(found_user) ? false : true;
+	return count_lookup(true,
+			    entry_expired(found_user->epoch,
+					  found_user->negative),
+			    found_user->negative);
 }
 
 /**
  * @brief Lookup a group by name
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * @note The caller must hold rcu_read_lock.
  *
  * @param[in]  name The user name to look up.
  * @param[out] gid  The group ID found.  May be NULL if the caller
@@ -595,39 +599,27 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 
 bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 {
-	struct cache_group prototype = {
-		.gname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.gname_node,
-							 &gname_tree);
-	struct cache_group *found_group;
-	void **cache_slot;
+	struct cache_group *found_group = find_gname(name);
 
-	if (unlikely(!found_node))
-		return false;
-
-	found_group =
-	    avltree_container_of(found_node, struct cache_group, gname_node);
-
-	/* I assume that if someone likes this group enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
-
-	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	if (unlikely(!found_group))
+		return count_lookup(false, false, false);
 
 	if (likely(gid))
 		*gid = found_group->gid;
 	else
 		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
 
-	return group_expired(found_group) ? false : true;
+	return count_lookup(true,
+			    entry_expired(found_group->epoch,
+					  found_group->negative),
+			    found_group->negative);
 }
 
 /**
  * @brief Look up a group by ID
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * @note The caller must hold rcu_read_lock across this call and any
+ *       use of the returned name.
  *
  * @param[in]  gid  The group ID to look up.
  * @param[out] name The user name to look up. (May be NULL if the user
@@ -639,39 +631,20 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 
 bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 {
-	struct cache_group prototype = {
-		.gid = gid
-	};
-	void **cache_slot = (void **)&gid_cache[gid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_group *found_group;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-		if (found_group->gid == gid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.gid_node, &gid_tree);
-		if (unlikely(!found_node))
-			return false;
+	struct cache_group *found_group = find_gid(gid);
 
-		atomic_store_voidptr(cache_slot, found_node);
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-	}
+	if (unlikely(!found_group))
+		return count_lookup(false, false, false);
 
 	if (likely(name))
 		*name = &found_group->gname;
 	else
 		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
 
-	return group_expired(found_group) ? false : true;
+	return count_lookup(true,
+			    entry_expired(found_group->epoch,
+					  found_group->negative),
+			    found_group->negative);
 }
 
 /**
@@ -680,45 +653,47 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 
 void idmapper_clear_cache(void)
 {
-	struct avltree_node *node;
+	int i;
 
 	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
 	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
 
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	for (node = avltree_first(&uname_tree);
-	     node != NULL;
-	     node = avltree_first(&uname_tree)) {
-		struct cache_user *user;
-
-		user = avltree_container_of(node,
-					    struct cache_user, uname_node);
-		avltree_remove(&user->uname_node, &uname_tree);
-		if (user->in_uidtree)
-			avltree_remove(&user->uid_node, &uid_tree);
-		gsh_free(user);
+	for (i = 0; i < id_cache_size; i++) {
+		while (uname_hash[i] != NULL)
+			remove_user(uname_hash[i]);
+		while (uid_hash[i] != NULL)
+			remove_user(uid_hash[i]);
+		while (gname_hash[i] != NULL)
+			remove_group(gname_hash[i]);
+		while (gid_hash[i] != NULL)
+			remove_group(gid_hash[i]);
 	}
 
-	assert(avltree_first(&uid_tree) == NULL);
-
-	for (node = avltree_first(&gname_tree);
-	     node != NULL;
-	     node = avltree_first(&gname_tree)) {
-		struct cache_group *group;
+	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
+	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+}
 
-		group = avltree_container_of(node,
-					     struct cache_group, gname_node);
-		avltree_remove(&group->gname_node, &gname_tree);
-		avltree_remove(&group->gid_node, &gid_tree);
-		gsh_free(group);
-	}
+#ifdef USE_DBUS
+/**
+ * @brief Report the cache counters over DBus
+ *
+ * @param[in,out] iter Reply iterator
+ */
 
-	assert(avltree_first(&gid_tree) == NULL);
+void idmapper_dbus_show(DBusMessageIter *iter)
+{
+	struct server_dbus_counter counters[] = {
+		{ "idmap_hits", &idmapper_cache_st.hits },
+		{ "idmap_negative_hits", &idmapper_cache_st.negative_hits },
+		{ "idmap_expired", &idmapper_cache_st.expired },
+		{ "idmap_misses", &idmapper_cache_st.misses },
+		{ "idmap_negative_added", &idmapper_cache_st.negative_added },
+		{ "idmap_preloaded", &idmapper_cache_st.preloaded },
+	};
 
-	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+	server_dbus_counters(counters, sizeof(counters) / sizeof(counters[0]),
+			     IDMAPPER_CACHE_TYPE, iter);
 }
+#endif /* USE_DBUS */
 
 /** @} */
@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
 #include "log.h"
 
 /**
@@ -262,6 +263,33 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 	free(p);
 }
 
+/**
+ * @page PoolAllocator Pool Allocator
+ *
+ * Pools hand out fixed size, zeroed objects.  Objects up to
+ * POOL_MAX_OBJECT_SIZE come from slabs shared by all pools of the same
+ * size class (object size rounded up to POOL_CLASS_ALIGN).  Each
+ * thread keeps a pair of magazines of free objects per size class, so
+ * most allocations and frees touch no lock and no shared cache line
+ * other than the pool's counters.  Magazines are exchanged whole with
+ * a per class depot, and only when the depot is empty (or full) are
+ * objects carved from (or returned to) slabs.  Larger objects are
+ * passed straight to gsh_calloc/gsh_free.
+ *
+ * With USE_NUMA, each size class keeps slabs per NUMA node and a
+ * thread allocates from slabs bound to the node it started on.
+ *
+ * Each pool counts its allocations, frees and magazine misses; they
+ * are reported by the ShowMemPools DBus method.
+ */
+
+/** Objects larger than this bypass the slabs */
+#define POOL_MAX_OBJECT_SIZE 4096
+/** Granularity of size classes */
+#define POOL_CLASS_ALIGN 16
+
+struct pool_class;
+
 /**
  * @brief Type representing a pool
  *
@@ -277,25 +305,24 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 typedef struct pool {
 	char *name; /*< The name of the pool */
 	size_t object_size; /*< The size of the objects created */
+	struct pool_class *cls; /*< Size class, NULL if not slab backed */
+	struct pool *next; /*< Next in list of all pools */
+	struct pool *prev; /*< Previous in list of all pools */
+	uint64_t allocs; /*< Objects allocated */
+	uint64_t frees; /*< Objects freed */
+	uint64_t misses; /*< Allocations not served by a magazine */
 } pool_t;
 
 /**
  * @brief Create a basic object pool
  *
- * This function creates a new object pool, given a name, object size,
- * constructor and destructor.
- *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
+ * This function creates a new object pool, given a name and object
+ * size.  The name is used in log messages and statistics.
  *
  * This initializer function is expected to abort if it fails.
  *
  * @param[in] name             The name of this pool
  * @param[in] object_size      The size of objects to allocate
- * @param[in] file             Calling source file
- * @param[in] line             Calling source line
- * @param[in] function         Calling source function
  *
  * @return A pointer to the pool object.  This pointer must not be
  *         dereferenced.  It may be stored or supplied as an argument
@@ -304,45 +331,25 @@ typedef struct pool {
  *         pool_destroy.
  */
 
-static inline pool_t *
-pool_basic_init(const char *name, size_t object_size)
-{
-	pool_t *pool = (pool_t *) gsh_malloc(sizeof(pool_t));
-
-	pool->object_size = object_size;
-
-	if (name)
-		pool->name = gsh_strdup(name);
-	else
-		pool->name = NULL;
-
-	return pool;
-}
+pool_t *pool_basic_init(const char *name, size_t object_size);
 
 /**
  * @brief Destroy a memory pool
  *
  * This function destroys a memory pool.  All objects must be returned
- * to the pool before this function is called.
+ * to the pool before this function is called.  Slabs belong to the
+ * size class, not to the pool, so they outlive it.
  *
  * @param[in] pool The pool to be destroyed.
  */
 
-static inline void
-pool_destroy(pool_t *pool)
-{
-	gsh_free(pool->name);
-	gsh_free(pool);
-}
+void pool_destroy(pool_t *pool);
 
 /**
  * @brief Allocate an object from a pool
  *
- * This function allocates a single object from the pool and returns a
- * pointer to it.  If a constructor was specified at pool creation, it
- * is called on that pointer.  This function must be thread safe.  If
- * the underlying pool abstraction requires a lock, this function must
- * take and release it.
+ * This function allocates a single zeroed object from the pool and
+ * returns a pointer to it.  This function is thread safe.
  *
  * This function returns void pointers.  Programmers who wish for more
  * type safety can easily create static inline wrappers (alloc_client
@@ -352,23 +359,17 @@ pool_destroy(pool_t *pool)
  * This function aborts if no memory is available.
  *
  * @param[in] pool       The pool from which to allocate
- * @param[in] file       Calling source file
- * @param[in] line       Calling source line
- * @param[in] function   Calling source function
  *
  * @return A pointer to the allocated pool item.
  */
 
-#define pool_alloc(pool) gsh_calloc(1, (pool)->object_size)
+void *pool_alloc(pool_t *pool);
 
 /**
  * @brief Return an entry to a pool
  *
- * This function returns a single object to the pool.  If a destructor
- * was defined at pool creation time, it is called before the object
- * is freed.  This function must be thread-safe.  If the underlying
- * pool abstract requires a lock, this function must take and release
- * it.
+ * This function returns a single object to the pool.  This function
+ * is thread-safe.
  *
  * @param[in] pool   Pool to which to return the object
  * @param[in] object Object to return.  This is a void pointer.
@@ -377,10 +378,6 @@ pool_destroy(pool_t *pool)
  *                   specific type (and omitting the pool parameter.)
  */
 
-static inline void
-pool_free(pool_t *pool, void *object)
-{
-	gsh_free(object);
-}
+void pool_free(pool_t *pool, void *object);
 
 #endif /* ABSTRACT_MEM_H */
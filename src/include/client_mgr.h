@@ -45,6 +45,8 @@
 #include "avltree.h"
 #include "gsh_types.h"
 
+struct qos_flow;
+
 struct gsh_client {
 	struct avltree_node node_k;
 	pthread_rwlock_t lock;
@@ -52,6 +54,7 @@ struct gsh_client {
 	int64_t refcnt;
 	nsecs_elapsed_t last_update;
 	char *hostaddr_str;
+	struct qos_flow *qos_flow;	/*< QoS scheduler state */
 	unsigned char addrbuf[];
 };
 
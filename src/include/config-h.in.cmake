@@ -45,6 +45,7 @@
 #cmakedefine LITTLEEND 1
 #cmakedefine HAVE_DAEMON 1
 #cmakedefine USE_LTTNG 1
+#cmakedefine USE_NUMA 1
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_XREADDIRPLUS 1
@@ -56,11 +57,14 @@
 #cmakedefine USE_FSAL_CEPH_STATX 1
 #cmakedefine USE_FSAL_CEPH_LL_DELEGATION 1
 #cmakedefine USE_FSAL_CEPH_LL_SYNC_INODE 1
+#cmakedefine USE_FSAL_CEPH_LL_NONBLOCKING_IO 1
 #cmakedefine USE_CEPH_LL_FALLOCATE 1
 #cmakedefine USE_FSAL_CEPH_ABORT_CONN 1
 #cmakedefine USE_FSAL_CEPH_RECLAIM_RESET 1
 #cmakedefine USE_FSAL_CEPH_GET_FS_CID 1
 #cmakedefine USE_FSAL_RGW_MOUNT2 1
+#cmakedefine USE_NEWFS_READDIR_BATCH 1
+#cmakedefine USE_NEWFS_WATCH 1
 #cmakedefine ENABLE_LOCKTRACE 1
 #cmakedefine SANITIZE_ADDRESS 1
 #cmakedefine DEBUG_MDCACHE 1
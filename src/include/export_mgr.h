@@ -49,6 +49,10 @@ enum export_status {
 	EXPORT_STALE,		/*< export is no longer valid */
 };
 
+struct export_path_node;
+struct pseudofs_node;
+struct qos_flow;
+
 /**
  * @brief Represents an export.
  *
@@ -61,6 +65,13 @@ struct gsh_export {
 	struct glist_head exp_list;
 	/** gsh_exports are kept in an AVL tree by export_id */
 	struct avltree_node node_k;
+	/** gsh_exports are indexed by path and pseudo path in tries of
+	    path components, protected by the export manager lock */
+	struct export_path_node *exp_path_node;
+	struct export_path_node *exp_pseudo_node;
+	/** Lists of exports with the same path / pseudo path */
+	struct glist_head exp_path_list;
+	struct glist_head exp_pseudo_list;
 	/** List of NFS v4 state belonging to this export */
 	struct glist_head exp_state_list;
 	/** List of locks belonging to this export */
@@ -85,6 +96,11 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
 	struct gsh_export *exp_parent_exp;
+	/** Pseudo fs directories in this export leading to the junctions
+	    of the exports mounted on it, and the node of our own junction
+	    in the export we sit on.  Protected by the pseudo fs lock */
+	struct pseudofs_node *exp_pseudofs_root;
+	struct pseudofs_node *exp_junction_node;
 	/** Pointer to the fsal_export associated with this export */
 	struct fsal_export *fsal_export;
 	/** CFG: Exported path - static option */
@@ -109,6 +125,12 @@ struct gsh_export {
 	uint64_t MaxOffsetWrite;
 	/** CFG: Maximum Offset allowed for read - atomic changeable option */
 	uint64_t MaxOffsetRead;
+	/** CFG: Aggregate QoS requests/sec limit - atomic changeable option */
+	uint64_t MaxIOPS;
+	/** CFG: Aggregate QoS bytes/sec limit - atomic changeable option */
+	uint64_t MaxBandwidth;
+	/** QoS scheduler state, protected by the scheduler */
+	struct qos_flow *qos_flow;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
 	/** References to this export */
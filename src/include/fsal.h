@@ -146,6 +146,120 @@ static inline void release_root_op_context(void)
 	op_ctx = ctx->old_op_ctx;
 }
 
+/**
+ * @brief An I/O an FSAL completes from its backend's callback
+ *
+ * read2 and write2 may return before the I/O is done and call done_cb
+ * later from another thread.  The FSAL embeds this in its per I/O
+ * structure, fills it in with fsal_async_io_init() before submitting
+ * the I/O, and calls fsal_async_io_done() when the backend completes
+ * it.
+ *
+ * The request's op context stays allocated while the request is
+ * suspended, but the submitting thread may still be unwinding through
+ * it (stacked FSALs swap op_ctx->fsal_export), so the completion runs
+ * with a copy taken at submission.
+ */
+
+struct fsal_async_io {
+	struct req_op_context ctx;	/*< Copy of the submitter's op_ctx */
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+};
+
+static inline void fsal_async_io_init(struct fsal_async_io *aio,
+				      struct fsal_obj_handle *obj_hdl,
+				      fsal_async_cb done_cb,
+				      struct fsal_io_arg *io_arg,
+				      void *caller_arg)
+{
+	aio->ctx = *op_ctx;
+	aio->obj_hdl = obj_hdl;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+}
+
+static inline void fsal_async_io_done(struct fsal_async_io *aio,
+				      fsal_status_t status)
+{
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = &aio->ctx;
+	aio->done_cb(aio->obj_hdl, status, aio->io_arg, aio->caller_arg);
+	op_ctx = saved_ctx;
+}
+
+/**
+ * @brief Asynchronous I/Os in flight on a state's file descriptor
+ *
+ * A state's fd is kept open by holding its rwlock for read, but the
+ * lock must be released by the thread that took it, which the backend's
+ * completion thread is not.  So the submitter pins the fd while it
+ * holds the read lock, drops the lock once the I/O is submitted, and
+ * the completion unpins the fd.  Whoever closes or replaces the fd
+ * waits for the pins to drain after taking the write lock, which keeps
+ * new I/O from pinning it.
+ */
+
+struct fsal_fd_pins {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t count;
+};
+
+static inline void fsal_fd_pins_init(struct fsal_fd_pins *pins)
+{
+	PTHREAD_MUTEX_init(&pins->mutex, NULL);
+	PTHREAD_COND_init(&pins->cond, NULL);
+	pins->count = 0;
+}
+
+static inline void fsal_fd_pins_destroy(struct fsal_fd_pins *pins)
+{
+	PTHREAD_MUTEX_destroy(&pins->mutex);
+	PTHREAD_COND_destroy(&pins->cond);
+}
+
+/**
+ * @brief Pin an fd for an I/O, with the fd's lock held for read
+ */
+
+static inline void fsal_fd_pin(struct fsal_fd_pins *pins)
+{
+	PTHREAD_MUTEX_lock(&pins->mutex);
+	pins->count++;
+	PTHREAD_MUTEX_unlock(&pins->mutex);
+}
+
+/**
+ * @brief Unpin an fd once its I/O is done, from any thread
+ *
+ * The fd may be closed as soon as this returns.
+ */
+
+static inline void fsal_fd_unpin(struct fsal_fd_pins *pins)
+{
+	PTHREAD_MUTEX_lock(&pins->mutex);
+	if (--pins->count == 0)
+		pthread_cond_broadcast(&pins->cond);
+	PTHREAD_MUTEX_unlock(&pins->mutex);
+}
+
+/**
+ * @brief Wait for the I/Os on an fd, with the fd's lock held for write
+ */
+
+static inline void fsal_fd_pins_wait(struct fsal_fd_pins *pins)
+{
+	PTHREAD_MUTEX_lock(&pins->mutex);
+	while (pins->count != 0)
+		pthread_cond_wait(&pins->cond, &pins->mutex);
+	PTHREAD_MUTEX_unlock(&pins->mutex);
+}
+
 /******************************************************
  *                Structure used to define a fsal
  ******************************************************/
@@ -319,7 +319,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 1
 
 /* Forward references for object methods */
 
@@ -348,10 +348,19 @@ struct fsal_dsh_ops;
 #define SEEK_HOLE 4
 #endif
 
+/** Most segments a READ_PLUS reply is split into */
+#define IO_INFO_MAX_SEGS 16
+
 struct io_info {
 	contents io_content;
 	uint32_t io_advise;
 	bool_t   io_eof;
+	/** Number of segments in io_segs */
+	uint32_t io_seg_count;
+	/** Data and holes of a READ_PLUS, in offset order.  The data of
+	 *  the data segments is packed from the start of the read buffer,
+	 *  so io_amount is their total length. */
+	contents io_segs[IO_INFO_MAX_SEGS];
 };
 
 struct io_hints {
@@ -1311,7 +1320,9 @@ typedef enum fsal_dir_result (*fsal_readdir_cb)(
  */
 struct fsal_io_arg {
 	size_t io_amount;	/**< Total amount of I/O actually done */
-	struct io_info *info;	/**< More info about data for read_plus */
+	struct io_info *info;	/**< Data and holes for read_plus, only
+				     passed if the FSAL supports
+				     fso_read_plus */
 	union {
 		bool end_of_file;	/**< True if end-of-file reached */
 		bool fsal_stable;	/**< requested/achieved stability */
@@ -2524,6 +2535,66 @@ struct fsal_obj_ops {
 
 /**@{*/
 
+/**
+ * Server-side copy
+ */
+
+/**
+ * @brief Copy a range of a file to another file
+ *
+ * Both files belong to this FSAL.  The copy may be short, in particular
+ * when the end of the source file is reached.  The data copied is not
+ * necessarily on stable storage, as with an UNSTABLE write.
+ *
+ * @param[in]  src_hdl		File to copy from
+ * @param[in]  src_state	state_t to read with, or NULL
+ * @param[in]  src_offset	Offset in the source file
+ * @param[in]  dst_hdl		File to copy to
+ * @param[in]  dst_state	state_t to write with, or NULL
+ * @param[in]  dst_offset	Offset in the destination file
+ * @param[in]  count		Bytes to copy
+ * @param[out] copied		Bytes copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy)(struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state,
+			       uint64_t src_offset,
+			       struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state,
+			       uint64_t dst_offset,
+			       uint64_t count,
+			       uint64_t *copied);
+
+/**
+ * @brief Share the storage of a range of a file with another file
+ *
+ * The destination range is made to refer to the blocks of the source
+ * range, as a reflink.  There is no general fallback, FSALs that cannot
+ * share blocks return ERR_FSAL_NOTSUPP.
+ *
+ * @param[in] src_hdl		File to clone from
+ * @param[in] src_state		state_t to read with, or NULL
+ * @param[in] src_offset	Offset in the source file
+ * @param[in] dst_hdl		File to clone to
+ * @param[in] dst_state		state_t to write with, or NULL
+ * @param[in] dst_offset	Offset in the destination file
+ * @param[in] count		Bytes to clone, 0 for up to the end of the
+ *				source file
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*clone)(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count);
+/**@}*/
+
+/**@{*/
+
 /**
  * ASYNC API functions.
  *
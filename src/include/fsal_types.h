@@ -99,6 +99,12 @@ struct export_perms {
 	    Attr_Expiration_Time (should never be set for client export_perms.
 	 */
 	int32_t  expire_time_attr;
+	/** QoS: requests per second a client may issue, 0 for no limit */
+	uint64_t client_max_iops;
+	/** QoS: READ and WRITE bytes per second a client may move */
+	uint64_t client_max_bw;
+	/** QoS: share of a client in the fair queue */
+	int32_t qos_weight;
 	/** available export options */
 	uint32_t options;
 	/** Permission Options that have been set */
@@ -665,6 +671,7 @@ typedef enum enum_fsal_fsinfo_options {
 	fso_compute_readdir_cookie,
 	fso_whence_is_name,
 	fso_readdir_plus,
+	fso_read_plus,
 } fsal_fsinfo_options_t;
 
 /* The largest maxread and maxwrite value */
@@ -711,6 +718,7 @@ typedef struct fsal_staticfsinfo_t {
 	bool compute_readdir_cookie;
 	bool whence_is_name;
 	bool readdir_plus;	/*< FSAL supports readdir_plus */
+	bool read_plus;		/*< read2 reports holes for READ_PLUS */
 } fsal_staticfsinfo_t;
 
 /**
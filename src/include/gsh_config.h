@@ -397,6 +397,9 @@ typedef struct nfs_core_param {
 	    ganesha instance. If this is set, dbus name will be
 	    <prefix>.org.ganesha.nfsd */
 	char *dbus_name_prefix;
+	/** Number of threads resolving export roots in parallel at
+	    startup and on export reload.  1 does it serially. */
+	uint32_t export_init_threads;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -437,6 +440,16 @@ typedef struct nfs_core_param {
  */
 #define RECOVERY_BACKEND_DEFAULT "fs"
 
+/**
+ * @brief Default value of recovery_journal_dir.
+ */
+#define RECOVERY_JOURNAL_DIR_DEFAULT NFS_V4_RECOV_ROOT "/v4journal"
+
+/**
+ * @brief Default value of recovery_journal_compact.
+ */
+#define RECOVERY_JOURNAL_COMPACT_DEFAULT 65536
+
 /**
  * @brief NFSv4 minor versions
  */
@@ -478,6 +491,14 @@ typedef struct nfs_version4_parameter {
 	    Only_Numeric_Owners. NB., this is permissible for a server
 	    implementation (RFC 5661). */
 	bool only_numeric_owners;
+	/** Whether to fill the ID mapper cache from the passwd and
+	    group databases at startup.  Only used with UseGetpwnam.
+	    Defaults to false and is settable with Idmap_Preload. */
+	bool idmap_preload;
+	/** Lifetime in seconds of cached fallback mappings made after
+	    a failed ID lookup.  Defaults to 60 and is settable with
+	    Idmap_Negative_Cache_Expiration. */
+	uint32_t idmap_negative_expiration;
 	/** Whether to allow delegations. Defaults to false and settable
 	    with Delegations */
 	bool allow_delegations;
@@ -489,6 +510,15 @@ typedef struct nfs_version4_parameter {
 	bool pnfs_ds;
 	/** Recovery backend */
 	char *recovery_backend;
+	/** Directory of the journal recovery backend.  Defaults to
+	    RECOVERY_JOURNAL_DIR_DEFAULT and is settable with
+	    Recovery_Journal_Dir. */
+	char *recovery_journal_dir;
+	/** Records in the journal of the journal recovery backend
+	    after which it is compacted into a snapshot.  Defaults to
+	    RECOVERY_JOURNAL_COMPACT_DEFAULT and is settable with
+	    Recovery_Journal_Compact. */
+	uint32_t recovery_journal_compact;
 	/** List of supported NFSV4 minor versions */
 	unsigned int minor_versions;
 	/** Number of allowed slots in the 4.1 slot table */
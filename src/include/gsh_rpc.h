@@ -71,6 +71,86 @@ struct nfs_request_lookahead {
 #define XDR_BYTES_MAXLEN_IO (64*1024*1024)
 #define XDR_STRING_MAXLEN (8*1024)
 
+/**
+ * @brief Runs of fixed size fields straight from the stream buffer
+ *
+ * xdr_inline_decode() and xdr_inline_encode() check once that a run of
+ * fields is contiguous in the stream buffer and return a pointer to it,
+ * or NULL in which case the fields go through the stream one at a time.
+ * IXDR_GET_U_INT32() and IXDR_PUT_U_INT32() handle the 32 bit fields of
+ * such a run, these the 64 bit and fixed length opaque ones.
+ */
+
+static inline uint64_t ixdr_get_u_int64(int32_t **buf)
+{
+	uint64_t hi = (uint32_t) IXDR_GET_U_INT32(*buf);
+	uint64_t lo = (uint32_t) IXDR_GET_U_INT32(*buf);
+
+	return (hi << 32) | lo;
+}
+
+static inline void ixdr_put_u_int64(int32_t **buf, uint64_t val)
+{
+	IXDR_PUT_U_INT32(*buf, (uint32_t) (val >> 32));
+	IXDR_PUT_U_INT32(*buf, (uint32_t) val);
+}
+
+static inline void ixdr_get_opaque(int32_t **buf, void *data, size_t len)
+{
+	memcpy(data, *buf, len);
+	*buf += RNDUP(len) / BYTES_PER_XDR_UNIT;
+}
+
+static inline void ixdr_put_opaque(int32_t **buf, const void *data,
+				   size_t len)
+{
+	size_t pad = RNDUP(len) - len;
+
+	memcpy(*buf, data, len);
+	if (pad != 0)
+		memset((char *)*buf + len, 0, pad);
+	*buf += RNDUP(len) / BYTES_PER_XDR_UNIT;
+}
+
+/**
+ * @brief Decode a variable length opaque into fixed storage
+ *
+ * Used for file handles, which are small and bounded: the length and the
+ * bytes are each taken from the stream buffer after a single check and
+ * copied into storage in the decoded structure, rather than allocated.
+ *
+ * @param[in]  xdrs   The stream, decoding
+ * @param[out] data   Storage for at least maxlen bytes
+ * @param[out] lenp   Length decoded
+ * @param[in]  maxlen Largest length accepted
+ *
+ * @return true on success, false on a short stream or too long opaque.
+ */
+
+static inline bool xdr_opaque_decode_fixed(XDR *xdrs, char *data,
+					   u_int *lenp, u_int maxlen)
+{
+	int32_t *buf = xdr_inline_decode(xdrs, BYTES_PER_XDR_UNIT);
+	u_int len;
+
+	if (buf != NULL)
+		len = IXDR_GET_U_INT32(buf);
+	else if (!XDR_GETUINT32(xdrs, &len))
+		return false;
+
+	if (len > maxlen)
+		return false;
+
+	buf = xdr_inline_decode(xdrs, RNDUP(len));
+	if (buf != NULL)
+		memcpy(data, buf, len);
+	else if (!xdr_opaque(xdrs, data, len))
+		return false;
+
+	*lenp = len;
+	return true;
+}
+
 typedef struct sockaddr_storage sockaddr_t;
 
 #define SOCK_NAME_MAX 128
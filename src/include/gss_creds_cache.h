@@ -0,0 +1,68 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @addtogroup idmapper
+ * @{
+ */
+
+/**
+ * @file gss_creds_cache.h
+ * @brief Credentials mapped from RPCSEC_GSS contexts
+ */
+
+#ifndef GSS_CREDS_CACHE_H
+#define GSS_CREDS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+#endif
+
+struct svc_rpc_gss_data;
+struct group_data;
+
+/**
+ * @brief GSS credentials cache counters
+ */
+struct gss_creds_cache_stats {
+	uint64_t hits;		/*< Found and fresh */
+	uint64_t expired;	/*< Found but stale */
+	uint64_t misses;	/*< Not found */
+	uint64_t replaced;	/*< Slot taken over by another context */
+};
+
+extern struct gss_creds_cache_stats gss_creds_cache_st;
+
+void gss_creds_cache_init(void);
+bool gss_creds_cache_lookup(struct svc_rpc_gss_data *gd, uid_t *uid,
+			    gid_t *gid, struct group_data **gdata);
+void gss_creds_cache_insert(struct svc_rpc_gss_data *gd, uid_t uid,
+			    gid_t gid, struct group_data *gdata);
+void gss_creds_cache_clear(void);
+
+#ifdef USE_DBUS
+void gss_creds_cache_dbus_show(DBusMessageIter *iter);
+#endif
+
+#endif				/* GSS_CREDS_CACHE_H */
+/** @} */
@@ -57,12 +57,32 @@
 extern pthread_rwlock_t idmapper_user_lock;
 extern pthread_rwlock_t idmapper_group_lock;
 
+/* Flags for idmapper_add_user and idmapper_add_group */
+#define IDMAP_BY_NAME	0x01	/*< Entry can be found by name */
+#define IDMAP_BY_ID	0x02	/*< Entry can be found by id */
+#define IDMAP_NEGATIVE	0x04	/*< Fallback for a failed lookup */
+
+/**
+ * @brief IDMapper cache counters
+ */
+struct idmapper_cache_stats {
+	uint64_t hits;		/*< Found and fresh */
+	uint64_t negative_hits;	/*< Found a fresh negative entry */
+	uint64_t expired;	/*< Found but expired */
+	uint64_t misses;	/*< Not found */
+	uint64_t negative_added;	/*< Negative entries added */
+	uint64_t preloaded;	/*< Entries added by the bulk preload */
+};
+
+extern struct idmapper_cache_stats idmapper_cache_st;
+extern uint64_t idmapper_generation;
+
 void idmapper_cache_init(void);
 bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *,
-		       bool);
-bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
+		       uint32_t);
+bool idmapper_add_group(const struct gsh_buffdesc *, gid_t, uint32_t);
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
-			      const gid_t **, bool);
+			      const gid_t **);
 bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
 			    const gid_t **);
 bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
@@ -70,6 +90,7 @@ bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
 /** @} */
 
 bool idmapper_init(void);
+void idmapper_start_preload(void);
 void idmapper_clear_cache(void);
 
 bool xdr_encode_nfs4_owner(XDR *, uid_t);
@@ -165,6 +165,8 @@ struct nfs_fh3 {
 		u_int data_len;
 		char *data_val;
 	} data;
+	/** Handles are decoded here, with data_val pointing to it */
+	char data_buf[NFS3_FHSIZE];
 };
 typedef struct nfs_fh3 nfs_fh3;
 
@@ -819,6 +821,10 @@ typedef struct entryplus3 entryplus3;
 struct dirlistplus3 {
 	entryplus3 *entries;
 	bool_t eof;
+	/* Not part of the protocol: entries already encoded by
+	 * READDIRPLUS, sent in place of entries when set (encode only). */
+	char *entries_xdr;
+	u_int entries_xdr_len;
 };
 typedef struct dirlistplus3 dirlistplus3;
 
@@ -181,6 +181,10 @@ typedef struct exportlist_client_entry__ {
 				       EXPORT_OPTION_AUTH_UNIX)
 
 #define EXPORT_OPTION_EXPIRE_SET 0x00080000	/*< Inode expire was set */
+#define EXPORT_OPTION_QOS_IOPS_SET 0x00020000	/*< Client_Max_IOPS was set */
+#define EXPORT_OPTION_QOS_BW_SET 0x00040000	/*< Client_Max_Bandwidth was
+						    set */
+#define EXPORT_OPTION_QOS_WEIGHT_SET 0x00800000	/*< QOS_Weight was set */
 
 /* Protocol flags */
 #define EXPORT_OPTION_NFSV3 0x00100000	/*< NFSv3 operations are supported */
@@ -210,7 +214,7 @@ typedef struct exportlist_client_entry__ {
 						    altgrp in AUTH_SYS creds */
 #define EXPORT_OPTION_NO_READDIR_PLUS 0x80000000 /*< Disallow readdir plus */
 
-#define EXPORT_OPTION_PERM_UNUSED 0x08860000
+#define EXPORT_OPTION_PERM_UNUSED 0x08000000
 
 /* Export list related functions */
 uid_t get_anonymous_uid(void);
@@ -55,6 +55,7 @@ pthread_t gsh_dbus_thrid;
 void nfs_init_init(void);
 void nfs_init_complete(void);
 void nfs_init_wait(void);
+void nfs_init_phase_done(const char *phase, struct timespec *start);
 
 /**
  * nfs_prereq_init:
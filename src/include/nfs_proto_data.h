@@ -217,6 +217,7 @@ typedef struct nfs_request {
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
 	void *proc_data;
+	bool qos_admitted;	/*< Counted in service by the QoS scheduler */
 } nfs_request_t;
 
 enum rpc_chan_type {
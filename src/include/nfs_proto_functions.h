@@ -166,6 +166,8 @@ int nfs3_mknod(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
 int nfs4_Compound(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
+void copy_tag(utf8str_cs *dest, utf8str_cs *src);
+
 enum nfs_req_result nfs4_op_read_resume(struct nfs_argop4 *op,
 					compound_data_t *data,
 					struct nfs_resop4 *resp);
@@ -376,6 +378,28 @@ enum nfs_req_result nfs4_op_deallocate(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_deallocate_Free(nfs_resop4 *resp);
 
+enum nfs_req_result nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+				 struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+enum nfs_req_result nfs4_op_offload_status(struct nfs_argop4 *,
+					   compound_data_t *,
+					   struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+enum nfs_req_result nfs4_op_offload_cancel(struct nfs_argop4 *,
+					   compound_data_t *,
+					   struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
+enum nfs_req_result nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+				  struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
 enum nfs_req_result nfs4_op_seek(struct nfs_argop4 *, compound_data_t *,
 				 struct nfs_resop4 *);
 
@@ -555,6 +579,7 @@ bool xdr_COMPOUND4res_extended(XDR *xdrs, struct COMPOUND4res_extended **objp);
 bool pseudo_mount_export(struct gsh_export *exp);
 void create_pseudofs(void);
 void pseudo_unmount_export(struct gsh_export *exp);
+void pseudofs_log_stats(void);
 bool export_is_defunct(struct gsh_export *exp, uint64_t generation);
 
 /* Slot functions */
@@ -297,6 +297,39 @@ int nfs4_Fattr_Fill_Error(compound_data_t *, fattr4 *, nfsstat4,
 int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *, struct bitmap4 *,
 			   fattr4 *);
 
+int nfs4_FSALattr_To_Fattr_xdr(struct xdr_attrs_args *, struct bitmap4 *,
+			       XDR *);
+
+/**
+ * @brief Directory entries being encoded for a READDIR(PLUS) reply
+ */
+struct xdr_entries_buf {
+	char *buf;		/*< Encoded entries */
+	u_int size;		/*< Allocated size of buf */
+	u_int limit;		/*< Entries must end within this */
+	u_int max;		/*< Never grow past this */
+	XDR xdrs;		/*< Memory stream over buf */
+};
+
+#define XDR_ENTRIES_BUF_INITIAL 8192
+
+/**
+ * @brief Outcome of appending an entry to a struct xdr_entries_buf
+ */
+enum xdr_entries_res {
+	XDR_ENTRIES_OK,		/*< Appended */
+	XDR_ENTRIES_FULL,	/*< Does not fit within the limit */
+	XDR_ENTRIES_FAILED	/*< Could not be encoded */
+};
+
+typedef bool (*xdr_entry_encoder_t)(XDR *, void *);
+
+void xdr_entries_buf_init(struct xdr_entries_buf *, u_int);
+enum xdr_entries_res xdr_entries_buf_append(struct xdr_entries_buf *,
+					    xdr_entry_encoder_t, void *);
+char *xdr_entries_buf_take(struct xdr_entries_buf *, u_int *);
+void xdr_entries_buf_destroy(struct xdr_entries_buf *);
+
 void nfs4_bitmap4_Remove_Unsupported(struct bitmap4 *);
 
 enum nfs4_minor_vers {
@@ -0,0 +1,112 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_qos.h
+ * @brief Request admission scheduler (QoS)
+ *
+ * When enabled by the QOS config block, every decoded NFS request with
+ * an export or a COMPOUND passes through nfs_qos_admit() before it is
+ * dispatched.  Requests are admitted in weighted fair queueing order
+ * across clients, subject to per client and per export IOPS and
+ * bandwidth token buckets and to a global limit on requests in
+ * service.  A request that cannot be admitted right away waits on the
+ * worker thread that decoded it.  So that a throttled client cannot tie
+ * up every worker, the number of waiting requests is capped per client
+ * and in total, and a request beyond the cap is answered with
+ * NFS3ERR_JUKEBOX or NFS4ERR_DELAY.
+ *
+ * Per client limits and weights come from the export permissions
+ * (Client_Max_IOPS, Client_Max_Bandwidth and QOS_Weight in CLIENT,
+ * EXPORT and EXPORT_DEFAULTS blocks).  Aggregate limits on an export
+ * come from Max_IOPS and Max_Bandwidth in its EXPORT block.
+ */
+
+#ifndef NFS_QOS_H
+#define NFS_QOS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config_parsing.h"
+#include "gsh_list.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+struct nfs_request;
+
+/**
+ * @brief A token bucket
+ *
+ * Tokens are kept as a double so that low rates refill smoothly.  The
+ * bucket holds at most one second worth of tokens.  A rate of 0 means
+ * no limit.
+ */
+
+struct qos_bucket {
+	double tokens;
+	uint64_t rate;
+	uint64_t last;		/*< Last refill, monotonic nsecs */
+};
+
+/**
+ * @brief Scheduling state of a client or an export
+ *
+ * All fields are protected by the scheduler mutex.
+ */
+
+struct qos_flow {
+	struct glist_head flows;	/*< On the list of all flows */
+	char *name;
+	struct qos_bucket iops;
+	struct qos_bucket bw;
+	uint64_t vfinish;	/*< WFQ finish tag of the last request */
+	uint32_t pass;		/*< Scheduling pass that found it blocked */
+	uint32_t queued;	/*< Requests waiting for admission */
+	uint64_t dispatched;	/*< Requests admitted */
+	uint64_t throttled;	/*< Requests that had to wait */
+	uint64_t refused;	/*< Requests told to retry later */
+	uint64_t wait;		/*< Total wait, nsecs */
+};
+
+/** @brief Configuration of the scheduler, QOS block */
+
+struct qos_param {
+	/** Run requests through the scheduler */
+	bool enable;
+	/** Maximum requests in service at once */
+	uint32_t max_inflight;
+	/** Maximum requests waiting for admission, 0 for half of
+	    RPC_Ioq_ThrdMax */
+	uint32_t max_queued;
+	/** Maximum requests of a client or an export waiting */
+	uint32_t max_queued_per_flow;
+};
+
+extern struct qos_param nfs_qos_param;
+extern struct config_block nfs_qos_block;
+
+bool nfs_qos_admit(struct nfs_request *reqdata);
+void nfs_qos_done(struct nfs_request *reqdata);
+void nfs_qos_release_flow(struct qos_flow **flow);
+#ifdef USE_DBUS
+void nfs_qos_dbus_show(DBusMessageIter *iter);
+#endif
+
+#endif				/* NFS_QOS_H */
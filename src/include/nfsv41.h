@@ -1647,6 +1647,8 @@ typedef struct OPEN_DOWNGRADE4res OPEN_DOWNGRADE4res;
 
 struct PUTFH4args {
 	nfs_fh4 object;
+	/** Handles are decoded here, with nfs_fh4_val pointing to it */
+	char object_buf[NFS4_FHSIZE];
 };
 typedef struct PUTFH4args PUTFH4args;
 
@@ -1709,6 +1711,10 @@ typedef struct entry4 entry4;
 struct dirlist4 {
 	entry4 *entries;
 	bool_t eof;
+	/* Not part of the protocol: entries already encoded by READDIR,
+	 * sent in place of entries when set (encode only). */
+	char *entries_xdr;
+	u_int entries_xdr_len;
 };
 typedef struct dirlist4 dirlist4;
 
@@ -2538,9 +2544,9 @@ typedef struct RECLAIM_COMPLETE4res RECLAIM_COMPLETE4res;
 
 /* NFSv4.2 */
 enum netloc_type4 {
-	NL4_NAME        = 0,
-	NL4_URL         = 1,
-	NL4_NETADDR     = 2
+	NL4_NAME        = 1,
+	NL4_URL         = 2,
+	NL4_NETADDR     = 3
 };
 typedef enum netloc_type4 netloc_type4;
 
@@ -2598,7 +2604,7 @@ typedef struct {
 typedef struct {
 	bool_t            rpr_eof;
 	count4            rpr_contents_count;
-	contents          rpr_contents;
+	contents          *rpr_contents;
 } read_plus_res4;
 
 typedef struct {
@@ -2607,11 +2613,21 @@ typedef struct {
 } seek_res4;
 
 typedef struct OFFLOAD_STATUS4resok {
-	length4         osr_bytes_copied;
-	count4          osr_count_complete;
+	length4         osr_count;
+	u_int           osr_complete_len;	/* 0 or 1 */
 	nfsstat4        osr_complete;
 } OFFLOAD_STATUS4resok;
 
+struct netloc4 {
+	netloc_type4        nl_type;
+	union {
+		utf8str_cis nl_name;
+		utf8str_cis nl_url;
+		netaddr4    nl_addr;
+	};
+};
+typedef struct netloc4 netloc4;
+
 struct COPY_NOTIFY4args {
 	stateid4 cna_stateid;
 	netloc_type4        cna_type;
@@ -2655,33 +2671,57 @@ struct COPY4args {
 	offset4         ca_src_offset;
 	offset4         ca_dst_offset;
 	length4         ca_count;
-	netloc_type4        ca_type;
-	union {
-		utf8str_cis ca_name;
-		utf8str_cis ca_url;
-		netaddr4    ca_addr;
-	};
+	bool_t          ca_consecutive;
+	bool_t          ca_synchronous;
+	struct {
+		u_int ca_source_server_len;
+		netloc4 *ca_source_server_val;
+	} ca_source_server;
 };
 typedef struct COPY4args COPY4args;
 
+typedef struct {
+	bool_t          cr_consecutive;
+	bool_t          cr_synchronous;
+} copy_requirements4;
+
+typedef struct {
+	write_response4    cr_response;
+	copy_requirements4 cr_requirements;
+} COPY4resok;
+
 struct COPY4res {
 	nfsstat4 cr_status;
 	union {
-		write_response4 cr_resok4;
-		length4         cr_bytes_copied;
+		COPY4resok         cr_resok4;
+		copy_requirements4 cr_requirements;
 	} COPY4res_u;
 };
 typedef struct COPY4res COPY4res;
 
-struct OFFLOAD_ABORT4args {
-	stateid4        oaa_stateid;
+struct OFFLOAD_CANCEL4args {
+	stateid4        oca_stateid;
 };
-typedef struct OFFLOAD_ABORT4args OFFLOAD_ABORT4args;
+typedef struct OFFLOAD_CANCEL4args OFFLOAD_CANCEL4args;
 
-struct OFFLOAD_ABORT4res {
-	stateid4        oar_stateid;
+struct OFFLOAD_CANCEL4res {
+	nfsstat4        ocr_status;
 };
-typedef struct OFFLOAD_ABORT4res OFFLOAD_ABORT4res;
+typedef struct OFFLOAD_CANCEL4res OFFLOAD_CANCEL4res;
+
+struct CLONE4args {
+	stateid4        cl_src_stateid;
+	stateid4        cl_dst_stateid;
+	offset4         cl_src_offset;
+	offset4         cl_dst_offset;
+	length4         cl_count;
+};
+typedef struct CLONE4args CLONE4args;
+
+struct CLONE4res {
+	nfsstat4        cl_status;
+};
+typedef struct CLONE4res CLONE4res;
 
 struct OFFLOAD_STATUS4args {
 	stateid4        osa_stateid;
@@ -3215,7 +3255,7 @@ struct nfs_argop4 {
 		COPY_NOTIFY4args opoffload_notify;
 		OFFLOAD_REVOKE4args opcopy_revoke;
 		COPY4args opcopy;
-		OFFLOAD_ABORT4args opoffload_abort;
+		OFFLOAD_CANCEL4args opoffload_cancel;
 		OFFLOAD_STATUS4args opoffload_status;
 		WRITE_SAME4args opwrite_same;
 		ALLOCATE4args opallocate;
@@ -3225,6 +3265,7 @@ struct nfs_argop4 {
 		IO_ADVISE4args opio_advise;
 		LAYOUTERROR4args oplayouterror;
 		LAYOUTSTATS4args oplayoutstats;
+		CLONE4args opclone;
 
 		/* NFSv4.3 */
 		GETXATTR4args opgetxattr;
@@ -3300,7 +3341,7 @@ struct nfs_resop4 {
 		COPY_NOTIFY4res opoffload_notify;
 		OFFLOAD_REVOKE4res opcopy_revoke;
 		COPY4res opcopy;
-		OFFLOAD_ABORT4res opoffload_abort;
+		OFFLOAD_CANCEL4res opoffload_cancel;
 		OFFLOAD_STATUS4res opoffload_status;
 		WRITE_SAME4res opwrite_same;
 		ALLOCATE4res opallocate;
@@ -3310,6 +3351,7 @@ struct nfs_resop4 {
 		IO_ADVISE4res opio_advise;
 		LAYOUTERROR4res oplayouterror;
 		LAYOUTSTATS4res oplayoutstats;
+		CLONE4res opclone;
 
 		/* NFSv4.3 */
 		GETXATTR4res opgetxattr;
@@ -3656,6 +3698,29 @@ struct CB_NOTIFY_DEVICEID4res {
 };
 typedef struct CB_NOTIFY_DEVICEID4res CB_NOTIFY_DEVICEID4res;
 
+/* Callback operations new to NFSv4.2 */
+
+struct offload_info4 {
+	nfsstat4 coa_status;
+	union {
+		write_response4 coa_resok4;
+		length4 coa_bytes_copied;
+	} offload_info4_u;
+};
+typedef struct offload_info4 offload_info4;
+
+struct CB_OFFLOAD4args {
+	nfs_fh4 coa_fh;
+	stateid4 coa_stateid;
+	offload_info4 coa_offload_info;
+};
+typedef struct CB_OFFLOAD4args CB_OFFLOAD4args;
+
+struct CB_OFFLOAD4res {
+	nfsstat4 cor_status;
+};
+typedef struct CB_OFFLOAD4res CB_OFFLOAD4res;
+
 /* Callback operations new to NFSv4.1 */
 
 enum nfs_cb_opnum4 {
@@ -3671,6 +3736,7 @@ enum nfs_cb_opnum4 {
 	NFS4_OP_CB_WANTS_CANCELLED = 12,
 	NFS4_OP_CB_NOTIFY_LOCK = 13,
 	NFS4_OP_CB_NOTIFY_DEVICEID = 14,
+	NFS4_OP_CB_OFFLOAD = 15,
 	NFS4_OP_CB_ILLEGAL = 10044,
 };
 typedef enum nfs_cb_opnum4 nfs_cb_opnum4;
@@ -3690,6 +3756,7 @@ struct nfs_cb_argop4 {
 		CB_WANTS_CANCELLED4args opcbwants_cancelled;
 		CB_NOTIFY_LOCK4args opcbnotify_lock;
 		CB_NOTIFY_DEVICEID4args opcbnotify_deviceid;
+		CB_OFFLOAD4args opcboffload;
 	} nfs_cb_argop4_u;
 };
 typedef struct nfs_cb_argop4 nfs_cb_argop4;
@@ -3709,6 +3776,7 @@ struct nfs_cb_resop4 {
 		CB_WANTS_CANCELLED4res opcbwants_cancelled;
 		CB_NOTIFY_LOCK4res opcbnotify_lock;
 		CB_NOTIFY_DEVICEID4res opcbnotify_deviceid;
+		CB_OFFLOAD4res opcboffload;
 		CB_ILLEGAL4res opcbillegal;
 	} nfs_cb_resop4_u;
 };
@@ -4162,8 +4230,33 @@ static inline bool xdr_nfs_impl_id4(XDR *xdrs, nfs_impl_id4 *objp)
 	return true;
 }
 
+/* Number of XDR units in an encoded stateid4 */
+#define STATEID4_XDR_UNITS 4
+
 static inline bool xdr_stateid4(XDR *xdrs, stateid4 *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs,
+					STATEID4_XDR_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			IXDR_PUT_U_INT32(buf, objp->seqid);
+			ixdr_put_opaque(&buf, objp->other, 12);
+			return true;
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs,
+					STATEID4_XDR_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			objp->seqid = IXDR_GET_U_INT32(buf);
+			ixdr_get_opaque(&buf, objp->other, 12);
+			return true;
+		}
+	}
+
 	if (!inline_xdr_u_int32_t(xdrs, &objp->seqid))
 		return false;
 	if (!xdr_opaque(xdrs, objp->other, 12))
@@ -6280,8 +6373,32 @@ static inline bool xdr_OPEN_DOWNGRADE4res(XDR *xdrs,
 	return true;
 }
 
+/*
+ * Handles of requests are decoded into object_buf, saving an allocation
+ * and free per PUTFH.  Handles set up by callers still go through
+ * xdr_nfs_fh4.
+ */
 static inline bool xdr_PUTFH4args(XDR *xdrs, PUTFH4args *objp)
 {
+	switch (xdrs->x_op) {
+	case XDR_DECODE:
+		if (objp->object.nfs_fh4_val != NULL)
+			break;
+		if (!xdr_opaque_decode_fixed(xdrs, objp->object_buf,
+					     &objp->object.nfs_fh4_len,
+					     NFS4_FHSIZE))
+			return false;
+		objp->object.nfs_fh4_val = objp->object_buf;
+		return true;
+	case XDR_FREE:
+		if (objp->object.nfs_fh4_val != objp->object_buf)
+			break;
+		objp->object.nfs_fh4_val = NULL;
+		return true;
+	default:
+		break;
+	}
+
 	if (!xdr_nfs_fh4(xdrs, &objp->object))
 		return false;
 	return true;
@@ -6310,6 +6427,21 @@ static inline bool xdr_PUTROOTFH4res(XDR *xdrs, PUTROOTFH4res *objp)
 
 static inline bool xdr_READ4args(XDR *xdrs, READ4args *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, (STATEID4_XDR_UNITS + 3) *
+					      BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			objp->stateid.seqid = IXDR_GET_U_INT32(buf);
+			ixdr_get_opaque(&buf, objp->stateid.other, 12);
+			objp->offset = ixdr_get_u_int64(&buf);
+			objp->count = IXDR_GET_U_INT32(buf);
+			return true;
+		}
+	}
+
 	if (!xdr_stateid4(xdrs, &objp->stateid))
 		return false;
 	if (!xdr_offset4(xdrs, &objp->offset))
@@ -6377,6 +6509,21 @@ static inline bool xdr_entry4(XDR *xdrs, entry4 *objp)
 
 static inline bool xdr_dirlist4(XDR *xdrs, dirlist4 *objp)
 {
+	if (xdrs->x_op == XDR_ENCODE && objp->entries_xdr != NULL) {
+		bool_t no_more = false;
+
+		/* Each pre-encoded entry already carries the discriminant
+		 * of the optional that precedes it, so terminate the list.
+		 */
+		if (!xdr_opaque(xdrs, objp->entries_xdr,
+				objp->entries_xdr_len))
+			return false;
+		if (!inline_xdr_bool(xdrs, &no_more))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->eof))
+			return false;
+		return true;
+	}
 	if (!xdr_pointer(xdrs,
 	    (void **)&objp->entries, sizeof(entry4),
 	    (xdrproc_t) xdr_entry4))
@@ -6694,12 +6841,25 @@ static inline bool xdr_stable_how4(XDR *xdrs, stable_how4 *objp)
 
 static inline bool xdr_WRITE4args(XDR *xdrs, WRITE4args *objp)
 {
-	if (!xdr_stateid4(xdrs, &objp->stateid))
-		return false;
-	if (!xdr_offset4(xdrs, &objp->offset))
-		return false;
-	if (!xdr_stable_how4(xdrs, &objp->stable))
-		return false;
+	int32_t *buf = NULL;
+
+	if (xdrs->x_op == XDR_DECODE)
+		buf = xdr_inline_decode(xdrs, (STATEID4_XDR_UNITS + 3) *
+					      BYTES_PER_XDR_UNIT);
+	if (buf != NULL) {
+		/* most likely */
+		objp->stateid.seqid = IXDR_GET_U_INT32(buf);
+		ixdr_get_opaque(&buf, objp->stateid.other, 12);
+		objp->offset = ixdr_get_u_int64(&buf);
+		objp->stable = IXDR_GET_U_INT32(buf);
+	} else {
+		if (!xdr_stateid4(xdrs, &objp->stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->offset))
+			return false;
+		if (!xdr_stable_how4(xdrs, &objp->stable))
+			return false;
+	}
 	if (!inline_xdr_bytes(xdrs,
 	    (char **)&objp->data.data_val,
 	    &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
@@ -7551,6 +7711,23 @@ static inline bool xdr_SECINFO_NO_NAME4res(XDR *xdrs,
 
 static inline bool xdr_SEQUENCE4args(XDR *xdrs, SEQUENCE4args *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, NFS4_SESSIONID_SIZE +
+					      4 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			ixdr_get_opaque(&buf, objp->sa_sessionid,
+					NFS4_SESSIONID_SIZE);
+			objp->sa_sequenceid = IXDR_GET_U_INT32(buf);
+			objp->sa_slotid = IXDR_GET_U_INT32(buf);
+			objp->sa_highest_slotid = IXDR_GET_U_INT32(buf);
+			objp->sa_cachethis = IXDR_GET_U_INT32(buf) != 0;
+			return true;
+		}
+	}
+
 	if (!xdr_sessionid4(xdrs, objp->sa_sessionid))
 		return false;
 	if (!xdr_sequenceid4(xdrs, &objp->sa_sequenceid))
@@ -7566,6 +7743,24 @@ static inline bool xdr_SEQUENCE4args(XDR *xdrs, SEQUENCE4args *objp)
 
 static inline bool xdr_SEQUENCE4resok(XDR *xdrs, SEQUENCE4resok *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs, NFS4_SESSIONID_SIZE +
+					      5 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			/* most likely */
+			ixdr_put_opaque(&buf, objp->sr_sessionid,
+					NFS4_SESSIONID_SIZE);
+			IXDR_PUT_U_INT32(buf, objp->sr_sequenceid);
+			IXDR_PUT_U_INT32(buf, objp->sr_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sr_highest_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sr_target_highest_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sr_status_flags);
+			return true;
+		}
+	}
+
 	if (!xdr_sessionid4(xdrs, objp->sr_sessionid))
 		return false;
 	if (!xdr_sequenceid4(xdrs, &objp->sr_sequenceid))
@@ -7826,36 +8021,42 @@ static inline bool xdr_READ_PLUS4args(XDR *xdrs, READ_PLUS4args *objp)
 	return true;
 }
 
-static inline bool xdr_READ_PLUS4resok(XDR *xdrs, read_plus_res4 *objp)
+static inline bool xdr_read_plus_content(XDR *xdrs, contents *objp)
 {
-	if (!inline_xdr_bool(xdrs, &objp->rpr_eof))
-		return false;
-	if (objp->rpr_contents_count != 1)  /* an array of 1 for now */
-		return false;
-	if (!xdr_count4(xdrs, &objp->rpr_contents_count))
-		return false;
-	if (!inline_xdr_enum(xdrs, (enum_t *)&objp->rpr_contents.what))
+	if (!inline_xdr_enum(xdrs, (enum_t *)&objp->what))
 		return false;
-	if (objp->rpr_contents.what == NFS4_CONTENT_DATA) {
-		if (!xdr_offset4(xdrs, &objp->rpr_contents.data.d_offset))
+	if (objp->what == NFS4_CONTENT_DATA) {
+		if (!xdr_offset4(xdrs, &objp->data.d_offset))
 			return false;
 		if (!inline_xdr_bytes(xdrs,
-		    (char **)&objp->rpr_contents.data.d_data.data_val,
-		    &objp->rpr_contents.data.d_data.data_len,
+		    (char **)&objp->data.d_data.data_val,
+		    &objp->data.d_data.data_len,
 		    XDR_BYTES_MAXLEN_IO))
 			return false;
 		return true;
 	}
-	if (objp->rpr_contents.what == NFS4_CONTENT_HOLE) {
-		if (!xdr_offset4(xdrs, &objp->rpr_contents.hole.di_offset))
+	if (objp->what == NFS4_CONTENT_HOLE) {
+		if (!xdr_offset4(xdrs, &objp->hole.di_offset))
 			return false;
-		if (!xdr_length4(xdrs, &objp->rpr_contents.hole.di_length))
+		if (!xdr_length4(xdrs, &objp->hole.di_length))
 			return false;
 		return true;
 	} else
 		return false;
 }
 
+static inline bool xdr_READ_PLUS4resok(XDR *xdrs, read_plus_res4 *objp)
+{
+	if (!inline_xdr_bool(xdrs, &objp->rpr_eof))
+		return false;
+	if (!xdr_array(xdrs,
+	    (char **)&objp->rpr_contents,
+	    &objp->rpr_contents_count, XDR_ARRAY_MAXLEN,
+	    sizeof(contents), (xdrproc_t) xdr_read_plus_content))
+		return false;
+	return true;
+}
+
 static inline bool xdr_READ_PLUS4res(XDR *xdrs, READ_PLUS4res *objp)
 {
 	if (!xdr_nfsstat4(xdrs, &objp->rpr_status))
@@ -7886,6 +8087,159 @@ static inline bool xdr_WRITE_SAME4res(XDR *xdrs, WRITE_SAME4res *objp)
 	return true;
 }
 
+static inline bool xdr_netloc_type4(XDR *xdrs, netloc_type4 *objp)
+{
+	if (!inline_xdr_enum(xdrs, (enum_t *) objp))
+		return false;
+	return true;
+}
+
+static inline bool xdr_netloc4(XDR *xdrs, netloc4 *objp)
+{
+	if (!xdr_netloc_type4(xdrs, &objp->nl_type))
+		return false;
+	switch (objp->nl_type) {
+	case NL4_NAME:
+		if (!xdr_utf8str_cis(xdrs, &objp->nl_name))
+			return false;
+		break;
+	case NL4_URL:
+		if (!xdr_utf8str_cis(xdrs, &objp->nl_url))
+			return false;
+		break;
+	case NL4_NETADDR:
+		if (!xdr_netaddr4(xdrs, &objp->nl_addr))
+			return false;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+static inline bool xdr_COPY4args(XDR *xdrs, COPY4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->ca_src_stateid))
+		return false;
+	if (!xdr_stateid4(xdrs, &objp->ca_dst_stateid))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->ca_src_offset))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->ca_dst_offset))
+		return false;
+	if (!xdr_length4(xdrs, &objp->ca_count))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->ca_consecutive))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->ca_synchronous))
+		return false;
+	if (!xdr_array(xdrs,
+	    (char **)&objp->ca_source_server.ca_source_server_val,
+	    &objp->ca_source_server.ca_source_server_len, XDR_ARRAY_MAXLEN,
+	    sizeof(netloc4), (xdrproc_t) xdr_netloc4))
+		return false;
+	return true;
+}
+
+static inline bool xdr_copy_requirements4(XDR *xdrs,
+					  copy_requirements4 *objp)
+{
+	if (!inline_xdr_bool(xdrs, &objp->cr_consecutive))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->cr_synchronous))
+		return false;
+	return true;
+}
+
+static inline bool xdr_COPY4res(XDR *xdrs, COPY4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->cr_status))
+		return false;
+	switch (objp->cr_status) {
+	case NFS4_OK:
+		if (!xdr_WRITE_SAME4resok(xdrs,
+		    &objp->COPY4res_u.cr_resok4.cr_response))
+			return false;
+		if (!xdr_copy_requirements4(xdrs,
+		    &objp->COPY4res_u.cr_resok4.cr_requirements))
+			return false;
+		break;
+	case NFS4ERR_OFFLOAD_NO_REQS:
+		if (!xdr_copy_requirements4(xdrs,
+		    &objp->COPY4res_u.cr_requirements))
+			return false;
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_CANCEL4args(XDR *xdrs,
+					   OFFLOAD_CANCEL4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->oca_stateid))
+		return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_CANCEL4res(XDR *xdrs, OFFLOAD_CANCEL4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->ocr_status))
+		return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_STATUS4args(XDR *xdrs,
+					   OFFLOAD_STATUS4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->osa_stateid))
+		return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_STATUS4res(XDR *xdrs, OFFLOAD_STATUS4res *objp)
+{
+	OFFLOAD_STATUS4resok *resok = &objp->OFFLOAD_STATUS4res_u.osr_resok4;
+
+	if (!xdr_nfsstat4(xdrs, &objp->osr_status))
+		return false;
+	if (objp->osr_status != NFS4_OK)
+		return true;
+	if (!xdr_length4(xdrs, &resok->osr_count))
+		return false;
+	if (!inline_xdr_u_int(xdrs, &resok->osr_complete_len))
+		return false;
+	if (resok->osr_complete_len > 1)
+		return false;
+	if (resok->osr_complete_len == 1)
+		if (!xdr_nfsstat4(xdrs, &resok->osr_complete))
+			return false;
+	return true;
+}
+
+static inline bool xdr_CLONE4args(XDR *xdrs, CLONE4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->cl_src_stateid))
+		return false;
+	if (!xdr_stateid4(xdrs, &objp->cl_dst_stateid))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->cl_src_offset))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->cl_dst_offset))
+		return false;
+	if (!xdr_length4(xdrs, &objp->cl_count))
+		return false;
+	return true;
+}
+
+static inline bool xdr_CLONE4res(XDR *xdrs, CLONE4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->cl_status))
+		return false;
+	return true;
+}
+
 static inline bool xdr_SEEK4args(XDR *xdrs, SEEK4args *objp)
 {
 	if (!xdr_stateid4(xdrs, &objp->sa_stateid))
@@ -8388,10 +8742,25 @@ static inline bool xdr_nfs_argop4(XDR *xdrs, nfs_argop4 *objp)
 		break;
 
 	case NFS4_OP_COPY:
-	case NFS4_OP_COPY_NOTIFY:
+		if (!xdr_COPY4args(xdrs, &objp->nfs_argop4_u.opcopy))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_CANCEL:
+		if (!xdr_OFFLOAD_CANCEL4args(xdrs,
+				&objp->nfs_argop4_u.opoffload_cancel))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_STATUS:
+		if (!xdr_OFFLOAD_STATUS4args(xdrs,
+				&objp->nfs_argop4_u.opoffload_status))
+			return false;
+		break;
 	case NFS4_OP_CLONE:
+		if (!xdr_CLONE4args(xdrs, &objp->nfs_argop4_u.opclone))
+			return false;
+		break;
+
+	case NFS4_OP_COPY_NOTIFY:
 		break;
 
 	/* NFSv4.3 */
@@ -8718,10 +9087,25 @@ static inline bool xdr_nfs_resop4(XDR *xdrs, nfs_resop4 *objp)
 		break;
 
 	case NFS4_OP_COPY:
-	case NFS4_OP_COPY_NOTIFY:
+		if (!xdr_COPY4res(xdrs, &objp->nfs_resop4_u.opcopy))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_CANCEL:
+		if (!xdr_OFFLOAD_CANCEL4res(xdrs,
+					    &objp->nfs_resop4_u.opoffload_cancel))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_STATUS:
+		if (!xdr_OFFLOAD_STATUS4res(xdrs,
+					    &objp->nfs_resop4_u.opoffload_status))
+			return false;
+		break;
 	case NFS4_OP_CLONE:
+		if (!xdr_CLONE4res(xdrs, &objp->nfs_resop4_u.opclone))
+			return false;
+		break;
+
+	case NFS4_OP_COPY_NOTIFY:
 
 	/* NFSv4.3 */
 	case NFS4_OP_GETXATTR:
@@ -9512,6 +9896,38 @@ static inline bool xdr_CB_NOTIFY_DEVICEID4res(XDR *xdrs,
 	return true;
 }
 
+static inline bool xdr_CB_OFFLOAD4args(XDR *xdrs, CB_OFFLOAD4args *objp)
+{
+	offload_info4 *info = &objp->coa_offload_info;
+
+	if (!xdr_nfs_fh4(xdrs, &objp->coa_fh))
+		return false;
+	if (!xdr_stateid4(xdrs, &objp->coa_stateid))
+		return false;
+	if (!xdr_nfsstat4(xdrs, &info->coa_status))
+		return false;
+	switch (info->coa_status) {
+	case NFS4_OK:
+		if (!xdr_WRITE_SAME4resok(xdrs,
+					  &info->offload_info4_u.coa_resok4))
+			return false;
+		break;
+	default:
+		if (!xdr_length4(xdrs,
+				 &info->offload_info4_u.coa_bytes_copied))
+			return false;
+		break;
+	}
+	return true;
+}
+
+static inline bool xdr_CB_OFFLOAD4res(XDR *xdrs, CB_OFFLOAD4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->cor_status))
+		return false;
+	return true;
+}
+
 /* Callback operations new to NFSv4.1 */
 
 static inline bool xdr_nfs_cb_opnum4(XDR *xdrs, nfs_cb_opnum4 *objp)
@@ -9586,6 +10002,11 @@ static inline bool xdr_nfs_cb_argop4(XDR *xdrs, nfs_cb_argop4 *objp)
 		    &objp->nfs_cb_argop4_u.opcbnotify_deviceid))
 			return false;
 		break;
+	case NFS4_OP_CB_OFFLOAD:
+		if (!xdr_CB_OFFLOAD4args(xdrs,
+		    &objp->nfs_cb_argop4_u.opcboffload))
+			return false;
+		break;
 	case NFS4_OP_CB_ILLEGAL:
 		break;
 	default:
@@ -9659,6 +10080,11 @@ static inline bool xdr_nfs_cb_resop4(XDR *xdrs, nfs_cb_resop4 *objp)
 		    &objp->nfs_cb_resop4_u.opcbnotify_deviceid))
 			return false;
 		break;
+	case NFS4_OP_CB_OFFLOAD:
+		if (!xdr_CB_OFFLOAD4res(xdrs,
+		    &objp->nfs_cb_resop4_u.opcboffload))
+			return false;
+		break;
 	case NFS4_OP_CB_ILLEGAL:
 		if (!xdr_CB_ILLEGAL4res(xdrs,
 		    &objp->nfs_cb_resop4_u.opcbillegal))
@@ -174,6 +174,53 @@ struct export_stats {
 	.direction = "out"   \
 }
 
+#define MEM_POOLS_REPLY      \
+{                            \
+	.name = "pools",     \
+	.type = "a(sttttt)", \
+	.direction = "out"   \
+}
+
+#define QOS_INFLIGHT_REPLY   \
+{                            \
+	.name = "inflight",  \
+	.type = "u",         \
+	.direction = "out"   \
+}
+
+#define QOS_QUEUED_REPLY     \
+{                            \
+	.name = "queued",    \
+	.type = "u",         \
+	.direction = "out"   \
+}
+
+#define QOS_FLOWS_REPLY      \
+{                            \
+	.name = "flows",     \
+	.type = "a(sttttt)", \
+	.direction = "out"   \
+}
+
+/* Counters of a cache, a struct of (name, value) pairs as sent by
+ * server_dbus_counters(), which checks the type against the counters.
+ */
+#define COUNTERS_REPLY(_name, _type) \
+{                                    \
+	.name = _name,               \
+	.type = _type,               \
+	.direction = "out"           \
+}
+
+#define IDMAPPER_CACHE_TYPE "(stststststst)"
+#define IDMAPPER_CACHE_REPLY COUNTERS_REPLY("idmapper", IDMAPPER_CACHE_TYPE)
+
+#define UID2GRP_CACHE_TYPE "(stststststststst)"
+#define UID2GRP_CACHE_REPLY COUNTERS_REPLY("uid2grp", UID2GRP_CACHE_TYPE)
+
+#define GSS_CREDS_CACHE_TYPE "(stststst)"
+#define GSS_CREDS_CACHE_REPLY COUNTERS_REPLY("gss_creds", GSS_CREDS_CACHE_TYPE)
+
 /* We are passing back FSAL name so that ganesha_stats can show it as per
  * the FSAL name
  * The fsal_stats is an array with below items in it
@@ -290,6 +337,14 @@ struct export_stats {
 }
 
 
+/**
+ * @brief A counter sent by server_dbus_counters()
+ */
+struct server_dbus_counter {
+	char *name;		/*< Name in the reply */
+	uint64_t *value;	/*< Counter, read atomically */
+};
+
 void server_stats_summary(DBusMessageIter * iter, struct gsh_stats *st);
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
 void server_dbus_v40_iostats(struct nfsv40_stats *v40p, DBusMessageIter *iter);
@@ -303,8 +358,13 @@ void server_dbus_all_iostats(struct export_stats *export_statistics,
 void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter);
 void global_dbus_total_ops(DBusMessageIter *iter);
+void server_dbus_counters(const struct server_dbus_counter *counters,
+			  int count, const char *type, DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
+void idmapper_dbus_show(DBusMessageIter *iter);
+void uid2grp_dbus_show(DBusMessageIter *iter);
+void pool_dbus_show(DBusMessageIter *iter);
 void server_dbus_v3_full_stats(DBusMessageIter *iter);
 void server_dbus_v4_full_stats(DBusMessageIter *iter);
 void reset_server_stats(void);
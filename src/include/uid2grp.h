@@ -56,12 +56,26 @@ typedef struct group_data {
 	gid_t gid;
 	time_t epoch;
 	int nbgroups;
-	unsigned int refcount;
-	pthread_mutex_t lock;
+	uint32_t refcount;	/*< Updated atomically */
+	uint32_t refreshing;	/*< A refresh is queued, updated atomically */
 	gid_t *groups;
 } group_data_t;
 
-extern pthread_rwlock_t uid2grp_user_lock;
+/**
+ * @brief uid2grp cache counters
+ */
+struct uid2grp_cache_stats {
+	uint64_t hits;		/*< Found and fresh */
+	uint64_t stale_hits;	/*< Found expired, served while refreshing */
+	uint64_t misses;	/*< Not found, looked up on the caller */
+	uint64_t refreshes;	/*< Background refreshes done */
+	uint64_t refresh_failures;	/*< Refreshes that dropped the entry */
+	uint64_t refresh_errors;	/*< Refreshes that failed, entry kept */
+	uint64_t refresh_ns;	/*< Total time spent refreshing */
+	uint64_t refresh_max_ns;	/*< Slowest refresh, approximate */
+};
+
+extern struct uid2grp_cache_stats uid2grp_cache_st;
 
 void uid2grp_cache_init(void);
 
@@ -42,6 +42,12 @@ Requires: openSUSE-release
 @BCOND_NULLFS@ nullfs
 %global use_fsal_null %{on_off_switch nullfs}
 
+@BCOND_RAWB@ rawb
+%global use_fsal_rawb %{on_off_switch rawb}
+
+@BCOND_BCACHE@ bcache
+%global use_fsal_bcache %{on_off_switch bcache}
+
 @BCOND_MEM@ mem
 %global use_fsal_mem %{on_off_switch mem}
 
@@ -303,6 +309,32 @@ This package contains a Stackable FSAL shared object to
 be used with NFS-Ganesha. This is mostly a template for future (more sophisticated) stackable FSALs
 %endif
 
+# RAWB
+%if %{with rawb}
+%package rawb
+Summary: The NFS-GANESHA readahead and write-behind Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description rawb
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It reads ahead of sequential readers and
+gathers small writes before passing them to the FSAL below it.
+%endif
+
+# BCACHE
+%if %{with bcache}
+%package bcache
+Summary: The NFS-GANESHA local block cache Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description bcache
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It caches file data of the FSAL below it
+on a local file or block device.
+%endif
+
 # MEM
 %if %{with mem}
 %package mem
@@ -491,6 +523,8 @@ Development headers and auxiliary files for developing with %{name}.
 cmake .	-DCMAKE_BUILD_TYPE=Debug			\
 	-DBUILD_CONFIG=rpmbuild				\
 	-DUSE_FSAL_NULL=%{use_fsal_null}		\
+	-DUSE_FSAL_RAWB=%{use_fsal_rawb}		\
+	-DUSE_FSAL_BCACHE=%{use_fsal_bcache}		\
 	-DUSE_FSAL_MEM=%{use_fsal_mem}			\
 	-DUSE_FSAL_NEWFS=%{use_fsal_newfs}			\
 	-DUSE_FSAL_XFS=%{use_fsal_xfs}			\
@@ -735,6 +769,16 @@ exit 0
 %{_libdir}/ganesha/libfsalnull*
 %endif
 
+%if %{with rawb}
+%files rawb
+%{_libdir}/ganesha/libfsalrawb*
+%endif
+
+%if %{with bcache}
+%files bcache
+%{_libdir}/ganesha/libfsalbcache*
+%endif
+
 %if %{with mem}
 %files mem
 %{_libdir}/ganesha/libfsalmem*
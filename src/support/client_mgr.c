@@ -66,6 +66,7 @@
 #include "gsh_intrinsic.h"
 #include "server_stats.h"
 #include "sal_functions.h"
+#include "nfs_qos.h"
 
 /* Clients are stored in an AVL tree
  */
@@ -334,6 +335,7 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 	if (removed == 0) {
 		server_st = container_of(cl, struct server_stats, client);
 		server_stats_free(&server_st->st);
+		nfs_qos_release_flow(&cl->qos_flow);
 		if (cl->hostaddr_str != NULL)
 			gsh_free(cl->hostaddr_str);
 		gsh_free(server_st);
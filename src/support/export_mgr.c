@@ -64,6 +64,10 @@
 #include "nfs_exports.h"
 #include "nfs_proto_functions.h"
 #include "pnfs_utils.h"
+#include "nfs_qos.h"
+#ifdef _HAVE_GSSAPI
+#include "gss_creds_cache.h"
+#endif
 
 struct timespec nfs_stats_time;
 struct timespec fsal_stats_time;
@@ -99,6 +103,217 @@ static struct glist_head mount_work;
   */
 static struct glist_head unexport_work;
 
+/**
+ * @brief A node in a trie of export paths
+ *
+ * Exports are indexed by path and by pseudo path in tries of path
+ * components, so finding the export for a path, or the export whose
+ * path is the longest prefix of it, costs one step per component
+ * instead of a string compare per export.  "/" is a single empty
+ * component, so relative paths (which some FSALs use) don't collide
+ * with absolute ones.
+ */
+struct export_path_node {
+	struct avltree_node node_k;	/*< In the parent's children */
+	struct avltree children;	/*< Nodes for the next component */
+	struct export_path_node *parent;	/*< NULL for the trie root */
+	struct glist_head exports;	/*< Exports with exactly this path */
+	const char *name;		/*< This component, not terminated */
+	size_t len;			/*< Length of name */
+};
+
+/** Tries of export paths and pseudo paths,
+  * protected by export_by_id.lock
+  */
+static struct export_path_node export_by_path;
+static struct export_path_node export_by_pseudo;
+
+/**
+ * @brief Iterator over the components of a path
+ */
+struct export_path_iter {
+	const char *p;		/*< Start of the next component */
+	const char *end;	/*< End of the path */
+	bool done;		/*< No more components */
+};
+
+static void export_path_iter_init(struct export_path_iter *it,
+				  const char *path)
+{
+	size_t len = strlen(path);
+
+	/* Ignore trailing slash in path, and look up "" as "/" */
+	if (len > 1 && path[len - 1] == '/')
+		len--;
+	if (len == 0)
+		path = "/";
+
+	it->p = path;
+	it->end = (len <= 1 && path[0] == '/') ? path : path + len;
+	it->done = false;
+}
+
+static bool export_path_next(struct export_path_iter *it,
+			     struct export_path_node *key)
+{
+	const char *q;
+
+	if (it->done)
+		return false;
+
+	q = memchr(it->p, '/', it->end - it->p);
+	if (q == NULL) {
+		q = it->end;
+		it->done = true;
+	}
+
+	key->name = it->p;
+	key->len = q - it->p;
+	it->p = q + 1;
+	return true;
+}
+
+static inline int export_path_cmpf(const struct avltree_node *lhs,
+				   const struct avltree_node *rhs)
+{
+	struct export_path_node *lk, *rk;
+	int rc;
+
+	lk = avltree_container_of(lhs, struct export_path_node, node_k);
+	rk = avltree_container_of(rhs, struct export_path_node, node_k);
+
+	rc = memcmp(lk->name, rk->name, MIN(lk->len, rk->len));
+	if (rc != 0)
+		return rc;
+	if (lk->len != rk->len)
+		return lk->len < rk->len ? -1 : 1;
+	return 0;
+}
+
+static void export_path_node_init(struct export_path_node *node,
+				  struct export_path_node *parent)
+{
+	avltree_init(&node->children, export_path_cmpf, 0);
+	glist_init(&node->exports);
+	node->parent = parent;
+}
+
+/**
+ * @brief Index an export in a path trie
+ *
+ * Must be called with the export manager lock held for write.
+ *
+ * @param[in]  root  The trie
+ * @param[in]  path  The export's path
+ * @param[in]  link  The export's link for this trie
+ * @param[out] where Set to the node the export is at
+ */
+
+static void export_path_insert(struct export_path_node *root,
+			       const char *path,
+			       struct glist_head *link,
+			       struct export_path_node **where)
+{
+	struct export_path_iter it;
+	struct export_path_node key, *node = root, *child;
+	struct avltree_node *found;
+
+	export_path_iter_init(&it, path);
+
+	while (export_path_next(&it, &key)) {
+		found = avltree_inline_lookup(&key.node_k, &node->children,
+					      export_path_cmpf);
+		if (found != NULL) {
+			node = avltree_container_of(found,
+						    struct export_path_node,
+						    node_k);
+			continue;
+		}
+
+		child = gsh_malloc(sizeof(*child) + key.len);
+		export_path_node_init(child, node);
+		memcpy(child + 1, key.name, key.len);
+		child->name = (const char *)(child + 1);
+		child->len = key.len;
+		avltree_inline_insert(&child->node_k, &node->children,
+				      export_path_cmpf);
+		node = child;
+	}
+
+	glist_add_tail(&node->exports, link);
+	*where = node;
+}
+
+/**
+ * @brief Remove an export from a path trie
+ *
+ * Nodes left with no export and no child are freed.  Must be called
+ * with the export manager lock held for write.
+ *
+ * @param[in]     link  The export's link for this trie
+ * @param[in,out] where The node the export is at, reset to NULL
+ */
+
+static void export_path_remove(struct glist_head *link,
+			       struct export_path_node **where)
+{
+	struct export_path_node *node = *where, *parent;
+
+	if (node == NULL)
+		return;
+
+	glist_del(link);
+	*where = NULL;
+
+	while (node->parent != NULL &&
+	       glist_empty(&node->exports) &&
+	       avltree_first(&node->children) == NULL) {
+		parent = node->parent;
+		avltree_remove(&node->node_k, &parent->children);
+		gsh_free(node);
+		node = parent;
+	}
+}
+
+/**
+ * @brief Find the node for a path in a path trie
+ *
+ * Must be called with the export manager lock held.
+ *
+ * @param[in] root        The trie
+ * @param[in] path        The path
+ * @param[in] exact_match Only the node for path itself, else the
+ *                        deepest node on the way that has exports.
+ *
+ * @return The node, with at least one export, or NULL.
+ */
+
+static struct export_path_node *export_path_lookup(
+					struct export_path_node *root,
+					const char *path,
+					bool exact_match)
+{
+	struct export_path_iter it;
+	struct export_path_node key, *node = root, *best = NULL;
+	struct avltree_node *found;
+
+	export_path_iter_init(&it, path);
+
+	while (export_path_next(&it, &key)) {
+		found = avltree_inline_lookup(&key.node_k, &node->children,
+					      export_path_cmpf);
+		if (found == NULL)
+			return exact_match ? NULL : best;
+
+		node = avltree_container_of(found, struct export_path_node,
+					    node_k);
+		if (!glist_empty(&node->exports))
+			best = node;
+	}
+
+	return best == node || !exact_match ? best : NULL;
+}
+
 void export_add_to_mount_work(struct gsh_export *export)
 {
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
@@ -204,6 +419,9 @@ void export_revert(struct gsh_export *export)
 	avltree_remove(&export->node_k, &export_by_id.t);
 	glist_del(&export->exp_list);
 	glist_del(&export->exp_work);
+	export_path_remove(&export->exp_path_list, &export->exp_path_node);
+	export_path_remove(&export->exp_pseudo_list,
+			   &export->exp_pseudo_node);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 
@@ -262,6 +480,8 @@ struct gsh_export *alloc_export(void)
 	glist_init(&export->exp_nlm_share_list);
 	glist_init(&export->mounted_exports_list);
 	glist_init(&export->clients);
+	glist_init(&export->exp_path_list);
+	glist_init(&export->exp_pseudo_list);
 
 	PTHREAD_RWLOCK_init(&export->lock, NULL);
 
@@ -283,6 +503,7 @@ void free_export(struct gsh_export *export)
 
 	/* free resources */
 	free_export_resources(export);
+	nfs_qos_release_flow(&export->qos_flow);
 	export_st = container_of(export, struct export_stats, export);
 	server_stats_free(&export_st->st);
 	PTHREAD_RWLOCK_destroy(&export->lock);
@@ -324,6 +545,14 @@ bool insert_gsh_export(struct gsh_export *export)
 	glist_add_tail(&exportlist, &export->exp_list);
 	get_gsh_export_ref(export);		/* == 2 */
 
+	/* index by path and pseudo path */
+	export_path_insert(&export_by_path, export->fullpath,
+			   &export->exp_path_list, &export->exp_path_node);
+	if (export->pseudopath != NULL)
+		export_path_insert(&export_by_pseudo, export->pseudopath,
+				   &export->exp_pseudo_list,
+				   &export->exp_pseudo_node);
+
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 	return true;
 }
@@ -383,10 +612,10 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list, assumes being called with
- * export manager lock held (such as from within foreach_gsh_export.
- * If path has a trailing '/', ignore it.
+ * Gets an export entry from its path, or the export whose path is the
+ * longest leading run of components of path, assumes being called
+ * with export manager lock held (such as from within
+ * foreach_gsh_export.  If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
  * @param exact_match [IN] the path must match exactly
@@ -397,66 +626,20 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 struct gsh_export *get_gsh_export_by_path_locked(char *path,
 						 bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
+	struct export_path_node *node;
+	struct gsh_export *ret_exp;
 
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		len_export = strlen(export->fullpath);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in fullpath just after the end of path is not '/'
-		 * it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->fullpath, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	node = export_path_lookup(&export_by_path, path, exact_match);
+	if (node == NULL)
+		return NULL;
 
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	ret_exp = glist_first_entry(&node->exports, struct gsh_export,
+				    exp_path_list);
+	get_gsh_export_ref(ret_exp);
 
 	return ret_exp;
 }
@@ -464,8 +647,8 @@ struct gsh_export *get_gsh_export_by_path_locked(char *path,
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list.
+ * Gets an export entry from its path, or the export whose path is the
+ * longest leading run of components of path.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -490,9 +673,10 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 /**
  * @brief Lookup the export manager struct by export pseudo path
  *
- * Gets an export entry from its pseudo (if it exists), assumes
- * being called with export manager lock held (such as from within
- * foreach_gsh_export.
+ * Gets an export entry from its pseudo (if it exists), or the export
+ * whose pseudo path is the longest leading run of components of path,
+ * assumes being called with export manager lock held (such as from
+ * within foreach_gsh_export.
  *
  * @param path        [IN] the path for the entry to be found.
  * @param exact_match [IN] the path must match exactly
@@ -503,76 +687,20 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 struct gsh_export *get_gsh_export_by_pseudo_locked(char *path,
 						   bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	/* Ignore trailing slash in path */
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
+	struct export_path_node *node;
+	struct gsh_export *ret_exp;
 
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching pseudo path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->pseudopath == NULL)
-			continue;
-
-		len_export = strlen(export->pseudopath);
-
-		LogFullDebug(COMPONENT_EXPORT,
-			     "Comparing %s %d to %s %d",
-			     path, len_path,
-			     export->pseudopath, len_export);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for Pseudo root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in pseudopath just after the end of path is not
-		 * '/' it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->pseudopath, path, len_export)
-		    == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	node = export_path_lookup(&export_by_pseudo, path, exact_match);
+	if (node == NULL)
+		return NULL;
 
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	ret_exp = glist_first_entry(&node->exports, struct gsh_export,
+				    exp_pseudo_list);
+	get_gsh_export_ref(ret_exp);
 
 	return ret_exp;
 }
@@ -735,6 +863,10 @@ void remove_gsh_export(uint16_t export_id)
 
 		/* Remove the export from the export list */
 		glist_del(&export->exp_list);
+		export_path_remove(&export->exp_path_list,
+				   &export->exp_path_node);
+		export_path_remove(&export->exp_pseudo_list,
+				   &export->exp_pseudo_node);
 
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
@@ -1004,6 +1136,9 @@ static bool gsh_export_addexport(DBusMessageIter *args,
 	DBusMessageIter iter;
 	char *err_detail = NULL;
 	struct error_detail conf_errs = {NULL, 0, NULL};
+	struct timespec start, end;
+
+	now(&start);
 
 	/* Get path */
 	if (dbus_message_iter_get_arg_type(args) == DBUS_TYPE_STRING)
@@ -1145,6 +1280,10 @@ static bool gsh_export_addexport(DBusMessageIter *args,
 	}
 
 out:
+	now(&end);
+	LogInfo(COMPONENT_EXPORT, "AddExport of %d exports took %" PRIu64
+		" us", exp_cnt, timespec_diff(&start, &end) / NS_PER_USEC);
+
 	if (conf_errs.buf)
 		gsh_free(conf_errs.buf);
 	if (err_detail != NULL)
@@ -1179,6 +1318,9 @@ static bool gsh_export_removeexport(DBusMessageIter *args,
 	bool rc = false;
 	bool op_ctx_set = false;
 	struct root_op_context ctx;
+	struct timespec start, end;
+
+	now(&start);
 
 	export = lookup_export(args, &errormsg);
 	if (export == NULL) {
@@ -1221,8 +1363,9 @@ static bool gsh_export_removeexport(DBusMessageIter *args,
 
 	unexport(export);
 
-	LogInfo(COMPONENT_EXPORT, "Removed export with id %d",
-		export->export_id);
+	now(&end);
+	LogInfo(COMPONENT_EXPORT, "Removed export with id %d in %" PRIu64 " us",
+		export->export_id, timespec_diff(&start, &end) / NS_PER_USEC);
 
 	put_gsh_export(export);
 
@@ -1970,6 +2113,90 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	return true;
 }
 
+static bool show_idmapper_stats(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	idmapper_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_uid2grp_stats(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	uid2grp_dbus_show(&iter);
+
+	return true;
+}
+
+#ifdef _HAVE_GSSAPI
+static bool show_gss_creds_stats(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	gss_creds_cache_dbus_show(&iter);
+
+	return true;
+}
+#endif
+
+static bool show_mem_pools(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	pool_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_qos(DBusMessageIter *args,
+		     DBusMessage *reply,
+		     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (!nfs_qos_param.enable)
+		errormsg = "QOS scheduler disabled";
+	dbus_status_reply(&iter, success, errormsg);
+
+	nfs_qos_dbus_show(&iter);
+
+	return true;
+}
+
 static struct gsh_dbus_method export_show_v41_layouts = {
 	.name = "GetNFSv41Layouts",
 	.method = get_nfsv41_export_layouts,
@@ -2529,6 +2756,55 @@ static struct gsh_dbus_method cache_inode_show = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method idmapper_show = {
+	.name = "ShowIdmapperCache",
+	.method = show_idmapper_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IDMAPPER_CACHE_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method uid2grp_show = {
+	.name = "ShowUid2grpCache",
+	.method = show_uid2grp_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 UID2GRP_CACHE_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef _HAVE_GSSAPI
+static struct gsh_dbus_method gss_creds_show = {
+	.name = "ShowGSSCredsCache",
+	.method = show_gss_creds_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 GSS_CREDS_CACHE_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
+static struct gsh_dbus_method mem_pools_show = {
+	.name = "ShowMemPools",
+	.method = show_mem_pools,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_POOLS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method qos_show = {
+	.name = "ShowQOS",
+	.method = show_qos,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 QOS_INFLIGHT_REPLY,
+		 QOS_QUEUED_REPLY,
+		 QOS_FLOWS_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -2598,6 +2874,13 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 	&global_show_total_ops,
 	&global_show_fast_ops,
 	&cache_inode_show,
+	&idmapper_show,
+	&uid2grp_show,
+#ifdef _HAVE_GSSAPI
+	&gss_creds_show,
+#endif
+	&mem_pools_show,
+	&qos_show,
 	&export_show_all_io,
 	&reset_statistics,
 	&fsal_statistics,
@@ -2651,6 +2934,9 @@ void export_pkginit(void)
 	glist_init(&mount_work);
 	glist_init(&unexport_work);
 
+	export_path_node_init(&export_by_path, NULL);
+	export_path_node_init(&export_by_pseudo, NULL);
+
 	pthread_rwlockattr_destroy(&rwlock_attr);
 }
 
@@ -52,6 +52,8 @@
 #include "pnfs_utils.h"
 #include "netgroup_cache.h"
 #include "mdcache.h"
+#include "fridgethr.h"
+#include "nfs_init.h"
 
 /**
  * @brief Protect EXPORT_DEFAULTS structure for dynamic update.
@@ -66,6 +68,7 @@ pthread_rwlock_t export_opt_lock = PTHREAD_RWLOCK_INITIALIZER;
 	.def.anonymous_uid = ANON_UID,				\
 	.def.anonymous_gid = ANON_GID,				\
 	.def.expire_time_attr = 60,				\
+	.def.qos_weight = 1,					\
 	/* Note: Access_Type defaults to None on purpose */	\
 	.def.options = EXPORT_OPTION_ROOT_SQUASH |		\
 		       EXPORT_OPTION_NO_ACCESS |		\
@@ -995,6 +998,8 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint64_t(&export->PrefReaddir, src->PrefReaddir);
 	atomic_store_uint64_t(&export->MaxOffsetWrite, src->MaxOffsetWrite);
 	atomic_store_uint64_t(&export->MaxOffsetRead, src->MaxOffsetRead);
+	atomic_store_uint64_t(&export->MaxIOPS, src->MaxIOPS);
+	atomic_store_uint64_t(&export->MaxBandwidth, src->MaxBandwidth);
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 }
@@ -1012,6 +1017,257 @@ enum export_commit_type {
 	update_export,
 };
 
+/**
+ * @brief An export whose root is to be looked up
+ */
+struct export_root_job {
+	struct gsh_export *export;	/*< The export, referenced */
+	int rc;				/*< Result of init_export_root */
+	struct export_root_batch *batch;	/*< Batch it belongs to */
+};
+
+/**
+ * @brief A set of exports having their roots looked up
+ */
+struct export_root_batch {
+	struct export_root_job *jobs;	/*< The exports */
+	size_t count;			/*< Number of jobs used */
+	size_t size;			/*< Number of jobs allocated */
+	pthread_mutex_t mtx;		/*< Protects pending */
+	pthread_cond_t cv;		/*< Signaled when pending drops to 0 */
+	size_t pending;			/*< Jobs not yet complete */
+};
+
+/**
+ * @brief New exports found by reread_exports, roots not looked up yet
+ */
+static struct export_root_batch deferred_roots;
+static pthread_mutex_t deferred_roots_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_deferred_export_roots(struct config_error_type *err_type);
+
+/**
+ * @brief Check a new export against those not inserted yet
+ *
+ * Exports added by reread_exports are only inserted in the export table
+ * once their root is known, so the usual checks against the table miss
+ * duplicates between them.
+ *
+ * @param[in]  export   The new export
+ * @param[out] err_type Config errors
+ *
+ * @return Number of errors found.
+ */
+
+static int deferred_export_conflicts(struct gsh_export *export,
+				     struct config_error_type *err_type)
+{
+	struct gsh_export *other;
+	int errcnt = 0;
+	size_t i;
+
+	PTHREAD_MUTEX_lock(&deferred_roots_mtx);
+
+	for (i = 0; i < deferred_roots.count; i++) {
+		other = deferred_roots.jobs[i].export;
+
+		if (other->export_id == export->export_id) {
+			LogDebug(COMPONENT_EXPORT,
+				 "Export %d already exists",
+				 export->export_id);
+			err_type->exists = true;
+			errcnt++;
+		}
+
+		if (export->FS_tag != NULL && other->FS_tag != NULL &&
+		    strcmp(export->FS_tag, other->FS_tag) == 0) {
+			LogCrit(COMPONENT_CONFIG,
+				"Tag (%s) is a duplicate",
+				export->FS_tag);
+			err_type->invalid = true;
+			errcnt++;
+		}
+
+		if (export->pseudopath != NULL && other->pseudopath != NULL &&
+		    strcmp(export->pseudopath, other->pseudopath) == 0) {
+			LogCrit(COMPONENT_CONFIG,
+				"Pseudo path (%s) is a duplicate",
+				export->pseudopath);
+			err_type->invalid = true;
+			errcnt++;
+		}
+
+		if (export->pseudopath == NULL && export->FS_tag == NULL &&
+		    strcmp(export->fullpath, other->fullpath) == 0) {
+			LogCrit(COMPONENT_CONFIG,
+				"Duplicate path (%s) without unique tag or Pseudo path",
+				export->fullpath);
+			err_type->invalid = true;
+			errcnt++;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&deferred_roots_mtx);
+
+	return errcnt;
+}
+
+/**
+ * @brief Add an export to a batch, taking a reference
+ *
+ * @param[in,out] batch  The batch
+ * @param[in]     export The export
+ */
+
+static void export_root_batch_add(struct export_root_batch *batch,
+				  struct gsh_export *export)
+{
+	if (batch->count == batch->size) {
+		batch->size = batch->size == 0 ? 64 : batch->size * 2;
+		batch->jobs = gsh_realloc(batch->jobs,
+					  batch->size * sizeof(*batch->jobs));
+	}
+
+	get_gsh_export_ref(export);
+	batch->jobs[batch->count].export = export;
+	batch->jobs[batch->count].rc = 0;
+	batch->jobs[batch->count].batch = batch;
+	batch->count++;
+}
+
+static void export_root_job_run(struct export_root_job *job)
+{
+	struct export_root_batch *batch = job->batch;
+
+	job->rc = init_export_root(job->export);
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	if (--batch->pending == 0)
+		pthread_cond_signal(&batch->cv);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+static void export_root_job_thread(struct fridgethr_context *ctx)
+{
+	export_root_job_run(ctx->arg);
+}
+
+/**
+ * @brief Look up the roots of a batch of exports
+ *
+ * Each lookup is a round trip to the backend, so with thousands of
+ * exports doing them one at a time dominates startup.  They are
+ * independent of each other, so run them on up to Export_Init_Threads
+ * threads and wait for all of them.  Results are left in each job.
+ *
+ * @param[in,out] batch The exports
+ */
+
+static void export_root_batch_run(struct export_root_batch *batch)
+{
+	struct fridgethr *fr = NULL;
+	struct fridgethr_params frp;
+	uint32_t threads = nfs_param.core_param.export_init_threads;
+	size_t i;
+	int rc;
+
+	if (batch->count == 0)
+		return;
+
+	PTHREAD_MUTEX_init(&batch->mtx, NULL);
+	PTHREAD_COND_init(&batch->cv, NULL);
+	batch->pending = batch->count;
+
+	if (threads > batch->count)
+		threads = batch->count;
+
+	if (threads > 1) {
+		memset(&frp, 0, sizeof(frp));
+		frp.thr_max = threads;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&fr, "Export_Init", &frp);
+		if (rc != 0) {
+			LogWarn(COMPONENT_EXPORT,
+				"Unable to start export init threads: %d, looking up export roots serially",
+				rc);
+			fr = NULL;
+		}
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		if (fr == NULL ||
+		    fridgethr_submit(fr, export_root_job_thread,
+				     &batch->jobs[i]) != 0)
+			export_root_job_run(&batch->jobs[i]);
+	}
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	while (batch->pending != 0)
+		pthread_cond_wait(&batch->cv, &batch->mtx);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+
+	if (fr != NULL) {
+		rc = fridgethr_sync_command(fr, fridgethr_comm_stop, 120);
+
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(fr);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Failed shutting down export init threads: %d",
+				 rc);
+		}
+		fridgethr_destroy(fr);
+	}
+
+	PTHREAD_COND_destroy(&batch->cv);
+	PTHREAD_MUTEX_destroy(&batch->mtx);
+}
+
+/**
+ * @brief Drop the references a batch holds and empty it
+ *
+ * @param[in,out] batch The batch
+ */
+
+static void export_root_batch_release(struct export_root_batch *batch)
+{
+	size_t i;
+
+	for (i = 0; i < batch->count; i++)
+		put_gsh_export(batch->jobs[i].export);
+
+	gsh_free(batch->jobs);
+	batch->jobs = NULL;
+	batch->count = 0;
+	batch->size = 0;
+}
+
+/**
+ * @brief Map an init_export_root error to a config error
+ *
+ * @param[in]  rc       The error
+ * @param[out] err_type Config error to flag
+ */
+
+static void export_root_err(int rc, struct config_error_type *err_type)
+{
+	switch (rc) {
+	case EINVAL:
+		err_type->invalid = true;
+		break;
+
+	case EFAULT:
+		err_type->internal = true;
+		break;
+
+	default:
+		err_type->resource = true;
+	}
+}
+
 static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				struct config_error_type *err_type,
 				enum export_commit_type commit_type)
@@ -1020,6 +1276,7 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	int errcnt = 0;
 	char perms[1024] = "\0";
 	struct display_buffer dspbuf = {sizeof(perms), perms, perms};
+	bool defer_root = false;
 
 	LogFullDebug(COMPONENT_EXPORT, "Processing %p", export);
 
@@ -1210,9 +1467,13 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 
 	if (commit_type == update_export) {
 		/* We found a new export during export update, consider it
-		 * an add_export for the rest of configuration.
+		 * an add_export for the rest of configuration.  Its root is
+		 * looked up along with any other new export once the whole
+		 * configuration has been read, and only then is it inserted,
+		 * see init_deferred_export_roots.
 		 */
 		commit_type = add_export;
+		defer_root = true;
 	}
 
 	if (probe_exp != NULL) {
@@ -1276,6 +1537,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		put_gsh_export(probe_exp);
 	}
 
+	if (defer_root)
+		errcnt += deferred_export_conflicts(export, err_type);
+
 	if (errcnt) {
 		if (err_type->exists && !err_type->invalid)
 			LogDebug(COMPONENT_EXPORT,
@@ -1288,24 +1552,12 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		return errcnt;  /* have errors. don't init or load a fsal */
 	}
 
-	if (commit_type != initial_export) {
-		/* add_export or update_export with new export_id. */
+	if (commit_type != initial_export && !defer_root) {
+		/* add_export */
 		int rc = init_export_root(export);
 
 		if (rc) {
-			switch (rc) {
-			case EINVAL:
-				err_type->invalid = true;
-				break;
-
-			case EFAULT:
-				err_type->internal = true;
-				break;
-
-			default:
-				err_type->resource = true;
-			}
-
+			export_root_err(rc, err_type);
 			errcnt++;
 			return errcnt;
 		}
@@ -1317,7 +1569,14 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		}
 	}
 
-	if (!insert_gsh_export(export)) {
+	if (defer_root) {
+		/* Not visible until its root is known, the batch holds the
+		 * only reference meanwhile.
+		 */
+		PTHREAD_MUTEX_lock(&deferred_roots_mtx);
+		export_root_batch_add(&deferred_roots, export);
+		PTHREAD_MUTEX_unlock(&deferred_roots_mtx);
+	} else if (!insert_gsh_export(export)) {
 		LogCrit(COMPONENT_CONFIG,
 			"Export id %d already in use.",
 			export->export_id);
@@ -1355,7 +1614,7 @@ success:
 		"Export %d has %zd defined clients", export->export_id,
 		glist_length(&export->clients));
 
-	if (commit_type != update_export) {
+	if (commit_type != update_export && !defer_root) {
 		/* For initial or add export, insert_gsh_export gave out
 		 * two references, a sentinel reference for the export's
 		 * presence in the export table, and one reference for our
@@ -1628,7 +1887,16 @@ struct config_item_list deleg_types[] =  {
 		_struct_, _perms_.options, _perms_.set),		\
 	CONF_ITEM_ENUM_BITS_SET("Delegations",				\
 		EXPORT_OPTION_NO_DELEGATIONS, EXPORT_OPTION_DELEGATIONS,\
-		delegations, _struct_, _perms_.options, _perms_.set)
+		delegations, _struct_, _perms_.options, _perms_.set),	\
+	CONF_ITEM_UI64_SET("Client_Max_IOPS", 0, UINT64_MAX, 0,		\
+		_struct_, _perms_.client_max_iops,			\
+		EXPORT_OPTION_QOS_IOPS_SET, _perms_.set),		\
+	CONF_ITEM_UI64_SET("Client_Max_Bandwidth", 0, UINT64_MAX, 0,	\
+		_struct_, _perms_.client_max_bw,			\
+		EXPORT_OPTION_QOS_BW_SET, _perms_.set),			\
+	CONF_ITEM_I32_SET("QOS_Weight", 1, 1000, 1,			\
+		_struct_, _perms_.qos_weight,				\
+		EXPORT_OPTION_QOS_WEIGHT_SET, _perms_.set)
 
 /**
  * @brief Process a list of clients for a client block
@@ -1759,7 +2027,11 @@ static struct config_item fsal_params[] = {
 		_struct_, options, options_set),			\
 	CONF_ITEM_BOOLBIT_SET("Security_Label",				\
 		false, EXPORT_OPTION_SECLABEL_SET,			\
-		_struct_, options, options_set)
+		_struct_, options, options_set),			\
+	CONF_ITEM_UI64("Max_IOPS", 0, UINT64_MAX, 0,			\
+		       _struct_, MaxIOPS),				\
+	CONF_ITEM_UI64("Max_Bandwidth", 0, UINT64_MAX, 0,		\
+		       _struct_, MaxBandwidth)
 
 /**
  * @brief Table of EXPORT block parameters
@@ -2073,9 +2345,12 @@ int reread_exports(config_file_t in_config,
 		   struct config_error_type *err_type)
 {
 	int rc, num_exp;
+	struct timespec phase_start;
 
 	LogInfo(COMPONENT_CONFIG, "Reread exports");
 
+	now(&phase_start);
+
 	rc = load_config_from_parse(in_config,
 				    &export_defaults_param,
 				    NULL,
@@ -2093,12 +2368,22 @@ int reread_exports(config_file_t in_config,
 					 false,
 					 err_type);
 
+	nfs_init_phase_done("Export configuration reload", &phase_start);
+
+	/* Look up the roots of the new exports, then mount them */
+	init_deferred_export_roots(err_type);
+
+	nfs_init_phase_done("Export root init for reload", &phase_start);
+
 	if (num_exp < 0) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
 		return -1;
 	}
 
 	prune_defunct_exports(get_config_generation(in_config));
+
+	nfs_init_phase_done("Export prune", &phase_start);
+	pseudofs_log_stats();
 	return num_exp;
 }
 
@@ -2169,7 +2454,7 @@ void free_export_resources(struct gsh_export *export)
 }
 
 /**
- * @brief pkginit callback to initialize exports from nfs_init
+ * @brief pkginit callback to collect the exports from nfs_init
  *
  * Assumes being called with the export_by_id.lock held.
  * true on success
@@ -2177,13 +2462,7 @@ void free_export_resources(struct gsh_export *export)
 
 static bool init_export_cb(struct gsh_export *exp, void *state)
 {
-	struct glist_head *errlist = state;
-
-	if (init_export_root(exp)) {
-		glist_del(&exp->exp_list);
-		glist_add(errlist, &exp->exp_list);
-	}
-
+	export_root_batch_add(state, exp);
 	return true;
 }
 
@@ -2193,17 +2472,118 @@ static bool init_export_cb(struct gsh_export *exp, void *state)
 
 void exports_pkginit(void)
 {
-	struct glist_head errlist;
-	struct glist_head *glist, *glistn;
+	struct export_root_batch batch;
+	size_t i;
+
+	memset(&batch, 0, sizeof(batch));
+	foreach_gsh_export(init_export_cb, false, &batch);
+
+	export_root_batch_run(&batch);
+
+	for (i = 0; i < batch.count; i++) {
+		if (batch.jobs[i].rc != 0)
+			export_revert(batch.jobs[i].export);
+	}
+
+	export_root_batch_release(&batch);
+}
+
+/**
+ * @brief Drop an export added by reread_exports that was never inserted
+ *
+ * The reference of its batch is dropped with the batch.
+ *
+ * @param[in] export The export
+ */
+
+static void discard_deferred_export(struct gsh_export *export)
+{
+	struct fsal_obj_handle *obj = export->exp_root_obj;
+	struct root_op_context root_op_context;
+
+	init_root_op_context(&root_op_context, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	if (obj != NULL) {
+		PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+		PTHREAD_RWLOCK_wrlock(&export->lock);
+
+		glist_del(&export->exp_root_list);
+		export->exp_root_obj = NULL;
+		(void) atomic_dec_int32_t(
+				&obj->state_hdl->dir.exp_root_refcount);
+
+		PTHREAD_RWLOCK_unlock(&export->lock);
+		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+		obj->obj_ops->put_ref(obj);
+	}
+
+	if (export->has_pnfs_ds) {
+		/* Drops the reference create_export took */
+		export->has_pnfs_ds = false;
+		pnfs_ds_remove(export->export_id, true);
+	}
+
+	release_root_op_context();
+}
+
+/**
+ * @brief Look up the roots of the exports added by reread_exports
+ *
+ * Exports are inserted in the export table once their root is known,
+ * so that no request finds them without one, and then mounted in the
+ * pseudo fs.  Those whose root can't be found are dropped.
+ *
+ * @param[out] err_type Config errors
+ */
+
+static void init_deferred_export_roots(struct config_error_type *err_type)
+{
+	struct export_root_batch batch;
 	struct gsh_export *export;
+	size_t i;
 
-	glist_init(&errlist);
-	foreach_gsh_export(init_export_cb, true, &errlist);
+	PTHREAD_MUTEX_lock(&deferred_roots_mtx);
+	batch = deferred_roots;
+	memset(&deferred_roots, 0, sizeof(deferred_roots));
+	PTHREAD_MUTEX_unlock(&deferred_roots_mtx);
+
+	/* The jobs point back at their batch */
+	for (i = 0; i < batch.count; i++)
+		batch.jobs[i].batch = &batch;
+
+	export_root_batch_run(&batch);
+
+	for (i = 0; i < batch.count; i++) {
+		export = batch.jobs[i].export;
+
+		if (batch.jobs[i].rc != 0) {
+			export_root_err(batch.jobs[i].rc, err_type);
+			discard_deferred_export(export);
+			continue;
+		}
 
-	glist_for_each_safe(glist, glistn, &errlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-		export_revert(export);
+		if (!insert_gsh_export(export)) {
+			/* Added over DBus in the meantime */
+			LogCrit(COMPONENT_CONFIG,
+				"Export id %d already in use.",
+				export->export_id);
+			err_type->exists = true;
+			discard_deferred_export(export);
+			continue;
+		}
+
+		/* Keep the sentinel reference, the batch has its own */
+		put_gsh_export(export);
+
+		if (!mount_gsh_export(export)) {
+			err_type->internal = true;
+			export_revert(export);
+		}
 	}
+
+	export_root_batch_release(&batch);
 }
 
 /**
@@ -2290,7 +2670,8 @@ static void set_fs_max_rdwr_size(struct gsh_export *export, uint64_t maxread,
 /**
  * @brief Initialize the root cache inode for an export.
  *
- * Assumes being called with the export_by_id.lock held.
+ * The caller must hold a reference to the export.  Roots of different
+ * exports may be initialized concurrently.
  *
  * @param exp [IN] the export
  *
@@ -2826,6 +3207,28 @@ gid_t get_anonymous_gid(void)
 	return anon_gid;
 }
 
+/**
+ * @brief Take the QoS limits not yet set from a less specific level
+ *
+ * @param[in,out] perms Permissions being built
+ * @param[in]     src   Client, export or default permissions
+ */
+
+static inline void export_merge_qos(struct export_perms *perms,
+				    struct export_perms *src)
+{
+	uint32_t take = src->set & ~perms->set;
+
+	if (take & EXPORT_OPTION_QOS_IOPS_SET)
+		perms->client_max_iops = src->client_max_iops;
+
+	if (take & EXPORT_OPTION_QOS_BW_SET)
+		perms->client_max_bw = src->client_max_bw;
+
+	if (take & EXPORT_OPTION_QOS_WEIGHT_SET)
+		perms->qos_weight = src->qos_weight;
+}
+
 /**
  * @brief Checks if a machine is authorized to access an export entry
  *
@@ -2886,6 +3289,8 @@ void export_check_access(void)
 			op_ctx->export_perms->anonymous_gid =
 					client->client_perms.anonymous_gid;
 
+		export_merge_qos(op_ctx->export_perms, &client->client_perms);
+
 		op_ctx->export_perms->set = client->client_perms.set;
 	}
 
@@ -2913,6 +3318,9 @@ void export_check_access(void)
 		op_ctx->export_perms->expire_time_attr =
 			op_ctx->ctx_export->export_perms.expire_time_attr;
 
+	export_merge_qos(op_ctx->export_perms,
+			 &op_ctx->ctx_export->export_perms);
+
 	op_ctx->export_perms->set |= op_ctx->ctx_export->export_perms.set;
 
  no_export:
@@ -2941,6 +3349,8 @@ void export_check_access(void)
 		op_ctx->export_perms->expire_time_attr =
 			export_opt.conf.expire_time_attr;
 
+	export_merge_qos(op_ctx->export_perms, &export_opt.conf);
+
 	op_ctx->export_perms->set |= export_opt.conf.set;
 
 	/* And finally take any options not yet set from global defaults */
@@ -2959,6 +3369,8 @@ void export_check_access(void)
 		op_ctx->export_perms->expire_time_attr =
 					export_opt.def.expire_time_attr;
 
+	export_merge_qos(op_ctx->export_perms, &export_opt.def);
+
 	op_ctx->export_perms->set |= export_opt.def.set;
 
 	if (isMidDebug(COMPONENT_EXPORT)) {
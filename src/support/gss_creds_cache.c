@@ -0,0 +1,262 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @addtogroup idmapper
+ * @{
+ */
+
+/**
+ * @file gss_creds_cache.c
+ * @brief Credentials mapped from RPCSEC_GSS contexts
+ *
+ * Every RPCSEC_GSS request used to map the context's principal with
+ * principal2uid() and then fetch the groups with uid2grp(), taking the
+ * idmapper and uid2grp locks each time.  The result only depends on the
+ * context, so it is kept here in a direct mapped table indexed by the
+ * context's address, with as many slots as there can be contexts
+ * (RPC_GSS_Max_Ctx).
+ *
+ * Slots are replaced with rcu_xchg_pointer and old entries are freed
+ * after a grace period, so lookups only need rcu_read_lock.  Contexts
+ * are freed and their memory reused by the RPC library without telling
+ * us, so an entry is only used if the context handle and the principal
+ * still match.  Entries expire with Manage_Gids_Expiration, or as soon
+ * as a mapping in the idmapper cache changes.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <urcu-bp.h>
+#include "log.h"
+#include "gsh_rpc.h"
+#include "nfs_core.h"
+#include "abstract_atomic.h"
+#include "idmapper.h"
+#include "uid2grp.h"
+#include "gss_creds_cache.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/**
+ * @brief Credentials of one context
+ */
+
+struct gss_creds {
+	struct svc_rpc_gss_data *gd;	/*< Context, only compared */
+	gss_ctx_id_t ctx;	/*< GSS context handle when added */
+	uid_t uid;
+	gid_t gid;
+	struct group_data *gdata;	/*< Groups, one reference held */
+	time_t epoch;
+	uint64_t generation;	/*< idmapper_generation when added */
+	uint64_t hits;		/*< Lookups served, updated atomically */
+	struct rcu_head rcu;	/*< For deferred free */
+	size_t len;		/*< Length of principal */
+	char principal[];
+};
+
+/**
+ * @brief Cache statistics, updated atomically
+ */
+
+struct gss_creds_cache_stats gss_creds_cache_st;
+
+/** @brief The slots, a power of two of them */
+static struct gss_creds **gss_creds_slots;
+static uint32_t gss_creds_mask;
+
+static inline uint32_t gss_creds_slot(struct svc_rpc_gss_data *gd)
+{
+	/* Fibonacci hashing of the address, the low bits are all zero */
+	return (((uintptr_t) gd * 0x9E3779B97F4A7C15ULL) >> 32) &
+		gss_creds_mask;
+}
+
+static void gss_creds_free_rcu(struct rcu_head *head)
+{
+	struct gss_creds *creds = container_of(head, struct gss_creds, rcu);
+
+	uid2grp_unref(creds->gdata);
+	gsh_free(creds);
+}
+
+/**
+ * @brief Drop an entry taken out of its slot
+ *
+ * @param[in] creds	The entry, may be NULL
+ */
+
+static void gss_creds_retire(struct gss_creds *creds)
+{
+	if (creds == NULL)
+		return;
+
+	LogFullDebug(COMPONENT_IDMAPPER,
+		     "Dropping credentials of %s, %" PRIu64 " hits",
+		     creds->principal, atomic_fetch_uint64_t(&creds->hits));
+
+	call_rcu(&creds->rcu, gss_creds_free_rcu);
+}
+
+/**
+ * @brief Size the table from RPC_GSS_Max_Ctx
+ */
+
+void gss_creds_cache_init(void)
+{
+	uint32_t nslots = 1;
+
+	while (nslots < nfs_param.core_param.rpc.gss.max_ctx &&
+	       nslots < (1U << 20))
+		nslots <<= 1;
+
+	gss_creds_slots = gsh_calloc(nslots, sizeof(*gss_creds_slots));
+	gss_creds_mask = nslots - 1;
+}
+
+/**
+ * @brief Find the credentials mapped from a context
+ *
+ * @param[in]  gd	The context of the request
+ * @param[out] uid	Mapped uid
+ * @param[out] gid	Mapped gid
+ * @param[out] gdata	Groups of the uid, a reference is taken
+ *
+ * @return true if fresh credentials were found.
+ */
+
+bool gss_creds_cache_lookup(struct svc_rpc_gss_data *gd, uid_t *uid,
+			    gid_t *gid, struct group_data **gdata)
+{
+	struct gss_creds *creds;
+	bool found = false;
+
+	if (gss_creds_slots == NULL)
+		return false;
+
+	rcu_read_lock();
+
+	creds = rcu_dereference(gss_creds_slots[gss_creds_slot(gd)]);
+
+	if (creds == NULL || creds->gd != gd || creds->ctx != gd->ctx ||
+	    creds->len != gd->cname.length ||
+	    memcmp(creds->principal, gd->cname.value, creds->len) != 0) {
+		(void) atomic_inc_uint64_t(&gss_creds_cache_st.misses);
+	} else if (time(NULL) - creds->epoch >
+		   nfs_param.core_param.manage_gids_expiration ||
+		   creds->generation !=
+		   atomic_fetch_uint64_t(&idmapper_generation)) {
+		(void) atomic_inc_uint64_t(&gss_creds_cache_st.expired);
+	} else {
+		*uid = creds->uid;
+		*gid = creds->gid;
+		uid2grp_hold_group_data(creds->gdata);
+		*gdata = creds->gdata;
+		(void) atomic_inc_uint64_t(&creds->hits);
+		(void) atomic_inc_uint64_t(&gss_creds_cache_st.hits);
+		found = true;
+	}
+
+	rcu_read_unlock();
+
+	return found;
+}
+
+/**
+ * @brief Remember the credentials mapped from a context
+ *
+ * Whatever was in the slot, a stale entry of the same context or
+ * another context, is replaced.
+ *
+ * @param[in] gd	The context of the request
+ * @param[in] uid	Mapped uid
+ * @param[in] gid	Mapped gid
+ * @param[in] gdata	Groups of the uid, the cache takes its own reference
+ */
+
+void gss_creds_cache_insert(struct svc_rpc_gss_data *gd, uid_t uid,
+			    gid_t gid, struct group_data *gdata)
+{
+	struct gss_creds *creds, *old;
+
+	if (gss_creds_slots == NULL)
+		return;
+
+	creds = gsh_malloc(sizeof(*creds) + gd->cname.length + 1);
+	creds->gd = gd;
+	creds->ctx = gd->ctx;
+	creds->uid = uid;
+	creds->gid = gid;
+	uid2grp_hold_group_data(gdata);
+	creds->gdata = gdata;
+	creds->epoch = time(NULL);
+	creds->generation = atomic_fetch_uint64_t(&idmapper_generation);
+	creds->hits = 0;
+	creds->len = gd->cname.length;
+	memcpy(creds->principal, gd->cname.value, creds->len);
+	creds->principal[creds->len] = '\0';
+
+	old = rcu_xchg_pointer(&gss_creds_slots[gss_creds_slot(gd)], creds);
+
+	if (old != NULL && old->gd != gd)
+		(void) atomic_inc_uint64_t(&gss_creds_cache_st.replaced);
+
+	gss_creds_retire(old);
+}
+
+/**
+ * @brief Forget all credentials, with the uid2grp cache
+ */
+
+void gss_creds_cache_clear(void)
+{
+	uint32_t i;
+
+	if (gss_creds_slots == NULL)
+		return;
+
+	for (i = 0; i <= gss_creds_mask; i++)
+		gss_creds_retire(rcu_xchg_pointer(&gss_creds_slots[i], NULL));
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the cache counters over DBus
+ *
+ * @param[in,out] iter Reply iterator
+ */
+
+void gss_creds_cache_dbus_show(DBusMessageIter *iter)
+{
+	struct server_dbus_counter counters[] = {
+		{ "gss_creds_hits", &gss_creds_cache_st.hits },
+		{ "gss_creds_expired", &gss_creds_cache_st.expired },
+		{ "gss_creds_misses", &gss_creds_cache_st.misses },
+		{ "gss_creds_replaced", &gss_creds_cache_st.replaced },
+	};
+
+	server_dbus_counters(counters, sizeof(counters) / sizeof(counters[0]),
+			     GSS_CREDS_CACHE_TYPE, iter);
+}
+#endif /* USE_DBUS */
+
+/** @} */
@@ -0,0 +1,550 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_pool.c
+ * @brief Slab pool allocator with per-thread magazines
+ *
+ * See @ref PoolAllocator in abstract_mem.h for the design.
+ *
+ * Locking: pool_mutex protects the size class table and the list of
+ * pools.  Each size class lock protects its slabs and its magazine
+ * depot.  A thread's magazines are only touched by that thread (and by
+ * the key destructor once it has exited.)
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <sched.h>
+#ifdef USE_NUMA
+#include <numa.h>
+#endif
+
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_list.h"
+#include "gsh_intrinsic.h"
+#include "common_utils.h"
+#include "log.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/* Sanitizers and valgrind need to see every object come and go */
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__) || \
+	defined(_VALGRIND_MEMCHECK)
+#define POOL_NO_SLABS 1
+#endif
+
+/** Size and alignment of a slab */
+#define POOL_SLAB_SIZE (64 * 1024)
+/** Objects in a magazine */
+#define POOL_MAG_ROUNDS 32
+/** Full magazines a size class depot will hold */
+#define POOL_DEPOT_MAX 64
+#define POOL_NUM_CLASSES (POOL_MAX_OBJECT_SIZE / POOL_CLASS_ALIGN)
+#define POOL_MAX_NODES 8
+
+/**
+ * @brief A slab of objects of one size class
+ *
+ * The header sits at the start of the slab, so an object's slab is
+ * found by masking its address.  Slots are carved on demand and
+ * free slots are linked through their first word.
+ */
+struct pool_slab {
+	struct glist_head list;	/*< In class partial list if not full */
+	void *free;		/*< Free slots */
+	uint32_t carved;	/*< Slots handed out at least once */
+	uint32_t inuse;		/*< Slots currently allocated */
+	uint32_t node;		/*< NUMA node of the slab */
+};
+
+#define POOL_SLAB_HDR \
+	((sizeof(struct pool_slab) + POOL_CLASS_ALIGN - 1) & \
+	 ~(POOL_CLASS_ALIGN - 1))
+
+struct pool_magazine {
+	struct glist_head list;	/*< In class depot */
+	uint32_t rounds;	/*< Objects in objs */
+	void *objs[POOL_MAG_ROUNDS];
+};
+
+struct pool_class {
+	pthread_mutex_t lock;
+	uint32_t index;		/*< Index in pool_classes */
+	size_t slot_size;	/*< Object size rounded to the class */
+	uint32_t slab_objs;	/*< Slots per slab */
+	uint32_t full_mags;	/*< Length of full */
+	struct glist_head partial[POOL_MAX_NODES]; /*< Slabs with room */
+	struct glist_head full;	/*< Depot of full magazines */
+	struct glist_head empty; /*< Depot of empty magazines */
+	uint64_t slabs;		/*< Slabs allocated */
+};
+
+/** A thread's magazines for one size class */
+struct pool_tcache {
+	struct pool_magazine *loaded;
+	struct pool_magazine *prev;
+};
+
+struct pool_thread {
+	uint32_t node;
+	struct pool_tcache cache[POOL_NUM_CLASSES];
+};
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_class *pool_classes[POOL_NUM_CLASSES];
+static pool_t *pool_list;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_thread_key;
+static __thread struct pool_thread *pool_thread;
+
+#ifdef USE_NUMA
+static bool pool_numa;
+#endif
+
+/**
+ * @brief Take an object from the slabs of a class
+ *
+ * Called with the class lock held.
+ */
+
+static void *pool_slab_get(struct pool_class *cls, uint32_t node)
+{
+	struct glist_head *partial = &cls->partial[node];
+	struct pool_slab *slab;
+	void *obj;
+
+	if (glist_empty(partial)) {
+		slab = gsh_malloc_aligned(POOL_SLAB_SIZE, POOL_SLAB_SIZE);
+#ifdef USE_NUMA
+		if (pool_numa)
+			numa_tonode_memory(slab, POOL_SLAB_SIZE, node);
+#endif
+		slab->free = NULL;
+		slab->carved = 0;
+		slab->inuse = 0;
+		slab->node = node;
+		glist_add(partial, &slab->list);
+		cls->slabs++;
+	}
+
+	slab = glist_first_entry(partial, struct pool_slab, list);
+
+	if (slab->free != NULL) {
+		obj = slab->free;
+		slab->free = *(void **)obj;
+	} else {
+		obj = (char *)slab + POOL_SLAB_HDR +
+		      (size_t)slab->carved * cls->slot_size;
+		slab->carved++;
+	}
+
+	slab->inuse++;
+	if (slab->free == NULL && slab->carved == cls->slab_objs)
+		glist_del(&slab->list);
+
+	return obj;
+}
+
+/**
+ * @brief Return an object to its slab
+ *
+ * An empty slab is freed unless it is the last one with room on its
+ * node.  Called with the class lock held.
+ */
+
+static void pool_slab_put(struct pool_class *cls, void *obj)
+{
+	struct pool_slab *slab = (struct pool_slab *)
+		((uintptr_t)obj & ~((uintptr_t)POOL_SLAB_SIZE - 1));
+	struct glist_head *partial = &cls->partial[slab->node];
+	bool was_full = slab->free == NULL &&
+			slab->carved == cls->slab_objs;
+
+	*(void **)obj = slab->free;
+	slab->free = obj;
+	slab->inuse--;
+
+	if (was_full) {
+		glist_add(partial, &slab->list);
+	} else if (slab->inuse == 0 &&
+		   !(partial->next == &slab->list &&
+		     slab->list.next == partial)) {
+		glist_del(&slab->list);
+		gsh_free(slab);
+		cls->slabs--;
+	}
+}
+
+/**
+ * @brief Give a thread's magazine back to its class
+ *
+ * Called with the class lock held.
+ */
+
+static void pool_magazine_release(struct pool_class *cls,
+				  struct pool_magazine *mag)
+{
+	if (mag == NULL)
+		return;
+
+	if (mag->rounds == POOL_MAG_ROUNDS &&
+	    cls->full_mags < POOL_DEPOT_MAX) {
+		glist_add(&cls->full, &mag->list);
+		cls->full_mags++;
+		return;
+	}
+
+	while (mag->rounds > 0)
+		pool_slab_put(cls, mag->objs[--mag->rounds]);
+
+	gsh_free(mag);
+}
+
+/**
+ * @brief Return a dead thread's magazines
+ */
+
+static void pool_thread_destroy(void *arg)
+{
+	struct pool_thread *thr = arg;
+	struct pool_class *cls;
+	int i;
+
+	for (i = 0; i < POOL_NUM_CLASSES; i++) {
+		if (thr->cache[i].loaded == NULL)
+			continue;
+
+		cls = pool_classes[i];
+		PTHREAD_MUTEX_lock(&cls->lock);
+		pool_magazine_release(cls, thr->cache[i].loaded);
+		pool_magazine_release(cls, thr->cache[i].prev);
+		PTHREAD_MUTEX_unlock(&cls->lock);
+	}
+
+	gsh_free(thr);
+}
+
+static void pool_key_init(void)
+{
+	int rc = pthread_key_create(&pool_thread_key, pool_thread_destroy);
+
+	if (rc != 0) {
+		LogFatal(COMPONENT_INIT,
+			 "Could not create pool thread key: %d", rc);
+	}
+
+#ifdef USE_NUMA
+	pool_numa = numa_available() >= 0 && numa_max_node() > 0;
+#endif
+}
+
+/**
+ * @brief Get this thread's magazines for a class
+ */
+
+static inline struct pool_tcache *pool_tcache_get(struct pool_class *cls)
+{
+	struct pool_thread *thr = pool_thread;
+	struct pool_tcache *tc;
+
+	if (unlikely(thr == NULL)) {
+		(void)pthread_once(&pool_once, pool_key_init);
+		thr = gsh_calloc(1, sizeof(*thr));
+#ifdef USE_NUMA
+		if (pool_numa) {
+			int cpu = sched_getcpu();
+
+			if (cpu >= 0)
+				thr->node = numa_node_of_cpu(cpu) %
+					    POOL_MAX_NODES;
+		}
+#endif
+		(void)pthread_setspecific(pool_thread_key, thr);
+		pool_thread = thr;
+	}
+
+	tc = &thr->cache[cls->index];
+
+	if (unlikely(tc->loaded == NULL)) {
+		tc->loaded = gsh_calloc(1, sizeof(struct pool_magazine));
+		tc->prev = gsh_calloc(1, sizeof(struct pool_magazine));
+	}
+
+	return tc;
+}
+
+/**
+ * @brief Refill an empty loaded magazine
+ *
+ * Swap in a full magazine from the depot if there is one, otherwise
+ * fill half of the loaded one from the slabs.
+ */
+
+static void pool_reload(struct pool_class *cls, struct pool_tcache *tc)
+{
+	struct pool_magazine *mag;
+
+	PTHREAD_MUTEX_lock(&cls->lock);
+
+	if (!glist_empty(&cls->full)) {
+		mag = glist_first_entry(&cls->full, struct pool_magazine,
+					list);
+		glist_del(&mag->list);
+		cls->full_mags--;
+		glist_add(&cls->empty, &tc->prev->list);
+		tc->prev = tc->loaded;
+		tc->loaded = mag;
+	} else {
+		mag = tc->loaded;
+		while (mag->rounds < POOL_MAG_ROUNDS / 2)
+			mag->objs[mag->rounds++] =
+				pool_slab_get(cls, pool_thread->node);
+	}
+
+	PTHREAD_MUTEX_unlock(&cls->lock);
+}
+
+/**
+ * @brief Make room in a full loaded magazine
+ *
+ * Hand the full previous magazine to the depot if it has room,
+ * otherwise return half of the loaded one to the slabs.
+ */
+
+static void pool_unload(struct pool_class *cls, struct pool_tcache *tc)
+{
+	struct pool_magazine *mag;
+
+	PTHREAD_MUTEX_lock(&cls->lock);
+
+	if (cls->full_mags < POOL_DEPOT_MAX) {
+		if (!glist_empty(&cls->empty)) {
+			mag = glist_first_entry(&cls->empty,
+						struct pool_magazine, list);
+			glist_del(&mag->list);
+		} else {
+			mag = gsh_calloc(1, sizeof(*mag));
+		}
+		glist_add(&cls->full, &tc->prev->list);
+		cls->full_mags++;
+		tc->prev = tc->loaded;
+		tc->loaded = mag;
+	} else {
+		mag = tc->loaded;
+		while (mag->rounds > POOL_MAG_ROUNDS / 2)
+			pool_slab_put(cls, mag->objs[--mag->rounds]);
+	}
+
+	PTHREAD_MUTEX_unlock(&cls->lock);
+}
+
+static struct pool_class *pool_get_class(size_t object_size)
+{
+	uint32_t index;
+	struct pool_class *cls;
+	int i;
+
+	if (object_size == 0)
+		object_size = 1;
+	index = (object_size + POOL_CLASS_ALIGN - 1) / POOL_CLASS_ALIGN - 1;
+
+	/* Called with pool_mutex held */
+	cls = pool_classes[index];
+	if (cls != NULL)
+		return cls;
+
+	cls = gsh_calloc(1, sizeof(*cls));
+	PTHREAD_MUTEX_init(&cls->lock, NULL);
+	cls->index = index;
+	cls->slot_size = (size_t)(index + 1) * POOL_CLASS_ALIGN;
+	cls->slab_objs = (POOL_SLAB_SIZE - POOL_SLAB_HDR) / cls->slot_size;
+	for (i = 0; i < POOL_MAX_NODES; i++)
+		glist_init(&cls->partial[i]);
+	glist_init(&cls->full);
+	glist_init(&cls->empty);
+
+	pool_classes[index] = cls;
+	return cls;
+}
+
+pool_t *pool_basic_init(const char *name, size_t object_size)
+{
+	pool_t *pool = gsh_calloc(1, sizeof(pool_t));
+
+	pool->object_size = object_size;
+
+	if (name)
+		pool->name = gsh_strdup(name);
+	else
+		pool->name = NULL;
+
+	PTHREAD_MUTEX_lock(&pool_mutex);
+#ifndef POOL_NO_SLABS
+	if (object_size <= POOL_MAX_OBJECT_SIZE)
+		pool->cls = pool_get_class(object_size);
+#endif
+	pool->next = pool_list;
+	if (pool_list != NULL)
+		pool_list->prev = pool;
+	pool_list = pool;
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	return pool;
+}
+
+void pool_destroy(pool_t *pool)
+{
+	PTHREAD_MUTEX_lock(&pool_mutex);
+	if (pool->prev != NULL)
+		pool->prev->next = pool->next;
+	else
+		pool_list = pool->next;
+	if (pool->next != NULL)
+		pool->next->prev = pool->prev;
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+void *pool_alloc(pool_t *pool)
+{
+	struct pool_class *cls = pool->cls;
+	struct pool_tcache *tc;
+	struct pool_magazine *mag;
+	void *obj;
+
+	(void)atomic_inc_uint64_t(&pool->allocs);
+
+	if (cls == NULL) {
+		(void)atomic_inc_uint64_t(&pool->misses);
+		return gsh_calloc(1, pool->object_size);
+	}
+
+	tc = pool_tcache_get(cls);
+
+	if (unlikely(tc->loaded->rounds == 0)) {
+		if (tc->prev->rounds != 0) {
+			mag = tc->loaded;
+			tc->loaded = tc->prev;
+			tc->prev = mag;
+		} else {
+			(void)atomic_inc_uint64_t(&pool->misses);
+			pool_reload(cls, tc);
+		}
+	}
+
+	mag = tc->loaded;
+	obj = mag->objs[--mag->rounds];
+
+	/* Only the object, not the whole slot, has to be zeroed */
+	memset(obj, 0, pool->object_size);
+	return obj;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+	struct pool_class *cls = pool->cls;
+	struct pool_tcache *tc;
+	struct pool_magazine *mag;
+
+	if (object == NULL)
+		return;
+
+	(void)atomic_inc_uint64_t(&pool->frees);
+
+	if (cls == NULL) {
+		gsh_free(object);
+		return;
+	}
+
+	tc = pool_tcache_get(cls);
+
+	if (unlikely(tc->loaded->rounds == POOL_MAG_ROUNDS)) {
+		if (tc->prev->rounds != POOL_MAG_ROUNDS) {
+			mag = tc->loaded;
+			tc->loaded = tc->prev;
+			tc->prev = mag;
+		} else {
+			pool_unload(cls, tc);
+		}
+	}
+
+	mag = tc->loaded;
+	mag->objs[mag->rounds++] = object;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report per pool statistics
+ *
+ * For each pool: name, object size, live objects, live bytes, total
+ * allocations and allocations served from a magazine.
+ */
+
+void pool_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	pool_t *pool;
+	char *name;
+	uint64_t size, live, bytes, allocs, hits;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sttttt)",
+					 &array_iter);
+
+	PTHREAD_MUTEX_lock(&pool_mutex);
+	for (pool = pool_list; pool != NULL; pool = pool->next) {
+		name = pool->name != NULL ? pool->name : "<unnamed>";
+		size = pool->object_size;
+		allocs = atomic_fetch_uint64_t(&pool->allocs);
+		live = allocs - atomic_fetch_uint64_t(&pool->frees);
+		bytes = live * size;
+		hits = allocs - atomic_fetch_uint64_t(&pool->misses);
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &size);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &live);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &bytes);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &allocs);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &hits);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
@@ -57,6 +57,9 @@
 #include "export_mgr.h"
 #include "uid2grp.h"
 #include "client_mgr.h"
+#ifdef _HAVE_GSSAPI
+#include "gss_creds_cache.h"
+#endif
 
 /* Export permissions for root op context */
 uint32_t root_op_export_options = EXPORT_OPTION_ROOT |
@@ -257,6 +260,7 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 #ifdef _HAVE_GSSAPI
 	struct svc_rpc_gss_data *gd = NULL;
 	char principal[MAXNAMLEN + 1];
+	bool gss_creds_mapped = false;
 #endif
 
 	/* Make sure we clear out all the cred_flags except CREDS_LOADED and
@@ -303,6 +307,16 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 			/* Get the gss data to process them */
 			gd = SVCAUTH_PRIVATE(req->rq_auth);
 
+			/* Reuse what was mapped for this context */
+			if (op_ctx->caller_gdata == NULL &&
+			    gss_creds_cache_lookup(gd,
+					&op_ctx->original_creds.caller_uid,
+					&op_ctx->original_creds.caller_gid,
+					&op_ctx->caller_gdata)) {
+				op_ctx->cred_flags |= CREDS_LOADED;
+				goto gss_mapped;
+			}
+
 			memcpy(principal, gd->cname.value, gd->cname.length);
 			principal[gd->cname.length] = 0;
 
@@ -336,8 +350,10 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 			}
 
 			op_ctx->cred_flags |= CREDS_LOADED;
+			gss_creds_mapped = true;
 		}
 
+ gss_mapped:
 		auth_label = "RPCSEC_GSS";
 		op_ctx->cred_flags |= MANAGED_GIDS;
 		garray_copy = &op_ctx->managed_garray_copy;
@@ -424,6 +440,14 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 			return NFS4ERR_ACCESS;
 		}
 
+#ifdef _HAVE_GSSAPI
+		if (gss_creds_mapped)
+			gss_creds_cache_insert(gd,
+					op_ctx->original_creds.caller_uid,
+					op_ctx->original_creds.caller_gid,
+					op_ctx->caller_gdata);
+#endif
+
 		op_ctx->creds->caller_glen = op_ctx->caller_gdata->nbgroups;
 		op_ctx->creds->caller_garray = op_ctx->caller_gdata->groups;
 	} else {
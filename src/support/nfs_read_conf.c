@@ -192,6 +192,8 @@ static struct config_item core_params[] = {
 		       nfs_core_param, mount_path_pseudo),
 	CONF_ITEM_BOOL("Enable_UDP", true,
 		       nfs_core_param, enable_UDP),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 1024, 16,
+		       nfs_core_param, export_init_threads),
 	CONF_ITEM_STR("Dbus_Name_Prefix", 1, 255, NULL,
 		       nfs_core_param, dbus_name_prefix),
 	CONFIG_EOL
@@ -268,6 +270,10 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, allow_numeric_owners),
 	CONF_ITEM_BOOL("Only_Numeric_Owners", false,
 		       nfs_version4_parameter, only_numeric_owners),
+	CONF_ITEM_BOOL("Idmap_Preload", false,
+		       nfs_version4_parameter, idmap_preload),
+	CONF_ITEM_UI32("Idmap_Negative_Cache_Expiration", 0, 7 * 24 * 60 * 60,
+		       60, nfs_version4_parameter, idmap_negative_expiration),
 	CONF_ITEM_BOOL("Delegations", false,
 		       nfs_version4_parameter, allow_delegations),
 	CONF_ITEM_UI32("Deleg_Recall_Retry_Delay", 0, 10,
@@ -280,6 +286,12 @@ static struct config_item version4_params[] = {
 	CONF_ITEM_STR("RecoveryBackend", 1, MAXPATHLEN,
 		      RECOVERY_BACKEND_DEFAULT,
 		      nfs_version4_parameter, recovery_backend),
+	CONF_ITEM_PATH("Recovery_Journal_Dir", 1, MAXPATHLEN,
+		       RECOVERY_JOURNAL_DIR_DEFAULT,
+		       nfs_version4_parameter, recovery_journal_dir),
+	CONF_ITEM_UI32("Recovery_Journal_Compact", 1024, UINT32_MAX,
+		       RECOVERY_JOURNAL_COMPACT_DEFAULT,
+		       nfs_version4_parameter, recovery_journal_compact),
 	CONF_ITEM_LIST("minor_versions", NFSV4_MINOR_VERSION_ALL,
 		       minor_versions, nfs_version4_parameter, minor_versions),
 	CONF_ITEM_UI32("slot_table_size", 1, 1024, NFS41_NB_SLOTS_DEF,
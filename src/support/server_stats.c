@@ -1943,6 +1943,43 @@ void global_dbus_total_ops(DBusMessageIter *iter)
 	global_dbus_total(iter);
 }
 
+/**
+ * @brief Report counters as a struct of (name, value) pairs
+ *
+ * Preceded by a timestamp, like the other statistics.
+ *
+ * @param[in]     counters The counters
+ * @param[in]     count    Number of counters
+ * @param[in]     type     Type declared for the reply
+ * @param[in,out] iter     Reply iterator
+ */
+
+void server_dbus_counters(const struct server_dbus_counter *counters,
+			  int count, const char *type, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	int i;
+
+	/* One "st" per counter, within parentheses */
+	assert(strlen(type) == 2 * count + 2);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < count; i++) {
+		uint64_t value = atomic_fetch_uint64_t(counters[i].value);
+
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &counters[i].name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &value);
+	}
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
 void reset_server_stats(void)
 {
 	reset_global_stats();
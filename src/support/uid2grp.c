@@ -44,41 +44,41 @@
 #include <grp.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <urcu-bp.h>
 #include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
 #include "uid2grp.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
 
 /* group_data has a reference counter. If it goes to zero, it implies
- * that it is out of the cache (AVL trees) and should be freed. The
- * reference count is 1 when we put it into AVL trees. We decrement when
- * we take it out of AVL trees. Also incremented when we pass this to
- * out siders (uid2grp and friends) and decremented when they are done
- * (in uid2grp_unref()).
+ * that it is out of the cache and should be freed. The reference count
+ * is 1 when we put it into the cache. We decrement when the cache entry
+ * is freed, a grace period after it was taken out. Also incremented when
+ * we pass this to out siders (uid2grp and friends) and decremented when
+ * they are done (in uid2grp_unref()).
  *
- * When a group_data needs to be removed or expired after a certain
- * timeout, we take it out of the cache (AVL trees). When everyone using
- * the group_data are done, the refcount will go to zero at which point
- * we free group_data as well as the buffer holding supplementary
- * groups.
+ * When a group_data expires, it is replaced in the cache by a freshly
+ * looked up one. When everyone using the old group_data are done, the
+ * refcount will go to zero at which point we free group_data as well as
+ * the buffer holding supplementary groups.
  */
 void uid2grp_hold_group_data(struct group_data *gdata)
 {
-	PTHREAD_MUTEX_lock(&gdata->lock);
-	gdata->refcount++;
-	PTHREAD_MUTEX_unlock(&gdata->lock);
+	(void) atomic_inc_uint32_t(&gdata->refcount);
 }
 
 void uid2grp_release_group_data(struct group_data *gdata)
 {
-	unsigned int refcount;
-
-	PTHREAD_MUTEX_lock(&gdata->lock);
-	refcount = --gdata->refcount;
-	PTHREAD_MUTEX_unlock(&gdata->lock);
+	uint32_t refcount = atomic_dec_uint32_t(&gdata->refcount);
 
 	if (refcount == 0) {
 		gsh_free(gdata->groups);
 		gsh_free(gdata);
-	} else if (refcount == (unsigned int)-1) {
+	} else if (refcount == (uint32_t)-1) {
 		LogAlways(COMPONENT_IDMAPPER, "negative refcount on gdata: %p",
 			  gdata);
 	}
@@ -148,9 +148,11 @@ static bool my_getgrouplist_alloc(char *user,
 	return true;
 }
 
-/* Allocate and fill in group_data structure */
+/* Allocate and fill in group_data structure, not_found is set if the
+ * user definitely does not exist rather than the lookup failing.
+ */
 static struct group_data *uid2grp_allocate_by_name(
-		const struct gsh_buffdesc *name)
+		const struct gsh_buffdesc *name, bool *not_found)
 {
 	struct passwd p;
 	struct passwd *pp;
@@ -162,6 +164,7 @@ static struct group_data *uid2grp_allocate_by_name(
 
 	memcpy(namebuff, name->addr, name->len);
 	*(namebuff + name->len) = '\0';
+	*not_found = false;
 
 	buff_size = sysconf(_SC_GETPW_R_SIZE_MAX);
 	if (buff_size == -1) {
@@ -178,6 +181,7 @@ static struct group_data *uid2grp_allocate_by_name(
 		return gdata;
 	}
 	if (pp == NULL) {
+		*not_found = true;
 		LogEvent(COMPONENT_IDMAPPER,
 			 "No matching password record found for name %s",
 			 namebuff);
@@ -196,14 +200,17 @@ static struct group_data *uid2grp_allocate_by_name(
 		return NULL;
 	}
 
-	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
-/* Allocate and fill in group_data structure */
-static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
+/* Allocate and fill in group_data structure, not_found is set if the
+ * user definitely does not exist rather than the lookup failing.
+ */
+static struct group_data *uid2grp_allocate_by_uid(uid_t uid,
+						  bool *not_found)
 {
 	struct passwd p;
 	struct passwd *pp;
@@ -212,6 +219,8 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 	long buff_size;
 	int retval;
 
+	*not_found = false;
+
 	buff_size = sysconf(_SC_GETPW_R_SIZE_MAX);
 	if (buff_size == -1) {
 		LogMajor(COMPONENT_IDMAPPER, "sysconf failure: %d", errno);
@@ -226,6 +235,7 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 		return gdata;
 	}
 	if (pp == NULL) {
+		*not_found = true;
 		LogInfo(COMPONENT_IDMAPPER,
 			"No matching password record found for uid %u", uid);
 		return gdata;
@@ -243,12 +253,154 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 		return NULL;
 	}
 
-	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
+/**
+ * @brief Cache statistics, updated atomically
+ */
+
+struct uid2grp_cache_stats uid2grp_cache_st;
+
+/**
+ * @brief A queued refresh of an expired entry
+ */
+
+struct uid2grp_refresh_job {
+	struct group_data *gdata;	/*< Expired group data, held */
+	bool by_name;			/*< Look the user up by name */
+};
+
+/**
+ * @brief Look an expired user up again and replace its entry
+ *
+ * If the user does not exist any more, its entry is dropped so that
+ * the next request looks it up again, and fails, on its own.  If the
+ * lookup itself failed, e.g. the directory service is unreachable, the
+ * expired entry is kept and served until a later refresh succeeds.
+ *
+ * @param[in] job	The refresh, freed here
+ */
+
+static void uid2grp_refresh(struct uid2grp_refresh_job *job)
+{
+	struct group_data *gdata = job->gdata;
+	struct group_data *fresh;
+	struct timespec start, end;
+	nsecs_elapsed_t elapsed;
+	bool not_found;
+
+	now(&start);
+
+	if (job->by_name)
+		fresh = uid2grp_allocate_by_name(&gdata->uname, &not_found);
+	else
+		fresh = uid2grp_allocate_by_uid(gdata->uid, &not_found);
+
+	now(&end);
+	elapsed = timespec_diff(&start, &end);
+
+	if (fresh != NULL) {
+		uid2grp_add_user(fresh);
+		(void) atomic_inc_uint64_t(&uid2grp_cache_st.refreshes);
+	} else if (!not_found) {
+		/* Keep serving it, the next lookup queues a new refresh */
+		atomic_store_uint32_t(&gdata->refreshing, 0);
+		(void) atomic_inc_uint64_t(&uid2grp_cache_st.refresh_errors);
+	} else {
+		if (job->by_name)
+			uid2grp_remove_by_uname(&gdata->uname);
+		else
+			uid2grp_remove_by_uid(gdata->uid);
+		(void) atomic_inc_uint64_t(
+				&uid2grp_cache_st.refresh_failures);
+	}
+
+	(void) atomic_add_uint64_t(&uid2grp_cache_st.refresh_ns, elapsed);
+	if (elapsed > atomic_fetch_uint64_t(&uid2grp_cache_st.refresh_max_ns))
+		atomic_store_uint64_t(&uid2grp_cache_st.refresh_max_ns,
+				      elapsed);
+
+	LogFullDebug(COMPONENT_IDMAPPER,
+		     "Refreshed groups of uid %u in %" PRIu64 " ns%s",
+		     gdata->uid, elapsed,
+		     fresh != NULL ? "" : not_found ? ", dropped" : ", failed");
+
+	uid2grp_release_group_data(gdata);
+	gsh_free(job);
+}
+
+static void uid2grp_refresh_caller(struct fridgethr_context *ctx)
+{
+	uid2grp_refresh(ctx->arg);
+}
+
+/**
+ * @brief Queue the refresh of an expired entry
+ *
+ * Only the first caller to find the entry expired queues it, later
+ * ones keep using the expired group data until it is replaced.
+ *
+ * @note The caller must hold rcu_read_lock.
+ *
+ * @param[in] gdata	Expired group data, from the cache
+ * @param[in] by_name	Look the user up by name
+ */
+
+static void uid2grp_queue_refresh(struct group_data *gdata, bool by_name)
+{
+	struct uid2grp_refresh_job *job;
+
+	if (atomic_fetch_uint32_t(&gdata->refreshing) != 0 ||
+	    atomic_inc_uint32_t(&gdata->refreshing) != 1)
+		return;
+
+	job = gsh_malloc(sizeof(*job));
+	uid2grp_hold_group_data(gdata);
+	job->gdata = gdata;
+	job->by_name = by_name;
+
+	if (general_fridge == NULL ||
+	    fridgethr_submit(general_fridge, uid2grp_refresh_caller,
+			     job) != 0) {
+		/* Try again on the next lookup */
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Unable to queue refresh of uid %u", gdata->uid);
+		atomic_store_uint32_t(&gdata->refreshing, 0);
+		uid2grp_release_group_data(gdata);
+		gsh_free(job);
+	}
+}
+
+/**
+ * @brief Take a reference on cached group data
+ *
+ * Expired group data is still returned while its refresh is queued, so
+ * a slow directory server doesn't hold up requests.
+ *
+ * @note The caller must hold rcu_read_lock.
+ *
+ * @param[in] gdata	Group data found in the cache
+ * @param[in] by_name	It was found by name
+ */
+
+static void uid2grp_use_cached(struct group_data *gdata, bool by_name)
+{
+	uid2grp_hold_group_data(gdata);
+
+	if (time(NULL) - gdata->epoch <=
+	    nfs_param.core_param.manage_gids_expiration) {
+		(void) atomic_inc_uint64_t(&uid2grp_cache_st.hits);
+		return;
+	}
+
+	(void) atomic_inc_uint64_t(&uid2grp_cache_st.stale_hits);
+	uid2grp_queue_refresh(gdata, by_name);
+}
+
 /**
  * @brief Get supplementary groups given uname
  *
@@ -257,41 +409,30 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
  *
  * @return true if successful, false otherwise
  */
-#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
 bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
 {
-	bool success = false;
 	uid_t uid = -1;
+	bool not_found;
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
-
-	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
+	rcu_read_lock();
+	if (uid2grp_lookup_by_uname(name, &uid, gdata)) {
+		uid2grp_use_cached(*gdata, true);
+		rcu_read_unlock();
+		return true;
 	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	rcu_read_unlock();
 
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uname(name);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-	}
+	(void) atomic_inc_uint64_t(&uid2grp_cache_st.misses);
+
+	*gdata = uid2grp_allocate_by_name(name, &not_found);
+	if (*gdata == NULL)
+		return false;
 
-	*gdata = uid2grp_allocate_by_name(name);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
-	if (success)
-		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	/* Our reference first, the entry may be replaced right away */
+	uid2grp_hold_group_data(*gdata);
+	uid2grp_add_user(*gdata);
 
-	return success;
+	return true;
 }
 
 /**
@@ -304,36 +445,27 @@ bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
  */
 bool uid2grp(uid_t uid, struct group_data **gdata)
 {
-	bool success = false;
-
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uid(uid, gdata);
+	bool not_found;
 
-	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
+	rcu_read_lock();
+	if (uid2grp_lookup_by_uid(uid, gdata)) {
+		uid2grp_use_cached(*gdata, false);
+		rcu_read_unlock();
+		return true;
 	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	rcu_read_unlock();
 
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uid(uid);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-	}
+	(void) atomic_inc_uint64_t(&uid2grp_cache_st.misses);
+
+	*gdata = uid2grp_allocate_by_uid(uid, &not_found);
+	if (*gdata == NULL)
+		return false;
 
-	*gdata = uid2grp_allocate_by_uid(uid);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uid(uid, gdata);
-	if (success)
-		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	/* Our reference first, the entry may be replaced right away */
+	uid2grp_hold_group_data(*gdata);
+	uid2grp_add_user(*gdata);
 
-	return success;
+	return true;
 }
 
 /*
@@ -345,4 +477,30 @@ void uid2grp_unref(struct group_data *gdata)
 	uid2grp_release_group_data(gdata);
 }
 
+#ifdef USE_DBUS
+/**
+ * @brief Report the cache counters over DBus
+ *
+ * @param[in,out] iter Reply iterator
+ */
+
+void uid2grp_dbus_show(DBusMessageIter *iter)
+{
+	struct server_dbus_counter counters[] = {
+		{ "uid2grp_hits", &uid2grp_cache_st.hits },
+		{ "uid2grp_stale_hits", &uid2grp_cache_st.stale_hits },
+		{ "uid2grp_misses", &uid2grp_cache_st.misses },
+		{ "uid2grp_refreshes", &uid2grp_cache_st.refreshes },
+		{ "uid2grp_refresh_failures",
+		  &uid2grp_cache_st.refresh_failures },
+		{ "uid2grp_refresh_errors", &uid2grp_cache_st.refresh_errors },
+		{ "uid2grp_refresh_ns", &uid2grp_cache_st.refresh_ns },
+		{ "uid2grp_refresh_max_ns", &uid2grp_cache_st.refresh_max_ns },
+	};
+
+	server_dbus_counters(counters, sizeof(counters) / sizeof(counters[0]),
+			     UID2GRP_CACHE_TYPE, iter);
+}
+#endif /* USE_DBUS */
+
 /** @} */
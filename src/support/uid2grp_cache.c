@@ -30,6 +30,15 @@
 /**
  * @file    uid_grplist_cache.c
  * @brief   Uid->Group List mapping cache functions
+ *
+ * Entries are kept in two hash indexes, by name and by UID.  Chains
+ * are only modified with uid2grp_user_lock held and updated with
+ * rcu_assign_pointer, so lookups only need rcu_read_lock.  Removed
+ * entries are freed, and their reference on the group data dropped,
+ * after a grace period with call_rcu.
+ *
+ * Group data is never modified once in the cache, a refresh adds a new
+ * entry replacing the old one.
  */
 #include "config.h"
 #include "log.h"
@@ -38,312 +47,197 @@
 #include <pwd.h>
 #include <grp.h>
 #include <unistd.h>
+#include <urcu-bp.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
 #include "common_utils.h"
-#include "avltree.h"
+#include "city.h"
 #include "uid2grp.h"
 #include "abstract_atomic.h"
 
 /**
- * @brief User entry in the IDMapper cache
+ * @brief User entry in the uid2grp cache
  */
 
 struct cache_info {
 	uid_t uid;		/*< Corresponding UID */
 	struct gsh_buffdesc uname;
-	struct group_data *gdata;
-	struct avltree_node uname_node;	/*< Node in the name tree */
-	struct avltree_node uid_node;	/*< Node in the UID tree */
+	struct group_data *gdata;	/*< One reference held */
+	bool in_uname_hash;	/*< true iff this is in uname_hash */
+	bool in_uid_hash;	/*< true iff this is in uid_hash */
+	struct cache_info *uname_next;	/*< Next in the name chain */
+	struct cache_info *uid_next;	/*< Next in the UID chain */
+	struct rcu_head rcu;	/*< For deferred free */
 };
 
 /**
- * @brief Number of entires in the UID cache, should be prime.
+ * @brief Number of buckets in each index, should be prime.
  */
 
-#define id_cache_size 1009
+#define id_cache_size 4093
 
 /**
- * @brief UID cache, may only be accessed with uid2grp_user_lock
- * held.  If uid2grp_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief Users, by name.  Chains are modified with
+ * uid2grp_user_lock held and read under rcu_read_lock.
  */
 
-static struct avltree_node *uid_grplist_cache[id_cache_size];
+static struct cache_info *uname_hash[id_cache_size];
 
 /**
- * @brief Lock that protects the idmapper user cache
+ * @brief Users, by ID
  */
 
-pthread_rwlock_t uid2grp_user_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct cache_info *uid_hash[id_cache_size];
 
 /**
- * @brief Tree of users, by name
+ * @brief Lock that serializes modifications of the cache
  */
 
-static struct avltree uname_tree;
+static pthread_mutex_t uid2grp_user_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/**
- * @brief Tree of users, by ID
- */
+static inline uint32_t name_bucket(const struct gsh_buffdesc *name)
+{
+	return CityHash64(name->addr, name->len) % id_cache_size;
+}
 
-static struct avltree uid_tree;
+static inline uint32_t id_bucket(uid_t uid)
+{
+	return uid % id_cache_size;
+}
 
 /**
- * @brief Compare two buffers
- *
- * Handle the case where one buffer is a left sub-buffer of another
- * buffer by counting the longer one as larger.
- *
- * @param[in] buff1 A buffer
- * @param[in] buffa Another buffer
- *
- * @retval -1 if buff1 is less than buffa
- * @retval 0 if buff1 and buffa are equal
- * @retval 1 if buff1 is greater than buffa
+ * @brief Initialize the uid2grp cache
  */
 
-static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
-				      const struct gsh_buffdesc *buff1)
+void uid2grp_cache_init(void)
 {
-	int mr = memcmp(buff1->addr, buffa->addr, MIN(buff1->len,
-						      buffa->len));
-	if (unlikely(mr == 0)) {
-		if (buff1->len < buffa->len)
-			return -1;
-		else if (buff1->len > buffa->len)
-			return 1;
-		else
-			return 0;
-	} else {
-		return mr;
-	}
+	memset(uname_hash, 0, sizeof(uname_hash));
+	memset(uid_hash, 0, sizeof(uid_hash));
 }
 
-/**
- * @brief Comparison for user names
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
-
-static int uname_comparator(const struct avltree_node *node1,
-			    const struct avltree_node *nodea)
+static void free_info_rcu(struct rcu_head *head)
 {
-	struct cache_info *user1 =
-	    avltree_container_of(node1, struct cache_info,
-				 uname_node);
-	struct cache_info *usera =
-	    avltree_container_of(nodea, struct cache_info,
-				 uname_node);
-
-	return buffdesc_comparator(&user1->uname, &usera->uname);
+	struct cache_info *info = container_of(head, struct cache_info, rcu);
+
+	/* We decrement hold on group data when it is
+	 * removed from cache indexes.
+	 */
+	uid2grp_release_group_data(info->gdata);
+	gsh_free(info);
 }
 
-/**
- * @brief Comparison for UIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
+/* Remove given user/cache_info from the indexes
  *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @note The caller must hold uid2grp_user_lock.
  */
-
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static void uid2grp_remove_user(struct cache_info *info)
 {
-	struct cache_info *user1 =
-	    avltree_container_of(node1, struct cache_info,
-				 uid_node);
-	struct cache_info *usera =
-	    avltree_container_of(nodea, struct cache_info,
-				 uid_node);
-
-	if (user1->uid < usera->uid)
-		return -1;
-	else if (user1->uid > usera->uid)
-		return 1;
-	else
-		return 0;
-}
+	struct cache_info **pp;
+
+	if (info->in_uname_hash) {
+		for (pp = &uname_hash[name_bucket(&info->uname)]; *pp != info;
+		     pp = &(*pp)->uname_next)
+			;
+		rcu_assign_pointer(*pp, info->uname_next);
+		info->in_uname_hash = false;
+	}
 
-/**
- * @brief Initialize the IDMapper cache
- */
+	if (info->in_uid_hash) {
+		for (pp = &uid_hash[id_bucket(info->uid)]; *pp != info;
+		     pp = &(*pp)->uid_next)
+			;
+		rcu_assign_pointer(*pp, info->uid_next);
+		info->in_uid_hash = false;
+	}
 
-void uid2grp_cache_init(void)
+	call_rcu(&info->rcu, free_info_rcu);
+}
+
+static struct cache_info *lookup_by_uname(const struct gsh_buffdesc *name)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_grplist_cache, 0,
-	       id_cache_size * sizeof(struct avltree_node *));
+	struct cache_info *info;
+
+	for (info = rcu_dereference(uname_hash[name_bucket(name)]);
+	     info != NULL; info = rcu_dereference(info->uname_next)) {
+		if (info->uname.len == name->len &&
+		    memcmp(info->uname.addr, name->addr, name->len) == 0)
+			return info;
+	}
+
+	return NULL;
 }
 
-/* Remove given user/cache_info from the AVL trees
- *
- * @note The caller must hold uid2grp_user_lock for write.
- */
-static void uid2grp_remove_user(struct cache_info *info)
+static struct cache_info *lookup_by_uid(const uid_t uid)
 {
-	uid_grplist_cache[info->uid % id_cache_size] = NULL;
-	avltree_remove(&info->uid_node, &uid_tree);
-	avltree_remove(&info->uname_node, &uname_tree);
-	/* We decrement hold on group data when it is
-	 * removed from cache trees.
-	 */
-	uid2grp_release_group_data(info->gdata);
-	gsh_free(info);
+	struct cache_info *info;
+
+	for (info = rcu_dereference(uid_hash[id_bucket(uid)]);
+	     info != NULL; info = rcu_dereference(info->uid_next)) {
+		if (info->uid == uid)
+			return info;
+	}
+
+	return NULL;
 }
 
 /**
  * @brief Add a user entry to the cache
  *
- * @note The caller must hold uid2grp_user_lock for write.
+ * Entries for the same name or the same UID are replaced.
  *
  * @param[in] group_data that has supplementary groups allocated
- *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
  */
 void uid2grp_add_user(struct group_data *gdata)
 {
-	struct avltree_node *name_node;
-	struct avltree_node *id_node;
-	struct avltree_node *name_node2 = NULL;
-	struct avltree_node *id_node2 = NULL;
-	struct cache_info *info;
-	struct cache_info *tmp;
+	struct cache_info *info, *old;
+	uint32_t bucket;
 
-	info = gsh_malloc(sizeof(struct cache_info));
+	info = gsh_calloc(1, sizeof(struct cache_info));
 
 	info->uid = gdata->uid;
 	info->uname.addr = gdata->uname.addr;
 	info->uname.len = gdata->uname.len;
 	info->gdata = gdata;
 
-	/* The refcount on group_data should be 1 when we put it in
-	 * AVL trees.
+	/* The cache holds a reference on the group data for as long as
+	 * the entry is in it.
 	 */
 	uid2grp_hold_group_data(gdata);
 
-	/* We may have lost the race to insert. We remove existing
-	 * entry and insert this new entry if so!
-	 */
-	name_node = avltree_insert(&info->uname_node, &uname_tree);
-	if (unlikely(name_node)) {
-		tmp = avltree_container_of(name_node,
-					   struct cache_info,
-					   uname_node);
-		uid2grp_remove_user(tmp);
-		name_node2 = avltree_insert(&info->uname_node, &uname_tree);
-	}
-
-	id_node = avltree_insert(&info->uid_node, &uid_tree);
-	if (unlikely(id_node)) {
-		/* We should not come here unless someone changed uid of
-		 * a user. Remove old entry and re-insert the new
-		 * entry.
-		 */
-		tmp = avltree_container_of(id_node,
-					   struct cache_info,
-					   uid_node);
-		uid2grp_remove_user(tmp);
-		id_node2 = avltree_insert(&info->uid_node, &uid_tree);
-	}
-	uid_grplist_cache[info->uid % id_cache_size] = &info->uid_node;
-
-	if (name_node && id_node)
-		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
-	if ((name_node && name_node2) || (id_node && id_node2))
-		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
-}
-
-
-static bool lookup_by_uname(const struct gsh_buffdesc *name,
-			    struct cache_info **info)
-{
-	struct cache_info prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_info *found_info;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_info = avltree_container_of(found_node,
-					  struct cache_info,
-					  uname_node);
-
-	/* I assume that if someone likes this user enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
-
-	cache_slot = (void **)
-		&uid_grplist_cache[found_info->uid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_info->uid_node);
+	PTHREAD_MUTEX_lock(&uid2grp_user_lock);
 
-	*info = found_info;
-
-	return true;
-}
-
-static bool lookup_by_uid(const uid_t uid, struct cache_info **info)
-{
-	struct cache_info prototype = {
-		.uid = uid
-	};
-	void **cache_slot = (void **)
-	    &uid_grplist_cache[prototype.uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_info *found_info;
-	bool found = false;
-
-	/* Verify that the node found in the cache array is in fact what we
-	 * want.
+	/* We may have lost the race to insert, or the user may have
+	 * been renamed or renumbered.  The new entry wins.
 	 */
-	if (likely(found_node)) {
-		found_info =
-		    avltree_container_of(found_node, struct cache_info,
-					 uid_node);
-		if (found_info->uid == uid)
-			found = true;
-	}
+	old = lookup_by_uname(&info->uname);
+	if (old != NULL)
+		uid2grp_remove_user(old);
 
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
+	old = lookup_by_uid(info->uid);
+	if (old != NULL)
+		uid2grp_remove_user(old);
 
-		atomic_store_voidptr(cache_slot, found_node);
-		found_info =
-		    avltree_container_of(found_node, struct cache_info,
-					 uid_node);
-	}
+	bucket = name_bucket(&info->uname);
+	info->uname_next = uname_hash[bucket];
+	info->in_uname_hash = true;
+	rcu_assign_pointer(uname_hash[bucket], info);
 
-	*info = found_info;
+	bucket = id_bucket(info->uid);
+	info->uid_next = uid_hash[bucket];
+	info->in_uid_hash = true;
+	rcu_assign_pointer(uid_hash[bucket], info);
 
-	return true;
+	PTHREAD_MUTEX_unlock(&uid2grp_user_lock);
 }
 
 /**
  * @brief Look up a user by name
  *
- * @note The caller must hold uid2grp_user_lock for read.
+ * @note The caller must hold rcu_read_lock across this call and any
+ *       use of the group data, or take a reference on it first.
  *
  * @param[in]  name The user name to look up.
- * @param[out] uid  The user ID found.  May be NULL if the caller
- *                  isn't interested in the UID.  (This seems
- *                  unlikely.)
+ * @param[out] uid  The user ID found.
  * @gdata[out] group_data containing supplementary groups.
  *
  * @retval true on success.
@@ -353,23 +247,22 @@ static bool lookup_by_uid(const uid_t uid, struct cache_info **info)
 bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 			     struct group_data **gdata)
 {
-	struct cache_info *info;
-	bool success;
+	struct cache_info *info = lookup_by_uname(name);
 
-	success = lookup_by_uname(name, &info);
+	if (info == NULL)
+		return false;
 
-	if (success) {
-		*gdata = info->gdata;
-		*uid = info->gdata->uid;
-	}
+	*gdata = info->gdata;
+	*uid = info->gdata->uid;
 
-	return success;
+	return true;
 }
 
 /**
  * @brief Look up a user by ID
  *
- * @note The caller must hold uid2grp_user_lock for read.
+ * @note The caller must hold rcu_read_lock across this call and any
+ *       use of the group data, or take a reference on it first.
  *
  * @param[in]  uid  The user ID to look up.
  * @gdata[out] group_data containing supplementary groups.
@@ -380,34 +273,40 @@ bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 
 bool uid2grp_lookup_by_uid(const uid_t uid, struct group_data **gdata)
 {
-	struct cache_info *info;
-	bool success;
+	struct cache_info *info = lookup_by_uid(uid);
+
+	if (info == NULL)
+		return false;
 
-	success = lookup_by_uid(uid, &info);
-	if (success)
-		*gdata = info->gdata;
+	*gdata = info->gdata;
 
-	return success;
+	return true;
 }
 
 void uid2grp_remove_by_uid(const uid_t uid)
 {
 	struct cache_info *info;
-	bool success;
 
-	success = lookup_by_uid(uid, &info);
-	if (success)
+	PTHREAD_MUTEX_lock(&uid2grp_user_lock);
+
+	info = lookup_by_uid(uid);
+	if (info != NULL)
 		uid2grp_remove_user(info);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_user_lock);
 }
 
 void uid2grp_remove_by_uname(const struct gsh_buffdesc *name)
 {
 	struct cache_info *info;
-	bool success;
 
-	success = lookup_by_uname(name, &info);
-	if (success)
+	PTHREAD_MUTEX_lock(&uid2grp_user_lock);
+
+	info = lookup_by_uname(name);
+	if (info != NULL)
 		uid2grp_remove_user(info);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_user_lock);
 }
 
 /**
@@ -416,21 +315,17 @@ void uid2grp_remove_by_uname(const struct gsh_buffdesc *name)
 
 void uid2grp_clear_cache(void)
 {
-	struct avltree_node *node;
+	uint32_t i;
 
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
+	PTHREAD_MUTEX_lock(&uid2grp_user_lock);
 
-	while ((node = avltree_first(&uname_tree))) {
-		struct cache_info *info = avltree_container_of(node,
-							       struct
-							       cache_info,
-							       uname_node);
-		uid2grp_remove_user(info);
+	/* Every entry is in both indexes */
+	for (i = 0; i < id_cache_size; i++) {
+		while (uname_hash[i] != NULL)
+			uid2grp_remove_user(uname_hash[i]);
 	}
 
-	assert(avltree_first(&uid_tree) == NULL);
-
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	PTHREAD_MUTEX_unlock(&uid2grp_user_lock);
 }
 
 /** @} */